@@ -0,0 +1,260 @@
+"""
+Converts the decision trees of an emlearn header into the packed node format of
+Source_C/utils/packed_trees.h, writes the header compiled into the actuator, prints
+the ROM the node tables take in both formats and checks that the packed trees give
+the class of the emlearn ones on every threshold and on random readings.
+
+Usage (after cmodel.save(file='seed_classifier_emlearn.h', name='seed_classifier')):
+  python3 model_pack.py seed_classifier_emlearn.h ../Source_C/utils/DT_model.h
+"""
+import os
+import re
+import sys
+import random
+import argparse
+
+# Features of apply_decision_tree_model() in actuator.c and the range of their sensor;
+# there is no sensor for the last one, which is left at 0
+SENSOR_RANGES = ((0, 140), (5, 145), (5, 205), (3, 10), (0, 100), (8, 43), (0, 0))
+
+# Votes of the packed trees are counted in MODEL_CONF_MAX_CLASSES (Source_C/utils/model.h)
+MAX_CLASSES = 32
+
+# Size of EmlTreesNode: int8 feature, int16 value, left and right, aligned
+EMLEARN_NODE_SIZE = 8
+
+RANDOM_CHECKS = 100000
+
+
+class PackError(ValueError):
+    pass
+
+
+def _array(text, name):
+    values = re.search(name + r"\[\d+\] = \{(.*?)\};", text, re.S)
+    if values is None:
+        raise PackError(f"No {name} table in the header")
+    return [int(v) for v in values.group(1).split(',') if v.strip()]
+
+
+def read_emlearn(path):
+    """
+    Node table of an emlearn header.
+    :return: dict with nodes (feature, threshold, left, right), roots, leaves and the name of the model
+    """
+    with open(path) as f:
+        text = f.read()
+    name = re.search(r"(\w+)_nodes\[\d+\]", text)
+    if name is None:
+        raise PackError("No node table in the header: not an emlearn model?")
+    nodes = re.search(r"_nodes\[\d+\] = \{(.*?)\};", text, re.S).group(1)
+    nodes = [tuple(int(v) for v in node.split(',')) for node in re.findall(r"\{([^{}]*)\}", nodes)]
+    return {"name": name.group(1), "nodes": nodes, "roots": _array(text, "_tree_roots"),
+            "leaves": _array(text, "_leaves")}
+
+
+def bits_for(value):
+    return max(1, value.bit_length())
+
+
+def pack(model, features):
+    """
+    Pack the nodes of a model.
+    :return: dict with the fields of packed_trees_t and the packed nodes
+    """
+    nodes, leaves = model["nodes"], model["leaves"]
+    classes = max(leaves) + 1
+    if classes > MAX_CLASSES:
+        raise PackError(f"{classes} classes, at most {MAX_CLASSES}")
+    if any(not 0 <= node[0] < features for node in nodes):
+        raise PackError(f"A node tests a feature beyond the {features} of the model")
+    for i, (_, _, left, right) in enumerate(nodes):
+        for child in (left, right):
+            if child == 0 or (child > 0 and i + child >= len(nodes)) or (child < 0 and -child - 1 >= len(leaves)):
+                raise PackError(f"Node {i} has a child out of the table")
+
+    # Thresholds as the distance from the lowest one of their feature
+    bases = [0] * features
+    spans = [0] * features
+    for f in range(features):
+        thresholds = [node[1] for node in nodes if node[0] == f]
+        if thresholds:
+            bases[f] = min(thresholds)
+            spans[f] = max(thresholds) - bases[f]
+    threshold_bits = 8 if max(spans) < 256 else 16
+
+    # A child is a leaf flag and the class of the leaf or the offset of the child
+    largest = max([classes - 1] + [c for node in nodes for c in node[2:] if c > 0])
+    child_bits = bits_for(largest) + 1
+    feature_bits = bits_for(features - 1)
+    if child_bits > 16:
+        raise PackError("Trees too deep for 16-bit child offsets")
+
+    def child(value):
+        return 1 << (child_bits - 1) | leaves[-value - 1] if value < 0 else value
+
+    bits = ""
+    for feature, threshold, left, right in nodes:
+        bits += format(feature, f"0{feature_bits}b") + format(threshold - bases[feature], f"0{threshold_bits}b")
+        bits += format(child(left), f"0{child_bits}b") + format(child(right), f"0{child_bits}b")
+    bits += "0" * (-len(bits) % 8)
+    data = bytes(int(bits[i:i + 8], 2) for i in range(0, len(bits), 8)) + b"\0\0"
+
+    return {"n_features": features, "n_classes": classes, "n_trees": len(model["roots"]), "n_nodes": len(nodes),
+            "feature_bits": feature_bits, "threshold_bits": threshold_bits, "child_bits": child_bits,
+            "roots": model["roots"], "bases": bases, "nodes": data}
+
+
+def node_bits(packed):
+    return packed["feature_bits"] + packed["threshold_bits"] + 2 * packed["child_bits"]
+
+
+def read_bits(data, bit, count):
+    value = 0
+    for i in range(bit, bit + count):
+        value = value << 1 | (data[i >> 3] >> (7 - (i & 7))) & 1
+    return value
+
+
+def unpack_node(packed, index):
+    """Node of the packed trees as packed_trees_node(): children relative, leaf -(class + 1)."""
+    bit = index * node_bits(packed)
+    feature = read_bits(packed["nodes"], bit, packed["feature_bits"])
+    bit += packed["feature_bits"]
+    threshold = packed["bases"][feature] + read_bits(packed["nodes"], bit, packed["threshold_bits"])
+    bit += packed["threshold_bits"]
+    leaf = 1 << (packed["child_bits"] - 1)
+    children = []
+    for _ in range(2):
+        value = read_bits(packed["nodes"], bit, packed["child_bits"])
+        children.append(-(value & ~leaf) - 1 if value & leaf else value)
+        bit += packed["child_bits"]
+    return (feature, threshold, *children)
+
+
+def predict(roots, node, leaf_class, classes, features):
+    """Majority class of the trees, ties to the lowest as in eml_trees."""
+    votes = [0] * classes
+    for root in roots:
+        index = root
+        while True:
+            feature, threshold, left, right = node(index)
+            child = left if features[feature] < threshold else right
+            if child < 0:
+                break
+            index += child
+        votes[leaf_class(-child - 1)] += 1
+    return votes.index(max(votes))
+
+
+def check_vectors(model, features, rng):
+    """Readings on both sides of every threshold, the others drawn in the sensor ranges."""
+    vectors = []
+    for feature, threshold, _, _ in model["nodes"]:
+        for value in (threshold - 1, threshold):
+            vector = [rng.randint(*SENSOR_RANGES[f]) if f < len(SENSOR_RANGES) else 0 for f in range(features)]
+            vector[feature] = value
+            vectors.append(vector)
+    return vectors
+
+
+def check(model, packed, vectors, rng, count=RANDOM_CHECKS):
+    """
+    Compare the packed trees with the emlearn ones.
+    :return: number of readings compared
+    """
+    emlearn_nodes, leaves = model["nodes"], model["leaves"]
+    for i, node in enumerate(emlearn_nodes):
+        feature, threshold, left, right = unpack_node(packed, i)
+        expected = tuple(("leaf", leaves[-c - 1]) if c < 0 else ("node", c) for c in node[2:])
+        actual = tuple(("leaf", -c - 1) if c < 0 else ("node", c) for c in (left, right))
+        if (feature, threshold) != node[:2] or expected != actual:
+            raise PackError(f"Node {i} packed as {(feature, threshold, left, right)}, emlearn has {node}")
+
+    features = packed["n_features"]
+    randoms = [[rng.randint(*SENSOR_RANGES[f]) if f < len(SENSOR_RANGES) else 0 for f in range(features)]
+               for _ in range(count)]
+    for vector in vectors + randoms:
+        reference = predict(model["roots"], lambda i: emlearn_nodes[i], lambda leaf: leaves[leaf],
+                            packed["n_classes"], vector)
+        result = predict(packed["roots"], lambda i: unpack_node(packed, i), lambda leaf: leaf,
+                         packed["n_classes"], vector)
+        if result != reference:
+            raise PackError(f"Readings {vector}: packed class {result}, emlearn class {reference}")
+    return len(vectors) + len(randoms)
+
+
+def rom_report(model, packed):
+    """Bytes of the tables in the emlearn and packed formats."""
+    emlearn = {"nodes": len(model["nodes"]) * EMLEARN_NODE_SIZE, "roots": 4 * len(model["roots"]),
+               "leaves": len(model["leaves"])}
+    compact = {"nodes": len(packed["nodes"]), "roots": 2 * len(packed["roots"]), "bases": 2 * packed["n_features"]}
+    print(f"{'Tables (bytes)':<16}" + "".join(f"{k:>8}" for k in ("nodes", "roots", "leaves", "bases", "total")))
+    for name, sizes in (("emlearn", emlearn), ("packed", compact)):
+        print(f"{name:<16}" + "".join(f"{sizes.get(k, 0):>8}" for k in ("nodes", "roots", "leaves", "bases"))
+              + f"{sum(sizes.values()):>8}")
+    print(f"{len(model['nodes'])} nodes of {node_bits(packed)} bits instead of {8 * EMLEARN_NODE_SIZE}; "
+          f"the emlearn header also carries every tree a second time as code")
+    return sum(emlearn.values()), sum(compact.values())
+
+
+def _c_array(values, per_line, fmt="{}"):
+    items = [fmt.format(v) for v in values]
+    lines = [", ".join(items[i:i + per_line]) for i in range(0, len(items), per_line)]
+    return "{\n    " + ",\n    ".join(lines) + "}"
+
+
+def write_header(path, name, packed, vectors, classes, source):
+    fields = ("n_features", "n_classes", "n_trees", "n_nodes", "feature_bits", "threshold_bits", "child_bits")
+    text = f"// !!! This file is generated by ML/model_pack.py from {source}, do not edit !!!\n"
+    text += f"// {packed['n_nodes']} nodes of {node_bits(packed)} bits in {packed['n_trees']} tree{'s' if packed['n_trees'] > 1 else ''}, " \
+            f"{packed['n_classes']} classes\n\n"
+    text += "#ifndef DT_MODEL_H\n#define DT_MODEL_H\n\n#include \"packed_trees.h\"\n\n"
+    text += f"static const uint8_t {name}_nodes[{len(packed['nodes'])}] = " \
+            f"{_c_array(packed['nodes'], 12, '0x{:02x}')};\n\n"
+    text += f"static const uint16_t {name}_roots[{packed['n_trees']}] = {{{', '.join(map(str, packed['roots']))}}};\n\n"
+    text += f"static const int16_t {name}_bases[{packed['n_features']}] = " \
+            f"{{{', '.join(map(str, packed['bases']))}}};\n\n"
+    text += f"static const packed_trees_t {name} = {{\n"
+    text += "".join(f"    .{field} = {packed[field]},\n" for field in fields)
+    text += f"    .roots = {name}_roots,\n    .bases = {name}_bases,\n    .nodes = {name}_nodes}};\n\n"
+    text += f"static inline int32_t {name}_predict(const int16_t *features, int32_t features_length)\n{{\n" \
+            f"    return packed_trees_predict(&{name}, features, features_length);\n}}\n\n"
+    text += f"#ifdef {name.upper()}_CHECK\n// Readings on both sides of every threshold and the class emlearn gives them\n"
+    text += f"#define {name.upper()}_CHECKS {len(vectors)}\n"
+    text += f"static const int16_t {name}_check_features[{len(vectors)}][{packed['n_features']}] = " \
+            f"{_c_array(['{' + ', '.join(map(str, v)) + '}' for v in vectors], 4)};\n"
+    text += f"static const uint8_t {name}_check_classes[{len(vectors)}] = {_c_array(classes, 16)};\n#endif\n\n"
+    text += "#endif\n"
+    with open(path, "w") as f:
+        f.write(text)
+
+
+def main(args):
+    try:
+        model = read_emlearn(args.emlearn)
+        packed = pack(model, args.features)
+        rng = random.Random(args.seed)
+        vectors = check_vectors(model, args.features, rng)
+        checked = check(model, packed, vectors, rng)
+    except PackError as e:
+        print(f"Error: {e}")
+        return 1
+
+    rom_report(model, packed)
+    print(f"Equivalence: {checked} readings, same class as emlearn")
+    classes = [predict(model["roots"], lambda i: model["nodes"][i], lambda leaf: model["leaves"][leaf],
+                       packed["n_classes"], v) for v in vectors]
+    if args.output:
+        write_header(args.output, model["name"], packed, vectors, classes, os.path.basename(args.emlearn))
+        print(f"Written {args.output}")
+    return 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Pack the emlearn trees of the seed model for the motes.")
+    parser.add_argument("emlearn", help="header saved by emlearn")
+    parser.add_argument("output", nargs="?", help="packed header to write (Source_C/utils/DT_model.h)")
+    parser.add_argument("--features", type=int, default=len(SENSOR_RANGES), help="features the model takes")
+    parser.add_argument("--seed", type=int, default=1, help="seed of the check readings")
+    sys.exit(main(parser.parse_args()))
@@ -0,0 +1,303 @@
+"""
+Sweep of candidate seed models: decision trees of several depths and leaf counts and
+random forests of several sizes, trained on readings quantized to several steps. Every
+candidate is exported with emlearn and packed with model_pack.py, then compiled with
+the code of the actuator (Source_C/utils/packed_trees.c) to measure its inference time,
+the nodes it walks per cell and the .text + .data it adds to the image. The report
+marks the candidates no other beats on held-out accuracy, size and time at once.
+
+The readings are those the actuator gives the model (apply_decision_tree_model() in
+actuator.c): N, P, K, pH, moisture (the humidity of the dataset) and temperature as
+integers, and a last feature left at 0. The shipped header is evaluated the same way.
+
+Usage:
+  python3 model_sweep.py Crop_recommendation.csv --csv sweep.csv
+  python3 model_sweep.py Crop_recommendation.csv --target-cc arm-none-eabi-gcc --target-cflags "-mcpu=cortex-m4 -mthumb" \\
+      --target-ld arm-none-eabi-ld --target-size arm-none-eabi-size
+"""
+import os
+import re
+import csv
+import sys
+import random
+import shlex
+import argparse
+import tempfile
+import subprocess
+import model_pack
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+UTILS = os.path.join(ROOT, "Source_C", "utils")
+# Host stand-ins of the Contiki headers model.h includes
+SIM_INCLUDE = os.path.join(ROOT, "Source_C", "sim", "include")
+SHIPPED = os.path.join(UTILS, "DT_model.h")
+
+# Dataset columns in the feature order of the actuator
+COLUMNS = ("N", "P", "K", "ph", "humidity", "temperature")
+FEATURE_COUNT = len(model_pack.SENSOR_RANGES)
+
+DEPTHS = (4, 6, 8, 12, None)
+LEAVES = (None, 24, 48)
+FOREST_SIZES = (3, 5, 10, 20)
+FOREST_DEPTHS = (6, 8, 12)
+STEPS = (1, 2, 4)
+
+# Predictions timed per candidate
+TIMED_PREDICTIONS = 200000
+
+HARNESS = r"""
+#include <stdlib.h>
+#include <time.h>
+#include "{header}"
+#include "readings.h"
+#undef printf
+#include <stdio.h>
+
+// model.c checks uploaded images with the CRC-16 of Contiki, never called here
+unsigned short crc16_data(const unsigned char *data, int len, unsigned short acc)
+{{
+    return acc;
+}}
+
+int main(int argc, char **argv)
+{{
+    int repeats = atoi(argv[1]);
+    struct timespec start, end;
+    volatile int sink = 0;
+
+    for (int i = 0; i < READINGS; i++)
+        printf("%d\n", (int)seed_classifier_predict(readings[i], {features}));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < repeats; r++)
+        for (int i = 0; i < READINGS; i++)
+            sink += seed_classifier_predict(readings[i], {features});
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("%.1f\n", ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / ((double)repeats * READINGS));
+    return 0;
+}}
+"""
+
+SIZE_UNIT = r"""
+#include "{header}"
+
+int32_t sweep_predict(const int16_t *features)
+{{
+    return seed_classifier_predict(features, {features});
+}}
+"""
+
+
+def load_dataset(path):
+    """
+    Readings and labels of the crop dataset, the labels numbered in alphabetical order as
+    LabelEncoder does in the notebook.
+    """
+    with open(path, newline="") as f:
+        rows = list(csv.DictReader(f))
+    labels = sorted({row["label"] for row in rows})
+    x = [[int(round(float(row[c]))) for c in COLUMNS] + [0] * (FEATURE_COUNT - len(COLUMNS)) for row in rows]
+    y = [labels.index(row["label"]) for row in rows]
+    return x, y, labels
+
+
+def quantize(x, step):
+    return [[int(round(v / step)) * step for v in row] for row in x]
+
+
+def candidates():
+    from sklearn.tree import DecisionTreeClassifier
+    from sklearn.ensemble import RandomForestClassifier
+
+    for step in STEPS:
+        for depth in DEPTHS:
+            for leaves in LEAVES:
+                yield (f"tree d={depth or '-'} l={leaves or '-'}", step,
+                       DecisionTreeClassifier(max_depth=depth, max_leaf_nodes=leaves, random_state=0))
+        for trees in FOREST_SIZES:
+            for depth in FOREST_DEPTHS:
+                yield (f"forest n={trees} d={depth}", step,
+                       RandomForestClassifier(n_estimators=trees, max_depth=depth, random_state=0))
+
+
+def run(command, **kwargs):
+    return subprocess.run(command, check=True, capture_output=True, text=True, **kwargs).stdout
+
+
+class Toolchain:
+    def __init__(self, args):
+        self.cc = shlex.split(args.cc)
+        self.target_cc = shlex.split(args.target_cc or args.cc)
+        self.target_cflags = shlex.split(args.target_cflags)
+        self.target_ld = args.target_ld
+        self.target_size = args.target_size
+        self.include = ["-I" + UTILS, "-I" + SIM_INCLUDE]
+        self.emlearn_include = []
+
+    def bench(self, directory, header, readings):
+        """
+        Classes of the readings and nanoseconds per prediction, on the host.
+        """
+        source = os.path.join(directory, "bench.c")
+        program = os.path.join(directory, "bench")
+        with open(source, "w") as f:
+            f.write(HARNESS.format(header=header, features=FEATURE_COUNT))
+        run(self.cc + ["-O2", "-std=gnu99", "-I" + directory] + self.include + self.emlearn_include +
+            ["-o", program, source, os.path.join(UTILS, "packed_trees.c"), os.path.join(UTILS, "model.c")])
+        repeats = max(1, TIMED_PREDICTIONS // len(readings))
+        output = run([program, str(repeats)]).split()
+        return [int(v) for v in output[:-1]], float(output[-1])
+
+    def size(self, directory, header, sources):
+        """
+        .text + .data of the prediction code and tables with the target compiler, as the
+        firmware is linked: sections no code reaches are dropped.
+        """
+        unit = os.path.join(directory, "size.c")
+        with open(unit, "w") as f:
+            f.write(SIZE_UNIT.format(header=header, features=FEATURE_COUNT))
+        objects = []
+        for source in [unit] + sources:
+            obj = os.path.join(directory, os.path.basename(source)[:-2] + ".o")
+            run(self.target_cc + ["-Os", "-std=gnu99", "-ffunction-sections", "-fdata-sections", "-c"] +
+                self.target_cflags + ["-I" + directory] + self.include + self.emlearn_include + ["-o", obj, source])
+            objects.append(obj)
+        linked = os.path.join(directory, "predict.o")
+        run([self.target_ld, "-r", "--gc-sections", "-u", "sweep_predict", "-o", linked] + objects)
+        text, data = run([self.target_size, "-B", linked]).splitlines()[1].split()[:2]
+        return int(text) + int(data)
+
+
+def walked_nodes(model, readings):
+    """Nodes walked per prediction by all the trees, before the vote stops early."""
+    total = 0
+    for features in readings:
+        for root in model["roots"]:
+            index = root
+            while True:
+                total += 1
+                feature, threshold, left, right = model["nodes"][index]
+                child = left if features[feature] < threshold else right
+                if child < 0:
+                    break
+                index += child
+    return total / len(readings)
+
+
+def evaluate(name, step, clf, data, tools, directory):
+    import emlearn
+
+    xtrain, ytrain, xtest, ytest = data
+    clf.fit(quantize(xtrain, step), ytrain)
+
+    # The header the notebook saves, then the one the motes build with
+    source = os.path.join(directory, "seed_classifier_emlearn.h")
+    emlearn.convert(clf, method="inline").save(file=source, name="seed_classifier")
+    model = model_pack.read_emlearn(source)
+    packed = model_pack.pack(model, FEATURE_COUNT)
+    rng = random.Random(1)
+    vectors = model_pack.check_vectors(model, FEATURE_COUNT, rng)
+    model_pack.check(model, packed, vectors, rng, count=1000)
+    classes = [model_pack.predict(model["roots"], lambda i: model["nodes"][i], lambda leaf: model["leaves"][leaf],
+                                  packed["n_classes"], v) for v in vectors]
+    model_pack.write_header(os.path.join(directory, "DT_model.h"), "seed_classifier", packed, vectors, classes,
+                            "model_sweep.py")
+
+    predictions, ns = tools.bench(directory, "DT_model.h", xtest)
+    sklearn_predictions = list(clf.predict(xtest))
+    return {"model": name, "step": step, "trees": packed["n_trees"], "nodes": packed["n_nodes"],
+            "accuracy": sum(p == y for p, y in zip(predictions, ytest)) / len(ytest),
+            "differs_from_sklearn": sum(p != s for p, s in zip(predictions, sklearn_predictions)),
+            "walked": walked_nodes(model, xtest), "ns": ns,
+            "rom": tools.size(directory, "DT_model.h", [os.path.join(UTILS, "packed_trees.c"),
+                                                        os.path.join(UTILS, "model.c")]),
+            "rom_emlearn": tools.size(directory, "seed_classifier_emlearn.h", [])}
+
+
+def evaluate_shipped(data, tools, directory):
+    """The header compiled into the actuator today, on the same held-out readings."""
+    _, _, xtest, ytest = data
+    predictions, ns = tools.bench(directory, SHIPPED, xtest)
+    with open(SHIPPED) as f:
+        text = f.read()
+    trees, nodes = (int(re.search(r"\." + field + r" = (\d+)", text).group(1)) for field in ("n_trees", "n_nodes"))
+    return {"model": "shipped DT_model.h", "step": 1, "trees": trees, "nodes": nodes,
+            "accuracy": sum(p == y for p, y in zip(predictions, ytest)) / len(ytest),
+            "differs_from_sklearn": "", "walked": "", "ns": ns,
+            "rom": tools.size(directory, SHIPPED, [os.path.join(UTILS, "packed_trees.c"),
+                                                   os.path.join(UTILS, "model.c")]),
+            "rom_emlearn": ""}
+
+
+def pareto(results):
+    """Mark the results no other one matches or beats on accuracy, ROM and time, and beats on one of them."""
+    for r in results:
+        r["pareto"] = not any(o is not r and o["accuracy"] >= r["accuracy"] and o["rom"] <= r["rom"] and
+                              o["ns"] <= r["ns"] and (o["accuracy"], -o["rom"], -o["ns"]) != (r["accuracy"], -r["rom"], -r["ns"])
+                              for o in results)
+
+
+def print_report(results):
+    print(f"{'':2}{'Model':<22} {'step':>4} {'trees':>5} {'nodes':>6} {'accuracy':>9} {'walked':>7} "
+          f"{'ns/pred':>8} {'ROM':>7} {'emlearn':>8}")
+    for r in sorted(results, key=lambda r: (r["rom"], -r["accuracy"])):
+        walked = f"{r['walked']:.1f}" if r["walked"] != "" else "-"
+        print(f"{'*' if r['pareto'] else ' ':2}{r['model']:<22} {r['step']:>4} {r['trees']:>5} {r['nodes']:>6} "
+              f"{r['accuracy']:>8.2%} {walked:>7} {r['ns']:>8.1f} {r['rom']:>7} {r['rom_emlearn'] or '-':>8}")
+    print("* Pareto front: no other model is at least as accurate, small and fast")
+    # Forests differ on close calls by design: the mote counts votes, scikit-learn averages probabilities
+    mismatches = sum(r["differs_from_sklearn"] or 0 for r in results if r["trees"] == 1)
+    if mismatches:
+        print(f"Warning: {mismatches} predictions of the compiled trees differ from scikit-learn")
+
+
+def main(args):
+    try:
+        import emlearn
+        from sklearn.model_selection import train_test_split
+    except ImportError as e:
+        print(f"Error: {e.name} is needed for the sweep (pip install emlearn scikit-learn)")
+        return 1
+
+    x, y, _ = load_dataset(args.dataset)
+    xtrain, xtest, ytrain, ytest = train_test_split(x, y, test_size=0.2, random_state=42, stratify=y)
+    data = (xtrain, ytrain, xtest, ytest)
+    tools = Toolchain(args)
+    tools.emlearn_include = ["-I" + emlearn.includedir]
+
+    results = []
+    with tempfile.TemporaryDirectory() as directory:
+        with open(os.path.join(directory, "readings.h"), "w") as f:
+            f.write(f"#define READINGS {len(xtest)}\nstatic const int16_t readings[READINGS][{FEATURE_COUNT}] = {{\n")
+            f.write(",\n".join("    {" + ", ".join(map(str, row)) + "}" for row in xtest) + "};\n")
+        try:
+            results.append(evaluate_shipped(data, tools, directory))
+            for name, step, clf in candidates():
+                try:
+                    results.append(evaluate(name, step, clf, data, tools, directory))
+                except model_pack.PackError as e:
+                    print(f"{name}, step {step}: {e}")
+        except subprocess.CalledProcessError as e:
+            print(f"Error: {' '.join(e.cmd)}\n{e.stderr}")
+            return 1
+
+    pareto(results)
+    print_report(results)
+    if args.csv:
+        with open(args.csv, "w", newline="") as f:
+            writer = csv.DictWriter(f, fieldnames=list(results[0].keys()))
+            writer.writeheader()
+            writer.writerows(results)
+    return 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Accuracy, inference time and ROM of candidate seed models.")
+    parser.add_argument("dataset", help="Crop_recommendation.csv")
+    parser.add_argument("--csv", help="write the results to this file")
+    parser.add_argument("--cc", default="cc", help="host compiler for the timings")
+    parser.add_argument("--target-cc", help="compiler of the mote for the sizes (default: --cc)")
+    parser.add_argument("--target-cflags", default="", help="flags of the mote compiler, e.g. -mcpu=cortex-m4 -mthumb")
+    parser.add_argument("--target-ld", default="ld")
+    parser.add_argument("--target-size", default="size")
+    sys.exit(main(parser.parse_args()))
@@ -4,21 +4,52 @@ PROCESS(device_process, "Device Process");
 PROCESS(button_process, "Button Process");
 AUTOSTART_PROCESSES(&device_process, &button_process);
 
-static int max_registration_retry = MAX_REGISTRATION_RETRY;
+// Sensors read for the cells, in this order; sensor i is entry i of the discovery cache
+static const sensor_t sensors[] = {
+    {NPK_SENSOR, "npk", NPK_SENSOR_URL, METRIC_NPK_FETCH, 0, 3, SAMPLING_CONF_NPK},
+    {PH_SENSOR, "ph", PH_SENSOR_URL, METRIC_PH_FETCH, 3, 1, SAMPLING_CONF_PH},
+    {TEMP_SENSOR, "temperature", TEMP_SENSOR_URL, METRIC_TEMP_FETCH, 5, 1, SAMPLING_CONF_TEMP},
+    {MOISTURE_SENSOR, "moisture", MOISTURE_SENSOR_URL, METRIC_MOISTURE_FETCH, 4, 1, SAMPLING_CONF_MOISTURE}};
 
-static char npk_sensor_ip[MAX_IPV6_LENGTH];
-static char ph_sensor_ip[MAX_IPV6_LENGTH];
-static char moisture_sensor_ip[MAX_IPV6_LENGTH];
-static char temperature_sensor_ip[MAX_IPV6_LENGTH];
+#define SENSOR_COUNT (sizeof(sensors) / sizeof(sensors[0]))
 
 static npk npk_data = {0, 0, 0};
 static int ph_data = 0;
 static int moisture_data = 0;
 static int temperature_data = 0;
 
+// Whether the sensor being read answered
+static short int measurement_received = 0;
+
+// Sensors whose last reading is used for the current cell, one bit each
+static uint8_t reused = 0;
+
+#if SAMPLING_CONF_AUDIT
+static npk audit_npk;
+static int audit_ph, audit_moisture, audit_temperature;
+#endif
+
+#if !SAVE_CONF_STREAM
+// Fragment of the cell being sent to /save, and whether the server answered it 5.03
+static int save_fragment = 0;
+static int save_attempts = 0;
+static short int save_busy = 0;
+static uint32_t save_retry_after = 0; // Max-Age of the 5.03, in seconds
+static char save_payload[MSG_SIZE];
+#endif
+
+#if SAVE_CONF_STREAM
+static uint8_t cell_record[CELL_RECORD_SIZE];
+static uint8_t ack_request[STREAM_HEADER_SIZE];
+static short int stream_acked = 0;
+static int ack_requests = 0;
+#endif
+
 // Flag to check the output from the cycle
 static short int exit_flag = 0;
 static int seed_type = -1;
+// Seed type of the current cell in the prescription map, -1 when it is sensed
+static int prescribed = -1;
 // Initialize mov_data
 
 static movement_grid_t mov_data = {
@@ -29,13 +60,16 @@ static movement_grid_t mov_data = {
     .current_col = 0,
     .total_rows = 10,
     .total_cols = 10,
-    .matrix = NULL,
     .direction = 0,
     .field_id = 0};
 
 static short int move_complete = 0;
 static short int active = 0;
 
+// Cells sown in the field and version of the coverage map, the ETag of sowing_actuator/coverage
+static uint16_t sown_cells = 0;
+static uint32_t coverage_version = 0;
+
 /*-----------------SOWING RESOURCE-----------------*/
 
 // Definizione della risorsa
@@ -49,18 +83,18 @@ RESOURCE(sowing_actuator_resource,
 
 static void sowing_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
 {
-   char data[128]; // Define a buffer to hold the JSON string.
-
    if (is_movement_active(&mov_data))
    {
-      // Format the JSON string using snprintf.
-      int len = snprintf(data, sizeof(data), "{\"current_row\": %d, \"current_col\": %d}", mov_data.current_row, mov_data.current_col);
+      // Format the JSON string in the response buffer: the payload is sent after the handler returns.
+      static const char *const keys[] = {"current_row", "current_col"};
+      int values[] = {mov_data.current_row, mov_data.current_col};
+      int len = codec_encode((char *)buffer, preferred_size, NULL, keys, values, 2);
 
       // Set the content format to JSON.
       coap_set_header_content_format(response, APPLICATION_JSON);
 
       // Set the response payload.
-      coap_set_payload(response, (uint8_t *)data, len);
+      coap_set_payload(response, buffer, len);
 
       // Set the response status code.
       coap_set_status_code(response, CONTENT_2_05); // Content, successful response with payload
@@ -102,6 +136,7 @@ static void sowing_post_handler(coap_message_t *request, coap_message_t *respons
 
    // Variables for the movement parameters
    int length = 0, width = 0, square_size = 0, field_id;
+   int survey_id = -1;
 
    // Default status code for error handling
    coap_status_t response_code = BAD_REQUEST_4_00; // Set to BAD_REQUEST by default
@@ -109,8 +144,11 @@ static void sowing_post_handler(coap_message_t *request, coap_message_t *respons
    // Extract payload data if existent
    if (payload_len > 0)
    {
-      // Use sscanf to extract length, width, e square_size
-      int extracted_values = sscanf((char *)payload, "{\"length\": %d, \"width\": %d, \"square_size\": %d, \"field_id\": %d}", &length, &width, &square_size, &field_id);
+      // Extract length, width, square_size and field_id
+      int extracted_values = codec_find_int(payload, payload_len, "length", &length) +
+                             codec_find_int(payload, payload_len, "width", &width) +
+                             codec_find_int(payload, payload_len, "square_size", &square_size) +
+                             codec_find_int(payload, payload_len, "field_id", &field_id);
 
       // Verify if the extraction was succesful
       if (extracted_values == 4 && length > 0 && width > 0 && square_size > 0 && field_id > 0)
@@ -122,17 +160,33 @@ static void sowing_post_handler(coap_message_t *request, coap_message_t *respons
          if (!is_movement_active())
          {
 
-            setup_movement_info(length, width, square_size, field_id);
-
-            start_movement();
-
-            response_code = CHANGED_2_04; // Success: Resource modified succesfully
+            if (setup_movement_info(length, width, square_size, field_id) == 0)
+            {
+               // Optional field surveyed earlier whose prescription map is followed
+               if (codec_find_int(payload, payload_len, "survey", &survey_id) && survey_id > 0)
+                  prescription_start(survey_id, mov_data.total_rows, mov_data.total_cols);
+               else
+                  prescription_stop();
+               start_movement();
+
+               response_code = CHANGED_2_04; // Success: Resource modified succesfully
+            }
+            else
+            {
+               response_code = REQUEST_ENTITY_TOO_LARGE_4_13; // The field does not fit in the coverage map
+            }
          }
       }
    }
 
    // Verify the status of the movement and set the response message
-   if (!is_move_complete() && is_movement_active())
+   if (response_code == REQUEST_ENTITY_TOO_LARGE_4_13)
+   {
+      // Field larger than MAX_FIELD_ROWS x MAX_FIELD_COLS cells
+      coap_set_header_content_format(response, TEXT_PLAIN);
+      coap_set_payload(response, (uint8_t *)"Field too large", strlen("Field too large"));
+   }
+   else if (!is_move_complete() && is_movement_active())
    {
       // Movement active and not complete
       coap_set_header_content_format(response, TEXT_PLAIN);
@@ -160,7 +214,7 @@ static void sowing_put_handler(coap_message_t *request, coap_message_t *response
 
    if (payload_len > 0)
    {
-      printf("PUT payload: %.*s\n", payload_len, (char *)payload);
+      APP_LOG("PUT payload: %.*s\n", payload_len, (char *)payload);
 
       // Comparison of the received command with "start" and "stop"
       if (strncmp((const char *)payload, "start", payload_len) == 0)
@@ -205,7 +259,7 @@ static void sowing_put_handler(coap_message_t *request, coap_message_t *response
 
 static void sowing_delete_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
 {
-   printf("DELETE request received.\n");
+   BINLOG(DELETE_RECEIVED);
 
    // Response to confirme delete
    coap_set_status_code(response, DELETED_2_02); // Resource deleted successfully
@@ -230,18 +284,26 @@ EVENT_RESOURCE(actuator_status_res,
                NULL, // No DELETE handler
                obs_);
 
+// Encode {"complete":..,"active":..}
+static int encode_status(char *buf, int size)
+{
+   static const char *const keys[] = {"complete", "active"};
+   int values[] = {move_complete, active};
+
+   return codec_encode(buf, size, NULL, keys, values, 2);
+}
+
 // Handler for the GET request
 static void status_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buf, uint16_t preferred_size, int32_t *offset)
 {
-   char response_buf[128];
    int len;
 
-   // Create the response string in JSON format
-   len = snprintf(response_buf, sizeof(response_buf), "{\"complete\": %d, \"active\": %d}", move_complete, active);
+   // Create the response string in JSON format, in the response buffer
+   len = encode_status((char *)buf, preferred_size);
 
    // Set the payload and response headers
    coap_set_header_content_format(response, APPLICATION_JSON);
-   coap_set_payload(response, (uint8_t *)response_buf, len);
+   coap_set_payload(response, buf, len);
 }
 
 // Handler for notifications to observers
@@ -251,7 +313,7 @@ static void obs_(void)
     char msg[MSG_SIZE];
     
     // Format the JSON message
-    snprintf(msg, sizeof(msg), "{\"complete\": %d, \"active\": %d}", move_complete, active);
+    encode_status(msg, sizeof(msg));
 
     // Initialize the notification message
     coap_init_message(notification, COAP_TYPE_CON, CONTENT_2_05, coap_get_mid());
@@ -263,162 +325,246 @@ static void obs_(void)
     coap_notify_observers(&actuator_status_res);
 }
 
+/*--------------------METRICS RESOURCE-----------------*/
 
-/*----------------------------------------------------------------*/
+// Binary snapshot of the per-phase timings (layout in metrics.h), notified after every cell
+EVENT_RESOURCE(actuator_metrics_res,
+               "title=\"Actuator Metrics\";ct=42;obs",
+               metrics_get_handler,
+               NULL,
+               NULL,
+               NULL,
+               NULL);
+
+static uint8_t metrics_buf[METRICS_SNAPSHOT_SIZE];
+static snapshot_t metrics_snapshot = {metrics_buf, sizeof(metrics_buf), 0, metrics_encode};
 
-static void discovery_response_callback(coap_message_t *response)
+static void metrics_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
 {
-   if (response == NULL)
+   snapshot_serve(&metrics_snapshot, response, buffer, preferred_size, offset);
+}
+
+
+/*--------------------ENERGY RESOURCE-----------------*/
+
+// Binary snapshot of the Energest time per workflow phase (layout in energy.h)
+RESOURCE(actuator_energy_res,
+         "title=\"Actuator Energy\";ct=42",
+         energy_get_handler,
+         NULL,
+         NULL,
+         NULL);
+
+static uint8_t energy_buf[ENERGY_SNAPSHOT_SIZE(ENERGY_ACTUATOR_PHASES)];
+static snapshot_t energy_snapshot = {energy_buf, sizeof(energy_buf), 0, energy_encode};
+
+static void energy_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+   snapshot_serve(&energy_snapshot, response, buffer, preferred_size, offset);
+}
+
+
+/*----------------------LOG RESOURCE------------------*/
+
+// Records of the binary log (layout in binlog.h); reading them does not consume them
+RESOURCE(actuator_log_res,
+         "title=\"Actuator Log\";ct=42",
+         log_get_handler,
+         NULL,
+         NULL,
+         NULL);
+
+static uint8_t log_buf[BINLOG_SNAPSHOT_SIZE];
+static snapshot_t log_snapshot = {log_buf, sizeof(log_buf), 0, binlog_encode};
+
+static void log_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+   snapshot_serve(&log_snapshot, response, buffer, preferred_size, offset);
+}
+
+
+/*----------------------RTO RESOURCE------------------*/
+
+// Round-trip estimates and retransmission timeouts per destination (layout in cocoa.h)
+RESOURCE(actuator_rto_res,
+         "title=\"Actuator Retransmission Timeouts\";ct=42",
+         rto_get_handler,
+         NULL,
+         NULL,
+         NULL);
+
+static uint8_t rto_buf[COCOA_SNAPSHOT_SIZE];
+static snapshot_t rto_snapshot = {rto_buf, sizeof(rto_buf), 0, cocoa_encode};
+
+static void rto_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+   snapshot_serve(&rto_snapshot, response, buffer, preferred_size, offset);
+}
+
+/*----------------------MODEL RESOURCE----------------*/
+
+// Seed model uploaded with Block1 (layout in model.h), used instead of the compiled-in one
+RESOURCE(actuator_model_res,
+         "title=\"Actuator Model\"",
+         model_get_handler,
+         NULL,
+         model_put_handler,
+         NULL);
+
+// {"version":..,"pending":..}: the model in use and the one waiting for the next cell, 0 for none
+static void model_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+   static const char *const keys[] = {"version", "pending"};
+   int values[] = {(int)model_version(), (int)model_pending_version()};
+   int len = codec_encode((char *)buffer, preferred_size, NULL, keys, values, 2);
+
+   coap_set_header_content_format(response, APPLICATION_JSON);
+   coap_set_payload(response, buffer, len);
+}
+
+static void model_put_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+   const uint8_t *payload = NULL;
+   int len = coap_get_payload(request, &payload);
+   uint32_t num = 0, block_offset = 0;
+   uint8_t more = 0;
+   uint16_t size = 0;
+   int block = coap_get_header_block1(request, &num, &more, &size, &block_offset);
+
+   // Blocks larger than the engine takes would be cut: ask for smaller ones
+   if (block && size > COAP_MAX_CHUNK_SIZE)
    {
-      printf("Discovery failed: no response from server.\n");
+      coap_set_status_code(response, REQUEST_ENTITY_TOO_LARGE_4_13);
+      coap_set_header_block1(response, 0, 0, COAP_MAX_CHUNK_SIZE);
       return;
    }
 
-   const uint8_t *payload;
-   int len = coap_get_payload(response, &payload);
-   if (len > 0)
+   switch (model_upload(payload, len, block ? block_offset : 0, block && more))
    {
-      const char *payload_str = (const char *)payload;
+   case MODEL_UPLOAD_MORE:
+      coap_set_status_code(response, CONTINUE_2_31);
+      break;
+   case MODEL_UPLOAD_DONE:
+      coap_set_status_code(response, CHANGED_2_04);
+      BINLOG(MODEL_RECEIVED, model_pending_version());
+      break;
+   case MODEL_UPLOAD_TOO_LARGE:
+      coap_set_status_code(response, REQUEST_ENTITY_TOO_LARGE_4_13);
+      break;
+   case MODEL_UPLOAD_INCOMPLETE:
+      coap_set_status_code(response, REQUEST_ENTITY_INCOMPLETE_4_08);
+      break;
+   default:
+      coap_set_status_code(response, BAD_REQUEST_4_00);
+      coap_set_header_content_format(response, TEXT_PLAIN);
+      coap_set_payload(response, (uint8_t *)model_error(), strlen(model_error()));
+      BINLOG(MODEL_REJECTED);
+      break;
+   }
+   if (block)
+      coap_set_header_block1(response, num, more, size);
+}
 
-      if (strstr(payload_str, "\"npk\"") != NULL)
-      {
-         if (sscanf(payload_str, "{\"npk\": \"%45[^\"]\"}", npk_sensor_ip) == 1)
-         {
-            printf("NPK Sensor IP: %s\n", npk_sensor_ip);
-         }
-         else
-         {
-            printf("Failed to parse NPK sensor IP.\n");
-         }
-      }
-      else if (strstr(payload_str, "\"ph\"") != NULL)
-      {
-         if (sscanf(payload_str, "{\"ph\": \"%45[^\"]\"}", ph_sensor_ip) == 1)
-         {
-            printf("pH Sensor IP: %s\n", ph_sensor_ip);
-         }
-         else
-         {
-            printf("Failed to parse pH sensor IP.\n");
-         }
-      }
-      else if (strstr(payload_str, "\"moisture\"") != NULL)
-      {
-         if (sscanf(payload_str, "{\"moisture\": \"%45[^\"]\"}", moisture_sensor_ip) == 1)
-         {
+/*--------------------COVERAGE RESOURCE----------------*/
 
-            printf("Moisture Sensor IP: %s\n", moisture_sensor_ip);
-         }
-         else
-         {
-            printf("Failed to parse Moisture sensor IP.\n");
-         }
-      }
-      else if (strstr(payload_str, "\"temperature\"") != NULL)
-      {
-         if (sscanf(payload_str, "{\"temperature\": \"%45[^\"]\"}", temperature_sensor_ip) == 1)
-         {
-            printf("Temperature Sensor IP: %s\n", temperature_sensor_ip);
-         }
-         else
-         {
-            printf("Failed to parse Temperature sensor IP.\n");
-         }
-      }
-      else
-      {
-         printf("Unexpected sensor type in response.\n");
-      }
+// Visited cells of the field as a bitmap (layout in actuator.h), read with Block2
+RESOURCE(actuator_coverage_res,
+         "title=\"Actuator Coverage\";ct=42",
+         coverage_get_handler,
+         NULL,
+         NULL,
+         NULL);
+
+// Byte i of the representation
+static uint8_t coverage_byte(int i)
+{
+   uint8_t header[COVERAGE_HEADER_SIZE] = {COVERAGE_VERSION,
+                                           mov_data.field_id >> 8, mov_data.field_id & 0xFF,
+                                           mov_data.total_rows >> 8, mov_data.total_rows & 0xFF,
+                                           mov_data.total_cols >> 8, mov_data.total_cols & 0xFF,
+                                           sown_cells >> 8, sown_cells & 0xFF};
+
+   return i < COVERAGE_HEADER_SIZE ? header[i] : mov_data.matrix[i - COVERAGE_HEADER_SIZE];
+}
+
+static void coverage_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+   int32_t start = offset != NULL ? *offset : 0;
+   int total = COVERAGE_HEADER_SIZE + (mov_data.total_rows * mov_data.total_cols + 7) / 8;
+   uint8_t etag[COVERAGE_ETAG_SIZE] = {coverage_version >> 24, coverage_version >> 16, coverage_version >> 8, coverage_version};
+   const uint8_t *known;
+   int len;
+
+   // The blocks are sliced from the live map: the ETag tells a client that it changed in between
+   coap_set_header_etag(response, etag, sizeof(etag));
+
+   // The client already has this version
+   if (start == 0 && coap_get_header_etag(request, &known) == sizeof(etag) && memcmp(known, etag, sizeof(etag)) == 0)
+   {
+      coap_set_status_code(response, VALID_2_03);
+      if (offset != NULL)
+         *offset = -1;
+      return;
    }
-   else
+
+   if (start >= total)
    {
-      printf("Empty payload in server response.\n");
+      coap_set_status_code(response, BAD_OPTION_4_02);
+      coap_set_payload(response, (uint8_t *)"BlockOutOfScope", strlen("BlockOutOfScope"));
+      return;
    }
+
+   len = total - start < preferred_size ? total - start : preferred_size;
+   for (int i = 0; i < len; i++)
+      buffer[i] = coverage_byte(start + i);
+
+   coap_set_header_content_format(response, APPLICATION_OCTET_STREAM);
+   coap_set_payload(response, buffer, len);
+   if (offset != NULL)
+      *offset = start + len < total ? start + len : -1;
+   else if (len < total)
+      coap_set_header_block2(response, 0, 1, preferred_size);
 }
 
+/*----------------------------------------------------------------*/
+
 void get_measurement_callback(coap_message_t *response)
 {
    if (response == NULL)
-   {
-      printf("Failed to retrieve data.\n");
       return;
-   }
+   measurement_received = 1;
+   metrics_exchange_response();
 
    const uint8_t *payload;
    int len = coap_get_payload(response, &payload);
    if (len <= 0 || payload == NULL)
    {
-      printf("No payload received.\n");
+      BINLOG(SENSOR_NO_PAYLOAD);
       return;
    }
 
-   // Convert payload to a string for easy manipulation
-   const char *payload_str = (const char *)payload;
-
-   // Determine sensor type by checking for specific keys
-   int sensor_type = evaluate_sensor_type(payload_str);
-
-   // Extract sensor values based on sensor type
-   switch (sensor_type)
-   {
-   case NPK_SENSOR:
+   // Determine the sensor by the keys of its reading
+   if (codec_find_int(payload, len, "n", &npk_data.nitrogen))
    {
-      char *n_start = strstr(payload_str, "\"n\"");
-      if (n_start)
-      {
-         npk_data.nitrogen = atof(strchr(n_start, ':') + 1);
-      }
-      char *p_start = strstr(payload_str, "\"p\"");
-      if (p_start)
-      {
-         npk_data.phosphorus = atof(strchr(p_start, ':') + 1);
-      }
-      char *k_start = strstr(payload_str, "\"k\"");
-      if (k_start)
-      {
-         npk_data.potassium = atof(strchr(k_start, ':') + 1);
-      }
-      printf("NPK Data - n: %d, p: %d, k: %d\n",
-             npk_data.nitrogen, npk_data.phosphorus, npk_data.potassium);
-      break;
+      codec_find_int(payload, len, "p", &npk_data.phosphorus);
+      codec_find_int(payload, len, "k", &npk_data.potassium);
+      BINLOG(NPK_DATA, npk_data.nitrogen, npk_data.phosphorus, npk_data.potassium);
    }
-
-   case PH_SENSOR:
+   else if (codec_find_int(payload, len, "ph", &ph_data))
    {
-      char *ph_start = strstr(payload_str, "\"ph\"");
-      if (ph_start)
-      {
-         ph_data = atof(strchr(ph_start, ':') + 1);
-         printf("pH Data - pH: %d\n", ph_data);
-      }
-      break;
+      BINLOG(PH_DATA, ph_data);
    }
-
-   case MOISTURE_SENSOR:
+   else if (codec_find_int(payload, len, "moisture", &moisture_data))
    {
-      char *moisture_start = strstr(payload_str, "\"moisture\"");
-      if (moisture_start)
-      {
-         moisture_data = atof(strchr(moisture_start, ':') + 1);
-         printf("Moisture Data - Moisture: %d\n", moisture_data);
-      }
-      break;
+      BINLOG(MOISTURE_DATA, moisture_data);
    }
-
-   case TEMP_SENSOR:
+   else if (codec_find_int(payload, len, "temperature", &temperature_data))
    {
-      char *temp_start = strstr(payload_str, "\"temperature\"");
-      if (temp_start)
-      {
-         temperature_data = atof(strchr(temp_start, ':') + 1);
-         printf("Temperature Data - Temp: %d\n", temperature_data);
-      }
-      break;
+      BINLOG(TEMP_DATA, temperature_data);
    }
-
-   default:
-      printf("Unknown sensor data.\n");
-      break;
+   else
+   {
+      BINLOG(SENSOR_UNKNOWN_DATA);
    }
 }
 // Callback function for the response to the saving in the DB
@@ -427,36 +573,131 @@ void save_response_callback(coap_message_t *response)
 
    if (response == NULL)
    {
-      printf("Failed to send data to the DB.\n");
+      BINLOG(SAVE_FAILED);
+      return;
+   }
+   metrics_exchange_response();
+
+#if !SAVE_CONF_STREAM
+   // A busy server keeps the fragments it has and asks for this one again after Max-Age
+   if (response->code == SERVICE_UNAVAILABLE_5_03)
+   {
+      save_busy = 1;
+      coap_get_header_max_age(response, &save_retry_after);
       return;
    }
+#endif
 
    const uint8_t *payload = NULL;
    int len = coap_get_payload(response, &payload);
    if (len > 0)
    {
-      printf("Data successfully sent to the DB.\n");
+      BINLOG(SAVE_OK);
       return;
    }
 }
 
-// Handler for the responce to CoAP registration
-static void client_chunk_handler(coap_message_t *response)
+// Sensor value reported for the current cell: the sensors are not read for a prescribed cell
+static int reported(int value)
 {
-   if (response == NULL)
+   return prescribed >= 0 ? CELL_NOT_MEASURED : value;
+}
+
+#if !SAVE_CONF_STREAM
+// Fragment of the current cell for /save, SAVE_FRAGMENTS of them: position, NPK, moisture, temperature, pH, seed type
+#define SAVE_FRAGMENTS 6
+
+static void encode_save_fragment(char *payload, int size, int fragment)
+{
+   static const char *const position_keys[] = {"row", "col", "field_id"};
+   static const char *const npk_keys[] = {"n", "p", "k"};
+
+   switch (fragment)
+   {
+   case 0:
    {
-      printf("Request timed out\n");
-      max_registration_retry--;
+      int position[] = {mov_data.current_row, mov_data.current_col, mov_data.field_id};
+      codec_encode(payload, size, NULL, position_keys, position, 3);
+      break;
    }
-   else
+   case 1:
+   {
+      int npk_values[] = {reported(npk_data.nitrogen), reported(npk_data.phosphorus), reported(npk_data.potassium)};
+      codec_encode(payload, size, "npk", npk_keys, npk_values, 3);
+      break;
+   }
+   case 2:
+      codec_encode_int(payload, size, "moisture", reported(moisture_data));
+      break;
+   case 3:
+      codec_encode_int(payload, size, "temp", reported(temperature_data));
+      break;
+   case 4:
+      codec_encode_int(payload, size, "ph", reported(ph_data));
+      break;
+   default:
+      codec_encode_int(payload, size, "seed_type", seed_type);
+      break;
+   }
+}
+#endif
+
+#if SAVE_CONF_STREAM
+// Record of a cell, layout in actuator.h
+static void encode_cell_record(uint8_t *p)
+{
+   int values[] = {mov_data.field_id, mov_data.current_row, mov_data.current_col,
+                   reported(npk_data.nitrogen), reported(npk_data.phosphorus), reported(npk_data.potassium),
+                   reported(moisture_data), reported(temperature_data), reported(ph_data), seed_type};
+
+   for (int i = 0; i < CELL_RECORD_FIELDS; i++)
+   {
+      *p++ = (values[i] >> 8) & 0xFF;
+      *p++ = values[i] & 0xFF;
+   }
+}
+
+// Send the records not sent since the last acknowledgement, in non-confirmable messages
+static void stream_send(const coap_endpoint_t *ep)
+{
+   coap_message_t message[1];
+   uint8_t payload[COAP_MAX_CHUNK_SIZE];
+   coap_transaction_t *t;
+   int len;
+
+   while ((len = stream_encode(payload, sizeof(payload))) > 0)
    {
-      printf("Registration successful\n");
-      max_registration_retry = -1; // Exit the registration loop
+      coap_init_message(message, COAP_TYPE_NON, COAP_POST, coap_get_mid());
+      coap_set_header_uri_path(message, SAVE_STREAM_URL);
+      coap_set_header_content_format(message, APPLICATION_OCTET_STREAM);
+      coap_set_payload(message, payload, len);
+
+      // The records stay buffered: the next acknowledgement has them sent again
+      if ((t = coap_new_transaction(message->mid, ep)) == NULL)
+      {
+         BINLOG(STREAM_SEND_FAILED);
+         return;
+      }
+      t->message_len = coap_serialize_message(message, t->message);
+      coap_send_transaction(t);
    }
 }
 
-const char *sensor_names[] = {"npk", "temperature", "ph", "moisture"};
-const char *sensor_urls[] = {NPK_SENSOR_URL, TEMP_SENSOR_URL, PH_SENSOR_URL, MOISTURE_SENSOR_URL};
+// Callback function for the acknowledgement of the streamed records
+void stream_ack_callback(coap_message_t *response)
+{
+   const uint8_t *payload = NULL;
+   int len = coap_get_payload(response, &payload);
+   int released;
+
+   metrics_exchange_response();
+   if ((released = stream_ack(payload, len)) >= 0)
+   {
+      stream_acked = 1;
+      BINLOG(STREAM_ACK, released, stream_pending());
+   }
+}
+#endif
 
 PROCESS_THREAD(button_process, ev, data)
 {
@@ -472,12 +713,12 @@ PROCESS_THREAD(button_process, ev, data)
          if (is_movement_active(&mov_data))
          {
             stop_movement(&mov_data);
-            printf("Pause request initiated via button\n");
+            BINLOG(BUTTON_PAUSE);
          }
          else
          {
             start_movement(&mov_data);
-            printf("Movement request initiated via button\n");
+            BINLOG(BUTTON_START);
          }
       }
    }
@@ -488,14 +729,18 @@ PROCESS_THREAD(button_process, ev, data)
 PROCESS_THREAD(device_process, ev, data)
 {
    static coap_message_t request;
-   static coap_message_t reg_request[1];
    static coap_endpoint_t sensor_ep;
    static coap_endpoint_t server_ep;
    static struct etimer sowing_timer;
    static struct etimer timer;
+#if !SAVE_CONF_STREAM
+   static struct etimer busy_timer;
+#endif
+   static unsigned int sensor;
+   static char sensor_query[16];
 
    PROCESS_BEGIN();
-   printf("Starting Actuator\n");
+   APP_LOG("Starting Actuator\n");
 
    // Initialize the endpoint of the CoAP server
    coap_endpoint_parse(SERVER_EP, strlen(SERVER_EP), &server_ep);
@@ -503,137 +748,219 @@ PROCESS_THREAD(device_process, ev, data)
    // Activate the resource
    coap_activate_resource(&sowing_actuator_resource, "sowing_actuator");
    coap_activate_resource(&actuator_status_res, "sowing_actuator/status");
+   coap_activate_resource(&actuator_metrics_res, "metrics");
+   coap_activate_resource(&actuator_energy_res, "energy");
+   coap_activate_resource(&actuator_log_res, "log");
+   coap_activate_resource(&actuator_rto_res, "rto");
+   coap_activate_resource(&actuator_coverage_res, "sowing_actuator/coverage");
+   coap_activate_resource(&actuator_model_res, "model");
+   model_init(MODEL_FEATURES);
+   metrics_init();
+   energy_init(ENERGY_ACTUATOR_PHASES);
+   binlog_init();
+#if SAVE_CONF_STREAM
+   stream_init();
+#endif
 
    button_hal_init();
 
    /* ----------------------------REGISTER-------------------------------*/
 
-   while (max_registration_retry > 0)
-   {
-
-      coap_endpoint_parse(SERVER_EP, strlen(SERVER_EP), &server_ep);
-      coap_init_message(reg_request, COAP_TYPE_CON, COAP_POST, 0);
-      coap_set_header_uri_path(reg_request, REGISTER_URL);
-      const char msg[] = "sowing_actuator";
-      coap_set_payload(reg_request, (uint8_t *)msg, sizeof(msg) - 1);
-
-      // Send the registration request and handle the response
-      COAP_BLOCKING_REQUEST(&server_ep, reg_request, client_chunk_handler);
-
-      if (max_registration_retry > 0)
-      {
-         // Wait and retry if registration failed
-         etimer_set(&timer, 15 * CLOCK_SECOND);
-         PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
-
-         // Decrement retry count if registration failed
-         max_registration_retry--;
-      }
-   }
+   // Register with the server, retrying every 15 s
+   registration_start("sowing_actuator", 15 * CLOCK_SECOND);
+   PROCESS_WAIT_EVENT_UNTIL(ev == registration_event);
 
-   if (max_registration_retry == 0)
-   {
-      printf("Registration failed after maximum attempts\n");
-   }
-   else
-   {
-      printf("Registration successful\n");
-   }
    // Wait for registration of the other devices to the server
    etimer_set(&timer, 30 * CLOCK_SECOND);
    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
 
    /* ----------------------------DISCOVER-------------------------------*/
 
-   coap_endpoint_parse(SERVER_EP, strlen(SERVER_EP), &server_ep);
-   coap_init_message(&request, COAP_TYPE_CON, COAP_POST, 0);
-   coap_set_header_uri_path(&request, DISCOVER_URL);
-   coap_set_header_content_format(&request, APPLICATION_JSON);
-
-   const char msg_1[] = "{\"name\": \"npk\"}";
-   coap_set_payload(&request, (uint8_t *)msg_1, sizeof(msg_1) - 1);
-   COAP_BLOCKING_REQUEST(&server_ep, &request, discovery_response_callback);
-
-   const char msg_2[] = "{\"name\": \"temperature\"}";
-   coap_set_payload(&request, (uint8_t *)msg_2, sizeof(msg_2) - 1);
-   COAP_BLOCKING_REQUEST(&server_ep, &request, discovery_response_callback);
-
-   const char msg_3[] = "{\"name\": \"ph\"}";
-   coap_set_payload(&request, (uint8_t *)msg_3, sizeof(msg_3) - 1);
-   COAP_BLOCKING_REQUEST(&server_ep, &request, discovery_response_callback);
-
-   const char msg_4[] = "{\"name\": \"moisture\"}";
-   coap_set_payload(&request, (uint8_t *)msg_4, sizeof(msg_4) - 1);
-   COAP_BLOCKING_REQUEST(&server_ep, &request, discovery_response_callback);
+   // Look up the sensors; the cache keeps their addresses up to date from then on
+   for (sensor = 0; sensor < SENSOR_COUNT; sensor++)
+      discovery_add(sensors[sensor].name);
+   discovery_refresh();
+   PROCESS_WAIT_EVENT_UNTIL(ev == discovery_event);
 
    /* ------------------------MAIN LOOP-----------------------*/
 
-   printf("Starting main loop\n");
+   APP_LOG("Starting main loop\n");
 
    while (!exit_flag)
    {
       etimer_set(&timer, 30 * CLOCK_SECOND);
+      binlog_idle();
       PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
 
       // Check the status of mov_data structure
       if (is_movement_active(&mov_data) && !is_move_complete(&mov_data))
       {
-         char endpoint_uri[64];
-
-         coap_init_message(&request, COAP_TYPE_CON, COAP_GET, 0);
-
-         coap_set_header_uri_path(&request, NPK_SENSOR_URL);
-         snprintf(endpoint_uri, sizeof(endpoint_uri), "coap://[%s]:5683", npk_sensor_ip);
-         coap_endpoint_parse(endpoint_uri, strlen(endpoint_uri), &sensor_ep);
-         COAP_BLOCKING_REQUEST(&sensor_ep, &request, get_measurement_callback);
-
-         // Request to pH sensor
-         coap_init_message(&request, COAP_TYPE_CON, COAP_GET, 0);
-         coap_set_header_uri_path(&request, PH_SENSOR_URL);
-         snprintf(endpoint_uri, sizeof(endpoint_uri), "coap://[%s]:5683", ph_sensor_ip);
-         coap_endpoint_parse(endpoint_uri, strlen(endpoint_uri), &sensor_ep);
-         COAP_BLOCKING_REQUEST(&sensor_ep, &request, get_measurement_callback);
-
-         // Request to the temperature sensor
-         coap_init_message(&request, COAP_TYPE_CON, COAP_GET, 0);
-         coap_set_header_uri_path(&request, TEMP_SENSOR_URL);
-         snprintf(endpoint_uri, sizeof(endpoint_uri), "coap://[%s]:5683", temperature_sensor_ip);
-         coap_endpoint_parse(endpoint_uri, strlen(endpoint_uri), &sensor_ep);
-         COAP_BLOCKING_REQUEST(&sensor_ep, &request, get_measurement_callback);
-
-         // Request to moisture sensor
-         coap_init_message(&request, COAP_TYPE_CON, COAP_GET, 0);
-         coap_set_header_uri_path(&request, MOISTURE_SENSOR_URL);
-         snprintf(endpoint_uri, sizeof(endpoint_uri), "coap://[%s]:5683", moisture_sensor_ip);
-         coap_endpoint_parse(endpoint_uri, strlen(endpoint_uri), &sensor_ep);
-         COAP_BLOCKING_REQUEST(&sensor_ep, &request, get_measurement_callback);
-         seed_type = apply_decision_tree_model(npk_data, ph_data, moisture_data, temperature_data);
-
-         printf("Temperature Data - Temp: %d\n", temperature_data);
-         printf("Ph Data - Ph: %d\n", ph_data);
-         printf("Moisture Data - Moisture: %d\n", moisture_data);
-         printf("NPK Data - n: %d, p: %d, k: %d\n",
-                npk_data.nitrogen, npk_data.phosphorus, npk_data.potassium);
-         printf("Seed type: %d\n", seed_type);
+         rtimer_clock_t inference_start;
+
+         metrics_start(METRIC_CELL);
+         energy_switch(ENERGY_PHASE_SENSING);
+
+         // A model uploaded since the last cell is used from this one
+         if (model_commit())
+            BINLOG(MODEL_SWAPPED, model_version());
+
+         // Cells of a surveyed field take the seed type of the prescription map, fetched
+         // a block at a time as the actuator moves; the others are sensed
+         if (prescription_due(mov_data.current_row, mov_data.current_col))
+         {
+            prescription_fetch(mov_data.current_row, mov_data.current_col);
+            PROCESS_WAIT_EVENT_UNTIL(ev == prescription_event);
+         }
+         prescribed = prescription_seed(mov_data.current_row, mov_data.current_col);
+
+         if (prescribed >= 0)
+         {
+            seed_type = prescribed;
+            BINLOG(SEED_PRESCRIBED, mov_data.current_row, mov_data.current_col, seed_type);
+         }
+         else
+         {
+            // Look up again the sensors that moved, stopped answering or expired, and
+            // the closest instances once the actuator is a few rows further
+            discovery_set_position(mov_data.current_row, mov_data.current_col);
+            if (discovery_due())
+            {
+               discovery_refresh();
+               PROCESS_WAIT_EVENT_UNTIL(ev == discovery_event);
+            }
+
+            // Keep the readings that are recent, taken close by and far from a split of the model
+            reused = 0;
+            for (sensor = 0; sensor < SENSOR_COUNT; sensor++)
+            {
+               if (sampling_reusable(sensor, &sensors[sensor].policy, mov_data.current_row, mov_data.current_col,
+                                     split_margin(sensors[sensor].feature, sensors[sensor].features)))
+               {
+                  reused |= 1 << sensor;
+                  BINLOG(SENSOR_REUSED, sensors[sensor].id);
+               }
+            }
+
+            // The sensors report the soil of the cell the actuator is on
+            snprintf(sensor_query, sizeof(sensor_query), "r=%d&c=%d", mov_data.current_row, mov_data.current_col);
+            for (sensor = 0; sensor < SENSOR_COUNT; sensor++)
+            {
+               const coap_endpoint_t *ep = discovery_endpoint(sensor);
+
+               if (reused & (1 << sensor))
+                  continue;
+               if (ep == NULL)
+               {
+                  // Never found: keep the last reading
+                  BINLOG(SENSOR_UNDISCOVERED, sensors[sensor].id);
+                  continue;
+               }
+               coap_endpoint_copy(&sensor_ep, ep);
+
+               coap_init_message(&request, COAP_TYPE_CON, COAP_GET, 0);
+               coap_set_header_uri_path(&request, sensors[sensor].url);
+               coap_set_header_uri_query(&request, sensor_query);
+               measurement_received = 0;
+               metrics_exchange_begin(sensors[sensor].metric);
+               COCOA_BLOCKING_REQUEST(&sensor_ep, &request, get_measurement_callback);
+               metrics_exchange_end(cocoa_last_retransmissions());
+
+               if (measurement_received)
+                  sampling_taken(sensor, mov_data.current_row, mov_data.current_col);
+               else
+                  BINLOG(SENSOR_TIMEOUT, sensors[sensor].id);
+               discovery_result(sensor, measurement_received);
+            }
+
+            energy_switch(ENERGY_PHASE_INFERENCE);
+            inference_start = RTIMER_NOW();
+            seed_type = apply_decision_tree_model(npk_data, ph_data, moisture_data, temperature_data);
+            metrics_record(METRIC_INFERENCE, (uint32_t)((uint64_t)(RTIMER_NOW() - inference_start) * 1000000 / RTIMER_SECOND));
+
+            BINLOG(SEED_TYPE, mov_data.current_row, mov_data.current_col, seed_type);
+
+#if SAMPLING_CONF_AUDIT
+            // Read the reused sensors anyway and compare the seed type of the fresh readings, then
+            // go on with the reused ones as without the audit
+            audit_npk = npk_data;
+            audit_ph = ph_data;
+            audit_moisture = moisture_data;
+            audit_temperature = temperature_data;
+            for (sensor = 0; sensor < SENSOR_COUNT; sensor++)
+            {
+               if (!(reused & (1 << sensor)) || discovery_endpoint(sensor) == NULL)
+                  continue;
+               coap_endpoint_copy(&sensor_ep, discovery_endpoint(sensor));
+               coap_init_message(&request, COAP_TYPE_CON, COAP_GET, 0);
+               coap_set_header_uri_path(&request, sensors[sensor].url);
+               coap_set_header_uri_query(&request, sensor_query);
+               COCOA_BLOCKING_REQUEST(&sensor_ep, &request, get_measurement_callback);
+            }
+            if (reused)
+            {
+               int fresh_type = apply_decision_tree_model(npk_data, ph_data, moisture_data, temperature_data);
+
+               if (fresh_type != seed_type)
+                  BINLOG(SAMPLING_CHANGED, mov_data.current_row, mov_data.current_col, seed_type, fresh_type);
+            }
+            npk_data = audit_npk;
+            ph_data = audit_ph;
+            moisture_data = audit_moisture;
+            temperature_data = audit_temperature;
+#endif
+         }
 
          /*----------------------SEEDING SIMULATION-------------------------*/
 
+         energy_switch(ENERGY_PHASE_SEEDING);
+
          // Set the timer for 20 seconds
          etimer_set(&sowing_timer, CLOCK_SECOND * 20);
+         metrics_start(METRIC_SEEDING);
 
          leds_on(LEDS_GREEN);
 
-         printf("Seeding simulation started. Waiting...\n");
+         BINLOG(SEEDING_STARTED);
+
+         // Nothing to do until the seeding is over: print the pending log records
+         binlog_idle();
 
          // Wait until the timer expiration
          PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&sowing_timer));
-         printf("Simulation complete.\n");
+         metrics_stop(METRIC_SEEDING);
+         energy_switch(ENERGY_PHASE_REPORTING);
+         BINLOG(SEEDING_DONE);
          leds_off(LEDS_GREEN);
 
          /*--------------------------SEND TO DB------------------------------*/
 
-         char payload[MSG_SIZE]; // One variable for the payload
-
+#if SAVE_CONF_STREAM
+         // One record per cell, streamed without waiting for the server
+         coap_endpoint_parse(SERVER_EP, strlen(SERVER_EP), &server_ep);
+         encode_cell_record(cell_record);
+         stream_push(cell_record);
+         stream_send(&server_ep);
+
+         // Every few cells ask which records arrived and send the missing ones again.
+         // The last cell waits until all of them are stored, the field is then complete
+         ack_requests = is_last_cell() ? SAVE_STREAM_FLUSH_ATTEMPTS : 1;
+         while (ack_requests-- > 0 && stream_pending() >= (is_last_cell() ? 1 : SAVE_STREAM_ACK_EVERY))
+         {
+            coap_init_message(&request, COAP_TYPE_CON, COAP_POST, 0);
+            coap_set_header_uri_path(&request, SAVE_STREAM_URL);
+            coap_set_header_content_format(&request, APPLICATION_OCTET_STREAM);
+            coap_set_payload(&request, ack_request, stream_encode_ack_request(ack_request, sizeof(ack_request)));
+            stream_acked = 0;
+            metrics_exchange_begin(METRIC_SAVE);
+            COCOA_BLOCKING_REQUEST(&server_ep, &request, stream_ack_callback);
+            metrics_exchange_end(cocoa_last_retransmissions());
+            if (!stream_acked)
+            {
+               BINLOG(STREAM_NO_ACK, stream_pending());
+            }
+            stream_send(&server_ep);
+         }
+#else
          // Initialization of the timer
          etimer_set(&timer, 10 * CLOCK_SECOND);
 
@@ -643,60 +970,47 @@ PROCESS_THREAD(device_process, ev, data)
          coap_set_header_content_format(&request, APPLICATION_JSON); // Set the content format to simple text
          coap_endpoint_parse(SERVER_EP, strlen(SERVER_EP), &server_ep);
 
-         // Sending of the first payload: information about row, column and field ID
-         snprintf(payload, sizeof(payload),
-                  "{\"row\":%d, \"col\":%d, \"field_id\":%d}",
-                  mov_data.current_row, mov_data.current_col, mov_data.field_id);
-         coap_set_payload(&request, (const uint8_t *)payload, strlen(payload));
-         COAP_BLOCKING_REQUEST(&server_ep, &request, save_response_callback);
-         PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
-         etimer_reset(&timer);
-
-         // Sendind the second payload: Invio del secondo payload: NPK data
-         snprintf(payload, sizeof(payload),
-                  "{\"npk\":{\"n\":%d, \"p\":%d, \"k\":%d}}",
-                  (int)round(npk_data.nitrogen), (int)round(npk_data.phosphorus), (int)round(npk_data.potassium));
-
-         coap_set_payload(&request, (const uint8_t *)payload, strlen(payload));
-         COAP_BLOCKING_REQUEST(&server_ep, &request, save_response_callback);
-         PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
-         etimer_reset(&timer);
-
-         // Sending the third payload: moisture
-         snprintf(payload, sizeof(payload),
-                  "{\"moisture\":%d}", (int)round(moisture_data));
-         coap_set_payload(&request, (const uint8_t *)payload, strlen(payload));
-         COAP_BLOCKING_REQUEST(&server_ep, &request, save_response_callback);
-         PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
-         etimer_reset(&timer);
-
-         // Sending the forth payload: temperature
-         snprintf(payload, sizeof(payload),
-                  "{\"temp\":%d}", (int)round(temperature_data));
-         coap_set_payload(&request, (const uint8_t *)payload, strlen(payload));
-         COAP_BLOCKING_REQUEST(&server_ep, &request, save_response_callback);
-         PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
-         etimer_reset(&timer);
-
-         // Sending the fifth payload: pH
-         snprintf(payload, sizeof(payload),
-                  "{\"ph\":%d}", (int)round(ph_data));
-         coap_set_payload(&request, (const uint8_t *)payload, strlen(payload));
-         COAP_BLOCKING_REQUEST(&server_ep, &request, save_response_callback);
-         PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
-         etimer_reset(&timer);
-
-         // Sending the sixth payload: seed type
-         snprintf(payload, sizeof(payload),
-                  "{\"seed_type\":%d}", seed_type);
-         coap_set_payload(&request, (const uint8_t *)payload, strlen(payload));
-         COAP_BLOCKING_REQUEST(&server_ep, &request, save_response_callback);
-         PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
-         etimer_reset(&timer);
+         // One fragment every 10 s. The server stores the cell with the last one and answers
+         // it 5.03 when its database is busy: that fragment is sent again after Max-Age
+         for (save_fragment = 0; save_fragment < SAVE_FRAGMENTS; save_fragment++)
+         {
+            encode_save_fragment(save_payload, sizeof(save_payload), save_fragment);
+            coap_set_payload(&request, (const uint8_t *)save_payload, strlen(save_payload));
+
+            save_attempts = 0;
+            save_busy = 0;
+            do
+            {
+               if (save_busy)
+               {
+                  BINLOG(SAVE_BUSY, save_retry_after);
+                  etimer_set(&busy_timer, save_retry_after * CLOCK_SECOND);
+                  PROCESS_WAIT_UNTIL(etimer_expired(&busy_timer));
+                  save_busy = 0;
+               }
+               metrics_exchange_begin(METRIC_SAVE);
+               COCOA_BLOCKING_REQUEST(&server_ep, &request, save_response_callback);
+               metrics_exchange_end(cocoa_last_retransmissions());
+            } while (save_busy && save_attempts++ < SAVE_CONF_BUSY_RETRIES);
+            if (save_busy)
+            {
+               BINLOG(SAVE_FAILED);
+            }
+
+            PROCESS_WAIT_UNTIL(etimer_expired(&timer));
+            etimer_reset(&timer);
+         }
+#endif
 
          // Update position
          update_position(&mov_data);
 
+         // Cell done: publish the updated timings
+         metrics_cell_done();
+         energy_unit_done();
+         energy_switch(ENERGY_PHASE_IDLE);
+         coap_notify_observers(&actuator_metrics_res);
+
          // reset il wake up timer
          etimer_set(&timer, 30 * CLOCK_SECOND);
       }
@@ -704,16 +1018,16 @@ PROCESS_THREAD(device_process, ev, data)
       {
          if (!is_movement_active(&mov_data))
          {
-            printf("Sowing process inactive.\n");
+            BINLOG(SOWING_INACTIVE);
          }
          else if (is_move_complete(&mov_data))
          {
-            printf("Sowing process already completed.\n");
+            BINLOG(SOWING_COMPLETED);
          }
       }
    }
 
-   printf("Exiting Actuator\n");
+   APP_LOG("Exiting Actuator\n");
    PROCESS_END();
 }
 
@@ -727,40 +1041,61 @@ short int is_movement_active()
    return active;
 }
 
+// The next update_position() completes the field
+short int is_last_cell()
+{
+   return mov_data.direction == 1 && mov_data.current_row == mov_data.total_rows - 1;
+}
+
 void calculate_mat_dimensions()
 {
-   mov_data.total_rows = (int)ceil((double)mov_data.length / mov_data.square_size);
-   mov_data.total_cols = (int)ceil((double)mov_data.width / mov_data.square_size);
+   mov_data.total_rows = (mov_data.length + mov_data.square_size - 1) / mov_data.square_size;
+   mov_data.total_cols = (mov_data.width + mov_data.square_size - 1) / mov_data.square_size;
 }
 
-void allocate_matrix()
+void clear_matrix()
 {
-   calculate_mat_dimensions(mov_data);
-   mov_data.matrix = (unsigned int **)malloc(mov_data.total_rows * sizeof(unsigned int *));
-   for (int i = 0; i < mov_data.total_rows; i++)
-   {
-      mov_data.matrix[i] = (unsigned int *)malloc(mov_data.total_cols * sizeof(unsigned int));
-      memset(mov_data.matrix[i], 0, mov_data.total_cols * sizeof(unsigned int));
-   }
+   memset(mov_data.matrix, 0, sizeof(mov_data.matrix));
+   sown_cells = 0;
+   coverage_version++;
 }
 
-void free_matrix()
+void mark_visited(unsigned int row, unsigned int col)
 {
-   for (int i = 0; i < mov_data.total_rows; i++)
-   {
-      free(mov_data.matrix[i]);
-   }
-   free(mov_data.matrix);
+   unsigned int cell = row * mov_data.total_cols + col;
+
+   if (is_visited(row, col))
+      return;
+   mov_data.matrix[cell / 8] |= 1 << (cell % 8);
+   sown_cells++;
+   coverage_version++;
 }
 
-void setup_movement_info(int length, int width, int square_size, int field_id)
+int is_visited(unsigned int row, unsigned int col)
+{
+   unsigned int cell = row * mov_data.total_cols + col;
+   return (mov_data.matrix[cell / 8] >> (cell % 8)) & 1;
+}
+
+int setup_movement_info(int length, int width, int square_size, int field_id)
 {
    mov_data.length = length;
    mov_data.width = width;
    mov_data.square_size = square_size;
    mov_data.field_id = field_id;
    calculate_mat_dimensions(mov_data);
-   allocate_matrix(mov_data);
+
+   // The coverage map is sized at build time: refuse fields that do not fit
+   if (mov_data.total_rows > MAX_FIELD_ROWS || mov_data.total_cols > MAX_FIELD_COLS)
+   {
+      clear_movement_info();
+      return -1;
+   }
+   clear_matrix();
+
+   // Readings of another field are of no use
+   sampling_reset();
+   return 0;
 }
 
 void clear_movement_info()
@@ -773,18 +1108,64 @@ void clear_movement_info()
    mov_data.current_col = 0;
    mov_data.total_rows = 0;
    mov_data.total_cols = 0;
-   mov_data.matrix = NULL; // The matrix is cleared, pointer to NULL
    mov_data.direction = 0; // Reset direction (assuming that 0 is a neutral value)
    mov_data.field_id = 0;  // Reset field ID
 
-   // Clear the allocated memory for the matrix (function already defined)
-   free_matrix();
+   // Forget the visited cells
+   clear_matrix();
+}
+
+int split_margin(int first, int count)
+{
+   // Same features as apply_decision_tree_model()
+   int16_t features[MODEL_FEATURES] = {npk_data.nitrogen, npk_data.phosphorus, npk_data.potassium, ph_data, moisture_data, temperature_data, 0};
+   int margin = INT16_MAX;
+
+   // Follow the path of the features in every tree of the model in use; the children of a node are relative to it
+   int32_t trees = model_loaded() ? model_trees() : seed_classifier.n_trees;
+
+   for (int32_t tree = 0; tree < trees; tree++)
+   {
+      int32_t node = model_loaded() ? model_root(tree) : seed_classifier.roots[tree];
+
+      for (;;)
+      {
+         model_node_t n;
+
+         if (model_loaded())
+            model_node(node, &n);
+         else
+            packed_trees_node(&seed_classifier, node, &n);
+         int value = features[n.feature];
+
+         if (n.feature >= first && n.feature < first + count)
+         {
+            // Change that takes the value to the other side of the threshold
+            int distance = value < n.threshold ? n.threshold - value : value - n.threshold + 1;
+            if (distance < margin)
+               margin = distance;
+         }
+         int32_t child = value < n.threshold ? n.left : n.right;
+
+         // A negative child is a leaf
+         if (child < 0)
+            break;
+         node += child;
+      }
+   }
+   return margin;
 }
 
 int apply_decision_tree_model(npk npk_value, int ph, int moisture, int temp)
 {
-   // Apply the decision tree model to determine the type of seed to use
-   int seed_type = seed_classifier_predict((int16_t[]){npk_value.nitrogen, npk_value.phosphorus, npk_value.potassium, ph, moisture, temp}, 6);
+   // The model takes 7 features; there is no sensor for the last one, which is left at 0
+   int16_t features[MODEL_FEATURES] = {npk_value.nitrogen, npk_value.phosphorus, npk_value.potassium, ph, moisture, temp, 0};
+
+   // Apply the decision tree model to determine the type of seed to use: the uploaded one,
+   // or the one compiled into the image until a model is uploaded
+   int seed_type = model_predict(features, MODEL_FEATURES);
+   if (seed_type < 0)
+      seed_type = seed_classifier_predict(features, 7);
    return seed_type;
 }
 
@@ -794,8 +1175,8 @@ void update_position()
    if (!is_movement_active())
       return;
 
-   // Mark the current position in the matrix as visited (value 1)
-   mov_data.matrix[mov_data.current_row][mov_data.current_col] = 1;
+   // Mark the current position in the matrix as visited
+   mark_visited(mov_data.current_row, mov_data.current_col);
 
    // Handle movement based on the current direction
    switch (mov_data.direction)
@@ -857,68 +1238,6 @@ void update_position()
    }
 }
 
-// Function to parse and identify the type of sensor from the data
-int parse_sensors_data(const uint8_t *payload)
-{
-   if (payload == NULL)
-   {
-      printf("Payload is null.\n");
-      return -1;
-   }
-
-   // Convert payload to string for searching
-   const char *payload_str = (const char *)payload;
-
-   int sensor_type = -1;
-
-   // Check for different sensor type identifiers in the payload
-   if (strstr(payload_str, "\"n\"") != NULL ||
-       strstr(payload_str, "\"p\"") != NULL ||
-       strstr(payload_str, "\"k\"") != NULL)
-   {
-      sensor_type = NPK_SENSOR;
-   }
-   else if (strstr(payload_str, "\"ph\"") != NULL)
-   {
-      sensor_type = PH_SENSOR;
-   }
-   else if (strstr(payload_str, "\"moisture\"") != NULL)
-   {
-      sensor_type = MOISTURE_SENSOR;
-   }
-   else if (strstr(payload_str, "\"temperature\"") != NULL)
-   {
-      sensor_type = TEMP_SENSOR;
-   }
-
-   // Return identified sensor type, or -1 if not found
-   return sensor_type;
-}
-int evaluate_sensor_type(const char *payload_str)
-{
-
-   int sensor_type = -1;
-   if (strstr(payload_str, "\"n\"") != NULL ||
-       strstr(payload_str, "\"p\"") != NULL ||
-       strstr(payload_str, "\"k\"") != NULL)
-   {
-      sensor_type = NPK_SENSOR;
-   }
-   else if (strstr(payload_str, "\"ph\"") != NULL)
-   {
-      sensor_type = PH_SENSOR;
-   }
-   else if (strstr(payload_str, "\"moisture\"") != NULL)
-   {
-      sensor_type = MOISTURE_SENSOR;
-   }
-   else if (strstr(payload_str, "\"temperature\"") != NULL)
-   {
-      sensor_type = TEMP_SENSOR;
-   }
-
-   return sensor_type;
-}
 
 void start_movement()
 {
@@ -941,4 +1260,4 @@ void set_movement_complete(){
 }
 void set_movement_uncomplete(){
    move_complete=0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,17 @@
+#ifndef PROJECT_CONF_H_
+#define PROJECT_CONF_H_
+
+// Energest feeds the per-phase energy accounting (utils/energy.h)
+#define ENERGEST_CONF_ON 1
+
+// Largest field the actuator can sow; the coverage map takes one bit per cell
+#define MAX_FIELD_ROWS 64
+#define MAX_FIELD_COLS 64
+
+// Keep the per-sensor readings in the binary log (utils/binlog_events.def)
+#define BINLOG_CONF_LEVEL BINLOG_LEVEL_DBG
+
+// The discovery cache observes the registry of the server (utils/discovery.h)
+#define COAP_OBSERVE_CLIENT 1
+
+#endif
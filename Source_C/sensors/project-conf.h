@@ -0,0 +1,7 @@
+#ifndef PROJECT_CONF_H_
+#define PROJECT_CONF_H_
+
+// Energest feeds the per-phase energy accounting (utils/energy.h)
+#define ENERGEST_CONF_ON 1
+
+#endif
@@ -2,121 +2,125 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <math.h>
 #include "coap-engine.h"
-#include "coap-blocking-api.h"
 #include "sys/etimer.h"
-#include "gaussian.h"
+#include "field.h"
+#include "codec.h"
+#include "registration.h"
+#include "logging.h"
+#include "energy.h"
+#include "snapshot.h"
+#include "rolling.h"
 
 #include "contiki-net.h"
 
-// mean and standard deviation
-#define MEAN_MOISTURE 71
-#define STD_MOISTURE 22
-
-#define MIN_MOISTURE 0   
-#define MAX_MOISTURE 100 
-
-#define SERVER_EP "coap://[fd00::1]:5683" // server CoAP address
-#define REGISTER_URL "/register"          // registration endpoint
-#define MAX_REGISTRATION_RETRY 5
-
-static int max_registration_retry = MAX_REGISTRATION_RETRY;
+// Cell the probe is in: the last one the actuator asked about, the start of the zone until then
+static int row = REGISTRATION_CONF_ZONE_ROW < 0 ? 0 : REGISTRATION_CONF_ZONE_ROW;
+static int col = REGISTRATION_CONF_ZONE_COL;
 
 int simulate_soil_moisture()
 {
-    int moisture = gaussian(MEAN_MOISTURE, STD_MOISTURE);
-    
-    if (moisture < MIN_MOISTURE) {
-        moisture = MIN_MOISTURE;  
-    } else if (moisture > MAX_MOISTURE) {
-        moisture = MAX_MOISTURE;  
-    }
-    
-    return moisture;
+    return field_sample(FIELD_MOISTURE, row, col);
 }
 
+// Samples of the last ROLLING_CONF_WINDOW periods (rolling.h)
+static rolling_t moisture;
+static struct etimer sample_timer;
 
-static void res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+// Fill the window with readings of a new cell
+static void settle(void)
 {
-    int moisture = simulate_soil_moisture();
-    coap_set_header_content_format(response, APPLICATION_JSON);
-    int payload_len = snprintf((char *)buffer, preferred_size, "{\"moisture\":%d}", moisture);
-    coap_set_payload(response, buffer, payload_len);
+    rolling_init(&moisture);
+    for (int i = 0; i < ROLLING_CONF_WINDOW; i++)
+        rolling_add(&moisture, simulate_soil_moisture());
 }
 
-// Defining resource for soil moisture
-RESOURCE(res_soil_moisture,
-         "title=\"Soil Moisture\";rt=\"moisture",
-         res_get_handler,
-         NULL,
-         NULL,
-         NULL);
-
-// Handler for the response to the CoAP registration
-static void client_chunk_handler(coap_message_t *response)
+static void res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
 {
-    if (response == NULL)
+    energy_switch(ENERGY_PHASE_REQUEST);
+
+    // The aggregate asked for with ?agg=, the median of the window by default
+    int aggregate = rolling_query(request);
+    if (field_query(request, &row, &col) && ROLLING_CONF_SETTLE)
+        settle();
+    if (aggregate < 0)
     {
-        printf("Request timed out\n");
-        max_registration_retry--;
+        coap_set_status_code(response, BAD_REQUEST_4_00);
     }
     else
     {
-        printf("Registration successful\n");
-        max_registration_retry = -1; // Exit the registration loop
+        static const char *const keys[] = {"moisture", "cnt"};
+        int values[] = {rolling_get(&moisture, aggregate), rolling_count(&moisture)};
+        coap_set_header_content_format(response, APPLICATION_JSON);
+        int payload_len = codec_encode((char *)buffer, preferred_size, NULL, keys, values, 2);
+        coap_set_payload(response, buffer, payload_len);
     }
+
+    energy_unit_done();
+    energy_switch(ENERGY_PHASE_IDLE);
+}
+
+// Defining resource for soil moisture, notified every window of samples
+EVENT_RESOURCE(res_soil_moisture,
+               "title=\"Soil Moisture\";rt=\"moisture\";obs",
+               res_get_handler,
+               NULL,
+               NULL,
+               NULL,
+               NULL);
+
+static void sample(void)
+{
+    energy_switch(ENERGY_PHASE_SAMPLING);
+    if (rolling_add(&moisture, simulate_soil_moisture()))
+        coap_notify_observers(&res_soil_moisture);
+    energy_switch(ENERGY_PHASE_IDLE);
 }
 
+// Energest time spent idle and serving requests (layout in energy.h)
+static uint8_t energy_buf[ENERGY_SNAPSHOT_SIZE(ENERGY_SENSOR_PHASES)];
+static snapshot_t energy_snapshot = {energy_buf, sizeof(energy_buf), 0, energy_encode};
+
+static void res_get_handler_energy(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+    snapshot_serve(&energy_snapshot, response, buffer, preferred_size, offset);
+}
+
+RESOURCE(res_energy,
+         "title=\"Energy\";ct=42",
+         res_get_handler_energy,
+         NULL,
+         NULL,
+         NULL);
+
 PROCESS(soil_sensor_server, "Moisture Sensor CoAP Server");
 AUTOSTART_PROCESSES(&soil_sensor_server);
 
 PROCESS_THREAD(soil_sensor_server, ev, data)
 {
-    static coap_endpoint_t main_server_ep;
-    static coap_message_t request[1];
-    static struct etimer registration_timer;
-
     PROCESS_BEGIN();
 
-    printf("Moisture Sensor Server Started\n");
+    APP_LOG("Moisture Sensor Server Started\n");
 
     // Activate the resource with the right path
     coap_activate_resource(&res_soil_moisture, "moisture");
+    coap_activate_resource(&res_energy, "energy");
+    energy_init(ENERGY_SENSOR_PHASES);
 
-    while (max_registration_retry > 0)
-    {
-        /* -------------- REGISTRATION --------------*/
-        // Analyze the server endpoint and prepare the registration request
-        coap_endpoint_parse(SERVER_EP, strlen(SERVER_EP), &main_server_ep);
-        coap_init_message(request, COAP_TYPE_CON, COAP_POST, 0);
-        coap_set_header_uri_path(request, REGISTER_URL);
-        const char msg[] = "moisture";
-        coap_set_payload(request, (uint8_t *)msg, sizeof(msg) - 1);
-
-        // send the registratione request and handle the response
-        COAP_BLOCKING_REQUEST(&main_server_ep, request, client_chunk_handler);
-
-        // if the registration failed, wait and try again
-        if (max_registration_retry > 0)
-        {
-            etimer_set(&registration_timer, 30 * CLOCK_SECOND);
-            PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&registration_timer));
-        }
-    }
+    // Sample from the start, so the window has readings once the sensor is registered
+    rolling_init(&moisture);
+    sample();
+    if (ROLLING_CONF_SAMPLE_INTERVAL > 0)
+        etimer_set(&sample_timer, ROLLING_CONF_SAMPLE_INTERVAL);
 
-    if (max_registration_retry == 0)
-    {
-        printf("Registration failed after maximum attempts\n");
-    }
-    else
-    {
-        printf("Registration successful\n");
-    }
+    // Register with the server, retrying every 30 s
+    registration_start("moisture", 30 * CLOCK_SECOND);
 
     while (1)
     {
-        PROCESS_WAIT_EVENT();
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER && data == &sample_timer);
+        etimer_reset(&sample_timer);
+        sample();
     }
 
     PROCESS_END();
@@ -2,17 +2,15 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <math.h>
 #include "coap-engine.h"
-#include "coap-blocking-api.h"
 #include "sys/etimer.h"
-#include "gaussian.h"
-
-
-// Constants for CoAP registration
-#define SERVER_EP "coap://[fd00::1]:5683" // server CoAP address
-#define REGISTER_URL "/register"          // registration endpoint
-#define MAX_REGISTRATION_RETRY 5
+#include "field.h"
+#include "codec.h"
+#include "registration.h"
+#include "logging.h"
+#include "energy.h"
+#include "snapshot.h"
+#include "rolling.h"
 
 // Definition of the structure for npk values
 typedef struct {
@@ -21,43 +19,76 @@ typedef struct {
     int potassium;
 } npk;
 
-// Constants for the means and standard deviations of npk values from my dataset
-#define MEAN_NITROGEN    50.551818
-#define STD_NITROGEN     36.917334
-#define MEAN_PHOSPHORUS  53.362727
-#define STD_PHOSPHORUS   32.985883
-#define MEAN_POTASSIUM   48.149091
-#define STD_POTASSIUM    50.647931
-
-
+// Cell the probe is in: the last one the actuator asked about, the start of the zone until then
+static int row = REGISTRATION_CONF_ZONE_ROW < 0 ? 0 : REGISTRATION_CONF_ZONE_ROW;
+static int col = REGISTRATION_CONF_ZONE_COL;
 
-// Function to simulate npk values
+// Function to simulate npk values, from the soil of the field at the cell (field.h)
 npk npk_simulate() {
     npk simulated_npk;
 
-    // Generate simulated values
-    simulated_npk.nitrogen = gaussian(MEAN_NITROGEN, STD_NITROGEN);
-    simulated_npk.phosphorus = gaussian(MEAN_PHOSPHORUS, STD_PHOSPHORUS);
-    simulated_npk.potassium = gaussian(MEAN_POTASSIUM, STD_POTASSIUM);
-
-    // Ensure the simulated values are within the range [0, 205]
-    simulated_npk.nitrogen = simulated_npk.nitrogen < 0 ? 0 : (simulated_npk.nitrogen > 140 ? 140 : simulated_npk.nitrogen);
-    simulated_npk.phosphorus = simulated_npk.phosphorus < 5 ? 5 : (simulated_npk.phosphorus > 145 ? 145 : simulated_npk.phosphorus);
-    simulated_npk.potassium = simulated_npk.potassium < 5 ? 5 : (simulated_npk.potassium > 205 ? 205 : simulated_npk.potassium);
+    simulated_npk.nitrogen = field_sample(FIELD_NITROGEN, row, col);
+    simulated_npk.phosphorus = field_sample(FIELD_PHOSPHORUS, row, col);
+    simulated_npk.potassium = field_sample(FIELD_POTASSIUM, row, col);
 
     return simulated_npk;
 }
 
+static void res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
 
+// Definition of the resource for the npk sensor, notified every window of samples
+EVENT_RESOURCE(res_npk_sensor,
+               "title=\"npk Sensor\";rt=\"npk\";obs",
+               res_get_handler,
+               NULL,
+               NULL,
+               NULL,
+               NULL);
+
+// Samples of the last ROLLING_CONF_WINDOW periods (rolling.h), one window per nutrient
+static rolling_t nitrogen, phosphorus, potassium;
+static struct etimer sample_timer;
+
+// Add a reading to the three windows, which turn over together; return 1 when they did
+static int add_reading(void)
+{
+    npk simulated_npk = npk_simulate();
 
-static int max_registration_retry = MAX_REGISTRATION_RETRY;
+    rolling_add(&phosphorus, simulated_npk.phosphorus);
+    rolling_add(&potassium, simulated_npk.potassium);
+    return rolling_add(&nitrogen, simulated_npk.nitrogen);
+}
 
-static void res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void sample(void)
+{
+    energy_switch(ENERGY_PHASE_SAMPLING);
+    if (add_reading())
+        coap_notify_observers(&res_npk_sensor);
+    energy_switch(ENERGY_PHASE_IDLE);
+}
+
+// Fill the windows with readings of a new cell
+static void settle(void)
+{
+    rolling_init(&nitrogen);
+    rolling_init(&phosphorus);
+    rolling_init(&potassium);
+    for (int i = 0; i < ROLLING_CONF_WINDOW; i++)
+        add_reading();
+}
 
-// Definition of the resource for the npk sensor
-RESOURCE(res_npk_sensor,
-         "title=\"npk Sensor\";rt=\"npk",
-         res_get_handler,
+// Energest time spent idle and serving requests (layout in energy.h)
+static uint8_t energy_buf[ENERGY_SNAPSHOT_SIZE(ENERGY_SENSOR_PHASES)];
+static snapshot_t energy_snapshot = {energy_buf, sizeof(energy_buf), 0, energy_encode};
+
+static void res_get_handler_energy(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+    snapshot_serve(&energy_snapshot, response, buffer, preferred_size, offset);
+}
+
+RESOURCE(res_energy,
+         "title=\"Energy\";ct=42",
+         res_get_handler_energy,
          NULL,
          NULL,
          NULL);
@@ -65,71 +96,62 @@ RESOURCE(res_npk_sensor,
 // Handler function for GET requests (reading npk values)
 static void res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
 {
-    // Retrieve simulated npk values
-    npk simulated_npk = npk_simulate();
+    energy_switch(ENERGY_PHASE_REQUEST);
 
-    // Construct the response in JSON format
-    int len = snprintf((char *)buffer, preferred_size, "{\"n\":%d,\"p\":%d,\"k\":%d}", 
-                        simulated_npk.nitrogen, simulated_npk.phosphorus, simulated_npk.potassium);
+    // The aggregate asked for with ?agg=, the median of the windows by default
+    int aggregate = rolling_query(request);
+    if (field_query(request, &row, &col) && ROLLING_CONF_SETTLE)
+        settle();
+    if (aggregate < 0)
+    {
+        coap_set_status_code(response, BAD_REQUEST_4_00);
+    }
+    else
+    {
+        // Construct the response in JSON format
+        static const char *const keys[] = {"n", "p", "k", "cnt"};
+        int values[] = {rolling_get(&nitrogen, aggregate), rolling_get(&phosphorus, aggregate),
+                        rolling_get(&potassium, aggregate), rolling_count(&nitrogen)};
+        int len = codec_encode((char *)buffer, preferred_size, NULL, keys, values, 4);
+
+        // Set the response headers
+        coap_set_header_content_format(response, APPLICATION_JSON);
+        coap_set_payload(response, (uint8_t *)buffer, len);
+    }
 
-    // Set the response headers
-    coap_set_header_content_format(response, APPLICATION_JSON);
-    coap_set_payload(response, (uint8_t *)buffer, len);
+    energy_unit_done();
+    energy_switch(ENERGY_PHASE_IDLE);
 }
 
-// Handler for the response to CoAP registration
-static void client_chunk_handler(coap_message_t *response) {
-    if (response == NULL) {
-        printf("Request timed out\n");
-        max_registration_retry--;
-    } else {
-        printf("Registration successful\n");
-        max_registration_retry = -1; // Exit the registration loop
-    }
-}
 PROCESS(npk_sensor_server, "npk Sensor CoAP Server");
 AUTOSTART_PROCESSES(&npk_sensor_server);
 
 PROCESS_THREAD(npk_sensor_server, ev, data) {
-    static coap_endpoint_t main_server_ep;
-    static coap_message_t request[1];
-    static struct etimer registration_timer;
-
     PROCESS_BEGIN();
 
-    printf("npk Sensor CoAP Server started\n");
+    APP_LOG("npk Sensor CoAP Server started\n");
 
     // Activate the resource
     coap_activate_resource(&res_npk_sensor, "npk");
+    coap_activate_resource(&res_energy, "energy");
+    energy_init(ENERGY_SENSOR_PHASES);
 
-    while (max_registration_retry > 0) {
-        /* -------------- REGISTRATION --------------*/
-        // Parse the server endpoint and prepare the registration request
-        coap_endpoint_parse(SERVER_EP, strlen(SERVER_EP), &main_server_ep);
-        coap_init_message(request, COAP_TYPE_CON, COAP_POST, 0);
-        coap_set_header_uri_path(request, REGISTER_URL);
-        const char msg[] = "npk";
-        coap_set_payload(request, (uint8_t *)msg, sizeof(msg) - 1);
-
-        // Send the registration request and handle the response
-        COAP_BLOCKING_REQUEST(&main_server_ep, request, client_chunk_handler);
-
-        if (max_registration_retry > 0) {
-            // If registration failed, wait and retry
-            etimer_set(&registration_timer, 30 * CLOCK_SECOND);
-            PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&registration_timer));
-        }
-    }
+    // Sample from the start, so the windows have readings once the sensor is registered
+    rolling_init(&nitrogen);
+    rolling_init(&phosphorus);
+    rolling_init(&potassium);
+    sample();
+    if (ROLLING_CONF_SAMPLE_INTERVAL > 0)
+        etimer_set(&sample_timer, ROLLING_CONF_SAMPLE_INTERVAL);
 
-    if (max_registration_retry == 0) {
-        printf("Registration failed after maximum attempts\n");
-    } else {
-        printf("Registration successful\n");
-    }
+    // Register with the server, retrying every 30 s
+    registration_start("npk", 30 * CLOCK_SECOND);
 
     while (1)
     {
-        PROCESS_WAIT_EVENT();
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER && data == &sample_timer);
+        etimer_reset(&sample_timer);
+        sample();
     }
 
     PROCESS_END();
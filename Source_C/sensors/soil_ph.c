@@ -2,105 +2,116 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <math.h>
 #include "coap-engine.h"
-#include "coap-blocking-api.h"
 #include "sys/etimer.h"
-#include "gaussian.h"
+#include "field.h"
+#include "codec.h"
+#include "registration.h"
+#include "logging.h"
+#include "energy.h"
+#include "snapshot.h"
+#include "rolling.h"
+
+// Cell the probe is in: the last one the actuator asked about, the start of the zone until then
+static int row = REGISTRATION_CONF_ZONE_ROW < 0 ? 0 : REGISTRATION_CONF_ZONE_ROW;
+static int col = REGISTRATION_CONF_ZONE_COL;
 
-// Constants for CoAP registration
-#define SERVER_EP "coap://[fd00::1]:5683" // server CoAP registration
-#define REGISTER_URL "/register"          // registration endpoint
+// function to simulate data 
+int simulate_soil_ph() {
+    return field_sample(FIELD_PH, row, col);
+}
 
-// mean and standard deviation 
-#define MEAN_PH          6.469480
-#define STD_PH           1.2
+// Samples of the last ROLLING_CONF_WINDOW periods (rolling.h)
+static rolling_t ph;
+static struct etimer sample_timer;
 
+// Fill the window with readings of a new cell
+static void settle(void) {
+    rolling_init(&ph);
+    for (int i = 0; i < ROLLING_CONF_WINDOW; i++)
+        rolling_add(&ph, simulate_soil_ph());
+}
 
-#define MAX_REGISTRATION_RETRY 5
+// Handler for GET requests (reading soil pH), the median of the window unless ?agg= asks otherwise
+static void res_get_handler_soil_ph(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+    energy_switch(ENERGY_PHASE_REQUEST);
 
-static int max_registration_retry = MAX_REGISTRATION_RETRY;
+    int aggregate = rolling_query(request);
+    if (field_query(request, &row, &col) && ROLLING_CONF_SETTLE)
+        settle();
+    if (aggregate < 0) {
+        coap_set_status_code(response, BAD_REQUEST_4_00);
+    } else {
+        static const char *const keys[] = {"ph", "cnt"};
+        int values[] = {rolling_get(&ph, aggregate), rolling_count(&ph)};
+        int len = codec_encode((char *)buffer, preferred_size, NULL, keys, values, 2);
 
+        coap_set_header_content_format(response, APPLICATION_JSON);
+        coap_set_payload(response, buffer, len);
+    }
 
-// function to simulate data 
-int simulate_soil_ph() {
-    int ph = gaussian(MEAN_PH, STD_PH);
-    if (ph < 3.5) ph = 3.5;
-    if (ph > 10) ph = 10;
-    return ph;
+    energy_unit_done();
+    energy_switch(ENERGY_PHASE_IDLE);
 }
 
-// Handler for GET requests (reading soil pH)
-static void res_get_handler_soil_ph(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
-    int ph = simulate_soil_ph();
-    int len = snprintf((char *)buffer, preferred_size, "{\"ph\":%d}", ph);
+// resoutce definition for pH sensor, notified every window of samples
+EVENT_RESOURCE(res_soil_ph,
+               "title=\"Soil pH\";rt=\"ph\";obs",
+               res_get_handler_soil_ph,
+               NULL,
+               NULL,
+               NULL,
+               NULL);
+
+static void sample(void) {
+    energy_switch(ENERGY_PHASE_SAMPLING);
+    if (rolling_add(&ph, simulate_soil_ph()))
+        coap_notify_observers(&res_soil_ph);
+    energy_switch(ENERGY_PHASE_IDLE);
+}
+
+// Energest time spent idle and serving requests (layout in energy.h)
+static uint8_t energy_buf[ENERGY_SNAPSHOT_SIZE(ENERGY_SENSOR_PHASES)];
+static snapshot_t energy_snapshot = {energy_buf, sizeof(energy_buf), 0, energy_encode};
 
-    coap_set_header_content_format(response, APPLICATION_JSON);
-    coap_set_payload(response, buffer, len);
+static void res_get_handler_energy(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+    snapshot_serve(&energy_snapshot, response, buffer, preferred_size, offset);
 }
 
-// resoutce definition for pH sensor
-RESOURCE(res_soil_ph,
-         "title=\"Soil pH\";rt=\"ph",
-         res_get_handler_soil_ph,
+RESOURCE(res_energy,
+         "title=\"Energy\";ct=42",
+         res_get_handler_energy,
          NULL,
          NULL,
          NULL);
 
-// Handler for response to the CoAP registration
-static void client_chunk_handler(coap_message_t *response) {
-    if (response == NULL) {
-        printf("Request timed out\n");
-        max_registration_retry--;
-    } else {
-        printf("Registration successful\n");
-        max_registration_retry = -1; // Exit the registration loop
-    }
-}
-
 PROCESS(soil_sensor_server, "Ph Sensor CoAP Server");
 AUTOSTART_PROCESSES(&soil_sensor_server);
 
 PROCESS_THREAD(soil_sensor_server, ev, data) {
-    static coap_endpoint_t main_server_ep;
-    static coap_message_t request[1];
-    static struct etimer registration_timer;
-
     PROCESS_BEGIN();
 
-    printf("Ph Sensor CoAP Server Started\n");
+    APP_LOG("Ph Sensor CoAP Server Started\n");
 
     // activate the resource with the correct path
     coap_activate_resource(&res_soil_ph, "ph");
+    coap_activate_resource(&res_energy, "energy");
+    energy_init(ENERGY_SENSOR_PHASES);
 
-    while (max_registration_retry > 0) {
-        /* -------------- REGISTRATION --------------*/
-        // Analyze the server endpoint and prepare the registration request
-        coap_endpoint_parse(SERVER_EP, strlen(SERVER_EP), &main_server_ep);
-        coap_init_message(request, COAP_TYPE_CON, COAP_POST, 0);
-        coap_set_header_uri_path(request, REGISTER_URL);
-        const char msg[] = "ph";
-        coap_set_payload(request, (uint8_t *)msg, sizeof(msg) - 1);
-
-        // send the registration request and handle the response
-        COAP_BLOCKING_REQUEST(&main_server_ep, request, client_chunk_handler);
-
-        // if the registration failed, wait and retry
-        if (max_registration_retry > 0) {
-            etimer_set(&registration_timer, 30 * CLOCK_SECOND);
-            PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&registration_timer));
-        }
-    }
+    // Sample from the start, so the window has readings once the sensor is registered
+    rolling_init(&ph);
+    sample();
+    if (ROLLING_CONF_SAMPLE_INTERVAL > 0)
+        etimer_set(&sample_timer, ROLLING_CONF_SAMPLE_INTERVAL);
 
-    if (max_registration_retry == 0) {
-        printf("Registration failed after maximum attempts\n");
-    } else {
-        printf("Registration successful\n");
-    }
+    // Register with the server, retrying every 30 s
+    registration_start("ph", 30 * CLOCK_SECOND);
 
     while (1)
     {
-        PROCESS_WAIT_EVENT();
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER && data == &sample_timer);
+        etimer_reset(&sample_timer);
+        sample();
     }
 
     PROCESS_END();
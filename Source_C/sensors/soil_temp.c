@@ -2,121 +2,128 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <math.h>
 #include "coap-engine.h"
-#include "coap-blocking-api.h"
 #include "sys/etimer.h"
-#include "gaussian.h"
-
+#include "field.h"
+#include "codec.h"
+#include "registration.h"
+#include "logging.h"
+#include "energy.h"
+#include "snapshot.h"
+#include "rolling.h"
+
+// Cell the probe is in: the last one the actuator asked about, the start of the zone until then
+static int row = REGISTRATION_CONF_ZONE_ROW < 0 ? 0 : REGISTRATION_CONF_ZONE_ROW;
+static int col = REGISTRATION_CONF_ZONE_COL;
+
+// Function to simulate soil temperature data, in whole degrees
+int soil_temp_simulate()
+{
+    return field_sample(FIELD_TEMPERATURE, row, col);
+}
 
-// Constants for CoAP registration
-#define SERVER_EP "coap://[fd00::1]:5683" // server CoAP address
-#define REGISTER_URL "/register"          // registration endpoint
+// Samples of the last ROLLING_CONF_WINDOW periods (rolling.h)
+static rolling_t temperature;
+static struct etimer sample_timer;
 
-// Constants for the means and standard deviations of soil temperature values
-#define MEAN_TEMP 25.616244
-#define STD_TEMP 5.063749
+// Fill the window with readings of a new cell
+static void settle(void)
+{
+    rolling_init(&temperature);
+    for (int i = 0; i < ROLLING_CONF_WINDOW; i++)
+        rolling_add(&temperature, soil_temp_simulate());
+}
 
-#define MAX_REGISTRATION_RETRY 5
+// Handler function for GET requests (reading soil temperature), the median of the window unless ?agg= asks otherwise
+static void res_get_handler_soil_temp(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+    energy_switch(ENERGY_PHASE_REQUEST);
 
-static int max_registration_retry = MAX_REGISTRATION_RETRY;
+    int aggregate = rolling_query(request);
+    if (field_query(request, &row, &col) && ROLLING_CONF_SETTLE)
+        settle();
+    if (aggregate < 0)
+    {
+        coap_set_status_code(response, BAD_REQUEST_4_00);
+    }
+    else
+    {
+        static const char *const keys[] = {"temperature", "cnt"};
+        int values[] = {rolling_get(&temperature, aggregate), rolling_count(&temperature)};
 
-// Function to simulate soil temperature data
-int soil_temp_simulate()
-{
-    int temperature = gaussian(MEAN_TEMP, STD_TEMP);
+        int len = codec_encode((char *)buffer, preferred_size, NULL, keys, values, 2);
 
-    // Ensure the simulated values are within the range [8.8, 43.7]
-    if (temperature < 8.8)
-        temperature = 8.8;
-    if (temperature > 43.7)
-        temperature = 43.7;
+        coap_set_header_content_format(response, APPLICATION_JSON);
+        coap_set_payload(response, (uint8_t *)buffer, len);
+    }
 
-    return temperature;
+    energy_unit_done();
+    energy_switch(ENERGY_PHASE_IDLE);
 }
 
-// Handler function for GET requests (reading soil temperature)
-static void res_get_handler_soil_temp(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+// Definition of the resource for the soil temperature sensor, notified every window of samples
+EVENT_RESOURCE(res_soil_temp,
+               "title=\"Soil Temperature\";rt=\"Temperature\";obs",
+               res_get_handler_soil_temp,
+               NULL,
+               NULL,
+               NULL,
+               NULL);
+
+static void sample(void)
 {
-    int temperature = soil_temp_simulate();
+    energy_switch(ENERGY_PHASE_SAMPLING);
+    if (rolling_add(&temperature, soil_temp_simulate()))
+        coap_notify_observers(&res_soil_temp);
+    energy_switch(ENERGY_PHASE_IDLE);
+}
 
-    int len = snprintf((char *)buffer, preferred_size, "{\"temperature\":%d}",
-                       temperature);
+// Energest time spent idle and serving requests (layout in energy.h)
+static uint8_t energy_buf[ENERGY_SNAPSHOT_SIZE(ENERGY_SENSOR_PHASES)];
+static snapshot_t energy_snapshot = {energy_buf, sizeof(energy_buf), 0, energy_encode};
 
-    coap_set_header_content_format(response, APPLICATION_JSON);
-    coap_set_payload(response, (uint8_t *)buffer, len);
+static void res_get_handler_energy(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+    snapshot_serve(&energy_snapshot, response, buffer, preferred_size, offset);
 }
 
-// Definition of the resource for the soil temperature sensor
-RESOURCE(res_soil_temp,
-         "title=\"Soil Temperature\";rt=\"Temperature",
-         res_get_handler_soil_temp,
+RESOURCE(res_energy,
+         "title=\"Energy\";ct=42",
+         res_get_handler_energy,
          NULL,
          NULL,
          NULL);
 
-// Handler for the response to the CoAP registration
-static void client_chunk_handler(coap_message_t *response) {
-    if (response == NULL) {
-        printf("Request timed out\n");
-        max_registration_retry--;
-    } else {
-        printf("Registration successful\n");
-        max_registration_retry = -1; // Exit the registration loop
-    }
-}
-
 //coap-client -m POST coap://[fd00::206:6:6:6]:5683/sowing_actuator -e '{"length": 10, "width": 10, "square_size": 1}' -t 50
 
-
 PROCESS(soil_temp_sensor_server, "Temperature Sensor CoAP Server");
 AUTOSTART_PROCESSES(&soil_temp_sensor_server);
 
 PROCESS_THREAD(soil_temp_sensor_server, ev, data)
 {
-    static coap_endpoint_t main_server_ep;
-    static coap_message_t request[1];
-    static struct etimer registration_timer;
-
     PROCESS_BEGIN();
 
-    printf("Soil Temperature Started\n");
+    APP_LOG("Soil Temperature Started\n");
 
     // Activate the resource
     coap_activate_resource(&res_soil_temp, "temperature");
+    coap_activate_resource(&res_energy, "energy");
+    energy_init(ENERGY_SENSOR_PHASES);
 
-    while (max_registration_retry > 0) {
-        /* -------------- REGISTRATION --------------*/
-        // Parse the server endpoint and prepare the registration request
-        coap_endpoint_parse(SERVER_EP, strlen(SERVER_EP), &main_server_ep);
-        coap_init_message(request, COAP_TYPE_CON, COAP_POST, 0);  // Use POST for registration
-        coap_set_header_uri_path(request, REGISTER_URL);
-        const char msg[] = "temperature";
-        coap_set_payload(request, (uint8_t *)msg, sizeof(msg) - 1);
-
-        // Send the registration request and handle the response
-        COAP_BLOCKING_REQUEST(&main_server_ep, request, client_chunk_handler);
-
-        /* -------------- END REGISTRATION --------------*/
-        if (max_registration_retry > 0) {
-            // Wait and retry if registration failed
-            etimer_set(&registration_timer, 30 * CLOCK_SECOND);
-            PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&registration_timer));
-            
-            // Decrement retry count if registration failed
-            max_registration_retry--;
-        }
-    }
+    // Sample from the start, so the window has readings once the sensor is registered
+    rolling_init(&temperature);
+    sample();
+    if (ROLLING_CONF_SAMPLE_INTERVAL > 0)
+        etimer_set(&sample_timer, ROLLING_CONF_SAMPLE_INTERVAL);
 
-    if (max_registration_retry == 0) {
-        printf("Registration failed after maximum attempts\n");
-    } else {
-        printf("Registration successful\n");
-    }
+    // Register with the server, retrying every 30 s
+    registration_start("temperature", 30 * CLOCK_SECOND);
 
     while (1)
     {
-        PROCESS_WAIT_EVENT();
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER && data == &sample_timer);
+        etimer_reset(&sample_timer);
+        sample();
     }
 
     PROCESS_END();
@@ -0,0 +1,57 @@
+#ifndef COAP_BLOCKING_API_H_
+#define COAP_BLOCKING_API_H_
+
+#include "coap-engine.h"
+
+/*
+Blocking request API, identical to Contiki-NG's: the calling process yields
+until the exchange completes. On timeout the handler is not called.
+*/
+
+typedef enum
+{
+    COAP_REQUEST_STATUS_RESPONSE,
+    COAP_REQUEST_STATUS_MORE,
+    COAP_REQUEST_STATUS_FINISHED,
+    COAP_REQUEST_STATUS_TIMEOUT,
+    COAP_REQUEST_STATUS_BLOCK_ERROR
+} coap_request_status_t;
+
+typedef struct coap_request_state
+{
+    coap_transaction_t *transaction;
+    coap_message_t *response;
+    coap_message_t *request;
+    coap_endpoint_t *remote_endpoint;
+    uint32_t block_num;
+    uint32_t res_block;
+    uint8_t more;
+    uint8_t block_error;
+    void *user_data;
+    coap_request_status_t status;
+} coap_request_state_t;
+
+typedef struct coap_blocking_request_state
+{
+    coap_request_state_t state;
+    struct pt pt;
+    struct process *process;
+} coap_blocking_request_state_t;
+
+typedef void (*coap_blocking_response_handler_t)(coap_message_t *response);
+
+PT_THREAD(coap_blocking_request(coap_blocking_request_state_t *blocking_state, process_event_t ev,
+                                coap_endpoint_t *remote_ep,
+                                coap_message_t *request,
+                                coap_blocking_response_handler_t request_callback));
+
+#define COAP_BLOCKING_REQUEST(server_endpoint, request, chunk_handler)  \
+    {                                                                   \
+        static coap_blocking_request_state_t blocking_state;            \
+        PT_SPAWN(process_pt, &blocking_state.pt,                        \
+                 coap_blocking_request(&blocking_state, ev,             \
+                                       server_endpoint,                 \
+                                       request, chunk_handler));        \
+    }
+
+#endif
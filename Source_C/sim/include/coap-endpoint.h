@@ -0,0 +1,24 @@
+#ifndef COAP_ENDPOINT_H_
+#define COAP_ENDPOINT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define COAP_DEFAULT_PORT 5683
+#define SIM_ADDR_LEN 46
+
+typedef struct
+{
+    char addr[SIM_ADDR_LEN]; // IPv6 address in text form, as handed out by the server
+    uint16_t port;
+    uint8_t secure;
+} coap_endpoint_t;
+
+int coap_endpoint_parse(const char *text, size_t size, coap_endpoint_t *ep);
+int coap_endpoint_print(const coap_endpoint_t *ep);
+int coap_endpoint_snprint(char *str, size_t size, const coap_endpoint_t *ep);
+void coap_endpoint_copy(coap_endpoint_t *dest, const coap_endpoint_t *src);
+int coap_endpoint_cmp(const coap_endpoint_t *e1, const coap_endpoint_t *e2);
+int coap_endpoint_is_connected(const coap_endpoint_t *ep);
+
+#endif
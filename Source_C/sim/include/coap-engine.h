@@ -0,0 +1,70 @@
+#ifndef COAP_ENGINE_H_
+#define COAP_ENGINE_H_
+
+#include "contiki.h"
+#include "coap.h"
+#include "coap-transactions.h"
+
+typedef struct coap_resource_s coap_resource_t;
+typedef struct coap_periodic_resource_s coap_periodic_resource_t;
+
+typedef enum
+{
+    NO_FLAGS = 0,
+    METHOD_GET = (1 << 0),
+    METHOD_POST = (1 << 1),
+    METHOD_PUT = (1 << 2),
+    METHOD_DELETE = (1 << 3),
+    HAS_SUB_RESOURCES = (1 << 4),
+    IS_SEPARATE = (1 << 5),
+    IS_OBSERVABLE = (1 << 6),
+    IS_PERIODIC = (1 << 7)
+} coap_resource_flags_t;
+
+typedef void (*coap_resource_handler_t)(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+typedef void (*coap_resource_periodic_handler_t)(void);
+typedef void (*coap_resource_trigger_handler_t)(void);
+
+struct coap_resource_s
+{
+    coap_resource_t *next;
+    const char *url;
+    coap_resource_flags_t flags;
+    const char *attributes;
+    coap_resource_handler_t get_handler;
+    coap_resource_handler_t post_handler;
+    coap_resource_handler_t put_handler;
+    coap_resource_handler_t delete_handler;
+    union
+    {
+        coap_periodic_resource_t *periodic;
+        coap_resource_trigger_handler_t trigger;
+        coap_resource_trigger_handler_t resume;
+    };
+};
+
+struct coap_periodic_resource_s
+{
+    coap_periodic_resource_t *next;
+    coap_resource_t *resource;
+    uint32_t period;
+    struct etimer periodic_timer;
+    coap_resource_periodic_handler_t periodic_handler;
+};
+
+#define RESOURCE(name, attributes, get_handler, post_handler, put_handler, delete_handler) \
+    coap_resource_t name = {NULL, NULL, NO_FLAGS, attributes, get_handler, post_handler, put_handler, delete_handler, {NULL}}
+
+#define PARENT_RESOURCE(name, attributes, get_handler, post_handler, put_handler, delete_handler) \
+    coap_resource_t name = {NULL, NULL, HAS_SUB_RESOURCES, attributes, get_handler, post_handler, put_handler, delete_handler, {NULL}}
+
+#define EVENT_RESOURCE(name, attributes, get_handler, post_handler, put_handler, delete_handler, event_handler) \
+    coap_resource_t name = {NULL, NULL, IS_OBSERVABLE, attributes, get_handler, post_handler, put_handler, delete_handler, {.trigger = event_handler}}
+
+void coap_activate_resource(coap_resource_t *resource, const char *path);
+coap_resource_t *coap_get_first_resource(void);
+coap_resource_t *coap_get_next_resource(coap_resource_t *resource);
+
+void coap_notify_observers(coap_resource_t *resource);
+
+#endif
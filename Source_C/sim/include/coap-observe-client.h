@@ -0,0 +1,34 @@
+#ifndef COAP_OBSERVE_CLIENT_H_
+#define COAP_OBSERVE_CLIENT_H_
+
+#include "coap-engine.h"
+
+typedef enum
+{
+    OBSERVE_OK,
+    NOTIFICATION_OK,
+    OBSERVE_NOT_SUPPORTED,
+    ERROR_RESPONSE_CODE,
+    NO_REPLY_FROM_SERVER
+} coap_notification_flag_t;
+
+typedef struct coap_observee_s coap_observee_t;
+
+typedef void (*notification_callback_t)(coap_observee_t *subject, void *notification, coap_notification_flag_t flag);
+
+struct coap_observee_s
+{
+    coap_observee_t *next;
+    const char *url;
+    coap_endpoint_t endpoint;
+    uint8_t token_len;
+    uint8_t token[COAP_TOKEN_LEN];
+    void *data;
+    notification_callback_t notification_callback;
+    uint32_t last_observe;
+};
+
+coap_observee_t *coap_obs_request_registration(const coap_endpoint_t *endpoint, char *uri, notification_callback_t notification_callback, void *data);
+int coap_obs_remove_observee(coap_observee_t *o);
+
+#endif
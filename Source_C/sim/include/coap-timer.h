@@ -0,0 +1,40 @@
+#ifndef COAP_TIMER_H_
+#define COAP_TIMER_H_
+
+#include <stdint.h>
+#include "sim-timer.h"
+
+/* CoAP timers count milliseconds, as in Contiki-NG */
+
+typedef struct coap_timer coap_timer_t;
+
+struct coap_timer
+{
+    struct sim_timer sim;
+    void (*callback)(coap_timer_t *);
+    void *user_data;
+    uint64_t expiration_time;
+};
+
+uint64_t coap_timer_uptime(void);
+
+static inline void coap_timer_set_callback(coap_timer_t *timer, void (*callback)(coap_timer_t *))
+{
+    timer->callback = callback;
+}
+
+static inline void *coap_timer_get_user_data(coap_timer_t *timer)
+{
+    return timer->user_data;
+}
+
+static inline void coap_timer_set_user_data(coap_timer_t *timer, void *data)
+{
+    timer->user_data = data;
+}
+
+void coap_timer_set(coap_timer_t *timer, uint64_t time);
+void coap_timer_stop(coap_timer_t *timer);
+int coap_timer_expired(const coap_timer_t *timer);
+
+#endif
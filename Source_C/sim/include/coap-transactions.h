@@ -0,0 +1,31 @@
+#ifndef COAP_TRANSACTIONS_H_
+#define COAP_TRANSACTIONS_H_
+
+#include "coap.h"
+#include "coap-timer.h"
+
+#define COAP_RESPONSE_TIMEOUT_TICKS (1000 * COAP_RESPONSE_TIMEOUT)
+#define COAP_RESPONSE_TIMEOUT_BACKOFF_MASK (long)((1000 * COAP_RESPONSE_TIMEOUT * ((float)COAP_RESPONSE_RANDOM_FACTOR - 1.0)) + 0.5) + 1
+
+typedef void (*coap_resource_response_handler_t)(void *data, coap_message_t *response);
+
+typedef struct coap_transaction
+{
+    struct coap_transaction *next;
+    uint16_t mid;
+    coap_timer_t retrans_timer;
+    uint32_t retrans_interval;
+    uint8_t retrans_counter;
+    coap_endpoint_t endpoint;
+    coap_resource_response_handler_t callback;
+    void *callback_data;
+    uint16_t message_len;
+    uint8_t message[COAP_MAX_PACKET_SIZE + 1];
+} coap_transaction_t;
+
+coap_transaction_t *coap_new_transaction(uint16_t mid, const coap_endpoint_t *endpoint);
+void coap_send_transaction(coap_transaction_t *t);
+void coap_clear_transaction(coap_transaction_t *t);
+coap_transaction_t *coap_get_transaction_by_mid(uint16_t mid);
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef COAP_H_
+#define COAP_H_
+
+/*
+CoAP message layer (RFC 7252) with the Contiki-NG API.
+Messages are serialized to real CoAP bytes, so radio airtime follows the actual message sizes.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include "coap-endpoint.h"
+
+#ifndef COAP_MAX_CHUNK_SIZE
+#define COAP_MAX_CHUNK_SIZE 64
+#endif
+#define COAP_MAX_HEADER_SIZE 70
+#define COAP_MAX_PACKET_SIZE (COAP_MAX_HEADER_SIZE + COAP_MAX_CHUNK_SIZE)
+#define COAP_MAX_BLOCK_SIZE COAP_MAX_CHUNK_SIZE
+
+#define COAP_TOKEN_LEN 8
+#define COAP_ETAG_LEN 8
+
+#ifndef COAP_RESPONSE_TIMEOUT
+#define COAP_RESPONSE_TIMEOUT 3
+#endif
+#define COAP_RESPONSE_RANDOM_FACTOR 1.5
+#ifndef COAP_MAX_RETRANSMIT
+#define COAP_MAX_RETRANSMIT 4
+#endif
+#define COAP_MAX_ATTEMPTS 4
+
+typedef enum
+{
+    COAP_TYPE_CON,
+    COAP_TYPE_NON,
+    COAP_TYPE_ACK,
+    COAP_TYPE_RST
+} coap_message_type_t;
+
+typedef enum
+{
+    COAP_GET = 1,
+    COAP_POST,
+    COAP_PUT,
+    COAP_DELETE
+} coap_method_t;
+
+typedef enum
+{
+    NO_ERROR = 0,
+    CREATED_2_01 = 65,
+    DELETED_2_02 = 66,
+    VALID_2_03 = 67,
+    CHANGED_2_04 = 68,
+    CONTENT_2_05 = 69,
+    CONTINUE_2_31 = 95,
+    BAD_REQUEST_4_00 = 128,
+    UNAUTHORIZED_4_01 = 129,
+    BAD_OPTION_4_02 = 130,
+    FORBIDDEN_4_03 = 131,
+    NOT_FOUND_4_04 = 132,
+    METHOD_NOT_ALLOWED_4_05 = 133,
+    NOT_ACCEPTABLE_4_06 = 134,
+    REQUEST_ENTITY_INCOMPLETE_4_08 = 136,
+    PRECONDITION_FAILED_4_12 = 140,
+    REQUEST_ENTITY_TOO_LARGE_4_13 = 141,
+    UNSUPPORTED_MEDIA_TYPE_4_15 = 143,
+    INTERNAL_SERVER_ERROR_5_00 = 160,
+    NOT_IMPLEMENTED_5_01 = 161,
+    BAD_GATEWAY_5_02 = 162,
+    SERVICE_UNAVAILABLE_5_03 = 163,
+    GATEWAY_TIMEOUT_5_04 = 164,
+    PROXYING_NOT_SUPPORTED_5_05 = 165,
+    MEMORY_ALLOCATION_ERROR = 192,
+    PACKET_SERIALIZATION_ERROR
+} coap_status_t;
+
+typedef enum
+{
+    COAP_OPTION_IF_MATCH = 1,
+    COAP_OPTION_URI_HOST = 3,
+    COAP_OPTION_ETAG = 4,
+    COAP_OPTION_IF_NONE_MATCH = 5,
+    COAP_OPTION_OBSERVE = 6,
+    COAP_OPTION_URI_PORT = 7,
+    COAP_OPTION_LOCATION_PATH = 8,
+    COAP_OPTION_URI_PATH = 11,
+    COAP_OPTION_CONTENT_FORMAT = 12,
+    COAP_OPTION_MAX_AGE = 14,
+    COAP_OPTION_URI_QUERY = 15,
+    COAP_OPTION_ACCEPT = 17,
+    COAP_OPTION_LOCATION_QUERY = 20,
+    COAP_OPTION_BLOCK2 = 23,
+    COAP_OPTION_BLOCK1 = 27,
+    COAP_OPTION_SIZE2 = 28,
+    COAP_OPTION_PROXY_URI = 35,
+    COAP_OPTION_PROXY_SCHEME = 39,
+    COAP_OPTION_SIZE1 = 60
+} coap_option_t;
+
+typedef enum
+{
+    TEXT_PLAIN = 0,
+    TEXT_XML = 1,
+    TEXT_CSV = 2,
+    TEXT_HTML = 3,
+    IMAGE_GIF = 21,
+    IMAGE_JPEG = 22,
+    IMAGE_PNG = 23,
+    IMAGE_TIFF = 24,
+    AUDIO_RAW = 25,
+    VIDEO_RAW = 26,
+    APPLICATION_LINK_FORMAT = 40,
+    APPLICATION_XML = 41,
+    APPLICATION_OCTET_STREAM = 42,
+    APPLICATION_RDF_XML = 43,
+    APPLICATION_SOAP_XML = 44,
+    APPLICATION_ATOM_XML = 45,
+    APPLICATION_XMPP_XML = 46,
+    APPLICATION_EXI = 47,
+    APPLICATION_FASTINFOSET = 48,
+    APPLICATION_SOAP_FASTINFOSET = 49,
+    APPLICATION_JSON = 50,
+    APPLICATION_X_OBIX_BINARY = 51,
+    APPLICATION_CBOR = 60
+} coap_content_format_t;
+
+#define COAP_OPTION_MAP_SIZE (sizeof(uint8_t) * 8)
+#define SET_OPTION(packet, opt) ((packet)->options[(opt) / COAP_OPTION_MAP_SIZE] |= 1 << ((opt) % COAP_OPTION_MAP_SIZE))
+#define IS_OPTION(packet, opt) ((packet)->options[(opt) / COAP_OPTION_MAP_SIZE] & (1 << ((opt) % COAP_OPTION_MAP_SIZE)))
+
+typedef struct
+{
+    uint8_t *buffer;
+
+    uint8_t version;
+    coap_message_type_t type;
+    uint8_t code;
+    uint16_t mid;
+
+    uint8_t token_len;
+    uint8_t token[COAP_TOKEN_LEN];
+
+    uint8_t options[COAP_OPTION_SIZE1 / COAP_OPTION_MAP_SIZE + 1];
+
+    uint16_t content_format;
+    uint32_t max_age;
+    uint8_t etag_len;
+    uint8_t etag[COAP_ETAG_LEN];
+    size_t uri_path_len;
+    const char *uri_path;
+    int32_t observe;
+    uint16_t accept;
+    uint32_t block2_num;
+    uint8_t block2_more;
+    uint16_t block2_size;
+    uint32_t block2_offset;
+    uint32_t block1_num;
+    uint8_t block1_more;
+    uint16_t block1_size;
+    uint32_t block1_offset;
+    uint32_t size2;
+    uint32_t size1;
+    size_t uri_query_len;
+    const char *uri_query;
+
+    uint16_t payload_len;
+    const uint8_t *payload;
+
+    const coap_endpoint_t *src_ep;
+} coap_message_t;
+
+static inline int coap_set_status_code(coap_message_t *message, unsigned int code)
+{
+    if(code <= 0xFF)
+    {
+        message->code = (uint8_t)code;
+        return 1;
+    }
+    return 0;
+}
+
+void coap_init_message(coap_message_t *message, coap_message_type_t type, uint8_t code, uint16_t mid);
+size_t coap_serialize_message(coap_message_t *message, uint8_t *buffer);
+coap_status_t coap_parse_message(coap_message_t *request, uint8_t *data, uint16_t data_len);
+uint16_t coap_get_mid(void);
+int coap_sendto(const coap_endpoint_t *ep, const uint8_t *data, uint16_t length);
+
+int coap_set_token(coap_message_t *message, const uint8_t *token, size_t token_len);
+int coap_get_query_variable(coap_message_t *message, const char *name, const char **output);
+int coap_get_post_variable(coap_message_t *message, const char *name, const char **output);
+
+int coap_get_header_content_format(coap_message_t *message, unsigned int *format);
+int coap_set_header_content_format(coap_message_t *message, unsigned int format);
+int coap_get_header_max_age(coap_message_t *message, uint32_t *age);
+int coap_set_header_max_age(coap_message_t *message, uint32_t age);
+int coap_get_header_etag(coap_message_t *message, const uint8_t **etag);
+int coap_set_header_etag(coap_message_t *message, const uint8_t *etag, size_t etag_len);
+int coap_get_header_uri_path(coap_message_t *message, const char **path);
+int coap_set_header_uri_path(coap_message_t *message, const char *path);
+int coap_get_header_uri_query(coap_message_t *message, const char **query);
+int coap_set_header_uri_query(coap_message_t *message, const char *query);
+int coap_get_header_observe(coap_message_t *message, uint32_t *observe);
+int coap_set_header_observe(coap_message_t *message, uint32_t observe);
+int coap_get_header_block2(coap_message_t *message, uint32_t *num, uint8_t *more, uint16_t *size, uint32_t *offset);
+int coap_set_header_block2(coap_message_t *message, uint32_t num, uint8_t more, uint16_t size);
+int coap_get_header_block1(coap_message_t *message, uint32_t *num, uint8_t *more, uint16_t *size, uint32_t *offset);
+int coap_set_header_block1(coap_message_t *message, uint32_t num, uint8_t more, uint16_t size);
+int coap_get_header_size2(coap_message_t *message, uint32_t *size);
+int coap_set_header_size2(coap_message_t *message, uint32_t size);
+int coap_get_header_size1(coap_message_t *message, uint32_t *size);
+int coap_set_header_size1(coap_message_t *message, uint32_t size);
+
+int coap_get_payload(coap_message_t *message, const uint8_t **payload);
+int coap_set_payload(coap_message_t *message, const void *payload, size_t length);
+
+#endif
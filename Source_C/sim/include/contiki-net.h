@@ -0,0 +1,6 @@
+#ifndef CONTIKI_NET_H_
+#define CONTIKI_NET_H_
+
+#include "contiki.h"
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef CONTIKI_H_
+#define CONTIKI_H_
+
+/*
+Host-side stand-in for the Contiki-NG headers used by the SeedBot firmware.
+Firmware sources compile unmodified against it and run inside the simulator.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "sys/pt.h"
+#include "sys/process.h"
+#include "sys/clock.h"
+#include "sys/etimer.h"
+#include "sys/rtimer.h"
+#include "lib/random.h"
+
+/* Console output of the firmware is tagged with node and virtual time */
+int sim_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+#define printf sim_printf
+
+/* Soil field of the simulated sensors (utils/field.h), chosen at run time with --field-seed */
+extern uint32_t sim_field_seed;
+#define FIELD_CONF_SEED sim_field_seed
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef BUTTON_HAL_H_
+#define BUTTON_HAL_H_
+
+#include "sys/process.h"
+
+extern process_event_t button_hal_press_event;
+extern process_event_t button_hal_release_event;
+
+void button_hal_init(void);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef LEDS_H_
+#define LEDS_H_
+
+typedef unsigned char leds_mask_t;
+typedef unsigned char leds_num_t;
+
+#define LEDS_GREEN 1
+#define LEDS_YELLOW 2
+#define LEDS_RED 4
+#define LEDS_BLUE 8
+#define LEDS_ALL 15
+
+void leds_on(leds_mask_t leds);
+void leds_off(leds_mask_t leds);
+void leds_toggle(leds_mask_t leds);
+void leds_single_on(leds_num_t led);
+void leds_single_off(leds_num_t led);
+leds_mask_t leds_get(void);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef SIM_TIMER_H_
+#define SIM_TIMER_H_
+
+#include <stdint.h>
+
+/*
+Entry of the simulation's time-ordered queue.
+Timers fire in expiry order, ties in scheduling order, on the node that set them.
+*/
+
+struct sim_node;
+
+struct sim_timer
+{
+    struct sim_timer *next;
+    uint64_t expiry_us;
+    uint64_t seq;
+    void (*callback)(void *ptr);
+    void *ptr;
+    struct sim_node *node;
+    uint8_t pending;
+};
+
+void sim_timer_set(struct sim_timer *t, uint64_t delay_us, void (*callback)(void *), void *ptr);
+void sim_timer_stop(struct sim_timer *t);
+
+#endif
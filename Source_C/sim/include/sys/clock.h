@@ -0,0 +1,16 @@
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+/*
+Virtual clock of the simulation: it only advances when every node is idle,
+jumping straight to the next pending timer.
+*/
+
+typedef unsigned long clock_time_t;
+
+#define CLOCK_SECOND 1000
+
+clock_time_t clock_time(void);
+unsigned long clock_seconds(void);
+
+#endif
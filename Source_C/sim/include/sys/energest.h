@@ -0,0 +1,27 @@
+#ifndef ENERGEST_H_
+#define ENERGEST_H_
+
+#include <stdint.h>
+
+/*
+Energest of the simulation, kept per node by the simulator: the radio is always on
+(CSMA without duty cycling), the CPU is charged a fixed time per event and per received
+frame, and transmissions their airtime to the first hop.
+*/
+
+typedef enum energest_type
+{
+    ENERGEST_TYPE_CPU,
+    ENERGEST_TYPE_LPM,
+    ENERGEST_TYPE_DEEP_LPM,
+    ENERGEST_TYPE_TRANSMIT,
+    ENERGEST_TYPE_LISTEN,
+    ENERGEST_TYPE_MAX
+} energest_type_t;
+
+#define ENERGEST_SECOND 1000000UL
+
+void energest_flush(void);
+uint64_t energest_type_time(energest_type_t type);
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef PROCESS_H_
+#define PROCESS_H_
+
+/*
+Contiki-NG process API. Every process belongs to the simulated node that started it.
+*/
+
+#include "sys/pt.h"
+
+typedef unsigned char process_event_t;
+typedef void *process_data_t;
+typedef unsigned char process_num_events_t;
+
+#define PROCESS_ERR_OK 0
+#define PROCESS_ERR_FULL 1
+
+#define PROCESS_NONE NULL
+#define PROCESS_BROADCAST NULL
+
+#define PROCESS_EVENT_NONE 0x80
+#define PROCESS_EVENT_INIT 0x81
+#define PROCESS_EVENT_POLL 0x82
+#define PROCESS_EVENT_EXIT 0x83
+#define PROCESS_EVENT_SERVICE_REMOVED 0x84
+#define PROCESS_EVENT_CONTINUE 0x85
+#define PROCESS_EVENT_MSG 0x86
+#define PROCESS_EVENT_EXITED 0x87
+#define PROCESS_EVENT_TIMER 0x88
+#define PROCESS_EVENT_COM 0x89
+#define PROCESS_EVENT_MAX 0x8a
+
+struct sim_node;
+
+struct process
+{
+    struct process *next;
+    const char *name;
+    PT_THREAD((*thread)(struct pt *, process_event_t, process_data_t));
+    struct pt pt;
+    unsigned char state, needspoll;
+    struct sim_node *node; // Simulated node the process runs on
+};
+
+#define PROCESS_BEGIN() PT_BEGIN(process_pt)
+#define PROCESS_END() PT_END(process_pt)
+#define PROCESS_WAIT_EVENT() PROCESS_YIELD()
+#define PROCESS_WAIT_EVENT_UNTIL(c) PROCESS_YIELD_UNTIL(c)
+#define PROCESS_YIELD() PT_YIELD(process_pt)
+#define PROCESS_YIELD_UNTIL(c) PT_YIELD_UNTIL(process_pt, c)
+#define PROCESS_WAIT_UNTIL(c) PT_WAIT_UNTIL(process_pt, c)
+#define PROCESS_WAIT_WHILE(c) PT_WAIT_WHILE(process_pt, c)
+#define PROCESS_EXIT() PT_EXIT(process_pt)
+#define PROCESS_PT_SPAWN(pt, thread) PT_SPAWN(process_pt, pt, thread)
+#define PROCESS_PAUSE()                                        \
+    do                                                         \
+    {                                                          \
+        process_post(PROCESS_CURRENT(), PROCESS_EVENT_CONTINUE, NULL); \
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_CONTINUE); \
+    } while(0)
+
+#define PROCESS_THREAD(name, ev, data)            \
+    static PT_THREAD(process_thread_##name(struct pt *process_pt, \
+                                           process_event_t ev,    \
+                                           process_data_t data))
+
+#define PROCESS_NAME(name) extern struct process name
+
+#define PROCESS(name, strname)       \
+    PROCESS_THREAD(name, ev, data);  \
+    struct process name = {NULL, strname, process_thread_##name, {0}, 0, 0, NULL}
+
+/* Each firmware image exports its autostart list under its own symbol (see the Makefile) */
+#ifndef SIM_NODE_SYMBOL
+#define SIM_NODE_SYMBOL autostart_processes
+#endif
+
+#define AUTOSTART_PROCESSES(...) \
+    struct process *const SIM_NODE_SYMBOL[] = {__VA_ARGS__, NULL}
+
+extern struct process *process_current;
+#define PROCESS_CURRENT() process_current
+
+void process_start(struct process *p, process_data_t data);
+void process_exit(struct process *p);
+int process_post(struct process *p, process_event_t ev, process_data_t data);
+void process_post_synch(struct process *p, process_event_t ev, process_data_t data);
+void process_poll(struct process *p);
+int process_is_running(struct process *p);
+process_event_t process_alloc_event(void);
+
+#endif
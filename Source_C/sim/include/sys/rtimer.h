@@ -0,0 +1,18 @@
+#ifndef RTIMER_H_
+#define RTIMER_H_
+
+#include <stdint.h>
+
+/*
+Real-time clock of the simulation: the virtual clock at microsecond resolution.
+Code runs in zero virtual time, so intervals measured within a single event are 0.
+*/
+
+typedef uint32_t rtimer_clock_t;
+
+#define RTIMER_SECOND 1000000UL
+#define RTIMER_NOW() ((rtimer_clock_t)sim_now_us())
+
+uint64_t sim_now_us(void);
+
+#endif
@@ -0,0 +1,1399 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "coap-blocking-api.h"
+
+#undef printf
+
+#define COAP_HEADER_LEN 4
+#define COAP_PAYLOAD_MARKER 0xFF
+#define COAP_OBSERVE_REFRESH_INTERVAL 20
+#define COAP_EXCHANGE_LIFETIME_US (247ULL * 1000000)
+
+/*--------------------------------ENDPOINTS--------------------------------*/
+
+int coap_endpoint_parse(const char *text, size_t size, coap_endpoint_t *ep)
+{
+    const char *end = text + size;
+    const char *start;
+    size_t len;
+
+    memset(ep, 0, sizeof(*ep));
+    ep->port = COAP_DEFAULT_PORT;
+
+    if (size >= 8 && strncmp(text, "coaps://", 8) == 0)
+    {
+        ep->secure = 1;
+        text += 8;
+    }
+    else if (size >= 7 && strncmp(text, "coap://", 7) == 0)
+    {
+        text += 7;
+    }
+
+    if (text < end && *text == '[')
+    {
+        start = ++text;
+        while (text < end && *text != ']')
+            text++;
+        if (text == end)
+            return 0;
+        len = text - start;
+        text++;
+    }
+    else
+    {
+        start = text;
+        while (text < end && *text != '/')
+            text++;
+        len = text - start;
+    }
+
+    if (len == 0 || len >= sizeof(ep->addr))
+        return 0;
+    memcpy(ep->addr, start, len);
+    ep->addr[len] = '\0';
+
+    if (text < end && *text == ':')
+        ep->port = (uint16_t)atoi(text + 1);
+    return 1;
+}
+
+int coap_endpoint_snprint(char *str, size_t size, const coap_endpoint_t *ep)
+{
+    return snprintf(str, size, "coap://[%s]:%u", ep->addr, ep->port);
+}
+
+int coap_endpoint_print(const coap_endpoint_t *ep)
+{
+    char text[SIM_ADDR_LEN + 16];
+    coap_endpoint_snprint(text, sizeof(text), ep);
+    return sim_printf("%s", text);
+}
+
+void coap_endpoint_copy(coap_endpoint_t *dest, const coap_endpoint_t *src)
+{
+    memcpy(dest, src, sizeof(*dest));
+}
+
+int coap_endpoint_cmp(const coap_endpoint_t *e1, const coap_endpoint_t *e2)
+{
+    return e1->port == e2->port && strcmp(e1->addr, e2->addr) == 0;
+}
+
+int coap_endpoint_is_connected(const coap_endpoint_t *ep)
+{
+    return sim_node_by_addr(ep->addr) != NULL;
+}
+
+/*-------------------------------MESSAGE CODEC-------------------------------*/
+
+uint16_t coap_get_mid(void)
+{
+    return ++sim_current->next_mid;
+}
+
+void coap_init_message(coap_message_t *message, coap_message_type_t type, uint8_t code, uint16_t mid)
+{
+    memset(message, 0, sizeof(coap_message_t));
+    message->type = type;
+    message->code = code;
+    message->mid = mid;
+}
+
+static size_t int_length(uint32_t value)
+{
+    size_t len = 0;
+    while (value)
+    {
+        len++;
+        value >>= 8;
+    }
+    return len;
+}
+
+static size_t write_option(uint8_t *buffer, unsigned int *last, unsigned int number, const uint8_t *value, size_t len)
+{
+    unsigned int delta = number - *last;
+    uint8_t *head = buffer++;
+
+    *head = 0;
+    if (delta < 13)
+    {
+        *head |= delta << 4;
+    }
+    else if (delta < 269)
+    {
+        *head |= 13 << 4;
+        *buffer++ = delta - 13;
+    }
+    else
+    {
+        *head |= 14 << 4;
+        *buffer++ = (delta - 269) >> 8;
+        *buffer++ = (delta - 269) & 0xFF;
+    }
+
+    if (len < 13)
+    {
+        *head |= len;
+    }
+    else if (len < 269)
+    {
+        *head |= 13;
+        *buffer++ = len - 13;
+    }
+    else
+    {
+        *head |= 14;
+        *buffer++ = (len - 269) >> 8;
+        *buffer++ = (len - 269) & 0xFF;
+    }
+
+    memcpy(buffer, value, len);
+    *last = number;
+    return buffer + len - head;
+}
+
+static size_t write_int_option(uint8_t *buffer, unsigned int *last, unsigned int number, uint32_t value)
+{
+    uint8_t bytes[4];
+    size_t len = int_length(value);
+
+    for (size_t i = 0; i < len; i++)
+        bytes[i] = value >> (8 * (len - 1 - i));
+    return write_option(buffer, last, number, bytes, len);
+}
+
+static size_t write_multi_option(uint8_t *buffer, unsigned int *last, unsigned int number, const char *value, size_t len, char separator)
+{
+    size_t written = 0;
+    size_t start = 0;
+
+    for (size_t i = 0; i <= len; i++)
+    {
+        if (i == len || value[i] == separator)
+        {
+            written += write_option(buffer + written, last, number, (const uint8_t *)value + start, i - start);
+            start = i + 1;
+        }
+    }
+    return written;
+}
+
+static uint32_t block_value(uint32_t num, uint8_t more, uint16_t size)
+{
+    uint32_t szx = 0;
+    while ((16u << szx) < size && szx < 6)
+        szx++;
+    return (num << 4) | (more ? 0x08 : 0) | szx;
+}
+
+size_t coap_serialize_message(coap_message_t *message, uint8_t *buffer)
+{
+    uint8_t *option = buffer + COAP_HEADER_LEN + message->token_len;
+    unsigned int last = 0;
+
+    buffer[0] = 0x40 | (message->type & 0x03) << 4 | (message->token_len & 0x0F);
+    buffer[1] = message->code;
+    buffer[2] = message->mid >> 8;
+    buffer[3] = message->mid & 0xFF;
+    memcpy(buffer + COAP_HEADER_LEN, message->token, message->token_len);
+
+    if (IS_OPTION(message, COAP_OPTION_ETAG))
+        option += write_option(option, &last, COAP_OPTION_ETAG, message->etag, message->etag_len);
+    if (IS_OPTION(message, COAP_OPTION_OBSERVE))
+        option += write_int_option(option, &last, COAP_OPTION_OBSERVE, message->observe);
+    if (IS_OPTION(message, COAP_OPTION_URI_PATH))
+        option += write_multi_option(option, &last, COAP_OPTION_URI_PATH, message->uri_path, message->uri_path_len, '/');
+    if (IS_OPTION(message, COAP_OPTION_CONTENT_FORMAT))
+        option += write_int_option(option, &last, COAP_OPTION_CONTENT_FORMAT, message->content_format);
+    if (IS_OPTION(message, COAP_OPTION_MAX_AGE))
+        option += write_int_option(option, &last, COAP_OPTION_MAX_AGE, message->max_age);
+    if (IS_OPTION(message, COAP_OPTION_URI_QUERY))
+        option += write_multi_option(option, &last, COAP_OPTION_URI_QUERY, message->uri_query, message->uri_query_len, '&');
+    if (IS_OPTION(message, COAP_OPTION_ACCEPT))
+        option += write_int_option(option, &last, COAP_OPTION_ACCEPT, message->accept);
+    if (IS_OPTION(message, COAP_OPTION_BLOCK2))
+        option += write_int_option(option, &last, COAP_OPTION_BLOCK2, block_value(message->block2_num, message->block2_more, message->block2_size));
+    if (IS_OPTION(message, COAP_OPTION_BLOCK1))
+        option += write_int_option(option, &last, COAP_OPTION_BLOCK1, block_value(message->block1_num, message->block1_more, message->block1_size));
+    if (IS_OPTION(message, COAP_OPTION_SIZE2))
+        option += write_int_option(option, &last, COAP_OPTION_SIZE2, message->size2);
+    if (IS_OPTION(message, COAP_OPTION_SIZE1))
+        option += write_int_option(option, &last, COAP_OPTION_SIZE1, message->size1);
+
+    if (message->payload_len > 0)
+    {
+        *option++ = COAP_PAYLOAD_MARKER;
+        memmove(option, message->payload, message->payload_len);
+        option += message->payload_len;
+    }
+
+    message->buffer = buffer;
+    return option - buffer;
+}
+
+static uint32_t parse_int_option(const uint8_t *bytes, size_t len)
+{
+    uint32_t value = 0;
+    for (size_t i = 0; i < len; i++)
+        value = (value << 8) | bytes[i];
+    return value;
+}
+
+// Join repeated options in place, as Contiki-NG does: "a" + "b" -> "a/b"
+static void merge_multi_option(const char **dst, size_t *dst_len, uint8_t *option, size_t option_len, char separator)
+{
+    if (*dst_len > 0)
+    {
+        char *end = (char *)*dst + *dst_len;
+        *end = separator;
+        memmove(end + 1, option, option_len);
+        *dst_len += option_len + 1;
+    }
+    else
+    {
+        *dst = (const char *)option;
+        *dst_len = option_len;
+    }
+}
+
+static void parse_block(uint32_t value, uint32_t *num, uint8_t *more, uint16_t *size, uint32_t *offset)
+{
+    *num = value >> 4;
+    *more = (value & 0x08) >> 3;
+    *size = 16 << (value & 0x07);
+    *offset = (value & ~0x0F) << (value & 0x07);
+}
+
+coap_status_t coap_parse_message(coap_message_t *message, uint8_t *data, uint16_t data_len)
+{
+    uint8_t *current;
+    unsigned int number = 0;
+
+    memset(message, 0, sizeof(coap_message_t));
+    message->buffer = data;
+
+    if (data_len < COAP_HEADER_LEN)
+        return BAD_REQUEST_4_00;
+
+    message->version = data[0] >> 6;
+    message->type = (data[0] >> 4) & 0x03;
+    message->token_len = data[0] & 0x0F;
+    message->code = data[1];
+    message->mid = data[2] << 8 | data[3];
+
+    if (message->version != 1 || message->token_len > COAP_TOKEN_LEN || COAP_HEADER_LEN + message->token_len > data_len)
+        return BAD_REQUEST_4_00;
+
+    memcpy(message->token, data + COAP_HEADER_LEN, message->token_len);
+    current = data + COAP_HEADER_LEN + message->token_len;
+
+    while (current < data + data_len)
+    {
+        unsigned int delta, len;
+
+        if (*current == COAP_PAYLOAD_MARKER)
+        {
+            current++;
+            message->payload = current;
+            message->payload_len = data + data_len - current;
+            break;
+        }
+
+        delta = *current >> 4;
+        len = *current & 0x0F;
+        current++;
+        if (delta == 15 || len == 15)
+            return BAD_REQUEST_4_00;
+
+        if (delta == 13)
+            delta = 13 + *current++;
+        else if (delta == 14)
+        {
+            delta = 269 + (current[0] << 8 | current[1]);
+            current += 2;
+        }
+        if (len == 13)
+            len = 13 + *current++;
+        else if (len == 14)
+        {
+            len = 269 + (current[0] << 8 | current[1]);
+            current += 2;
+        }
+        if (current + len > data + data_len)
+            return BAD_REQUEST_4_00;
+
+        number += delta;
+        if (number <= COAP_OPTION_SIZE1)
+            SET_OPTION(message, number);
+
+        switch (number)
+        {
+        case COAP_OPTION_ETAG:
+            message->etag_len = len < COAP_ETAG_LEN ? len : COAP_ETAG_LEN;
+            memcpy(message->etag, current, message->etag_len);
+            break;
+        case COAP_OPTION_OBSERVE:
+            message->observe = parse_int_option(current, len);
+            break;
+        case COAP_OPTION_URI_PATH:
+            merge_multi_option(&message->uri_path, &message->uri_path_len, current, len, '/');
+            break;
+        case COAP_OPTION_CONTENT_FORMAT:
+            message->content_format = parse_int_option(current, len);
+            break;
+        case COAP_OPTION_MAX_AGE:
+            message->max_age = parse_int_option(current, len);
+            break;
+        case COAP_OPTION_URI_QUERY:
+            merge_multi_option(&message->uri_query, &message->uri_query_len, current, len, '&');
+            break;
+        case COAP_OPTION_ACCEPT:
+            message->accept = parse_int_option(current, len);
+            break;
+        case COAP_OPTION_BLOCK2:
+            parse_block(parse_int_option(current, len), &message->block2_num, &message->block2_more, &message->block2_size, &message->block2_offset);
+            break;
+        case COAP_OPTION_BLOCK1:
+            parse_block(parse_int_option(current, len), &message->block1_num, &message->block1_more, &message->block1_size, &message->block1_offset);
+            break;
+        case COAP_OPTION_SIZE2:
+            message->size2 = parse_int_option(current, len);
+            break;
+        case COAP_OPTION_SIZE1:
+            message->size1 = parse_int_option(current, len);
+            break;
+        default:
+            // Unknown critical options are rejected
+            if (number & 1)
+                return BAD_OPTION_4_02;
+        }
+        current += len;
+    }
+    return NO_ERROR;
+}
+
+/*-----------------------------HEADER ACCESSORS-----------------------------*/
+
+int coap_set_token(coap_message_t *message, const uint8_t *token, size_t token_len)
+{
+    message->token_len = token_len < COAP_TOKEN_LEN ? token_len : COAP_TOKEN_LEN;
+    memcpy(message->token, token, message->token_len);
+    return message->token_len;
+}
+
+static int get_variable(const char *buffer, size_t length, const char *name, const char **output)
+{
+    const char *start = NULL;
+    const char *value_end = NULL;
+    size_t name_len = strlen(name);
+
+    for (size_t i = 0; i + name_len < length; i++)
+    {
+        if ((i == 0 || buffer[i - 1] == '&') && strncmp(name, buffer + i, name_len) == 0 && buffer[i + name_len] == '=')
+        {
+            start = buffer + i + name_len + 1;
+            value_end = memchr(start, '&', buffer + length - start);
+            if (value_end == NULL)
+                value_end = buffer + length;
+            *output = start;
+            return value_end - start;
+        }
+    }
+    return 0;
+}
+
+int coap_get_query_variable(coap_message_t *message, const char *name, const char **output)
+{
+    if (IS_OPTION(message, COAP_OPTION_URI_QUERY))
+        return get_variable(message->uri_query, message->uri_query_len, name, output);
+    return 0;
+}
+
+int coap_get_post_variable(coap_message_t *message, const char *name, const char **output)
+{
+    if (message->payload_len)
+        return get_variable((const char *)message->payload, message->payload_len, name, output);
+    return 0;
+}
+
+int coap_get_header_content_format(coap_message_t *message, unsigned int *format)
+{
+    if (!IS_OPTION(message, COAP_OPTION_CONTENT_FORMAT))
+        return 0;
+    *format = message->content_format;
+    return 1;
+}
+
+int coap_set_header_content_format(coap_message_t *message, unsigned int format)
+{
+    message->content_format = format;
+    SET_OPTION(message, COAP_OPTION_CONTENT_FORMAT);
+    return 1;
+}
+
+int coap_get_header_max_age(coap_message_t *message, uint32_t *age)
+{
+    *age = IS_OPTION(message, COAP_OPTION_MAX_AGE) ? message->max_age : 60;
+    return 1;
+}
+
+int coap_set_header_max_age(coap_message_t *message, uint32_t age)
+{
+    message->max_age = age;
+    SET_OPTION(message, COAP_OPTION_MAX_AGE);
+    return 1;
+}
+
+int coap_get_header_etag(coap_message_t *message, const uint8_t **etag)
+{
+    if (!IS_OPTION(message, COAP_OPTION_ETAG))
+        return 0;
+    *etag = message->etag;
+    return message->etag_len;
+}
+
+int coap_set_header_etag(coap_message_t *message, const uint8_t *etag, size_t etag_len)
+{
+    message->etag_len = etag_len < COAP_ETAG_LEN ? etag_len : COAP_ETAG_LEN;
+    memcpy(message->etag, etag, message->etag_len);
+    SET_OPTION(message, COAP_OPTION_ETAG);
+    return message->etag_len;
+}
+
+int coap_get_header_uri_path(coap_message_t *message, const char **path)
+{
+    if (!IS_OPTION(message, COAP_OPTION_URI_PATH))
+        return 0;
+    *path = message->uri_path;
+    return message->uri_path_len;
+}
+
+int coap_set_header_uri_path(coap_message_t *message, const char *path)
+{
+    while (path[0] == '/')
+        ++path;
+    message->uri_path = path;
+    message->uri_path_len = strlen(path);
+    SET_OPTION(message, COAP_OPTION_URI_PATH);
+    return message->uri_path_len;
+}
+
+int coap_get_header_uri_query(coap_message_t *message, const char **query)
+{
+    if (!IS_OPTION(message, COAP_OPTION_URI_QUERY))
+        return 0;
+    *query = message->uri_query;
+    return message->uri_query_len;
+}
+
+int coap_set_header_uri_query(coap_message_t *message, const char *query)
+{
+    while (query[0] == '?')
+        ++query;
+    message->uri_query = query;
+    message->uri_query_len = strlen(query);
+    SET_OPTION(message, COAP_OPTION_URI_QUERY);
+    return message->uri_query_len;
+}
+
+int coap_get_header_observe(coap_message_t *message, uint32_t *observe)
+{
+    if (!IS_OPTION(message, COAP_OPTION_OBSERVE))
+        return 0;
+    *observe = message->observe;
+    return 1;
+}
+
+int coap_set_header_observe(coap_message_t *message, uint32_t observe)
+{
+    message->observe = 0x00FFFFFF & observe;
+    SET_OPTION(message, COAP_OPTION_OBSERVE);
+    return 1;
+}
+
+int coap_get_header_block2(coap_message_t *message, uint32_t *num, uint8_t *more, uint16_t *size, uint32_t *offset)
+{
+    if (!IS_OPTION(message, COAP_OPTION_BLOCK2))
+        return 0;
+    if (num)
+        *num = message->block2_num;
+    if (more)
+        *more = message->block2_more;
+    if (size)
+        *size = message->block2_size;
+    if (offset)
+        *offset = message->block2_offset;
+    return 1;
+}
+
+int coap_set_header_block2(coap_message_t *message, uint32_t num, uint8_t more, uint16_t size)
+{
+    if (size < 16 || size > 2048 || num > 0x0FFFFF)
+        return 0;
+    message->block2_num = num;
+    message->block2_more = more ? 1 : 0;
+    message->block2_size = size;
+    message->block2_offset = num * size;
+    SET_OPTION(message, COAP_OPTION_BLOCK2);
+    return 1;
+}
+
+int coap_get_header_block1(coap_message_t *message, uint32_t *num, uint8_t *more, uint16_t *size, uint32_t *offset)
+{
+    if (!IS_OPTION(message, COAP_OPTION_BLOCK1))
+        return 0;
+    if (num)
+        *num = message->block1_num;
+    if (more)
+        *more = message->block1_more;
+    if (size)
+        *size = message->block1_size;
+    if (offset)
+        *offset = message->block1_offset;
+    return 1;
+}
+
+int coap_set_header_block1(coap_message_t *message, uint32_t num, uint8_t more, uint16_t size)
+{
+    if (size < 16 || size > 2048 || num > 0x0FFFFF)
+        return 0;
+    message->block1_num = num;
+    message->block1_more = more ? 1 : 0;
+    message->block1_size = size;
+    message->block1_offset = num * size;
+    SET_OPTION(message, COAP_OPTION_BLOCK1);
+    return 1;
+}
+
+int coap_get_header_size2(coap_message_t *message, uint32_t *size)
+{
+    if (!IS_OPTION(message, COAP_OPTION_SIZE2))
+        return 0;
+    *size = message->size2;
+    return 1;
+}
+
+int coap_set_header_size2(coap_message_t *message, uint32_t size)
+{
+    message->size2 = size;
+    SET_OPTION(message, COAP_OPTION_SIZE2);
+    return 1;
+}
+
+int coap_get_header_size1(coap_message_t *message, uint32_t *size)
+{
+    if (!IS_OPTION(message, COAP_OPTION_SIZE1))
+        return 0;
+    *size = message->size1;
+    return 1;
+}
+
+int coap_set_header_size1(coap_message_t *message, uint32_t size)
+{
+    message->size1 = size;
+    SET_OPTION(message, COAP_OPTION_SIZE1);
+    return 1;
+}
+
+int coap_get_payload(coap_message_t *message, const uint8_t **payload)
+{
+    if (payload != NULL)
+        *payload = message->payload;
+    return message->payload != NULL ? message->payload_len : 0;
+}
+
+int coap_set_payload(coap_message_t *message, const void *payload, size_t length)
+{
+    message->payload = (const uint8_t *)payload;
+    message->payload_len = length < COAP_MAX_CHUNK_SIZE ? length : COAP_MAX_CHUNK_SIZE;
+    return message->payload_len;
+}
+
+/*--------------------------------COAP TIMERS--------------------------------*/
+
+uint64_t coap_timer_uptime(void)
+{
+    return sim_now_us() / 1000;
+}
+
+static void coap_timer_fire(void *ptr)
+{
+    coap_timer_t *timer = ptr;
+    if (timer->callback)
+        timer->callback(timer);
+}
+
+void coap_timer_set(coap_timer_t *timer, uint64_t time)
+{
+    timer->expiration_time = coap_timer_uptime() + time;
+    sim_timer_set(&timer->sim, time * 1000, coap_timer_fire, timer);
+}
+
+void coap_timer_stop(coap_timer_t *timer)
+{
+    sim_timer_stop(&timer->sim);
+}
+
+int coap_timer_expired(const coap_timer_t *timer)
+{
+    return !timer->sim.pending;
+}
+
+/*------------------------------TRANSACTIONS------------------------------*/
+
+static void remove_observer_by_client(struct sim_node *node, const coap_endpoint_t *ep);
+static void remove_observer_by_mid(struct sim_node *node, const coap_endpoint_t *ep, uint16_t mid);
+
+coap_transaction_t *coap_new_transaction(uint16_t mid, const coap_endpoint_t *endpoint)
+{
+    struct sim_node *node = sim_current;
+
+    for (int i = 0; i < SIM_MAX_TRANSACTIONS; i++)
+    {
+        if (!node->transaction_used[i])
+        {
+            coap_transaction_t *t = &node->transactions[i];
+            memset(t, 0, sizeof(*t));
+            t->mid = mid;
+            t->retrans_counter = 0;
+            coap_endpoint_copy(&t->endpoint, endpoint);
+            node->transaction_used[i] = 1;
+            return t;
+        }
+    }
+    return NULL;
+}
+
+static void coap_retransmit_transaction(coap_timer_t *nt)
+{
+    coap_transaction_t *t = coap_timer_get_user_data(nt);
+
+    ++(t->retrans_counter);
+    coap_send_transaction(t);
+}
+
+void coap_send_transaction(coap_transaction_t *t)
+{
+    if (COAP_TYPE_CON == ((t->message[0] >> 4) & 0x03))
+    {
+        if (t->retrans_counter <= COAP_MAX_RETRANSMIT)
+        {
+            // Every send after the first is a retransmission, whoever drives the timer
+            sim_current->retransmitting = t->retrans_counter > 0;
+            coap_sendto(&t->endpoint, t->message, t->message_len);
+            sim_current->retransmitting = 0;
+
+            // Not timed out yet: schedule the next retransmission with exponential back-off
+            if (t->retrans_counter == 0)
+            {
+                // As in Contiki-NG the callback is set once, so a caller may replace it
+                coap_timer_set_callback(&t->retrans_timer, coap_retransmit_transaction);
+                coap_timer_set_user_data(&t->retrans_timer, t);
+                t->retrans_interval = COAP_RESPONSE_TIMEOUT_TICKS + (random_rand() % COAP_RESPONSE_TIMEOUT_BACKOFF_MASK);
+            }
+            else
+            {
+                t->retrans_interval <<= 1;
+            }
+            coap_timer_set(&t->retrans_timer, t->retrans_interval);
+        }
+        else
+        {
+            // Timed out
+            coap_resource_response_handler_t callback = t->callback;
+            void *callback_data = t->callback_data;
+            struct sim_node *to = sim_node_by_addr(t->endpoint.addr);
+
+            if (to != NULL)
+                sim_paths[sim_current->id][to->id].timeouts++;
+
+            remove_observer_by_client(sim_current, &t->endpoint);
+            coap_clear_transaction(t);
+
+            if (callback)
+                callback(callback_data, NULL);
+        }
+    }
+    else
+    {
+        coap_sendto(&t->endpoint, t->message, t->message_len);
+        coap_clear_transaction(t);
+    }
+}
+
+void coap_clear_transaction(coap_transaction_t *t)
+{
+    struct sim_node *node = sim_current;
+    int i = t - node->transactions;
+
+    if (i < 0 || i >= SIM_MAX_TRANSACTIONS)
+        return;
+    coap_timer_stop(&t->retrans_timer);
+    node->transaction_used[i] = 0;
+}
+
+coap_transaction_t *coap_get_transaction_by_mid(uint16_t mid)
+{
+    struct sim_node *node = sim_current;
+
+    for (int i = 0; i < SIM_MAX_TRANSACTIONS; i++)
+    {
+        if (node->transaction_used[i] && node->transactions[i].mid == mid)
+            return &node->transactions[i];
+    }
+    return NULL;
+}
+
+/*-------------------------------RESOURCES-------------------------------*/
+
+void coap_activate_resource(coap_resource_t *resource, const char *path)
+{
+    coap_resource_t **it;
+
+    while (path[0] == '/')
+        ++path;
+    resource->url = path;
+    resource->next = NULL;
+
+    for (it = &sim_current->resources; *it != NULL; it = &(*it)->next)
+    {
+        if (*it == resource)
+            return;
+    }
+    *it = resource;
+}
+
+coap_resource_t *coap_get_first_resource(void)
+{
+    return sim_current->resources;
+}
+
+coap_resource_t *coap_get_next_resource(coap_resource_t *resource)
+{
+    return resource->next;
+}
+
+static coap_resource_t *find_resource(struct sim_node *node, const char *path, size_t len)
+{
+    for (coap_resource_t *r = node->resources; r != NULL; r = r->next)
+    {
+        size_t url_len = strlen(r->url);
+
+        if (url_len == len && strncmp(r->url, path, len) == 0)
+            return r;
+        if ((r->flags & HAS_SUB_RESOURCES) && len > url_len && strncmp(r->url, path, url_len) == 0 && path[url_len] == '/')
+            return r;
+    }
+    return NULL;
+}
+
+/*-------------------------------OBSERVE SERVER-------------------------------*/
+
+static void remove_observer_by_client(struct sim_node *node, const coap_endpoint_t *ep)
+{
+    for (int i = 0; i < SIM_MAX_OBSERVERS; i++)
+    {
+        if (node->observers[i].used && coap_endpoint_cmp(&node->observers[i].endpoint, ep))
+            node->observers[i].used = 0;
+    }
+}
+
+static void remove_observer_by_mid(struct sim_node *node, const coap_endpoint_t *ep, uint16_t mid)
+{
+    // A reset to a notification cancels the observation; notifications carry no
+    // stored MID here, so the client is dropped as a whole
+    (void)mid;
+    remove_observer_by_client(node, ep);
+}
+
+static void observe_handler(struct sim_node *node, coap_resource_t *resource, coap_message_t *request, coap_message_t *response)
+{
+    sim_observer_t *obs = NULL;
+
+    if (!IS_OPTION(request, COAP_OPTION_OBSERVE) || response->code >= BAD_REQUEST_4_00)
+        return;
+
+    for (int i = 0; i < SIM_MAX_OBSERVERS; i++)
+    {
+        sim_observer_t *o = &node->observers[i];
+        if (o->used && coap_endpoint_cmp(&o->endpoint, request->src_ep) && strcmp(o->url, resource->url) == 0)
+            obs = o;
+    }
+
+    if (request->observe == 1)
+    {
+        if (obs != NULL)
+            obs->used = 0;
+        return;
+    }
+
+    if (obs == NULL)
+    {
+        for (int i = 0; i < SIM_MAX_OBSERVERS && obs == NULL; i++)
+        {
+            if (!node->observers[i].used)
+                obs = &node->observers[i];
+        }
+        if (obs == NULL)
+            return;
+        memset(obs, 0, sizeof(*obs));
+        obs->used = 1;
+        coap_endpoint_copy(&obs->endpoint, request->src_ep);
+        snprintf(obs->url, sizeof(obs->url), "%s", resource->url);
+    }
+    obs->token_len = request->token_len;
+    memcpy(obs->token, request->token, request->token_len);
+
+    coap_set_header_observe(response, (obs->seq)++);
+}
+
+void coap_notify_observers(coap_resource_t *resource)
+{
+    struct sim_node *node = sim_current;
+
+    for (int i = 0; i < SIM_MAX_OBSERVERS; i++)
+    {
+        sim_observer_t *obs = &node->observers[i];
+        coap_message_t request[1], notification[1];
+        coap_transaction_t *t;
+
+        if (!obs->used || strcmp(obs->url, resource->url) != 0 || resource->get_handler == NULL)
+            continue;
+
+        coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+        coap_set_header_uri_path(request, resource->url);
+        request->src_ep = &obs->endpoint;
+
+        coap_init_message(notification, COAP_TYPE_NON, CONTENT_2_05, 0);
+        if ((t = coap_new_transaction(coap_get_mid(), &obs->endpoint)) == NULL)
+            continue;
+
+        // Every few notifications are confirmable, to find out whether the client is still there
+        if (obs->seq % COAP_OBSERVE_REFRESH_INTERVAL == 0)
+            notification->type = COAP_TYPE_CON;
+
+        resource->get_handler(request, notification, t->message + COAP_MAX_HEADER_SIZE, COAP_MAX_CHUNK_SIZE, NULL);
+
+        if (notification->code < BAD_REQUEST_4_00)
+            coap_set_header_observe(notification, (obs->seq)++);
+        coap_set_token(notification, obs->token, obs->token_len);
+        notification->mid = t->mid;
+
+        t->message_len = coap_serialize_message(notification, t->message);
+        coap_send_transaction(t);
+    }
+}
+
+/*-------------------------------OBSERVE CLIENT-------------------------------*/
+
+static coap_observee_t *find_observee(struct sim_node *node, const coap_endpoint_t *ep, const uint8_t *token, uint8_t token_len)
+{
+    for (int i = 0; i < SIM_MAX_OBSERVEES; i++)
+    {
+        coap_observee_t *o = &node->observees[i];
+        if (node->observee_used[i] && o->token_len == token_len && memcmp(o->token, token, token_len) == 0 && strcmp(o->endpoint.addr, ep->addr) == 0)
+            return o;
+    }
+    return NULL;
+}
+
+int coap_obs_remove_observee(coap_observee_t *o)
+{
+    int i = o - sim_current->observees;
+
+    if (i < 0 || i >= SIM_MAX_OBSERVEES)
+        return 0;
+    sim_current->observee_used[i] = 0;
+    return 1;
+}
+
+static void handle_obs_registration_response(void *data, coap_message_t *response)
+{
+    coap_observee_t *obs = data;
+    coap_notification_flag_t flag = OBSERVE_NOT_SUPPORTED;
+    uint32_t observe;
+
+    if (response)
+    {
+        if (response->code == CONTENT_2_05)
+        {
+            flag = NOTIFICATION_OK;
+            if (coap_get_header_observe(response, &observe))
+            {
+                flag = OBSERVE_OK;
+                obs->last_observe = observe;
+            }
+        }
+        else if (response->code >= BAD_REQUEST_4_00)
+        {
+            flag = ERROR_RESPONSE_CODE;
+        }
+    }
+    else
+    {
+        flag = NO_REPLY_FROM_SERVER;
+    }
+
+    obs->notification_callback(obs, response, flag);
+    if (flag != OBSERVE_OK)
+        coap_obs_remove_observee(obs);
+}
+
+coap_observee_t *coap_obs_request_registration(const coap_endpoint_t *endpoint, char *uri, notification_callback_t notification_callback, void *data)
+{
+    struct sim_node *node = sim_current;
+    coap_observee_t *obs = NULL;
+    coap_message_t request[1];
+    coap_transaction_t *t;
+    uint16_t token;
+
+    for (int i = 0; i < SIM_MAX_OBSERVEES; i++)
+    {
+        if (!node->observee_used[i])
+        {
+            obs = &node->observees[i];
+            node->observee_used[i] = 1;
+            break;
+        }
+    }
+    if (obs == NULL)
+        return NULL;
+
+    memset(obs, 0, sizeof(*obs));
+    obs->url = uri;
+    coap_endpoint_copy(&obs->endpoint, endpoint);
+    token = random_rand();
+    obs->token_len = 2;
+    obs->token[0] = token >> 8;
+    obs->token[1] = token & 0xFF;
+    obs->data = data;
+    obs->notification_callback = notification_callback;
+
+    coap_init_message(request, COAP_TYPE_CON, COAP_GET, coap_get_mid());
+    coap_set_header_uri_path(request, uri);
+    coap_set_header_observe(request, 0);
+    coap_set_token(request, obs->token, obs->token_len);
+
+    if ((t = coap_new_transaction(request->mid, endpoint)) == NULL)
+    {
+        coap_obs_remove_observee(obs);
+        return NULL;
+    }
+    t->callback = handle_obs_registration_response;
+    t->callback_data = obs;
+    t->message_len = coap_serialize_message(request, t->message);
+    coap_send_transaction(t);
+    return obs;
+}
+
+static void handle_notification(struct sim_node *node, const coap_endpoint_t *src, coap_message_t *notification)
+{
+    coap_observee_t *obs = find_observee(node, src, notification->token, notification->token_len);
+    uint32_t observe;
+
+    if (obs == NULL)
+        return;
+
+    coap_get_header_observe(notification, &observe);
+    // Drop notifications older than the last one seen (RFC 7641, 3.4)
+    if (((observe - obs->last_observe) & 0x00FFFFFF) >= (1 << 23) && observe != obs->last_observe)
+        return;
+    obs->last_observe = observe;
+
+    obs->notification_callback(obs, notification, NOTIFICATION_OK);
+}
+
+/*---------------------------------ENGINE---------------------------------*/
+
+static void send_empty(const coap_endpoint_t *ep, coap_message_type_t type, uint16_t mid)
+{
+    coap_message_t message[1];
+    uint8_t buffer[COAP_HEADER_LEN];
+
+    coap_init_message(message, type, 0, mid);
+    coap_sendto(ep, buffer, coap_serialize_message(message, buffer));
+}
+
+static sim_dedup_entry_t *find_duplicate(struct sim_node *node, const coap_endpoint_t *src, uint16_t mid)
+{
+    for (int i = 0; i < SIM_DEDUP_ENTRIES; i++)
+    {
+        sim_dedup_entry_t *e = &node->dedup_cache[i];
+        if (e->expiry_us > sim_now_us() && e->mid == mid && coap_endpoint_cmp(&e->endpoint, src))
+            return e;
+    }
+    return NULL;
+}
+
+static void remember_response(struct sim_node *node, const coap_endpoint_t *src, uint16_t mid, const uint8_t *response, uint16_t len)
+{
+    sim_dedup_entry_t *e = &node->dedup_cache[node->dedup_next];
+
+    node->dedup_next = (node->dedup_next + 1) % SIM_DEDUP_ENTRIES;
+    coap_endpoint_copy(&e->endpoint, src);
+    e->mid = mid;
+    e->expiry_us = sim_now_us() + COAP_EXCHANGE_LIFETIME_US;
+    e->response_len = len;
+    memcpy(e->response, response, len);
+}
+
+static void handle_request(struct sim_node *node, const coap_endpoint_t *src, coap_message_t *message)
+{
+    static uint8_t payload_buffer[COAP_MAX_CHUNK_SIZE + 1];
+    static uint8_t out[COAP_MAX_PACKET_SIZE + COAP_MAX_CHUNK_SIZE];
+    coap_message_t response[1];
+    coap_resource_t *resource;
+    coap_resource_handler_t handler = NULL;
+    uint32_t block_num = 0, block_offset = 0;
+    uint16_t block_size = COAP_MAX_BLOCK_SIZE;
+    int32_t new_offset = 0;
+    size_t len;
+
+    if (node->dedup && message->type == COAP_TYPE_CON)
+    {
+        sim_dedup_entry_t *duplicate = find_duplicate(node, src, message->mid);
+        if (duplicate != NULL)
+        {
+            // Retransmitted request: answer again without running the handler
+            coap_sendto(src, duplicate->response, duplicate->response_len);
+            return;
+        }
+    }
+
+    if (message->type == COAP_TYPE_CON)
+        coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, message->mid);
+    else
+        coap_init_message(response, COAP_TYPE_NON, CONTENT_2_05, coap_get_mid());
+    coap_set_token(response, message->token, message->token_len);
+
+    resource = find_resource(node, message->uri_path ? message->uri_path : "", message->uri_path_len);
+    if (resource == NULL)
+    {
+        coap_set_status_code(response, NOT_FOUND_4_04);
+    }
+    else
+    {
+        switch (message->code)
+        {
+        case COAP_GET:
+            handler = resource->get_handler;
+            break;
+        case COAP_POST:
+            handler = resource->post_handler;
+            break;
+        case COAP_PUT:
+            handler = resource->put_handler;
+            break;
+        case COAP_DELETE:
+            handler = resource->delete_handler;
+            break;
+        }
+
+        if (handler == NULL)
+        {
+            coap_set_status_code(response, METHOD_NOT_ALLOWED_4_05);
+        }
+        else
+        {
+            if (coap_get_header_block2(message, &block_num, NULL, &block_size, &block_offset))
+            {
+                if (block_size > COAP_MAX_BLOCK_SIZE)
+                    block_size = COAP_MAX_BLOCK_SIZE;
+                new_offset = block_offset;
+            }
+
+            handler(message, response, payload_buffer, block_size, &new_offset);
+
+            if (IS_OPTION(message, COAP_OPTION_BLOCK2))
+            {
+                if (new_offset == (int32_t)block_offset)
+                {
+                    // The handler is not block-aware: slice its payload
+                    if (block_offset >= response->payload_len)
+                    {
+                        coap_set_status_code(response, BAD_OPTION_4_02);
+                        coap_set_payload(response, "BlockOutOfScope", 15);
+                    }
+                    else
+                    {
+                        coap_set_header_block2(response, block_num, response->payload_len - block_offset > block_size, block_size);
+                        coap_set_payload(response, response->payload + block_offset,
+                                         response->payload_len - block_offset < block_size ? response->payload_len - block_offset : block_size);
+                    }
+                }
+                else
+                {
+                    coap_set_header_block2(response, block_num, new_offset != -1 || response->payload_len > block_size, block_size);
+                    if (response->payload_len > block_size)
+                        coap_set_payload(response, response->payload, block_size);
+                }
+            }
+            else if (new_offset != 0)
+            {
+                coap_set_header_block2(response, 0, new_offset != -1, COAP_MAX_BLOCK_SIZE);
+                coap_set_payload(response, response->payload, response->payload_len < COAP_MAX_BLOCK_SIZE ? response->payload_len : COAP_MAX_BLOCK_SIZE);
+            }
+
+            if ((resource->flags & IS_OBSERVABLE) && message->code == COAP_GET)
+                observe_handler(node, resource, message, response);
+        }
+    }
+
+    len = coap_serialize_message(response, out);
+    coap_sendto(src, out, len);
+
+    if (node->dedup && message->type == COAP_TYPE_CON && len <= COAP_MAX_PACKET_SIZE)
+        remember_response(node, src, message->mid, out, len);
+}
+
+static void coap_receive(struct sim_node *node, struct sim_node *from, const uint8_t *data, uint16_t len)
+{
+    coap_message_t *message = &node->rx_message;
+    coap_endpoint_t src;
+    coap_status_t status;
+
+    // Responses are handed to the application by pointer, so they live in the node's receive buffer
+    memcpy(node->rx_buffer, data, len);
+    node->rx_buffer[len] = '\0'; // Keeps the firmware's string parsing inside the datagram
+
+    memset(&node->rx_endpoint, 0, sizeof(node->rx_endpoint));
+    snprintf(node->rx_endpoint.addr, sizeof(node->rx_endpoint.addr), "%s", from->addr);
+    node->rx_endpoint.port = COAP_DEFAULT_PORT;
+    coap_endpoint_copy(&src, &node->rx_endpoint);
+
+    status = coap_parse_message(message, node->rx_buffer, len);
+    message->src_ep = &node->rx_endpoint;
+    sim_trace_deliver(from, node, message);
+
+    if (status != NO_ERROR)
+    {
+        if (message->type == COAP_TYPE_CON && message->code >= COAP_GET && message->code <= COAP_DELETE)
+        {
+            coap_message_t response[1];
+            uint8_t out[COAP_MAX_HEADER_SIZE];
+
+            coap_init_message(response, COAP_TYPE_ACK, status, message->mid);
+            coap_set_token(response, message->token, message->token_len);
+            coap_sendto(&src, out, coap_serialize_message(response, out));
+        }
+        return;
+    }
+
+    if (message->code >= COAP_GET && message->code <= COAP_DELETE)
+    {
+        handle_request(node, &src, message);
+        return;
+    }
+
+    if (message->type == COAP_TYPE_CON && message->code == 0)
+    {
+        // CoAP ping
+        send_empty(&src, COAP_TYPE_RST, message->mid);
+        return;
+    }
+
+    if (message->type == COAP_TYPE_RST)
+        remove_observer_by_mid(node, &src, message->mid);
+
+    if (message->type == COAP_TYPE_ACK || message->type == COAP_TYPE_RST)
+    {
+        coap_transaction_t *t = coap_get_transaction_by_mid(message->mid);
+        if (t != NULL)
+        {
+            // Free the transaction before the callback, which may open a new one
+            coap_resource_response_handler_t callback = t->callback;
+            void *callback_data = t->callback_data;
+
+            coap_clear_transaction(t);
+            if (callback)
+                callback(callback_data, message);
+        }
+        return;
+    }
+
+    // Separate response or notification
+    if (message->type == COAP_TYPE_CON)
+        send_empty(&src, COAP_TYPE_ACK, message->mid);
+    if (IS_OPTION(message, COAP_OPTION_OBSERVE))
+        handle_notification(node, &src, message);
+}
+
+/*----------------------------BLOCKING REQUESTS----------------------------*/
+
+static void coap_blocking_request_callback(void *callback_data, coap_message_t *response)
+{
+    coap_blocking_request_state_t *blocking_state = callback_data;
+
+    blocking_state->state.response = response;
+    process_poll(blocking_state->process);
+}
+
+PT_THREAD(coap_blocking_request(coap_blocking_request_state_t *blocking_state, process_event_t ev,
+                                coap_endpoint_t *remote_ep,
+                                coap_message_t *request,
+                                coap_blocking_response_handler_t request_callback))
+{
+    coap_request_state_t *state = &blocking_state->state;
+
+    PT_BEGIN(&blocking_state->pt);
+
+    state->block_num = 0;
+    state->response = NULL;
+    blocking_state->process = PROCESS_CURRENT();
+
+    state->more = 0;
+    state->res_block = 0;
+    state->block_error = 0;
+
+    do
+    {
+        request->mid = coap_get_mid();
+        if ((state->transaction = coap_new_transaction(request->mid, remote_ep)))
+        {
+            state->transaction->callback = coap_blocking_request_callback;
+            state->transaction->callback_data = blocking_state;
+
+            if (state->block_num > 0)
+            {
+                coap_set_header_block2(request, state->block_num, 0, COAP_MAX_CHUNK_SIZE);
+            }
+            state->transaction->message_len = coap_serialize_message(request, state->transaction->message);
+
+            coap_send_transaction(state->transaction);
+
+            PT_YIELD_UNTIL(&blocking_state->pt, ev == PROCESS_EVENT_POLL);
+
+            if (!state->response)
+            {
+                // Server not responding: the handler is not called
+                PT_EXIT(&blocking_state->pt);
+            }
+
+            coap_get_header_block2(state->response, &state->res_block, &state->more, NULL, NULL);
+
+            if (state->res_block == state->block_num)
+            {
+                request_callback(state->response);
+                ++(state->block_num);
+            }
+            else
+            {
+                ++(state->block_error);
+            }
+        }
+        else
+        {
+            // Could not allocate a transaction
+            PT_EXIT(&blocking_state->pt);
+        }
+    } while (state->more && (state->block_error) < COAP_MAX_ATTEMPTS);
+
+    PT_END(&blocking_state->pt);
+}
+
+/*---------------------------------NETWORK---------------------------------*/
+
+struct sim_packet
+{
+    struct sim_timer timer;
+    struct sim_node *from;
+    struct sim_node *to;
+    uint16_t len;
+    uint8_t data[];
+};
+
+static void deliver(void *ptr)
+{
+    struct sim_packet *packet = ptr;
+
+    sim_current = packet->to;
+    sim_cpu_begin(packet->to);
+    coap_receive(packet->to, packet->from, packet->data, packet->len);
+    sim_cpu_end(packet->to);
+    free(packet);
+}
+
+static int route_hops(const struct sim_node *from, const struct sim_node *to)
+{
+    // Every route goes through the root, which is also where the server lives
+    if (strcmp(from->addr, SIM_ROOT_ADDR) == 0)
+        return to->hops;
+    if (strcmp(to->addr, SIM_ROOT_ADDR) == 0)
+        return from->hops;
+    // Along the line of motes, from one depth to the other
+    if (sim_config.rows_per_hop > 0)
+        return abs(from->hops - to->hops) > 0 ? abs(from->hops - to->hops) : 1;
+    return from->hops + to->hops;
+}
+
+static void trace_send(struct sim_node *from, struct sim_node *to, const uint8_t *data, uint16_t length)
+{
+    // Trace on a private copy: parsing rewrites repeated options in place
+    uint8_t copy[COAP_MAX_PACKET_SIZE + COAP_MAX_CHUNK_SIZE];
+    coap_message_t message[1];
+
+    if (length <= sizeof(copy))
+    {
+        memcpy(copy, data, length);
+        if (coap_parse_message(message, copy, length) == NO_ERROR)
+            sim_trace_send(from, to, message, from->retransmitting);
+    }
+}
+
+int coap_sendto(const coap_endpoint_t *ep, const uint8_t *data, uint16_t length)
+{
+    struct sim_node *from = sim_current;
+    struct sim_node *to = sim_node_by_addr(ep->addr);
+    sim_path_stats_t *path;
+    struct sim_packet *packet;
+    uint64_t delay_us = 0;
+    int hops;
+
+    if (to == NULL)
+    {
+        // No mote has the address (any more): the frame goes out and is never answered
+        sim_unreachable++;
+        trace_send(from, NULL, data, length);
+        from->tx_us += (uint64_t)(length + SIM_LOWPAN_OVERHEAD) * SIM_AIRTIME_US_PER_BYTE;
+        return length;
+    }
+
+    path = &sim_paths[from->id][to->id];
+    path->sent++;
+    path->bytes += length;
+    if (from->retransmitting)
+        path->retransmissions++;
+
+    packet = malloc(sizeof(struct sim_packet) + length);
+    if (packet == NULL)
+        return -1;
+    memset(&packet->timer, 0, sizeof(packet->timer));
+    packet->from = from;
+    packet->to = to;
+    packet->len = length;
+    memcpy(packet->data, data, length);
+
+    trace_send(from, to, data, length);
+
+    // The sender only pays for the first hop; forwarding is done by the routers
+    from->tx_us += (uint64_t)(length + SIM_LOWPAN_OVERHEAD) * SIM_AIRTIME_US_PER_BYTE;
+
+    hops = route_hops(from, to);
+    for (int hop = 0; hop < hops; hop++)
+    {
+        delay_us += sim_config.hop_latency_us + (uint64_t)(length + SIM_LOWPAN_OVERHEAD) * SIM_AIRTIME_US_PER_BYTE;
+        path->frames++;
+        if (sim_config.loss > 0 && sim_rand_unit() < sim_config.loss)
+        {
+            path->lost++;
+            free(packet);
+            return length;
+        }
+    }
+
+    sim_timer_set(&packet->timer, delay_us, deliver, packet);
+    return length;
+}
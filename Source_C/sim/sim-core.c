@@ -0,0 +1,640 @@
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "os/dev/leds.h"
+#include "os/dev/button-hal.h"
+#include "sys/energest.h"
+#include "lib/crc16.h"
+
+#undef printf
+
+struct sim_node sim_nodes[SIM_MAX_NODES];
+int sim_node_count = 0;
+struct sim_node *sim_current = NULL;
+
+struct process *process_current = NULL;
+
+process_event_t button_hal_press_event;
+process_event_t button_hal_release_event;
+
+/*-----------------------------CLOCK AND TIMERS-----------------------------*/
+
+static uint64_t now_us = 0;
+static uint64_t timer_seq = 0;
+static struct sim_timer *timer_queue = NULL;
+static int stopped = 0;
+
+uint64_t sim_now_us(void)
+{
+    return now_us;
+}
+
+clock_time_t clock_time(void)
+{
+    return (clock_time_t)(now_us / 1000);
+}
+
+unsigned long clock_seconds(void)
+{
+    return (unsigned long)(now_us / 1000000);
+}
+
+void sim_timer_stop(struct sim_timer *t)
+{
+    struct sim_timer **it;
+
+    if (!t->pending)
+        return;
+
+    for (it = &timer_queue; *it != NULL; it = &(*it)->next)
+    {
+        if (*it == t)
+        {
+            *it = t->next;
+            break;
+        }
+    }
+    t->pending = 0;
+}
+
+void sim_timer_set(struct sim_timer *t, uint64_t delay_us, void (*callback)(void *), void *ptr)
+{
+    struct sim_timer **it;
+
+    sim_timer_stop(t);
+
+    t->expiry_us = now_us + delay_us;
+    t->seq = timer_seq++;
+    t->callback = callback;
+    t->ptr = ptr;
+    t->node = sim_current;
+    t->pending = 1;
+
+    // Keep the queue sorted by expiry, ties in scheduling order
+    for (it = &timer_queue; *it != NULL; it = &(*it)->next)
+    {
+        if ((*it)->expiry_us > t->expiry_us)
+            break;
+    }
+    t->next = *it;
+    *it = t;
+}
+
+/*--------------------------------PROCESSES--------------------------------*/
+
+#define EVENT_QUEUE_SIZE 256
+
+struct event_entry
+{
+    struct sim_node *node;
+    struct process *p;
+    process_event_t ev;
+    process_data_t data;
+};
+
+static struct process *process_list = NULL;
+static struct event_entry events[EVENT_QUEUE_SIZE];
+static int fevent = 0, nevents = 0;
+static int poll_requested = 0;
+static process_event_t lastevent = PROCESS_EVENT_MAX;
+
+process_event_t process_alloc_event(void)
+{
+    return lastevent++;
+}
+
+static void exit_process(struct process *p, struct process *fromprocess);
+
+static void call_process(struct process *p, process_event_t ev, process_data_t data)
+{
+    struct process *saved_process = process_current;
+    struct sim_node *saved_node = sim_current;
+    int ret;
+
+    if (p->state != 1 || p->thread == NULL)
+        return;
+
+    process_current = p;
+    sim_current = p->node;
+    if (p->node != NULL)
+        sim_cpu_begin(p->node);
+    p->state = 2;
+    ret = p->thread(&p->pt, ev, data);
+    if (p->node != NULL)
+        sim_cpu_end(p->node);
+    if (ret == PT_EXITED || ret == PT_ENDED || ev == PROCESS_EVENT_EXIT)
+    {
+        exit_process(p, p);
+    }
+    else
+    {
+        p->state = 1;
+    }
+    process_current = saved_process;
+    sim_current = saved_node;
+}
+
+static void etimer_remove_process(struct process *p);
+
+static void exit_process(struct process *p, struct process *fromprocess)
+{
+    struct process **it;
+
+    if (!process_is_running(p))
+        return;
+
+    p->state = 0;
+    for (it = &process_list; *it != NULL; it = &(*it)->next)
+    {
+        if (*it == p)
+        {
+            *it = p->next;
+            break;
+        }
+    }
+    etimer_remove_process(p);
+}
+
+void process_start(struct process *p, process_data_t data)
+{
+    struct process *q;
+
+    for (q = process_list; q != NULL; q = q->next)
+    {
+        if (q == p)
+            return;
+    }
+
+    p->next = process_list;
+    process_list = p;
+    p->state = 1;
+    p->node = sim_current;
+    PT_INIT(&p->pt);
+
+    process_post_synch(p, PROCESS_EVENT_INIT, data);
+}
+
+void process_exit(struct process *p)
+{
+    exit_process(p, PROCESS_CURRENT());
+}
+
+int process_is_running(struct process *p)
+{
+    return p->state != 0;
+}
+
+int process_post(struct process *p, process_event_t ev, process_data_t data)
+{
+    struct event_entry *e;
+
+    if (nevents == EVENT_QUEUE_SIZE)
+        return PROCESS_ERR_FULL;
+
+    e = &events[(fevent + nevents) % EVENT_QUEUE_SIZE];
+    e->node = sim_current;
+    e->p = p;
+    e->ev = ev;
+    e->data = data;
+    nevents++;
+    return PROCESS_ERR_OK;
+}
+
+void process_post_synch(struct process *p, process_event_t ev, process_data_t data)
+{
+    call_process(p, ev, data);
+}
+
+void process_poll(struct process *p)
+{
+    if (p != NULL && p->state == 1)
+    {
+        p->needspoll = 1;
+        poll_requested = 1;
+    }
+}
+
+static void do_poll(void)
+{
+    struct process *p;
+
+    poll_requested = 0;
+    for (p = process_list; p != NULL; p = p->next)
+    {
+        if (p->needspoll)
+        {
+            p->needspoll = 0;
+            call_process(p, PROCESS_EVENT_POLL, NULL);
+        }
+    }
+}
+
+static void do_event(void)
+{
+    struct event_entry e = events[fevent];
+    struct process *p;
+
+    fevent = (fevent + 1) % EVENT_QUEUE_SIZE;
+    nevents--;
+
+    if (e.p == PROCESS_BROADCAST)
+    {
+        // Broadcasts stay on the node that posted them
+        for (p = process_list; p != NULL; p = p->next)
+        {
+            if (poll_requested)
+                do_poll();
+            if (p->node == e.node)
+                call_process(p, e.ev, e.data);
+        }
+    }
+    else
+    {
+        call_process(e.p, e.ev, e.data);
+    }
+}
+
+static int run_processes(void)
+{
+    int ran = 0;
+
+    while (poll_requested || nevents > 0)
+    {
+        if (poll_requested)
+            do_poll();
+        if (nevents > 0)
+            do_event();
+        ran = 1;
+    }
+    return ran;
+}
+
+/*---------------------------------ETIMERS---------------------------------*/
+
+static void etimer_fire(void *ptr)
+{
+    struct etimer *et = ptr;
+    struct process *p = et->p;
+
+    // As in Contiki, an expired etimer has no owner
+    et->p = PROCESS_NONE;
+    if (p != PROCESS_NONE)
+    {
+        sim_current = p->node;
+        process_post(p, PROCESS_EVENT_TIMER, et);
+    }
+}
+
+static void etimer_schedule(struct etimer *et)
+{
+    clock_time_t now = clock_time();
+    clock_time_t expiry = et->timer.start + et->timer.interval;
+    uint64_t delay_us = expiry > now ? (uint64_t)(expiry - now) * 1000 : 0;
+
+    et->p = PROCESS_CURRENT();
+    sim_timer_set(&et->sim, delay_us, etimer_fire, et);
+}
+
+void etimer_set(struct etimer *et, clock_time_t interval)
+{
+    et->timer.start = clock_time();
+    et->timer.interval = interval;
+    etimer_schedule(et);
+}
+
+void etimer_reset(struct etimer *et)
+{
+    et->timer.start += et->timer.interval;
+    etimer_schedule(et);
+}
+
+void etimer_restart(struct etimer *et)
+{
+    et->timer.start = clock_time();
+    etimer_schedule(et);
+}
+
+void etimer_stop(struct etimer *et)
+{
+    sim_timer_stop(&et->sim);
+    et->p = PROCESS_NONE;
+}
+
+int etimer_expired(struct etimer *et)
+{
+    return et->p == PROCESS_NONE;
+}
+
+clock_time_t etimer_expiration_time(struct etimer *et)
+{
+    return et->timer.start + et->timer.interval;
+}
+
+static void etimer_remove_process(struct process *p)
+{
+    struct sim_timer *t = timer_queue;
+
+    while (t != NULL)
+    {
+        struct sim_timer *next = t->next;
+        if (t->callback == etimer_fire && ((struct etimer *)t->ptr)->p == p)
+        {
+            etimer_stop((struct etimer *)t->ptr);
+        }
+        t = next;
+    }
+}
+
+/*-----------------------------RANDOM NUMBERS-----------------------------*/
+
+static uint64_t rng_state = 88172645463325252ULL;
+
+static uint64_t rng_next(void)
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+void sim_seed(uint32_t seed)
+{
+    rng_state = 0x9E3779B97F4A7C15ULL ^ seed;
+    if (rng_state == 0)
+        rng_state = 1;
+}
+
+double sim_rand_unit(void)
+{
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+void random_init(unsigned short seed)
+{
+    (void)seed;
+}
+
+unsigned short random_rand(void)
+{
+    return (unsigned short)(rng_next() >> 48);
+}
+
+// CRC-16 of os/lib/crc16.c
+unsigned short crc16_add(unsigned char b, unsigned short acc)
+{
+    acc ^= b;
+    acc = (acc >> 8) | (acc << 8);
+    acc ^= (acc & 0xff00) << 4;
+    acc ^= (acc >> 8) >> 4;
+    acc ^= (acc & 0xff00) >> 5;
+    return acc;
+}
+
+unsigned short crc16_data(const unsigned char *data, int len, unsigned short acc)
+{
+    for (int i = 0; i < len; i++)
+        acc = crc16_add(data[i], acc);
+    return acc;
+}
+
+/*------------------------------LEDS AND BUTTON------------------------------*/
+
+void leds_on(leds_mask_t leds)
+{
+    sim_current->leds |= leds;
+    sim_trace_leds(sim_current, leds);
+}
+
+void leds_off(leds_mask_t leds)
+{
+    sim_current->leds &= ~leds;
+}
+
+void leds_toggle(leds_mask_t leds)
+{
+    sim_current->leds ^= leds;
+}
+
+void leds_single_on(leds_num_t led)
+{
+    leds_on(led);
+}
+
+void leds_single_off(leds_num_t led)
+{
+    leds_off(led);
+}
+
+leds_mask_t leds_get(void)
+{
+    return sim_current->leds;
+}
+
+void button_hal_init(void)
+{
+}
+
+/*---------------------------------CONSOLE---------------------------------*/
+
+int sim_printf(const char *format, ...)
+{
+    va_list args;
+    int len;
+
+    if (!sim_config.verbose)
+        return 0;
+
+    fprintf(stdout, "[%10.3f] %-12s ", now_us / 1e6, sim_current ? sim_current->name : "sim");
+    va_start(args, format);
+    len = vfprintf(stdout, format, args);
+    va_end(args);
+    return len;
+}
+
+/*---------------------------------ENERGEST---------------------------------*/
+
+/*
+The CPU time of an event is charged as it runs rather than up front: nothing at the
+first flush in the event, which is where a handler switches to its phase (energy.h),
+and the rest at the next flush or when the event returns. The phase a handler runs
+in then gets the time, as on the motes.
+*/
+void sim_cpu_begin(struct sim_node *node)
+{
+    node->cpu_event_us += SIM_CPU_US_PER_EVENT;
+    node->cpu_flushed = 0;
+}
+
+void sim_cpu_end(struct sim_node *node)
+{
+    node->cpu_us += node->cpu_event_us;
+    node->cpu_event_us = 0;
+}
+
+void energest_flush(void)
+{
+    struct sim_node *node = sim_current;
+
+    if (node == NULL)
+        return;
+    if (node->cpu_flushed)
+        sim_cpu_end(node);
+    node->cpu_flushed = 1;
+}
+
+/*
+Time on minus time busy. A burst of frames adds TX airtime (and a burst of events CPU
+time) without advancing the virtual clock, so the difference can shrink for a while;
+the counter holds its last value until the clock catches up, as Energest never goes back.
+*/
+static uint64_t remaining_time(uint64_t *last, uint64_t on_us, uint64_t busy_us)
+{
+    if (on_us > busy_us && on_us - busy_us > *last)
+        *last = on_us - busy_us;
+    return *last;
+}
+
+uint64_t energest_type_time(energest_type_t type)
+{
+    struct sim_node *node = sim_current;
+    uint64_t on_us;
+
+    if (node == NULL)
+        return 0;
+
+    on_us = now_us - node->boot_us;
+    switch (type)
+    {
+    case ENERGEST_TYPE_CPU:
+        return node->cpu_us;
+    case ENERGEST_TYPE_LPM:
+        return remaining_time(&node->lpm_us, on_us, node->cpu_us);
+    case ENERGEST_TYPE_TRANSMIT:
+        return node->tx_us;
+    case ENERGEST_TYPE_LISTEN:
+        return remaining_time(&node->listen_us, on_us, node->tx_us);
+    default:
+        return 0;
+    }
+}
+
+/*----------------------------------NODES----------------------------------*/
+
+struct sim_node *sim_add_node(const char *name, const char *addr, int hops, struct process *const *autostart)
+{
+    struct sim_node *node;
+
+    if (sim_node_count == SIM_MAX_NODES)
+        return NULL;
+
+    node = &sim_nodes[sim_node_count];
+    memset(node, 0, sizeof(*node));
+    node->id = sim_node_count++;
+    node->name = name;
+    snprintf(node->addr, sizeof(node->addr), "%s", addr);
+    node->hops = hops;
+    node->autostart = autostart;
+    node->next_mid = random_rand();
+    return node;
+}
+
+struct sim_node *sim_node_by_addr(const char *addr)
+{
+    for (int i = 0; i < sim_node_count; i++)
+    {
+        if (strcmp(sim_nodes[i].addr, addr) == 0)
+            return &sim_nodes[i];
+    }
+    return NULL;
+}
+
+static void boot_node(void *ptr)
+{
+    struct sim_node *node = ptr;
+
+    sim_current = node;
+    node->boot_us = now_us;
+    for (struct process *const *p = node->autostart; p != NULL && *p != NULL; p++)
+    {
+        process_start(*p, NULL);
+    }
+}
+
+void sim_boot_node(struct sim_node *node)
+{
+    static struct sim_timer boot_timers[SIM_MAX_NODES];
+    uint64_t delay_us = 0;
+
+    // The root and the server are up before the motes; motes boot with some jitter
+    if (node->hops > 0 && sim_config.boot_jitter_ms > 0)
+        delay_us = (uint64_t)(sim_rand_unit() * sim_config.boot_jitter_ms * 1000);
+
+    sim_current = node;
+    sim_timer_set(&boot_timers[node->id], delay_us, boot_node, node);
+    sim_current = NULL;
+}
+
+void sim_reboot_node(struct sim_node *node, const char *addr)
+{
+    struct process *p, *next;
+
+    // A power cycle: the processes and the CoAP state are lost, the firmware's static data is not reset
+    for (p = process_list; p != NULL; p = next)
+    {
+        next = p->next;
+        if (p->node == node)
+            exit_process(p, p);
+    }
+    for (int i = 0; i < SIM_MAX_TRANSACTIONS; i++)
+        sim_timer_stop(&node->transactions[i].retrans_timer.sim);
+    memset(node->transaction_used, 0, sizeof(node->transaction_used));
+    memset(node->observers, 0, sizeof(node->observers));
+    memset(node->observee_used, 0, sizeof(node->observee_used));
+    node->resources = NULL;
+
+    if (addr != NULL)
+        snprintf(node->addr, sizeof(node->addr), "%s", addr);
+    boot_node(node);
+}
+
+/*---------------------------------MAIN LOOP---------------------------------*/
+
+void sim_stop(void)
+{
+    stopped = 1;
+}
+
+void sim_run(void)
+{
+    uint64_t limit_us = (uint64_t)(sim_config.max_hours * 3600e6);
+
+    button_hal_press_event = process_alloc_event();
+    button_hal_release_event = process_alloc_event();
+
+    while (!stopped)
+    {
+        struct sim_timer *t;
+
+        run_processes();
+        if (stopped || timer_queue == NULL)
+            break;
+
+        // Every process is idle: fast-forward to the next timer
+        t = timer_queue;
+        if (limit_us > 0 && t->expiry_us > limit_us)
+        {
+            now_us = limit_us;
+            break;
+        }
+        timer_queue = t->next;
+        t->pending = 0;
+        now_us = t->expiry_us;
+
+        sim_current = t->node;
+        process_current = NULL;
+        t->callback(t->ptr);
+        sim_current = NULL;
+    }
+}
@@ -0,0 +1,636 @@
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "sim.h"
+#include "sys/energest.h"
+#include "os/dev/leds.h"
+
+#undef printf
+
+/*
+Runs the SeedBot network on a simulated field and reports the throughput of the
+sowing pipeline. Usage: seedbot-sim [--rows N] [--cols N] [--loss P] ...
+*/
+
+// Autostart lists of the firmware images (see SIM_NODE_SYMBOL in the Makefile)
+extern struct process *const sim_node_actuator[];
+extern struct process *const sim_node_npk[];
+extern struct process *const sim_node_ph[];
+extern struct process *const sim_node_moisture[];
+extern struct process *const sim_node_temp[];
+extern struct process *const sim_node_npk2[];
+extern struct process *const sim_node_ph2[];
+extern struct process *const sim_node_moisture2[];
+extern struct process *const sim_node_temp2[];
+
+sim_config_t sim_config = {
+    .loss = 0.0,
+    .hop_latency_us = 2000,
+    .boot_jitter_ms = 1000,
+    .seed = 1,
+    .max_hours = 48,
+    .rows_per_hop = 0,
+    .verbose = 0};
+
+// Seed of the soil field the sensors read (utils/field.h)
+uint32_t sim_field_seed = 1;
+
+sim_path_stats_t sim_paths[SIM_MAX_NODES][SIM_MAX_NODES];
+uint64_t sim_unreachable = 0;
+
+static struct sim_node *server = NULL;
+static struct sim_node *actuator = NULL;
+static unsigned char is_sensor[SIM_MAX_NODES];
+
+// Sensor reads of the actuator, retransmissions aside, in all and by resource
+static unsigned long sensor_reads;
+static const char *sensor_paths[] = {"npk", "ph", "moisture", "temperature"};
+#define SENSOR_PATHS (sizeof(sensor_paths) / sizeof(sensor_paths[0]))
+static unsigned long sensor_path_reads[SENSOR_PATHS];
+static int base_hops = 1;
+static int sensor_sets = 1;
+static double surveyed = 0;
+static double push_model_hours = 0;
+
+// The NPK sensor reboots with another address, as when a mote is replaced
+#define RENUMBERED_ADDR "fd00::212:2:2:2"
+static double renumber_hours = 0;
+static struct sim_timer renumber_timer;
+
+/*------------------------------PHASE TRACING------------------------------*/
+
+/*
+A cell goes through three phases, traced from the actuator's traffic:
+sensing (first sensor GET to last sensor response), seeding + inference (up to the
+first /save POST) and reporting (up to the last /save response; with the record
+stream, to the last response to a streamed record or acknowledgement request).
+Only responses to a /save exchange of the cell count, matched by token, or by MID when
+the token is empty: a /discover answered while reporting is not part of it.
+A cell that reuses all its readings starts without a GET: its sensing phase is
+empty and it starts when the green LED of the seeder goes on.
+*/
+
+enum
+{
+    PHASE_SENSING,
+    PHASE_SEEDING,
+    PHASE_REPORTING,
+    PHASE_TOTAL,
+    PHASE_COUNT
+};
+
+static const char *phase_names[PHASE_COUNT] = {"sensing", "seeding+inference", "reporting", "cell total"};
+
+typedef struct
+{
+    double *samples;
+    int count;
+    int capacity;
+} sample_set_t;
+
+static sample_set_t phases[PHASE_COUNT];
+
+static struct
+{
+    int state; // -1 idle, otherwise the open phase
+    uint64_t sensing_start;
+    uint64_t last_sensor_response;
+    uint64_t first_save;
+    uint64_t last_save_response;
+} cell = {-1, 0, 0, 0, 0};
+
+// Tokens and MIDs of the /save requests of the open cell, the oldest overwritten past SAVE_TOKENS
+#define SAVE_TOKENS 16
+static struct
+{
+    uint16_t mid;
+    uint8_t len;
+    uint8_t token[COAP_TOKEN_LEN];
+} save_tokens[SAVE_TOKENS];
+static int save_token_count;
+
+static void add_save_token(const coap_message_t *message)
+{
+    int i = save_token_count++ % SAVE_TOKENS;
+
+    save_tokens[i].mid = message->mid;
+    save_tokens[i].len = message->token_len;
+    memcpy(save_tokens[i].token, message->token, message->token_len);
+}
+
+static int is_save_response(const coap_message_t *message)
+{
+    int count = save_token_count < SAVE_TOKENS ? save_token_count : SAVE_TOKENS;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (save_tokens[i].len == message->token_len && memcmp(save_tokens[i].token, message->token, message->token_len) == 0 &&
+            (message->token_len > 0 || save_tokens[i].mid == message->mid))
+            return 1;
+    }
+    return 0;
+}
+
+static void add_sample(sample_set_t *set, double value)
+{
+    if (set->count == set->capacity)
+    {
+        set->capacity = set->capacity ? set->capacity * 2 : 256;
+        set->samples = realloc(set->samples, set->capacity * sizeof(double));
+    }
+    set->samples[set->count++] = value;
+}
+
+static void close_cell(void)
+{
+    if (cell.state == PHASE_REPORTING && cell.last_save_response >= cell.first_save)
+    {
+        add_sample(&phases[PHASE_SENSING], (cell.last_sensor_response - cell.sensing_start) / 1000.0);
+        add_sample(&phases[PHASE_SEEDING], (cell.first_save - cell.last_sensor_response) / 1000.0);
+        add_sample(&phases[PHASE_REPORTING], (cell.last_save_response - cell.first_save) / 1000.0);
+        add_sample(&phases[PHASE_TOTAL], (cell.last_save_response - cell.sensing_start) / 1000.0);
+    }
+    cell.state = -1;
+}
+
+// /save or /save/stream
+static int is_save(const coap_message_t *message)
+{
+    return message->uri_path_len >= 4 && strncmp(message->uri_path, "save", 4) == 0 &&
+           (message->uri_path_len == 4 || message->uri_path[4] == '/');
+}
+
+void sim_trace_send(struct sim_node *from, struct sim_node *to, const coap_message_t *message, int retransmission)
+{
+    if (from != actuator || retransmission)
+        return;
+
+    // A GET to a vanished address is a sensor read too
+    if (message->code == COAP_GET && (to == NULL || is_sensor[to->id]))
+    {
+        sensor_reads++;
+        for (size_t i = 0; i < SENSOR_PATHS; i++)
+            if (message->uri_path_len == strlen(sensor_paths[i]) && strncmp(message->uri_path, sensor_paths[i], message->uri_path_len) == 0)
+                sensor_path_reads[i]++;
+    }
+
+    if (message->code == COAP_GET && (to == NULL || is_sensor[to->id]) && cell.state != PHASE_SENSING)
+    {
+        close_cell();
+        cell.state = PHASE_SENSING;
+        cell.sensing_start = sim_now_us();
+        cell.last_sensor_response = cell.sensing_start;
+    }
+    else if (message->code == COAP_POST && to == server && is_save(message) && cell.state == PHASE_SENSING)
+    {
+        cell.state = PHASE_REPORTING;
+        cell.first_save = sim_now_us();
+        cell.last_save_response = cell.first_save;
+        save_token_count = 0;
+        add_save_token(message);
+    }
+    else if (message->code == COAP_POST && to == server && is_save(message) && cell.state == PHASE_REPORTING)
+        add_save_token(message);
+}
+
+void sim_trace_deliver(struct sim_node *from, struct sim_node *to, const coap_message_t *message)
+{
+    if (to != actuator || message->code < CREATED_2_01)
+        return;
+
+    if (is_sensor[from->id] && cell.state == PHASE_SENSING)
+        cell.last_sensor_response = sim_now_us();
+    else if (from == server && cell.state == PHASE_REPORTING && is_save_response(message))
+        cell.last_save_response = sim_now_us();
+}
+
+void sim_trace_leds(struct sim_node *node, unsigned char on)
+{
+    if (node == actuator && (on & LEDS_GREEN) && cell.state != PHASE_SENSING)
+    {
+        close_cell();
+        cell.state = PHASE_SENSING;
+        cell.sensing_start = sim_now_us();
+        cell.last_sensor_response = cell.sensing_start;
+    }
+}
+
+void sim_trace_cell(int row, int col)
+{
+    // The actuator reports the cell it just left: on a line it goes deeper down the field
+    if (sim_config.rows_per_hop > 0)
+        actuator->hops = base_hops + row / sim_config.rows_per_hop;
+}
+
+/*---------------------------------REPORT---------------------------------*/
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const sample_set_t *set, int p)
+{
+    int index = set->count * p / 100;
+    if (index >= set->count)
+        index = set->count - 1;
+    return set->samples[index];
+}
+
+static void print_report(double wall_seconds, int rows, int cols)
+{
+    uint64_t end_us = sim_server_complete() ? sim_server_completed_us() : sim_now_us();
+    double elapsed_h = (end_us - sim_server_started_us()) / 3600e6;
+    double virtual_s = sim_now_us() / 1e6;
+
+    close_cell();
+
+    printf("SeedBot simulation: %dx%d field, loss %.3f/hop, hop latency %.1f ms, seed %u, field seed %u\n",
+           rows, cols, sim_config.loss, sim_config.hop_latency_us / 1000.0, sim_config.seed, sim_field_seed);
+    printf("Virtual time   : %.1f s (%.2f h) in %.3f s of wall time\n", virtual_s, virtual_s / 3600, wall_seconds);
+    printf("Sowing         : %s\n", sim_server_complete() ? "complete" : (sim_server_started_us() ? "incomplete (time limit)" : "never started"));
+    printf("Cells          : %d of %d distinct, %d records stored", sim_server_distinct_cells(), rows * cols, sim_server_records());
+    if (sim_server_records() > 0)
+        printf(", last one at %.2f h", sim_server_last_record_us() / 3600e6);
+    printf("\n");
+    if (sim_server_started_us() && elapsed_h > 0)
+    {
+        printf("Throughput     : %.2f cells/hour (%.2f records/hour) over %.2f h of sowing\n",
+               sim_server_distinct_cells() / elapsed_h, sim_server_records() / elapsed_h, elapsed_h);
+    }
+
+    printf("\n%-20s %6s %10s %10s %10s %10s %10s\n", "Phase latency (ms)", "n", "mean", "p50", "p90", "p99", "max");
+    for (int i = 0; i < PHASE_COUNT; i++)
+    {
+        sample_set_t *set = &phases[i];
+        double sum = 0;
+
+        if (set->count == 0)
+        {
+            printf("%-20s %6d\n", phase_names[i], 0);
+            continue;
+        }
+        qsort(set->samples, set->count, sizeof(double), compare_double);
+        for (int j = 0; j < set->count; j++)
+            sum += set->samples[j];
+        printf("%-20s %6d %10.1f %10.1f %10.1f %10.1f %10.1f\n", phase_names[i], set->count, sum / set->count,
+               percentile(set, 50), percentile(set, 90), percentile(set, 99), set->samples[set->count - 1]);
+    }
+
+    {
+        uint64_t frames = 0;
+
+        for (int i = 0; i < sim_node_count; i++)
+            for (int j = 0; j < sim_node_count; j++)
+                frames += sim_paths[i][j].frames;
+        printf("Radio load     : %llu frame transmissions over all hops\n", (unsigned long long)frames);
+    }
+    if (sim_server_records() > 0)
+    {
+        printf("Sensor reads   : %lu, %.2f per cell record (", sensor_reads, (double)sensor_reads / sim_server_records());
+        for (size_t i = 0; i < SENSOR_PATHS; i++)
+            printf("%s%s %.2f", i ? ", " : "", sensor_paths[i], (double)sensor_path_reads[i] / sim_server_records());
+        printf(")\n");
+    }
+    {
+        int sown, mismatches, revalidated;
+        int len = sim_server_coverage(&sown, &mismatches, &revalidated);
+
+        if (len >= 0)
+            printf("Coverage map   : %d cells sown in %d bytes, %d differ from the stored cells, %s\n", sown, len, mismatches,
+                   revalidated ? "ETag revalidated" : "ETag not revalidated");
+    }
+    if (surveyed > 0)
+        printf("Prescription   : %d of %d cells in the map, %d blocks served\n", sim_server_prescribed_cells(), rows * cols,
+               sim_server_prescription_blocks());
+    {
+        uint32_t version;
+        int blocks;
+        uint64_t pushed_us;
+        int len = sim_server_model(&version, &blocks, &pushed_us);
+
+        if (len >= 0)
+            printf("Model push     : %d bytes in %d of %d blocks at %.2f h, version %u %s\n", len, blocks,
+                   (len + COAP_MAX_CHUNK_SIZE - 1) / COAP_MAX_CHUNK_SIZE, pushed_us / 3600e6, (unsigned)version,
+                   version ? "accepted" : "not accepted");
+    }
+    if (sim_config.busy > 0)
+        printf("Busy server    : %d complete records answered 5.03, Max-Age 5 s\n", sim_server_busy_answers());
+    if (sensor_sets > 1)
+        printf("Sensor sets    : 2, zones from rows 0 and %d\n", SENSOR_SET2_ROW);
+    if (sim_config.rows_per_hop > 0)
+        printf("Topology       : line along the field, one hop every %d rows\n", sim_config.rows_per_hop);
+    if (renumber_hours > 0)
+        printf("Renumbering    : npk moved to %s at %.2f h, %llu frames sent to its old address\n",
+               RENUMBERED_ADDR, renumber_hours, (unsigned long long)sim_unreachable);
+
+    printf("\n%-26s %8s %8s %8s %6s %6s %8s\n", "Messages", "sent", "frames", "bytes", "lost", "retx", "timeouts");
+    for (int i = 0; i < sim_node_count; i++)
+    {
+        for (int j = 0; j < sim_node_count; j++)
+        {
+            sim_path_stats_t *path = &sim_paths[i][j];
+            char name[64];
+
+            if (path->sent == 0)
+                continue;
+            snprintf(name, sizeof(name), "%s -> %s", sim_nodes[i].name, sim_nodes[j].name);
+            printf("%-26s %8llu %8llu %8llu %6llu %6llu %8llu\n", name, (unsigned long long)path->sent,
+                   (unsigned long long)path->frames, (unsigned long long)path->bytes,
+                   (unsigned long long)path->lost, (unsigned long long)path->retransmissions, (unsigned long long)path->timeouts);
+        }
+    }
+}
+
+/*---------------------------------ENERGY---------------------------------*/
+
+// nRF52840 at 3 V with the DC/DC converter on, figures of the product specification
+#define SUPPLY_V 3.0
+#define CPU_MA 3.3   // CPU running from flash
+#define LPM_MA 0.003 // System ON, RTC running, RAM retained
+#define TX_MA 4.8    // Radio TX at 0 dBm
+#define RX_MA 4.6    // Radio RX (802.15.4)
+
+static const char *actuator_phases[] = {"idle", "sensing", "inference", "seeding", "reporting"};
+static const char *sensor_phases[] = {"idle", "request", "sampling"};
+
+static double millijoules(double cpu_s, double lpm_s, double tx_s, double rx_s)
+{
+    return SUPPLY_V * (CPU_MA * cpu_s + LPM_MA * lpm_s + TX_MA * tx_s + RX_MA * rx_s);
+}
+
+static uint64_t get_u64(const uint8_t *p)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Per-phase breakdown reported by a mote's energy resource (layout in utils/energy.h)
+static void print_energy_phases(struct sim_node *node)
+{
+    const uint8_t *snapshot;
+    int len = sim_server_energy(node, &snapshot);
+    const char **names = node == actuator ? actuator_phases : sensor_phases;
+    int names_count = node == actuator ? 5 : 3;
+    int phases, counters;
+    double second;
+    uint32_t units;
+
+    if (len < 12 || snapshot[0] != 1)
+    {
+        printf("%-12s (no energy snapshot)\n", node->name);
+        return;
+    }
+    phases = snapshot[1];
+    counters = snapshot[2];
+    second = get_u32(snapshot + 4);
+    units = get_u32(snapshot + 8);
+    if (counters != 4 || len < 12 + phases * counters * 8)
+        return;
+
+    for (int i = 0; i < phases; i++)
+    {
+        const uint8_t *p = snapshot + 12 + i * counters * 8;
+        double cpu = get_u64(p) / second, lpm = get_u64(p + 8) / second;
+        double tx = get_u64(p + 16) / second, rx = get_u64(p + 24) / second;
+        double mj = millijoules(cpu, lpm, tx, rx);
+        char name[64];
+
+        snprintf(name, sizeof(name), "%s %s", node->name, i < names_count ? names[i] : "?");
+        printf("%-26s %10.1f %10.1f %10.1f %8u %10.2f\n", name, cpu * 1000, tx * 1000, mj, units, units ? mj / units : 0.0);
+    }
+}
+
+static void print_energy(void)
+{
+    double network_mj = 0;
+    int cells = sim_server_distinct_cells();
+
+    printf("\n%-14s %10s %10s %10s %10s %10s %10s\n", "Energy", "cpu s", "lpm s", "tx ms", "rx s", "mJ", "mJ/cell");
+    for (int i = 0; i < sim_node_count; i++)
+    {
+        struct sim_node *node = &sim_nodes[i];
+        double cpu, lpm, tx, rx, mj;
+
+        // The root is mains powered
+        if (node->hops == 0)
+            continue;
+
+        sim_current = node;
+        cpu = energest_type_time(ENERGEST_TYPE_CPU) / (double)ENERGEST_SECOND;
+        lpm = energest_type_time(ENERGEST_TYPE_LPM) / (double)ENERGEST_SECOND;
+        tx = energest_type_time(ENERGEST_TYPE_TRANSMIT) / (double)ENERGEST_SECOND;
+        rx = energest_type_time(ENERGEST_TYPE_LISTEN) / (double)ENERGEST_SECOND;
+        sim_current = NULL;
+
+        mj = millijoules(cpu, lpm, tx, rx);
+        network_mj += mj;
+        printf("%-14s %10.2f %10.1f %10.1f %10.1f %10.1f %10.2f\n", node->name, cpu, lpm, tx * 1000, rx, mj, cells ? mj / cells : 0.0);
+    }
+    printf("%-14s %54.1f %10.2f\n", "motes", network_mj, cells ? network_mj / cells : 0.0);
+
+    printf("\n%-26s %10s %10s %10s %8s %10s\n", "Energy per phase", "cpu ms", "tx ms", "mJ", "units", "mJ/unit");
+    for (int i = 0; i < sim_node_count; i++)
+    {
+        if (sim_nodes[i].hops > 0)
+            print_energy_phases(&sim_nodes[i]);
+    }
+}
+
+/*----------------------------------MAIN----------------------------------*/
+
+static void renumber(void *ptr)
+{
+    sim_reboot_node(ptr, RENUMBERED_ADDR);
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --rows N          Rows of the field (default 10)\n"
+            "  --cols N          Columns of the field (default 10)\n"
+            "  --loss P          Frame loss probability per hop (default 0)\n"
+            "  --hop-latency MS  Forwarding delay per hop, airtime excluded (default 2)\n"
+            "  --hops N          Hops between each mote and the root (default 1)\n"
+            "  --seed N          Seed of the random generators (default 1)\n"
+            "  --field-seed N    Seed of the soil of the field (default 1)\n"
+            "  --field-grid FILE Write the soil of the field to FILE as a grid (utils/field.h) and exit\n"
+            "  --max-hours H     Virtual time limit (default 48)\n"
+            "  --renumber H      Reboot the NPK sensor with another address after H hours\n"
+            "  --sensor-sets N   Sets of the four sensors, 1 or 2 (default 1)\n"
+            "  --rows-per-hop K  String the motes along the field, one hop every K rows\n"
+            "  --surveyed P      Follow a prescription map with a seed type for a fraction P of the cells\n"
+            "  --push-model H    Push the model to the actuator over CoAP after H hours of sowing\n"
+            "  --busy P          Answer a complete /save record 5.03 with probability P (make SAVE_STREAM=0)\n"
+            "  --check-model     Check the compiled-in model against the classes of emlearn and exit\n"
+            "  --verbose         Print the firmware console output\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"rows", required_argument, NULL, 'r'},
+        {"cols", required_argument, NULL, 'c'},
+        {"loss", required_argument, NULL, 'l'},
+        {"hop-latency", required_argument, NULL, 'L'},
+        {"hops", required_argument, NULL, 'H'},
+        {"seed", required_argument, NULL, 's'},
+        {"field-seed", required_argument, NULL, 'F'},
+        {"field-grid", required_argument, NULL, 'G'},
+        {"max-hours", required_argument, NULL, 'm'},
+        {"renumber", required_argument, NULL, 'R'},
+        {"sensor-sets", required_argument, NULL, 'S'},
+        {"rows-per-hop", required_argument, NULL, 'K'},
+        {"surveyed", required_argument, NULL, 'P'},
+        {"push-model", required_argument, NULL, 'M'},
+        {"busy", required_argument, NULL, 'B'},
+        {"check-model", no_argument, NULL, 'C'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+    int rows = 10, cols = 10;
+    struct timespec wall_start, wall_end;
+    struct sim_node *sensors[8];
+    const char *field_grid = NULL;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "r:c:l:L:H:s:F:G:m:R:S:K:P:M:B:Cvh", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            rows = atoi(optarg);
+            break;
+        case 'c':
+            cols = atoi(optarg);
+            break;
+        case 'l':
+            sim_config.loss = atof(optarg);
+            break;
+        case 'L':
+            sim_config.hop_latency_us = (uint32_t)(atof(optarg) * 1000);
+            break;
+        case 'H':
+            base_hops = atoi(optarg);
+            break;
+        case 's':
+            sim_config.seed = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'F':
+            sim_field_seed = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'G':
+            field_grid = optarg;
+            break;
+        case 'm':
+            sim_config.max_hours = atof(optarg);
+            break;
+        case 'R':
+            renumber_hours = atof(optarg);
+            break;
+        case 'S':
+            sensor_sets = atoi(optarg);
+            break;
+        case 'K':
+            sim_config.rows_per_hop = atoi(optarg);
+            break;
+        case 'P':
+            surveyed = atof(optarg);
+            break;
+        case 'M':
+            push_model_hours = atof(optarg);
+            break;
+        case 'B':
+            sim_config.busy = atof(optarg);
+            break;
+        case 'C':
+        {
+            int checked, mismatches = sim_server_check_model(&checked);
+
+            printf("Model check    : %d readings, %d classified otherwise than by emlearn\n", checked, mismatches);
+            return mismatches ? 2 : 0;
+        }
+        case 'v':
+            sim_config.verbose = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (rows <= 0 || cols <= 0 || base_hops <= 0 || sim_config.loss < 0 || sim_config.loss >= 1 ||
+        sensor_sets < 1 || sensor_sets > 2 || sim_config.rows_per_hop < 0 || sim_config.busy < 0 || sim_config.busy >= 1 ||
+        surveyed < 0 || surveyed > 1 || push_model_hours < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (field_grid != NULL)
+    {
+        if (sim_field_write_grid(field_grid, rows, cols) != 0)
+        {
+            perror(field_grid);
+            return 1;
+        }
+        printf("Field grid     : %dx%d cells, field seed %u, written to %s\n", rows, cols, sim_field_seed, field_grid);
+        return 0;
+    }
+
+    sim_seed(sim_config.seed);
+
+    // Same addressing as the Cooja setup: the border router and the server share fd00::1
+    server = sim_add_node("server", SIM_ROOT_ADDR, 0, sim_server_processes);
+    sensors[0] = sim_add_node("npk", "fd00::202:2:2:2", base_hops, sim_node_npk);
+    sensors[1] = sim_add_node("ph", "fd00::203:3:3:3", base_hops, sim_node_ph);
+    sensors[2] = sim_add_node("moisture", "fd00::204:4:4:4", base_hops, sim_node_moisture);
+    sensors[3] = sim_add_node("temperature", "fd00::205:5:5:5", base_hops, sim_node_temp);
+    actuator = sim_add_node("actuator", "fd00::206:6:6:6", base_hops, sim_node_actuator);
+
+    if (sensor_sets > 1)
+    {
+        // Further down the field, so deeper on a line
+        int set2_hops = base_hops + (sim_config.rows_per_hop > 0 ? SENSOR_SET2_ROW / sim_config.rows_per_hop : 0);
+
+        sensors[4] = sim_add_node("npk@2", "fd00::207:7:7:7", set2_hops, sim_node_npk2);
+        sensors[5] = sim_add_node("ph@2", "fd00::208:8:8:8", set2_hops, sim_node_ph2);
+        sensors[6] = sim_add_node("moisture@2", "fd00::209:9:9:9", set2_hops, sim_node_moisture2);
+        sensors[7] = sim_add_node("temperature@2", "fd00::20a:a:a:a", set2_hops, sim_node_temp2);
+    }
+
+    for (int i = 0; i < 4 * sensor_sets; i++)
+        is_sensor[sensors[i]->id] = 1;
+
+    sim_server_init(server, rows, cols, surveyed);
+    if (push_model_hours > 0)
+        sim_server_push_model(push_model_hours);
+    for (int i = 0; i < sim_node_count; i++)
+        sim_boot_node(&sim_nodes[i]);
+
+    if (renumber_hours > 0)
+    {
+        sim_current = sensors[0];
+        sim_timer_set(&renumber_timer, (uint64_t)(renumber_hours * 3600e6), renumber, sensors[0]);
+        sim_current = NULL;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+    sim_run();
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+
+    print_report((wall_end.tv_sec - wall_start.tv_sec) + (wall_end.tv_nsec - wall_start.tv_nsec) / 1e9, rows, cols);
+    print_energy();
+    return sim_server_complete() ? 0 : 2;
+}
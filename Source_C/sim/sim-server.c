@@ -0,0 +1,998 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "sim.h"
+#include "coap-blocking-api.h"
+#include "stream.h"
+#include "prescription.h"
+#include "model.h"
+#include "field.h"
+#include "lib/crc16.h"
+#define SEED_CLASSIFIER_CHECK
+#include "DT_model.h"
+
+/*
+Stand-in for the backend: the /register, /discover, /registry, /save, /save/stream and
+/prescription resources of coap_server.py, and a controller process that does what the web app
+does when the user starts a field (observe the actuator status, POST the field configuration)
+and what model_push.py does when a new model is pushed.
+*/
+
+#define MAX_DEVICES SIM_MAX_NODES
+#define MAX_NAME_LENGTH 32
+#define ACTUATOR_NAME "sowing_actuator"
+#define ACTUATOR_URL "sowing_actuator"
+#define ACTUATOR_STATUS_URL "sowing_actuator/status"
+#define RETRY_INTERVAL (5 * CLOCK_SECOND)
+#define ENERGY_URL "energy"
+#define ENERGY_SNAPSHOT_MAX 256
+#define COVERAGE_URL "sowing_actuator/coverage"
+#define MODEL_URL "model"
+#define MODEL_PUSH_TRIES 4
+
+// Fragments a cell record is made of, as in coap_server.expected_keys
+#define KEY_HEADER (1 << 0) // row, col and field_id
+#define KEY_NPK (1 << 1)
+#define KEY_PH (1 << 2)
+#define KEY_MOISTURE (1 << 3)
+#define KEY_TEMP (1 << 4)
+#define KEY_SEED_TYPE (1 << 5)
+#define KEY_ALL 0x3F
+
+// Record stream (utils/stream.h): every entry is a sequence number and a cell record
+#define STREAM_ENTRY_SIZE (2 + CELL_RECORD_SIZE)
+#define CELL_RECORD_SIZE 20
+
+// Coverage map of the actuator (utils/actuator.h): header, then one bit per cell
+#define COVERAGE_HEADER_SIZE 9
+#define COVERAGE_MAX (COVERAGE_HEADER_SIZE + 64 * 64 / 8)
+
+// Prescription map of the field surveyed earlier, as PrescriptionResource: 5 bits per cell
+#define SURVEY_FIELD_ID 1
+#define PRESCRIPTION_BITS 5
+
+typedef struct
+{
+    char name[MAX_NAME_LENGTH];
+    char addr[SIM_ADDR_LEN];
+    int zone_row; // -1 without a zone
+    int zone_col;
+} device_t;
+
+typedef struct
+{
+    unsigned int keys;
+    int row;
+    int col;
+    int field_id;
+} partial_record_t;
+
+// Records of a streaming actuator: all before next stored, bit i of received for next + i
+typedef struct
+{
+    int open;
+    uint16_t session;
+    uint16_t next;
+    uint32_t received;
+} stream_state_t;
+
+static device_t devices[MAX_DEVICES];
+static int device_count = 0;
+
+// Registry version and the last device added or moved, as in RegistryResource
+static int registry_version = 0;
+static char registry_changed[MAX_NAME_LENGTH];
+
+// Partial records, one per reporting node
+static partial_record_t partial[SIM_MAX_NODES];
+static stream_state_t streams[SIM_MAX_NODES];
+
+static int field_rows = 0;
+static int field_cols = 0;
+static unsigned char *cells = NULL;
+static int records = 0;
+static int distinct_cells = 0;
+
+// Fraction of the cells with survey data, 0 without a survey
+static double surveyed = 0;
+static uint8_t *prescription = NULL;
+static int prescription_len = 0;
+static int prescribed_cells = 0;
+static int prescription_blocks = 0;
+
+// Compiled-in model of the actuator, pushed again in the upload format of utils/model.h
+#define PUSHED_MODEL_VERSION 1
+static uint64_t model_push_us = 0; // 0 without a push
+static uint8_t model_image[MODEL_MAX_SIZE];
+static int model_image_len = 0;
+static int model_blocks = 0;
+static int model_status = 0;
+static uint32_t model_reported = 0; // Version in use or pending, from GET /model
+static uint64_t model_pushed_us = 0;
+
+static int started = 0;
+static int rejected = 0;
+static int complete = 0;
+static uint64_t started_us = 0;
+static uint64_t completed_us = 0;
+static uint64_t last_record_us = 0;
+
+static const device_t *find_device(const char *name)
+{
+    for (int i = 0; i < device_count; i++)
+    {
+        if (strcmp(devices[i].name, name) == 0)
+            return &devices[i];
+    }
+    return NULL;
+}
+
+// "<type>@<instance>" or a bare type, as device_type_of() in device_registry.py
+static int is_of_type(const device_t *device, const char *type)
+{
+    size_t len = strcspn(device->name, "@");
+    return strlen(type) == len && strncmp(device->name, type, len) == 0;
+}
+
+// Distance from a zone to a cell; devices without a zone come last
+static int zone_distance(const device_t *device, int row, int col)
+{
+    if (device->zone_row < 0)
+        return 1 << 30;
+    return abs(device->zone_row - row) + abs(device->zone_col - col);
+}
+
+// The instances of a type closest to a cell, as DeviceRegistry.nearest()
+static int nearest_devices(const char *type, int row, int col, const device_t **found, int max)
+{
+    const device_t *sorted[MAX_DEVICES];
+    int count = 0;
+
+    for (int i = 0; i < device_count; i++)
+    {
+        const device_t *device = &devices[i];
+        int j;
+
+        if (!is_of_type(device, type))
+            continue;
+        // Insertion sort; ties in registration order (the server prefers the latest seen)
+        for (j = count++; j > 0 && zone_distance(sorted[j - 1], row, col) > zone_distance(device, row, col); j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = device;
+    }
+
+    if (count > max)
+        count = max;
+    memcpy(found, sorted, count * sizeof(sorted[0]));
+    return count;
+}
+
+/*-------------------------------REGISTRY-------------------------------*/
+
+static void registry_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+    int len = snprintf((char *)buffer, preferred_size, "{\"version\": %d, \"name\": \"%s\"}", registry_version, registry_changed);
+
+    coap_set_header_content_format(response, APPLICATION_JSON);
+    coap_set_status_code(response, CONTENT_2_05);
+    coap_set_payload(response, buffer, len);
+}
+
+EVENT_RESOURCE(res_registry, "title=\"Registry\";obs", registry_get_handler, NULL, NULL, NULL, NULL);
+
+/*-----------------------------REGISTRATION-----------------------------*/
+
+static void register_post_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+    const uint8_t *payload;
+    int len = coap_get_payload(request, &payload);
+    char text[2 * MAX_NAME_LENGTH];
+    char name[MAX_NAME_LENGTH];
+    int zone_row = -1, zone_col = 0;
+    device_t *device;
+
+    if (len <= 0 || len >= sizeof(text))
+    {
+        coap_set_status_code(response, BAD_REQUEST_4_00);
+        return;
+    }
+    memcpy(text, payload, len);
+    text[len] = '\0';
+
+    // A bare name, or the name and zone of an instance (registration.h)
+    if (text[0] == '{')
+    {
+        if (sscanf(text, "{\"name\": \"%31[^\"]\", \"row\": %d, \"col\": %d}", name, &zone_row, &zone_col) != 3)
+        {
+            coap_set_status_code(response, BAD_REQUEST_4_00);
+            return;
+        }
+    }
+    else if (len < MAX_NAME_LENGTH)
+    {
+        memcpy(name, text, len + 1);
+    }
+    else
+    {
+        coap_set_status_code(response, BAD_REQUEST_4_00);
+        return;
+    }
+
+    device = (device_t *)find_device(name);
+    if (device == NULL && device_count < MAX_DEVICES)
+    {
+        device = &devices[device_count++];
+        snprintf(device->name, sizeof(device->name), "%s", name);
+        coap_set_status_code(response, CREATED_2_01);
+    }
+    else if (device != NULL)
+    {
+        coap_set_status_code(response, CHANGED_2_04);
+    }
+    else
+    {
+        coap_set_status_code(response, SERVICE_UNAVAILABLE_5_03);
+        return;
+    }
+    if (strcmp(device->addr, request->src_ep->addr) != 0 || device->zone_row != zone_row || device->zone_col != zone_col)
+    {
+        snprintf(device->addr, sizeof(device->addr), "%s", request->src_ep->addr);
+        device->zone_row = zone_row;
+        device->zone_col = zone_col;
+        registry_version++;
+        snprintf(registry_changed, sizeof(registry_changed), "%s", name);
+        coap_notify_observers(&res_registry);
+    }
+
+    len = snprintf((char *)buffer, preferred_size, "Device '%s' registered.", name);
+    coap_set_header_content_format(response, TEXT_PLAIN);
+    coap_set_payload(response, buffer, len);
+}
+
+RESOURCE(res_register, "title=\"Register\"", NULL, register_post_handler, NULL, NULL);
+
+/*-------------------------------DISCOVERY-------------------------------*/
+
+static void discover_post_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+    const uint8_t *payload;
+    char name[MAX_NAME_LENGTH];
+    const device_t *found[2];
+    int row, col, count;
+    int len;
+
+    coap_set_header_content_format(response, APPLICATION_JSON);
+
+    if (coap_get_payload(request, &payload) <= 0 || sscanf((const char *)payload, "{\"name\": \"%31[^\"]\"", name) != 1)
+    {
+        len = snprintf((char *)buffer, preferred_size, "{\"error\": \"Device name is required\"}");
+        coap_set_status_code(response, BAD_REQUEST_4_00);
+        coap_set_payload(response, buffer, len);
+        return;
+    }
+
+    // With the position of the actuator, the two closest instances of the type;
+    // otherwise the device of that name, or the first instance of the type
+    if (sscanf((const char *)payload, "{\"name\": \"%*[^\"]\", \"row\": %d, \"col\": %d}", &row, &col) == 2)
+        count = nearest_devices(name, row, col, found, 2);
+    else if ((found[0] = find_device(name)) != NULL)
+        count = 1;
+    else
+        count = nearest_devices(name, 0, 0, found, 1);
+
+    if (count == 0)
+    {
+        len = snprintf((char *)buffer, preferred_size, "{\"error\": \"Device not found\"}");
+        coap_set_status_code(response, NOT_FOUND_4_04);
+    }
+    else if (count == 1)
+    {
+        // Same layout as json.dumps() in coap_server.py
+        len = snprintf((char *)buffer, preferred_size, "{\"%s\": \"%s\"}", name, found[0]->addr);
+        coap_set_status_code(response, CONTENT_2_05);
+    }
+    else
+    {
+        len = snprintf((char *)buffer, preferred_size, "{\"%s\": \"%s\", \"alt\": \"%s\"}", name, found[0]->addr, found[1]->addr);
+        coap_set_status_code(response, CONTENT_2_05);
+    }
+    coap_set_payload(response, buffer, len);
+}
+
+RESOURCE(res_discover, "title=\"Discover\"", NULL, discover_post_handler, NULL, NULL);
+
+/*---------------------------------SAVE---------------------------------*/
+
+// Max-Age of a 5.03 of /save, RETRY_AFTER of coap_server.py
+#define BUSY_RETRY_AFTER 5
+static int busy_answers = 0;
+
+// Count a complete cell record, return 1 for a cell not stored before
+static int store_cell(int row, int col)
+{
+    records++;
+    last_record_us = sim_now_us();
+    sim_trace_cell(row, col);
+    if (row < 0 || row >= field_rows || col < 0 || col >= field_cols || cells[row * field_cols + col])
+        return 0;
+    cells[row * field_cols + col] = 1;
+    distinct_cells++;
+    return 1;
+}
+
+static void save_post_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+    const uint8_t *payload;
+    const char *text;
+    struct sim_node *source = sim_node_by_addr(request->src_ep->addr);
+    partial_record_t *record;
+    const char *message;
+    int row, col, field_id;
+
+    coap_set_header_content_format(response, TEXT_PLAIN);
+
+    if (source == NULL || coap_get_payload(request, &payload) <= 0)
+    {
+        coap_set_status_code(response, BAD_REQUEST_4_00);
+        coap_set_payload(response, "No payload received", strlen("No payload received"));
+        return;
+    }
+    text = (const char *)payload;
+    record = &partial[source->id];
+
+    if (sscanf(text, "{\"row\":%d, \"col\":%d, \"field_id\":%d}", &row, &col, &field_id) == 3)
+    {
+        // A header for another cell starts a new record
+        if ((record->keys & KEY_HEADER) && (record->row != row || record->col != col || record->field_id != field_id))
+            record->keys = 0;
+        record->row = row;
+        record->col = col;
+        record->field_id = field_id;
+        record->keys |= KEY_HEADER;
+    }
+    else if (strstr(text, "\"npk\"") != NULL)
+        record->keys |= KEY_NPK;
+    else if (strstr(text, "\"moisture\"") != NULL)
+        record->keys |= KEY_MOISTURE;
+    else if (strstr(text, "\"temp\"") != NULL)
+        record->keys |= KEY_TEMP;
+    else if (strstr(text, "\"ph\"") != NULL)
+        record->keys |= KEY_PH;
+    else if (strstr(text, "\"seed_type\"") != NULL)
+        record->keys |= KEY_SEED_TYPE;
+    else
+    {
+        coap_set_status_code(response, BAD_REQUEST_4_00);
+        coap_set_payload(response, "Invalid JSON payload", strlen("Invalid JSON payload"));
+        return;
+    }
+
+    if (record->keys != KEY_ALL)
+    {
+        message = "Data received, waiting for more.";
+        coap_set_status_code(response, VALID_2_03);
+    }
+    else if (sim_config.busy > 0 && sim_rand_unit() < sim_config.busy)
+    {
+        // The DB pool is full: the record is kept for the fragment sent again, as ReassemblyBuffer.restore()
+        busy_answers++;
+        message = "Server busy, retry later";
+        coap_set_status_code(response, SERVICE_UNAVAILABLE_5_03);
+        coap_set_header_max_age(response, BUSY_RETRY_AFTER);
+    }
+    else
+    {
+        record->keys = 0;
+        if (store_cell(record->row, record->col))
+        {
+            message = "New cell added";
+            coap_set_status_code(response, CREATED_2_01);
+        }
+        else
+        {
+            message = "Cell updated";
+            coap_set_status_code(response, CHANGED_2_04);
+        }
+    }
+    coap_set_payload(response, message, strlen(message));
+}
+
+RESOURCE(res_save, "title=\"Save\"", NULL, save_post_handler, NULL, NULL);
+
+/*------------------------------SAVE STREAM------------------------------*/
+
+// Release the records received in a row at the start of the window
+static void stream_advance(stream_state_t *stream)
+{
+    while (stream->received & 1)
+    {
+        stream->received >>= 1;
+        stream->next++;
+    }
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t value)
+{
+    return put_u16(put_u16(p, value >> 16), value & 0xFFFF);
+}
+
+// Layouts in utils/stream.h and actuator.h, as in record_stream.py
+static void save_stream_post_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+    const uint8_t *payload;
+    struct sim_node *source = sim_node_by_addr(request->src_ep->addr);
+    stream_state_t *stream;
+    uint16_t session, base;
+    int len = coap_get_payload(request, &payload);
+    int count;
+    uint8_t *p = buffer;
+
+    if (source == NULL || len < STREAM_HEADER_SIZE || payload[0] != STREAM_VERSION ||
+        len < STREAM_HEADER_SIZE + payload[1] * STREAM_ENTRY_SIZE)
+    {
+        coap_set_status_code(response, BAD_REQUEST_4_00);
+        return;
+    }
+    count = payload[1];
+    session = get_u16(payload + 2);
+    base = get_u16(payload + 4);
+    stream = &streams[source->id];
+
+    // A new session is a restarted actuator
+    if (!stream->open || stream->session != session)
+    {
+        stream->open = 1;
+        stream->session = session;
+        stream->next = base;
+        stream->received = 0;
+    }
+
+    // The actuator no longer has the records before base
+    while ((int16_t)(stream->next - base) < 0)
+    {
+        stream->received >>= 1;
+        stream->next++;
+    }
+    stream_advance(stream);
+
+    for (int i = 0; i < count; i++)
+    {
+        const uint8_t *entry = payload + STREAM_HEADER_SIZE + i * STREAM_ENTRY_SIZE;
+        uint16_t offset = get_u16(entry) - stream->next;
+
+        // Already stored, or beyond the window: the actuator sends it again
+        if ((int16_t)offset < 0 || offset >= 32 || (stream->received >> offset) & 1)
+            continue;
+        stream->received |= 1UL << offset;
+        store_cell(get_u16(entry + 4), get_u16(entry + 6));
+    }
+    stream_advance(stream);
+
+    *p++ = STREAM_VERSION;
+    *p++ = 0;
+    p = put_u16(p, stream->session);
+    p = put_u16(p, stream->next);
+    p = put_u16(p, stream->received >> 16);
+    p = put_u16(p, stream->received & 0xFFFF);
+    coap_set_status_code(response, CHANGED_2_04);
+    coap_set_header_content_format(response, APPLICATION_OCTET_STREAM);
+    coap_set_payload(response, buffer, p - buffer);
+}
+
+RESOURCE(res_save_stream, "title=\"Save Stream\"", NULL, save_stream_post_handler, NULL, NULL);
+
+/*------------------------------PRESCRIPTION-----------------------------*/
+
+// Survey the field and evaluate the model on every surveyed cell, as build_prescription()
+static void prescription_build(void)
+{
+    int bit = PRESCRIPTION_HEADER_SIZE * 8;
+
+    prescription_len = PRESCRIPTION_HEADER_SIZE + (field_rows * field_cols * PRESCRIPTION_BITS + 7) / 8;
+    prescription = calloc(prescription_len, 1);
+    prescription[0] = PRESCRIPTION_VERSION;
+    prescription[1] = PRESCRIPTION_BITS;
+    put_u16(put_u16(prescription + 2, field_rows), field_cols);
+
+    for (int cell = 0; cell < field_rows * field_cols; cell++)
+    {
+        int value = PRESCRIPTION_NONE(PRESCRIPTION_BITS);
+
+        if (sim_rand_unit() < surveyed)
+        {
+            // The soil the sensors read at the cell (field.h); the last feature has no sensor
+            int16_t features[7] = {0};
+
+            for (int q = 0; q < FIELD_QUANTITIES; q++)
+                features[q] = field_value(q, cell / field_cols, cell % field_cols);
+            value = seed_classifier_predict(features, 7);
+            prescribed_cells++;
+        }
+        for (int i = PRESCRIPTION_BITS - 1; i >= 0; i--, bit++)
+        {
+            if ((value >> i) & 1)
+                prescription[bit / 8] |= 0x80 >> (bit % 8);
+        }
+    }
+}
+
+static void prescription_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+    const char *field;
+    int32_t start = offset != NULL ? *offset : 0;
+    int len = coap_get_query_variable(request, "field", &field);
+
+    if (prescription == NULL || len <= 0 || atoi(field) != SURVEY_FIELD_ID)
+    {
+        coap_set_status_code(response, NOT_FOUND_4_04);
+        coap_set_payload(response, "No survey of the field", strlen("No survey of the field"));
+        return;
+    }
+    if (start >= prescription_len)
+    {
+        coap_set_status_code(response, BAD_OPTION_4_02);
+        coap_set_payload(response, "BlockOutOfScope", strlen("BlockOutOfScope"));
+        return;
+    }
+
+    len = prescription_len - start < preferred_size ? prescription_len - start : preferred_size;
+    memcpy(buffer, prescription + start, len);
+    coap_set_header_content_format(response, APPLICATION_OCTET_STREAM);
+    coap_set_payload(response, buffer, len);
+    if (offset != NULL)
+        *offset = start + len < prescription_len ? start + len : -1;
+    prescription_blocks++;
+}
+
+RESOURCE(res_prescription, "title=\"Prescription\"", prescription_get_handler, NULL, NULL, NULL);
+
+/*--------------------------------MODEL---------------------------------*/
+
+// Image of the compiled-in model, as model_push.py builds it from DT_model.h: leaf i holds class i
+static void model_build(void)
+{
+    uint8_t *p = model_image;
+    model_node_t node;
+
+    *p++ = MODEL_FORMAT;
+    *p++ = seed_classifier.n_features;
+    *p++ = seed_classifier.n_classes;
+    *p++ = seed_classifier.n_trees;
+    p = put_u16(p, seed_classifier.n_nodes);
+    p = put_u16(p, seed_classifier.n_classes);
+    p = put_u32(p, PUSHED_MODEL_VERSION);
+    for (int i = 0; i < seed_classifier.n_trees; i++)
+        p = put_u16(p, seed_classifier.roots[i]);
+    for (int i = 0; i < seed_classifier.n_nodes; i++)
+    {
+        packed_trees_node(&seed_classifier, i, &node);
+        *p++ = node.feature;
+        p = put_u16(p, node.threshold);
+        p = put_u16(p, node.left);
+        p = put_u16(p, node.right);
+    }
+    for (int i = 0; i < seed_classifier.n_classes; i++)
+        *p++ = i;
+    p = put_u16(p, crc16_data(model_image, p - model_image, 0));
+    model_image_len = p - model_image;
+}
+
+/*------------------------------CONTROLLER------------------------------*/
+
+static coap_observee_t *status_observee = NULL;
+
+// Energy snapshots read from the motes once the field is done
+static uint8_t energy_snapshots[SIM_MAX_NODES][ENERGY_SNAPSHOT_MAX];
+static int energy_lengths[SIM_MAX_NODES];
+static struct sim_node *energy_source = NULL;
+
+// Coverage map read from the actuator once the field is done, then validated with its ETag
+static uint8_t coverage[COVERAGE_MAX];
+static int coverage_len = 0;
+static uint8_t coverage_etag[COAP_ETAG_LEN];
+static int coverage_etag_len = 0;
+static int coverage_valid = 0;
+
+PROCESS(controller_process, "Controller");
+PROCESS(server_process, "Server");
+
+static void status_notification_callback(coap_observee_t *observee, void *notification, coap_notification_flag_t flag)
+{
+    const uint8_t *payload;
+    int is_complete = 0, is_active = 0;
+
+    if (flag != OBSERVE_OK && flag != NOTIFICATION_OK)
+    {
+        status_observee = NULL;
+        return;
+    }
+    if (coap_get_payload(notification, &payload) <= 0)
+        return;
+
+    if (sscanf((const char *)payload, "{\"complete\": %d, \"active\": %d}", &is_complete, &is_active) == 2 && is_complete && started && !complete)
+    {
+        complete = 1;
+        completed_us = sim_now_us();
+        process_poll(&controller_process);
+    }
+}
+
+static void energy_response_handler(coap_message_t *response)
+{
+    const uint8_t *payload;
+    int len = coap_get_payload(response, &payload);
+    int *total = &energy_lengths[energy_source->id];
+
+    // Called once per block
+    if (response->code == CONTENT_2_05 && len > 0 && *total + len <= ENERGY_SNAPSHOT_MAX)
+    {
+        memcpy(energy_snapshots[energy_source->id] + *total, payload, len);
+        *total += len;
+    }
+}
+
+static void coverage_response_handler(coap_message_t *response)
+{
+    const uint8_t *payload;
+    const uint8_t *etag;
+    int len = coap_get_payload(response, &payload);
+
+    if (response->code == VALID_2_03)
+    {
+        coverage_valid = 1;
+        return;
+    }
+    // Called once per block; the ETag of the first one is kept
+    if (response->code == CONTENT_2_05 && len > 0 && coverage_len + len <= COVERAGE_MAX)
+    {
+        if (coverage_len == 0)
+            coverage_etag_len = coap_get_header_etag(response, &etag);
+        if (coverage_len == 0 && coverage_etag_len > 0)
+            memcpy(coverage_etag, etag, coverage_etag_len);
+        memcpy(coverage + coverage_len, payload, len);
+        coverage_len += len;
+    }
+}
+
+static void model_put_response_handler(coap_message_t *response)
+{
+    model_status = response->code;
+}
+
+static void model_get_response_handler(coap_message_t *response)
+{
+    const uint8_t *payload;
+    unsigned int version = 0, pending = 0;
+
+    if (response->code == CONTENT_2_05 && coap_get_payload(response, &payload) > 0 &&
+        sscanf((const char *)payload, "{\"version\": %u, \"pending\": %u}", &version, &pending) == 2)
+        model_reported = pending ? pending : version;
+}
+
+static void start_response_handler(coap_message_t *response)
+{
+    if (response->code == CHANGED_2_04)
+    {
+        started = 1;
+        started_us = sim_now_us();
+    }
+    else if (response->code == REQUEST_ENTITY_TOO_LARGE_4_13)
+    {
+        // Larger than the coverage map of the actuator: retrying will not help
+        rejected = 1;
+    }
+}
+
+struct process *const sim_server_processes[] = {&server_process, &controller_process, NULL};
+
+PROCESS_THREAD(server_process, ev, data)
+{
+    PROCESS_BEGIN();
+
+    coap_activate_resource(&res_register, "register");
+    coap_activate_resource(&res_discover, "discover");
+    coap_activate_resource(&res_registry, "registry");
+    coap_activate_resource(&res_save, "save");
+    coap_activate_resource(&res_save_stream, "save/stream");
+    coap_activate_resource(&res_prescription, "prescription");
+
+    PROCESS_END();
+}
+
+PROCESS_THREAD(controller_process, ev, data)
+{
+    static struct etimer timer;
+    static coap_endpoint_t actuator_ep;
+    static coap_endpoint_t device_ep;
+    static int device;
+    static coap_message_t request[1];
+    static char payload[MAX_NAME_LENGTH * 4];
+    static char uri[SIM_ADDR_LEN + 16];
+    static int model_offset;
+    static int model_tries;
+    static int model_len;
+    const device_t *actuator;
+
+    PROCESS_BEGIN();
+
+    // The web app only offers to start a field once the actuator is registered
+    while ((actuator = find_device(ACTUATOR_NAME)) == NULL)
+    {
+        etimer_set(&timer, CLOCK_SECOND);
+        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+    }
+    snprintf(uri, sizeof(uri), "coap://[%s]:5683", actuator->addr);
+    coap_endpoint_parse(uri, strlen(uri), &actuator_ep);
+
+    while (!started && !rejected)
+    {
+        if (status_observee == NULL)
+            status_observee = coap_obs_request_registration(&actuator_ep, ACTUATOR_STATUS_URL, status_notification_callback, NULL);
+
+        coap_init_message(request, COAP_TYPE_CON, COAP_POST, 0);
+        coap_set_header_uri_path(request, ACTUATOR_URL);
+        coap_set_header_content_format(request, APPLICATION_JSON);
+        // Without spaces, as app.py: the request must fit in one COAP_MAX_CHUNK_SIZE payload
+        if (prescription != NULL)
+            snprintf(payload, sizeof(payload), "{\"length\":%d,\"width\":%d,\"square_size\":1,\"field_id\":1,\"survey\":%d}",
+                     field_rows, field_cols, SURVEY_FIELD_ID);
+        else
+            snprintf(payload, sizeof(payload), "{\"length\":%d,\"width\":%d,\"square_size\":1,\"field_id\":1}", field_rows, field_cols);
+        coap_set_payload(request, (uint8_t *)payload, strlen(payload));
+        COAP_BLOCKING_REQUEST(&actuator_ep, request, start_response_handler);
+
+        if (!started && !rejected)
+        {
+            etimer_set(&timer, RETRY_INTERVAL);
+            PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+        }
+    }
+
+    if (rejected)
+    {
+        fprintf(stderr, "The actuator rejected a %dx%d field (too large)\n", field_rows, field_cols);
+        sim_stop();
+        PROCESS_EXIT();
+    }
+
+    // Keep the status observation alive until the field is done
+    while (!complete)
+    {
+        etimer_set(&timer, 60 * CLOCK_SECOND);
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL || etimer_expired(&timer));
+        if (!complete && status_observee == NULL)
+            status_observee = coap_obs_request_registration(&actuator_ep, ACTUATOR_STATUS_URL, status_notification_callback, NULL);
+
+        if (!complete && model_push_us > 0 && model_pushed_us == 0 && sim_now_us() - started_us >= model_push_us)
+        {
+            // Push the model one block at a time; a block without an answer is sent again
+            model_pushed_us = sim_now_us();
+            for (model_offset = 0, model_tries = 0; model_offset < model_image_len && model_tries < MODEL_PUSH_TRIES;)
+            {
+                model_len = model_image_len - model_offset < COAP_MAX_CHUNK_SIZE ? model_image_len - model_offset : COAP_MAX_CHUNK_SIZE;
+                coap_init_message(request, COAP_TYPE_CON, COAP_PUT, 0);
+                coap_set_header_uri_path(request, MODEL_URL);
+                coap_set_header_content_format(request, APPLICATION_OCTET_STREAM);
+                coap_set_header_block1(request, model_offset / COAP_MAX_CHUNK_SIZE, model_offset + model_len < model_image_len, COAP_MAX_CHUNK_SIZE);
+                coap_set_payload(request, model_image + model_offset, model_len);
+                model_status = 0;
+                COAP_BLOCKING_REQUEST(&actuator_ep, request, model_put_response_handler);
+
+                if (model_status == CONTINUE_2_31 || model_status == CHANGED_2_04)
+                {
+                    model_offset += model_len;
+                    model_blocks++;
+                    model_tries = 0;
+                }
+                else if (model_status != 0)
+                    break;
+                else
+                    model_tries++;
+            }
+            coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+            coap_set_header_uri_path(request, MODEL_URL);
+            COAP_BLOCKING_REQUEST(&actuator_ep, request, model_get_response_handler);
+        }
+    }
+    etimer_stop(&timer);
+
+    // Read the coverage map of the actuator, then ask again with its ETag: nothing changed
+    coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+    coap_set_header_uri_path(request, COVERAGE_URL);
+    COAP_BLOCKING_REQUEST(&actuator_ep, request, coverage_response_handler);
+    if (coverage_etag_len > 0)
+    {
+        coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+        coap_set_header_uri_path(request, COVERAGE_URL);
+        coap_set_header_etag(request, coverage_etag, coverage_etag_len);
+        COAP_BLOCKING_REQUEST(&actuator_ep, request, coverage_response_handler);
+    }
+
+    // Read the energy accounting of every mote
+    for (device = 0; device < device_count; device++)
+    {
+        if ((energy_source = sim_node_by_addr(devices[device].addr)) == NULL)
+            continue;
+        snprintf(uri, sizeof(uri), "coap://[%s]:5683", devices[device].addr);
+        coap_endpoint_parse(uri, strlen(uri), &device_ep);
+        coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+        coap_set_header_uri_path(request, ENERGY_URL);
+        energy_lengths[energy_source->id] = 0;
+        COAP_BLOCKING_REQUEST(&device_ep, request, energy_response_handler);
+    }
+
+    sim_stop();
+    PROCESS_END();
+}
+
+/*--------------------------------------------------------------------*/
+
+void sim_server_init(struct sim_node *node, int rows, int cols, double surveyed_cells)
+{
+    node->dedup = 1;
+    field_rows = rows;
+    field_cols = cols;
+    cells = calloc((size_t)rows * cols, 1);
+    surveyed = surveyed_cells;
+    if (surveyed > 0)
+        prescription_build();
+}
+
+int sim_server_check_model(int *checked)
+{
+    int mismatches = 0;
+
+    // The packed trees against the classes model_pack.py took from emlearn
+    *checked = SEED_CLASSIFIER_CHECKS;
+    for (int i = 0; i < SEED_CLASSIFIER_CHECKS; i++)
+    {
+        int seed = seed_classifier_predict(seed_classifier_check_features[i], seed_classifier.n_features);
+
+        if (seed != seed_classifier_check_classes[i])
+        {
+            fprintf(stderr, "Check %d: class %d, emlearn gives %d\n", i, seed, seed_classifier_check_classes[i]);
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+void sim_server_push_model(double hours)
+{
+    model_push_us = (uint64_t)(hours * 3600e6);
+    model_build();
+}
+
+int sim_server_model(uint32_t *version, int *blocks, uint64_t *pushed_us)
+{
+    if (model_pushed_us == 0)
+        return -1;
+    *version = model_reported;
+    *blocks = model_blocks;
+    *pushed_us = model_pushed_us;
+    return model_image_len;
+}
+
+int sim_server_records(void)
+{
+    return records;
+}
+
+int sim_server_distinct_cells(void)
+{
+    return distinct_cells;
+}
+
+int sim_server_complete(void)
+{
+    return complete;
+}
+
+uint64_t sim_server_started_us(void)
+{
+    return started_us;
+}
+
+uint64_t sim_server_completed_us(void)
+{
+    return completed_us;
+}
+
+uint64_t sim_server_last_record_us(void)
+{
+    return last_record_us;
+}
+
+int sim_server_coverage(int *sown, int *mismatches, int *revalidated)
+{
+    int rows, cols;
+
+    if (coverage_len < COVERAGE_HEADER_SIZE)
+        return -1;
+    rows = get_u16(coverage + 3);
+    cols = get_u16(coverage + 5);
+    *sown = get_u16(coverage + 7);
+    *revalidated = coverage_valid;
+
+    // Cells the map and the stored records disagree on
+    *mismatches = 0;
+    for (int cell = 0; cell < field_rows * field_cols; cell++)
+    {
+        int byte = COVERAGE_HEADER_SIZE + cell / 8;
+        int visited = rows == field_rows && cols == field_cols && byte < coverage_len && (coverage[byte] >> (cell % 8)) & 1;
+
+        if (visited != cells[cell])
+            (*mismatches)++;
+    }
+    return coverage_len;
+}
+
+int sim_server_prescribed_cells(void)
+{
+    return prescribed_cells;
+}
+
+int sim_server_prescription_blocks(void)
+{
+    return prescription_blocks;
+}
+
+int sim_server_busy_answers(void)
+{
+    return busy_answers;
+}
+
+int sim_server_energy(const struct sim_node *node, const uint8_t **snapshot)
+{
+    *snapshot = energy_snapshots[node->id];
+    return energy_lengths[node->id];
+}
+
+int sim_field_write_grid(const char *path, int rows, int cols)
+{
+    size_t len = FIELD_GRID_HEADER_SIZE + (size_t)rows * cols * FIELD_QUANTITIES * sizeof(int16_t);
+    uint8_t *grid;
+    int16_t *values;
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+        return -1;
+    if (ftruncate(fd, len) != 0 || (grid = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        close(fd);
+        return -1;
+    }
+
+    memcpy(grid, FIELD_GRID_MAGIC, 4);
+    memcpy(grid + 4, &sim_field_seed, 4);
+    memcpy(grid + 8, &(uint16_t){rows}, 2);
+    memcpy(grid + 10, &(uint16_t){cols}, 2);
+    memcpy(grid + 12, &(uint16_t){FIELD_QUANTITIES}, 2);
+    values = (int16_t *)(grid + FIELD_GRID_HEADER_SIZE);
+    for (int row = 0; row < rows; row++)
+    {
+        for (int col = 0; col < cols; col++)
+        {
+            for (int q = 0; q < FIELD_QUANTITIES; q++)
+                *values++ = field_value(q, row, col);
+        }
+    }
+
+    munmap(grid, len);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,167 @@
+#ifndef SIM_H
+#define SIM_H
+
+/*
+SeedBot host simulation
+
+The actuator and sensor firmwares are linked into one Linux program together with a
+stand-in of the CoAP server. Each firmware runs as a simulated node with its own
+processes, CoAP engine and address; all nodes share a virtual clock that jumps
+straight to the next pending timer whenever every process is idle, so the 30 s wake-ups
+and 20 s seeding waits of the actuator cost no real time.
+
+Packets are serialized to real CoAP bytes and delivered through a simple multi-hop
+model (per-hop loss and latency, 250 kbit/s airtime), routed through the root (fd00::1).
+With rows_per_hop set the motes are strung along the field instead: a mote is one hop
+deeper every rows_per_hop rows from the root, and two motes are as many hops apart as
+their depths differ, at least one.
+*/
+
+#include <stdint.h>
+#include "contiki.h"
+#include "coap-engine.h"
+#include "coap-observe-client.h"
+
+#define SIM_MAX_NODES 12
+#define SIM_MAX_RESOURCES 16
+#define SIM_MAX_TRANSACTIONS 4   // COAP_MAX_OPEN_TRANSACTIONS of Contiki-NG
+#define SIM_MAX_OBSERVERS 4
+#define SIM_MAX_OBSERVEES 4
+#define SIM_DEDUP_ENTRIES 64
+
+#define SIM_AIRTIME_US_PER_BYTE 32 // 802.15.4 at 250 kbit/s
+#define SIM_LOWPAN_OVERHEAD 21     // MAC + compressed IPv6/UDP headers per frame
+#define SIM_CPU_US_PER_EVENT 300   // CPU time charged for a process event or a received frame
+
+#define SIM_ROOT_ADDR "fd00::1"
+
+typedef struct
+{
+    uint64_t sent;
+    uint64_t frames; // Transmissions over every hop of the route
+    uint64_t bytes;
+    uint64_t lost;
+    uint64_t retransmissions;
+    uint64_t timeouts;
+} sim_path_stats_t;
+
+typedef struct
+{
+    uint8_t used;
+    coap_endpoint_t endpoint;
+    char url[32];
+    uint8_t token_len;
+    uint8_t token[COAP_TOKEN_LEN];
+    uint32_t seq;
+} sim_observer_t;
+
+typedef struct
+{
+    coap_endpoint_t endpoint;
+    uint16_t mid;
+    uint64_t expiry_us;
+    uint16_t response_len;
+    uint8_t response[COAP_MAX_PACKET_SIZE];
+} sim_dedup_entry_t;
+
+struct sim_node
+{
+    int id;
+    const char *name;
+    char addr[SIM_ADDR_LEN];
+    int hops;                             // Hops to the root
+    struct process *const *autostart;
+
+    /* CoAP engine state */
+    coap_resource_t *resources;
+    coap_transaction_t transactions[SIM_MAX_TRANSACTIONS];
+    uint8_t transaction_used[SIM_MAX_TRANSACTIONS];
+    sim_observer_t observers[SIM_MAX_OBSERVERS];
+    coap_observee_t observees[SIM_MAX_OBSERVEES];
+    uint8_t observee_used[SIM_MAX_OBSERVEES];
+    uint16_t next_mid;
+    uint8_t retransmitting;
+
+    /* Last received datagram; like the uIP buffer, it stays valid until the next one */
+    uint8_t rx_buffer[COAP_MAX_PACKET_SIZE + COAP_MAX_CHUNK_SIZE + 1];
+    coap_message_t rx_message;
+    coap_endpoint_t rx_endpoint;
+
+    /* Duplicate detection, only on the server (Contiki-NG has none) */
+    uint8_t dedup;
+    sim_dedup_entry_t dedup_cache[SIM_DEDUP_ENTRIES];
+    int dedup_next;
+
+    uint8_t leds;
+
+    /* Energest counters */
+    uint64_t boot_us;
+    uint64_t cpu_us;
+    uint64_t cpu_event_us; // CPU time of the running event not charged yet
+    uint8_t cpu_flushed;   // Energest was flushed since the event started
+    uint64_t tx_us;
+    uint64_t lpm_us;    // Last LPM and LISTEN times reported, which never go back
+    uint64_t listen_us;
+};
+
+extern struct sim_node sim_nodes[SIM_MAX_NODES];
+extern int sim_node_count;
+extern struct sim_node *sim_current;
+
+extern sim_path_stats_t sim_paths[SIM_MAX_NODES][SIM_MAX_NODES];
+extern uint64_t sim_unreachable; // Frames sent to an address no mote has
+
+/* Simulation settings, set from the command line */
+typedef struct
+{
+    double loss;            // Per-hop frame loss probability
+    uint32_t hop_latency_us; // Per-hop forwarding delay, airtime excluded
+    uint32_t boot_jitter_ms;
+    uint32_t seed;
+    double max_hours;       // Virtual time limit
+    int rows_per_hop;       // Line topology along the field, 0 to route every packet through the root
+    double busy;            // Probability that /save answers a complete record 5.03, as a full DB pool
+    int verbose;
+} sim_config_t;
+
+extern sim_config_t sim_config;
+
+/* sim-core.c */
+struct sim_node *sim_add_node(const char *name, const char *addr, int hops, struct process *const *autostart);
+struct sim_node *sim_node_by_addr(const char *addr);
+void sim_boot_node(struct sim_node *node);
+void sim_reboot_node(struct sim_node *node, const char *addr); // addr NULL keeps the address
+void sim_run(void);
+void sim_stop(void);
+void sim_cpu_begin(struct sim_node *node); // An event or a received frame starts running on the node
+void sim_cpu_end(struct sim_node *node);
+uint64_t sim_now_us(void);
+double sim_rand_unit(void);
+void sim_seed(uint32_t seed);
+
+/* sim-server.c */
+extern struct process *const sim_server_processes[];
+void sim_server_init(struct sim_node *node, int rows, int cols, double surveyed); // surveyed: fraction of the cells in the prescription map
+int sim_server_records(void);
+int sim_server_distinct_cells(void);
+int sim_server_complete(void);
+uint64_t sim_server_started_us(void);
+uint64_t sim_server_completed_us(void);
+uint64_t sim_server_last_record_us(void);
+int sim_server_coverage(int *sown, int *mismatches, int *revalidated); // Bytes of the coverage map read, -1 without one
+int sim_server_prescribed_cells(void);   // Cells with a seed type in the prescription map
+int sim_server_prescription_blocks(void); // Blocks of the map served
+int sim_server_busy_answers(void);        // 5.03 answers of /save (--busy)
+int sim_server_check_model(int *checked); // Readings of DT_model.h classified otherwise than by emlearn
+void sim_server_push_model(double hours); // Push the compiled-in model to the actuator after hours of sowing
+int sim_server_model(uint32_t *version, int *blocks, uint64_t *pushed_us); // Bytes of the model pushed, -1 without a push
+int sim_server_energy(const struct sim_node *node, const uint8_t **snapshot);
+int sim_field_write_grid(const char *path, int rows, int cols); // Soil of the field into a grid file (utils/field.h), -1 on error
+
+/* Traffic hooks implemented by sim-main.c; sim_trace_send() gets a NULL to for an address no mote has */
+void sim_trace_send(struct sim_node *from, struct sim_node *to, const coap_message_t *message, int retransmission);
+void sim_trace_cell(int row, int col); // A cell record reached the server
+void sim_trace_deliver(struct sim_node *from, struct sim_node *to, const coap_message_t *message);
+void sim_trace_leds(struct sim_node *node, unsigned char on); // LEDs switched on by a mote
+
+#endif
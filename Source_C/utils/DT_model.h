@@ -1,219 +1,59 @@
-// !!! This file is generated using emlearn !!!
-
-#include <eml_trees.h>
-
-static const EmlTreesNode seed_classifier_nodes[21] = {
-    {1, 107, 1, 20},
-    {6, 20, 1, -1},
-    {6, 19, 1, -2},
-    {6, 13, 1, 12},
-    {6, 9, 1, 8},
-    {6, 8, 1, -3},
-    {6, 5, 1, 5},
-    {6, 4, 1, -4},
-    {0, 70, 1, -5},
-    {6, 2, -6, 1},
-    {4, 55, -7, -8},
-    {6, 7, -9, -10},
-    {6, 10, -11, 1},
-    {6, 11, -12, 1},
-    {6, 12, -13, -14},
-    {0, 75, 1, -15},
-    {6, 16, 1, 2},
-    {1, 32, -16, -17},
-    {6, 17, -18, 1},
-    {4, 77, -19, -20},
-    {4, 87, -21, -22}};
-
-static const int32_t seed_classifier_tree_roots[1] = {0};
-
-static const uint8_t seed_classifier_leaves[22] = {21, 20, 9, 5, 1, 2, 3, 4, 6, 8, 10, 11, 12, 13, 15, 16, 14, 17, 18, 19, 7, 0};
-
-EmlTrees seed_classifier = {
-    21,
-    (EmlTreesNode *)(seed_classifier_nodes),
-    1,
-    (int32_t *)(seed_classifier_tree_roots),
-    22,
-    (uint8_t *)(seed_classifier_leaves),
-    0,
-    7,
-    22,
-};
-
-static inline int32_t seed_classifier_tree_0(const int16_t *features, int32_t features_length)
+// !!! This file is generated by ML/model_pack.py from seed_classifier_emlearn.h, do not edit !!!
+// 21 nodes of 23 bits in 1 tree, 22 classes
+
+#ifndef DT_MODEL_H
+#define DT_MODEL_H
+
+#include "packed_trees.h"
+
+static const uint8_t seed_classifier_nodes[63] = {
+    0x29, 0x60, 0xa9, 0x84, 0x81, 0xd7, 0x08, 0x83, 0xa6, 0x0b, 0x04, 0xcc,
+    0x0e, 0x09, 0x18, 0x18, 0x1a, 0x70, 0x18, 0x22, 0xe0, 0x20, 0x65, 0x00,
+    0x00, 0xc3, 0x80, 0x22, 0x06, 0x00, 0x47, 0x26, 0x05, 0x9a, 0x8c, 0x11,
+    0x50, 0x38, 0x26, 0xb0, 0x70, 0x55, 0x96, 0x80, 0x50, 0x6f, 0xc1, 0xc0,
+    0x84, 0x40, 0x30, 0xbb, 0x07, 0xe2, 0x0c, 0x16, 0xcb, 0x38, 0x41, 0x3c,
+    0x00, 0x00, 0x00};
+
+static const uint16_t seed_classifier_roots[1] = {0};
+
+static const int16_t seed_classifier_bases[7] = {70, 32, 0, 0, 55, 0, 2};
+
+static const packed_trees_t seed_classifier = {
+    .n_features = 7,
+    .n_classes = 22,
+    .n_trees = 1,
+    .n_nodes = 21,
+    .feature_bits = 3,
+    .threshold_bits = 8,
+    .child_bits = 6,
+    .roots = seed_classifier_roots,
+    .bases = seed_classifier_bases,
+    .nodes = seed_classifier_nodes};
+
+static inline int32_t seed_classifier_predict(const int16_t *features, int32_t features_length)
 {
-    if (features[1] < 107)
-    {
-        if (features[6] < 20)
-        {
-            if (features[6] < 19)
-            {
-                if (features[6] < 13)
-                {
-                    if (features[6] < 9)
-                    {
-                        if (features[6] < 8)
-                        {
-                            if (features[6] < 5)
-                            {
-                                if (features[6] < 4)
-                                {
-                                    if (features[0] < 70)
-                                    {
-                                        if (features[6] < 2)
-                                        {
-                                            return 2;
-                                        }
-                                        else
-                                        {
-                                            if (features[4] < 55)
-                                            {
-                                                return 3;
-                                            }
-                                            else
-                                            {
-                                                return 4;
-                                            }
-                                        }
-                                    }
-                                    else
-                                    {
-                                        return 1;
-                                    }
-                                }
-                                else
-                                {
-                                    return 5;
-                                }
-                            }
-                            else
-                            {
-                                if (features[6] < 7)
-                                {
-                                    return 6;
-                                }
-                                else
-                                {
-                                    return 8;
-                                }
-                            }
-                        }
-                        else
-                        {
-                            return 9;
-                        }
-                    }
-                    else
-                    {
-                        if (features[6] < 10)
-                        {
-                            return 10;
-                        }
-                        else
-                        {
-                            if (features[6] < 11)
-                            {
-                                return 11;
-                            }
-                            else
-                            {
-                                if (features[6] < 12)
-                                {
-                                    return 12;
-                                }
-                                else
-                                {
-                                    return 13;
-                                }
-                            }
-                        }
-                    }
-                }
-                else
-                {
-                    if (features[0] < 75)
-                    {
-                        if (features[6] < 16)
-                        {
-                            if (features[1] < 32)
-                            {
-                                return 16;
-                            }
-                            else
-                            {
-                                return 14;
-                            }
-                        }
-                        else
-                        {
-                            if (features[6] < 17)
-                            {
-                                return 17;
-                            }
-                            else
-                            {
-                                if (features[4] < 77)
-                                {
-                                    return 18;
-                                }
-                                else
-                                {
-                                    return 19;
-                                }
-                            }
-                        }
-                    }
-                    else
-                    {
-                        return 15;
-                    }
-                }
-            }
-            else
-            {
-                return 20;
-            }
-        }
-        else
-        {
-            return 21;
-        }
-    }
-    else
-    {
-        if (features[4] < 87)
-        {
-            return 7;
-        }
-        else
-        {
-            return 0;
-        }
-    }
+    return packed_trees_predict(&seed_classifier, features, features_length);
 }
 
-int32_t seed_classifier_predict(const int16_t *features, int32_t features_length)
-{
-
-    int32_t votes[22] = {
-        0,
-    };
-    int32_t _class = -1;
-
-    _class = seed_classifier_tree_0(features, features_length);
-    votes[_class] += 1;
-
-    int32_t most_voted_class = -1;
-    int32_t most_voted_votes = 0;
-    for (int32_t i = 0; i < 22; i++)
-    {
-
-        if (votes[i] > most_voted_votes)
-        {
-            most_voted_class = i;
-            most_voted_votes = votes[i];
-        }
-    }
-    return most_voted_class;
-}
+#ifdef SEED_CLASSIFIER_CHECK
+// Readings on both sides of every threshold and the class emlearn gives them
+#define SEED_CLASSIFIER_CHECKS 42
+static const int16_t seed_classifier_check_features[42][7] = {
+    {34, 106, 70, 4, 63, 36, 0}, {97, 107, 29, 10, 3, 32, 0}, {0, 119, 73, 6, 75, 14, 19}, {7, 10, 11, 3, 48, 21, 20},
+    {7, 140, 61, 10, 63, 43, 18}, {88, 64, 178, 6, 97, 37, 19}, {5, 111, 147, 4, 23, 26, 12}, {85, 133, 113, 6, 38, 26, 13},
+    {129, 105, 155, 3, 61, 23, 8}, {106, 49, 98, 8, 11, 36, 9}, {41, 138, 105, 8, 62, 9, 7}, {11, 83, 185, 9, 82, 18, 8},
+    {128, 63, 8, 6, 69, 43, 4}, {103, 136, 93, 8, 58, 25, 5}, {98, 136, 38, 6, 54, 11, 3}, {93, 56, 134, 9, 62, 30, 4},
+    {69, 5, 142, 8, 58, 9, 0}, {70, 145, 154, 5, 11, 43, 0}, {8, 23, 26, 3, 57, 8, 1}, {63, 73, 33, 5, 44, 26, 2},
+    {42, 45, 70, 5, 54, 25, 0}, {116, 87, 132, 10, 55, 9, 0}, {98, 92, 112, 6, 33, 14, 6}, {130, 58, 160, 9, 2, 22, 7},
+    {101, 42, 14, 5, 57, 40, 9}, {139, 61, 166, 10, 28, 41, 10}, {101, 87, 173, 9, 7, 27, 10}, {54, 17, 83, 4, 9, 27, 11},
+    {40, 111, 149, 7, 16, 8, 11}, {55, 122, 48, 3, 48, 20, 12}, {74, 57, 151, 9, 75, 20, 0}, {75, 104, 80, 10, 2, 28, 0},
+    {72, 9, 45, 6, 41, 16, 15}, {109, 59, 73, 4, 48, 43, 16}, {136, 31, 201, 6, 8, 10, 0}, {34, 32, 47, 6, 34, 29, 0},
+    {94, 91, 92, 4, 37, 23, 16}, {34, 31, 87, 3, 52, 12, 17}, {37, 37, 92, 4, 76, 32, 0}, {140, 62, 149, 4, 77, 31, 0},
+    {136, 34, 122, 7, 86, 10, 0}, {3, 8, 28, 9, 87, 10, 0}};
+static const uint8_t seed_classifier_check_classes[42] = {
+    2, 7, 7, 21, 7, 20, 7, 7, 9, 10, 7, 9, 5, 7, 7, 5,
+    2, 7, 2, 3, 2, 1, 6, 8, 10, 11, 11, 12, 7, 7, 1, 1,
+    16, 15, 1, 2, 15, 18, 2, 1, 1, 2};
+#endif
+
+#endif
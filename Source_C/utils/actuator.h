@@ -30,10 +30,21 @@ Actuator Workflow
 #include <stdio.h>
 #include "coap-engine.h"
 #include "coap-blocking-api.h"
-#include <stdio.h>
 #include <string.h>
-#include <math.h>
 #include "DT_model.h"
+#include "registration.h"
+#include "codec.h"
+#include "logging.h"
+#include "binlog.h"
+#include "metrics.h"
+#include "snapshot.h"
+#include "energy.h"
+#include "cocoa.h"
+#include "stream.h"
+#include "discovery.h"
+#include "sampling.h"
+#include "prescription.h"
+#include "model.h"
 
 #include "os/dev/leds.h"
 #include "os/dev/button-hal.h"
@@ -43,26 +54,116 @@ Actuator Workflow
 #define MOISTURE_SENSOR 3
 #define TEMP_SENSOR 4
 
-#define SERVER_EP "coap://[fd00::1]:5683" // server CoAP address
-#define REGISTER_URL "/register"          // registration endpoint 
-#define DISCOVER_URL "/discover"          // discovery endpoint
 #define SAVE_URL "/save"                  // endpoint to save the data
+#define SAVE_STREAM_URL "/save/stream"    // endpoint of the streamed cell records
 
 #define NPK_SENSOR_URL "/npk"
 #define PH_SENSOR_URL "/ph"
 #define MOISTURE_SENSOR_URL "/moisture"
 #define TEMP_SENSOR_URL "/temperature"
 
-#define MAX_REGISTRATION_RETRY 5
 #define MAX_IPV6_LENGTH 46 // Maximum length for IPv6 address 45 + 1 of terminator character
 #define PAYLOAD_SIZE 256
 
 #define MSG_SIZE 64
 #define NUM_MSG_TO_SAVE 5
 
+// Report the cells as a stream of non-confirmable records (stream.h) instead of
+// six confirmable /save fragments each
+#ifndef SAVE_CONF_STREAM
+#define SAVE_CONF_STREAM 1
+#endif
+
+// Times a /save fragment answered 5.03 is sent again, after the Max-Age of the answer
+#ifndef SAVE_CONF_BUSY_RETRIES
+#define SAVE_CONF_BUSY_RETRIES 3
+#endif
+
+// Cells between two acknowledgement requests, and requests at the end of the field
+#define SAVE_STREAM_ACK_EVERY 8
+#define SAVE_STREAM_FLUSH_ATTEMPTS 4
+
+/*
+Record of a cell in the stream, big endian:
+  u16 field_id, u16 row, u16 col, i16 n, i16 p, i16 k,
+  i16 moisture, i16 temperature, i16 ph, i16 seed_type
+*/
+#define CELL_RECORD_FIELDS 10
+#define CELL_RECORD_SIZE (2 * CELL_RECORD_FIELDS)
+
+// Sensor value of a cell whose seed type came from the prescription map (prescription.h)
+#define CELL_NOT_MEASURED -32768
+
+#if SAVE_CONF_STREAM && CELL_RECORD_SIZE != STREAM_RECORD_SIZE
+#error "STREAM_CONF_RECORD_SIZE must be the size of a cell record"
+#endif
+
 #define INACTIVE 0
 #define ACTIVE 1
 
+// Largest field the actuator can sow, in cells (see project-conf.h)
+#ifndef MAX_FIELD_ROWS
+#define MAX_FIELD_ROWS 64
+#endif
+#ifndef MAX_FIELD_COLS
+#define MAX_FIELD_COLS 64
+#endif
+
+// Visited cells, one bit each, allocated at build time
+#define COVERAGE_MAP_SIZE ((MAX_FIELD_ROWS * MAX_FIELD_COLS + 7) / 8)
+
+/*
+Representation of sowing_actuator/coverage, big endian:
+  u8 version, u16 field_id, u16 rows, u16 cols, u16 sown cells
+followed by the visited cells of the field, cell row * cols + col in bit (cell % 8)
+of byte (cell / 8). It is read with Block2 and carries a 4-byte ETag that changes
+with every sown cell; a GET with the current ETag is answered 2.03 without payload.
+*/
+#define COVERAGE_VERSION 1
+#define COVERAGE_HEADER_SIZE 9
+#define COVERAGE_ETAG_SIZE 4
+
+
+// Features of the model: n, p, k, ph, moisture, temperature and a last one without a sensor
+#define MODEL_FEATURES 7
+
+/*
+Reuse of the readings in the next cells (sampling.h): cells, seconds and tolerance
+of each sensor. The model does not test pH and temperature, their readings are
+reused whenever in range. NPK and moisture are tested, and are read every cell until
+a field has been audited (SAMPLING_CONF_AUDIT): a tolerance must cover the change of
+the soil over that many cells plus the noise of a reading. The simulator reuses them
+with the tolerances its correlated field allows (sim/Makefile).
+*/
+#ifndef SAMPLING_CONF_NPK
+#define SAMPLING_CONF_NPK SAMPLING_POLICY_ALWAYS
+#endif
+#ifndef SAMPLING_CONF_PH
+#define SAMPLING_CONF_PH {4, 900, 1}
+#endif
+#ifndef SAMPLING_CONF_TEMP
+#define SAMPLING_CONF_TEMP {4, 900, 2}
+#endif
+#ifndef SAMPLING_CONF_MOISTURE
+#define SAMPLING_CONF_MOISTURE SAMPLING_POLICY_ALWAYS
+#endif
+
+// Read the reused sensors as well and log the cells whose seed type they would change
+#ifndef SAMPLING_CONF_AUDIT
+#define SAMPLING_CONF_AUDIT 0
+#endif
+
+// A sensor read for the cells
+typedef struct
+{
+    int id;                   // NPK_SENSOR, PH_SENSOR, ...
+    const char *name;         // Name the sensor registers with
+    const char *url;
+    metric_id_t metric;       // Latency of the fetch
+    uint8_t feature;          // First feature of the model it gives
+    uint8_t features;
+    sampling_policy_t policy; // When a reading is used again
+} sensor_t;
 
 typedef struct
 {
@@ -80,7 +181,7 @@ typedef struct
     unsigned int current_col;
     unsigned int total_rows;
     unsigned int total_cols;
-    unsigned int **matrix;
+    uint8_t matrix[COVERAGE_MAP_SIZE];
     short int move_complete;
     short int active;
     int direction;
@@ -89,20 +190,22 @@ typedef struct
 
 short int is_move_complete();
 short int is_movement_active();
+short int is_last_cell();
 
 void calculate_mat_dimensions();
-void allocate_matrix();
-void free_matrix();
-void setup_movement_info(int length, int width, int square_size, int field_id);
+void clear_matrix();
+void mark_visited(unsigned int row, unsigned int col);
+int is_visited(unsigned int row, unsigned int col);
+int setup_movement_info(int length, int width, int square_size, int field_id);
 void clear_movement_info();
 
+// Smallest change of the features [first, first + count) of the last readings that
+// takes the model to another branch, INT16_MAX when it does not test them
+int split_margin(int first, int count);
 int apply_decision_tree_model(npk npk_value, int ph, int moisture, int temp);
 
 void update_position();
 
-int parse_sensors_data(const uint8_t *payload);
-int evaluate_sensor_type(const char *payload_str);
-
 void start_movement();
 void stop_movement();
 void set_movement_complete();
@@ -114,5 +217,12 @@ static void sowing_put_handler(coap_message_t *request, coap_message_t *response
 static void sowing_delete_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
 static void status_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buf, uint16_t preferred_size, int32_t *offset);
 static void obs_(void);
+static void energy_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void metrics_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void log_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void rto_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void model_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void model_put_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void coverage_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
 
 #endif
@@ -0,0 +1,238 @@
+#include "binlog.h"
+#include "logging.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+PROCESS(binlog_process, "Binary Log Process");
+
+static const uint8_t event_argc[BINLOG_EVENT_COUNT] = {
+#define BINLOG_EVENT(name, level, argc, format) argc,
+#include "binlog_events.def"
+#undef BINLOG_EVENT
+};
+
+#if BINLOG_CONF_CONSOLE
+static const char *const event_format[BINLOG_EVENT_COUNT] = {
+#define BINLOG_EVENT(name, level, argc, format) format,
+#include "binlog_events.def"
+#undef BINLOG_EVENT
+};
+#endif
+
+// Ring of encoded records, from tail (oldest) to head
+static uint8_t ring[BINLOG_CONF_SIZE];
+static int tail = 0;
+static int used = 0;
+
+static uint32_t first_seq = 0;     // Sequence number of the record at the tail
+static uint32_t records = 0;       // Records in the ring
+static clock_time_t first_time = 0; // Time of the record at the tail
+static clock_time_t last_time = 0;  // Time of the newest record
+static uint32_t dropped = 0;
+
+#if BINLOG_CONF_CONSOLE
+static uint32_t printed_seq = 0; // Next record to print on the console
+#endif
+
+static uint8_t ring_byte(int pos)
+{
+    return ring[(tail + pos) % BINLOG_CONF_SIZE];
+}
+
+static int get_varint(int pos, uint32_t *value)
+{
+    int n = 0;
+    int shift = 0;
+    uint8_t b;
+
+    *value = 0;
+    do
+    {
+        b = ring_byte(pos + n++);
+        *value |= (uint32_t)(b & 0x7F) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    return n;
+}
+
+static int put_varint(uint8_t *p, uint32_t value)
+{
+    int n = 0;
+
+    while (value >= 0x80)
+    {
+        p[n++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    p[n++] = value;
+    return n;
+}
+
+// Decode the record at pos (bytes from the tail); return its length
+static int read_record(int pos, uint8_t *event, uint32_t *dt, int32_t *args)
+{
+    int n = 0;
+    uint32_t zigzag;
+
+    *event = ring_byte(pos);
+    n++;
+    n += get_varint(pos + n, dt);
+    for (int i = 0; i < event_argc[*event]; i++)
+    {
+        n += get_varint(pos + n, &zigzag);
+        args[i] = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+    }
+    return n;
+}
+
+static void drop_oldest(void)
+{
+    uint8_t event;
+    uint32_t dt;
+    int32_t args[BINLOG_MAX_ARGS];
+    int len = read_record(0, &event, &dt, args);
+
+    tail = (tail + len) % BINLOG_CONF_SIZE;
+    used -= len;
+    records--;
+    first_seq++;
+    dropped++;
+
+    // The new oldest record is timed from the one just dropped
+    if (records > 0)
+    {
+        read_record(0, &event, &dt, args);
+        first_time += dt;
+    }
+}
+
+void binlog_init(void)
+{
+    tail = 0;
+    used = 0;
+    first_seq = 0;
+    records = 0;
+    dropped = 0;
+#if BINLOG_CONF_CONSOLE
+    printed_seq = 0;
+#endif
+    process_start(&binlog_process, NULL);
+}
+
+void binlog_record(binlog_event_t event, ...)
+{
+    uint8_t arguments[BINLOG_MAX_ARGS * 5];
+    uint8_t header[1 + 5];
+    clock_time_t now = clock_time();
+    int args_len = 0;
+    int header_len;
+    va_list ap;
+
+    va_start(ap, event);
+    for (int i = 0; i < event_argc[event]; i++)
+    {
+        int32_t value = va_arg(ap, int);
+        args_len += put_varint(arguments + args_len, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+    }
+    va_end(ap);
+
+    // Make room; the first record of the ring has no time delta
+    do
+    {
+        header[0] = event;
+        header_len = 1 + put_varint(header + 1, records > 0 ? (uint32_t)(now - last_time) : 0);
+        if (records == 0 || used + header_len + args_len <= BINLOG_CONF_SIZE)
+            break;
+        drop_oldest();
+    } while (1);
+
+    if (records == 0)
+        first_time = now;
+    for (int i = 0; i < header_len + args_len; i++)
+        ring[(tail + used + i) % BINLOG_CONF_SIZE] = i < header_len ? header[i] : arguments[i - header_len];
+    used += header_len + args_len;
+    records++;
+    last_time = now;
+}
+
+void binlog_idle(void)
+{
+#if BINLOG_CONF_CONSOLE
+    process_poll(&binlog_process);
+#endif
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t value)
+{
+    p = put_u16(p, value >> 16);
+    return put_u16(p, value & 0xFFFF);
+}
+
+int binlog_encode(uint8_t *buf, int size)
+{
+    uint8_t *p = buf;
+
+    if (size < BINLOG_HEADER_SIZE + used)
+        return 0;
+
+    *p++ = BINLOG_VERSION;
+    *p++ = 0;
+    p = put_u16(p, used);
+    p = put_u32(p, CLOCK_SECOND);
+    p = put_u32(p, first_seq);
+    p = put_u32(p, first_time);
+    p = put_u32(p, dropped);
+    for (int i = 0; i < used; i++)
+        *p++ = ring_byte(i);
+    return p - buf;
+}
+
+PROCESS_THREAD(binlog_process, ev, data)
+{
+    PROCESS_BEGIN();
+
+    while (1)
+    {
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+
+#if BINLOG_CONF_CONSOLE
+        {
+            uint8_t event;
+            uint32_t dt;
+            int32_t a[BINLOG_MAX_ARGS];
+            char line[96];
+            clock_time_t time = first_time;
+            uint32_t seq = first_seq;
+            int pos = 0;
+
+            // Records dropped before they were printed are lost for the console
+            if (printed_seq < first_seq)
+                printed_seq = first_seq;
+
+            for (uint32_t i = 0; i < records; i++, seq++)
+            {
+                pos += read_record(pos, &event, &dt, a);
+                if (i > 0)
+                    time += dt;
+                if (seq < printed_seq)
+                    continue;
+
+                snprintf(line, sizeof(line), event_format[event], a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+                APP_LOG("[%lu.%03lu] %s\n", (unsigned long)(time / CLOCK_SECOND),
+                        (unsigned long)(time % CLOCK_SECOND * 1000 / CLOCK_SECOND), line);
+            }
+            printed_seq = seq;
+        }
+#endif
+    }
+
+    PROCESS_END();
+}
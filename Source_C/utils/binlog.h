@@ -0,0 +1,89 @@
+#ifndef BINLOG_H
+#define BINLOG_H
+
+/*
+Deferred binary logging.
+
+BINLOG(name, args...) appends a compact record (event number, time since the
+previous record and the integer arguments, as varints) to a ring buffer in RAM,
+which takes microseconds instead of the milliseconds of a printf on the UART.
+Events are declared in binlog_events.def with a level; the ones above
+BINLOG_CONF_LEVEL are compiled out. When the ring is full the oldest records are
+dropped.
+
+The records are drained two ways:
+  - on the console, formatted, when the firmware calls binlog_idle() before a
+    long wait (BINLOG_CONF_CONSOLE, on by default);
+  - over CoAP with binlog_encode(), decoded by Source_Python/Tools/mote_log.py.
+    Reading does not consume the records.
+
+Snapshot layout (version 1, big endian):
+  header  u8 version, u8 reserved, u16 record bytes, u32 CLOCK_SECOND,
+          u32 sequence number of the first record, u32 clock time of the first
+          record (ticks), u32 records dropped so far
+  record  u8 event, varint ticks since the previous record (0 for the first),
+          zigzag varint per argument
+*/
+
+#include "contiki.h"
+#include <stdint.h>
+
+#define BINLOG_VERSION 1
+
+#define BINLOG_LEVEL_NONE 0
+#define BINLOG_LEVEL_ERR 1
+#define BINLOG_LEVEL_WARN 2
+#define BINLOG_LEVEL_INFO 3
+#define BINLOG_LEVEL_DBG 4
+
+#ifndef BINLOG_CONF_LEVEL
+#define BINLOG_CONF_LEVEL BINLOG_LEVEL_INFO
+#endif
+
+// Bytes of the ring buffer
+#ifndef BINLOG_CONF_SIZE
+#define BINLOG_CONF_SIZE 512
+#endif
+
+#ifndef BINLOG_CONF_CONSOLE
+#define BINLOG_CONF_CONSOLE 1
+#endif
+
+#define BINLOG_MAX_ARGS 8
+#define BINLOG_HEADER_SIZE 20
+#define BINLOG_SNAPSHOT_SIZE (BINLOG_HEADER_SIZE + BINLOG_CONF_SIZE)
+
+typedef enum
+{
+#define BINLOG_EVENT(name, level, argc, format) BINLOG_##name,
+#include "binlog_events.def"
+#undef BINLOG_EVENT
+    BINLOG_EVENT_COUNT
+} binlog_event_t;
+
+enum
+{
+#define BINLOG_EVENT(name, level, argc, format) BINLOG_LEVEL_OF_##name = BINLOG_LEVEL_##level,
+#include "binlog_events.def"
+#undef BINLOG_EVENT
+};
+
+#define BINLOG(name, ...)                                        \
+    do                                                           \
+    {                                                            \
+        if (BINLOG_LEVEL_OF_##name <= BINLOG_CONF_LEVEL)         \
+            binlog_record(BINLOG_##name, ##__VA_ARGS__);         \
+    } while (0)
+
+void binlog_init(void);
+
+// Append a record; the arguments are ints, as many as the event declares
+void binlog_record(binlog_event_t event, ...);
+
+// The firmware is about to wait: print the pending records on the console
+void binlog_idle(void);
+
+// Encode a snapshot into buf, return its length
+int binlog_encode(uint8_t *buf, int size);
+
+#endif
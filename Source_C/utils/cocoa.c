@@ -0,0 +1,308 @@
+#include "cocoa.h"
+#include "coap-transactions.h"
+#include "lib/random.h"
+#include <stdio.h>
+#include <string.h>
+
+static cocoa_peer_t peers[COCOA_CONF_MAX_PEERS];
+static int last_retransmissions = 0;
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)coap_timer_uptime();
+}
+
+static void add_saturated(uint16_t *counter, uint16_t amount)
+{
+    *counter = (uint32_t)*counter + amount > 0xFFFF ? 0xFFFF : *counter + amount;
+}
+
+static uint16_t clamp_rto(uint32_t rto)
+{
+    if (rto < COCOA_CONF_MIN_RTO)
+        return COCOA_CONF_MIN_RTO;
+    if (rto > COCOA_CONF_MAX_RTO)
+        return COCOA_CONF_MAX_RTO;
+    return rto;
+}
+
+static cocoa_peer_t *find_peer(const coap_endpoint_t *ep)
+{
+    cocoa_peer_t *victim = &peers[0];
+
+    for (int i = 0; i < COCOA_CONF_MAX_PEERS; i++)
+    {
+        cocoa_peer_t *p = &peers[i];
+
+        if (p->used && coap_endpoint_cmp(&p->endpoint, ep))
+            return p;
+
+        // Prefer a free slot, then the least recently used destination
+        if (!p->used)
+        {
+            if (victim->used)
+                victim = p;
+        }
+        else if (victim->used && (int32_t)(p->last_used - victim->last_used) < 0)
+        {
+            victim = p;
+        }
+    }
+
+    memset(victim, 0, sizeof(*victim));
+    coap_endpoint_copy(&victim->endpoint, ep);
+    victim->used = 1;
+    victim->rto = COCOA_CONF_INITIAL_RTO;
+    victim->last_update = now_ms();
+    return victim;
+}
+
+// Let an RTO that has not been updated for a while drift back towards the initial one
+static void age_rto(cocoa_peer_t *p, uint32_t now)
+{
+    uint32_t idle = now - p->last_update;
+
+    if (p->rto < 1000 && idle > 16UL * p->rto)
+    {
+        p->rto = 2 * p->rto < 1000 ? 2 * p->rto : 1000;
+        p->last_update = now;
+    }
+    else if (p->rto > 3000 && idle > 4UL * p->rto)
+    {
+        p->rto = (COCOA_CONF_INITIAL_RTO + p->rto) / 2;
+        p->last_update = now;
+    }
+}
+
+// RFC 6298 smoothing, return SRTT + k * RTTVAR
+static uint32_t estimate(cocoa_estimator_t *e, uint32_t rtt, int k)
+{
+    if (rtt > 0xFFFF)
+        rtt = 0xFFFF;
+
+    if (e->samples == 0)
+    {
+        e->srtt = rtt;
+        e->rttvar = rtt / 2;
+    }
+    else
+    {
+        uint32_t delta = rtt > e->srtt ? rtt - e->srtt : e->srtt - rtt;
+
+        e->rttvar = (3 * (uint32_t)e->rttvar + delta) / 4;
+        e->srtt = (7 * (uint32_t)e->srtt + rtt) / 8;
+    }
+    add_saturated(&e->samples, 1);
+    return e->srtt + (uint32_t)k * e->rttvar;
+}
+
+static void sample_rtt(cocoa_request_state_t *s)
+{
+    cocoa_peer_t *p = s->peer;
+    uint32_t now = now_ms();
+    uint32_t rtt = now - s->sent;
+
+    if (s->transmissions == 1)
+    {
+        p->rto = clamp_rto((estimate(&p->strong, rtt, 4) + p->rto) / 2);
+    }
+    else if (s->transmissions <= 3)
+    {
+        // Which transmission was answered is unknown: time it from the first one
+        p->rto = clamp_rto((estimate(&p->weak, rtt, 1) + 3UL * p->rto) / 4);
+    }
+    else
+    {
+        return;
+    }
+    p->last_update = now;
+}
+
+static void retransmit(coap_timer_t *timer)
+{
+    coap_transaction_t *t = coap_timer_get_user_data(timer);
+    cocoa_request_state_t *s = t->callback_data;
+
+    // coap_send_transaction() doubles the interval: scale it first to back off by 3 or 1.5
+    if (s->rto < 1000)
+        t->retrans_interval = t->retrans_interval * 3 / 2;
+    else if (s->rto > 3000)
+        t->retrans_interval = t->retrans_interval * 3 / 4;
+
+    ++(t->retrans_counter);
+    if (t->retrans_counter <= COAP_MAX_RETRANSMIT)
+    {
+        s->transmissions++;
+        last_retransmissions++;
+        add_saturated(&s->peer->retransmissions, 1);
+    }
+    coap_send_transaction(t);
+}
+
+static void cocoa_request_callback(void *callback_data, coap_message_t *response)
+{
+    cocoa_request_state_t *s = callback_data;
+
+    s->state.response = response;
+    if (response != NULL)
+        sample_rtt(s);
+    else
+        add_saturated(&s->peer->timeouts, 1);
+    process_poll(s->process);
+}
+
+PT_THREAD(cocoa_blocking_request(cocoa_request_state_t *cocoa_state, process_event_t ev,
+                                 coap_endpoint_t *remote_ep,
+                                 coap_message_t *request,
+                                 coap_blocking_response_handler_t request_callback))
+{
+    coap_request_state_t *state = &cocoa_state->state;
+
+    PT_BEGIN(&cocoa_state->pt);
+
+    state->block_num = cocoa_state->block >= 0 ? cocoa_state->block : 0;
+    state->response = NULL;
+    cocoa_state->process = PROCESS_CURRENT();
+
+    state->more = 0;
+    state->res_block = 0;
+    state->block_error = 0;
+
+    cocoa_state->peer = find_peer(remote_ep);
+    cocoa_state->peer->last_used = now_ms();
+    age_rto(cocoa_state->peer, cocoa_state->peer->last_used);
+    add_saturated(&cocoa_state->peer->exchanges, 1);
+    last_retransmissions = 0;
+
+    do
+    {
+        request->mid = coap_get_mid();
+        if ((state->transaction = coap_new_transaction(request->mid, remote_ep)))
+        {
+            coap_transaction_t *t = state->transaction;
+
+            t->callback = cocoa_request_callback;
+            t->callback_data = cocoa_state;
+
+            if (state->block_num > 0 || cocoa_state->block >= 0)
+            {
+                coap_set_header_block2(request, state->block_num, 0, COAP_MAX_CHUNK_SIZE);
+            }
+            t->message_len = coap_serialize_message(request, t->message);
+
+            cocoa_state->rto = cocoa_state->peer->rto;
+            cocoa_state->transmissions = 1;
+            cocoa_state->sent = now_ms();
+            coap_send_transaction(t);
+
+            // Replace the default first timeout, drawn in [RTO, 1.5 * RTO], and the back-off
+            if (request->type == COAP_TYPE_CON)
+            {
+                t->retrans_interval = cocoa_state->rto + random_rand() % (cocoa_state->rto / 2 + 1);
+                coap_timer_set_callback(&t->retrans_timer, retransmit);
+                coap_timer_set(&t->retrans_timer, t->retrans_interval);
+            }
+
+            PT_YIELD_UNTIL(&cocoa_state->pt, ev == PROCESS_EVENT_POLL);
+
+            if (!state->response)
+            {
+                // Server not responding: the handler is not called
+                PT_EXIT(&cocoa_state->pt);
+            }
+
+            coap_get_header_block2(state->response, &state->res_block, &state->more, NULL, NULL);
+
+            if (state->res_block == state->block_num)
+            {
+                request_callback(state->response);
+                ++(state->block_num);
+            }
+            else
+            {
+                ++(state->block_error);
+            }
+        }
+        else
+        {
+            // Could not allocate a transaction
+            PT_EXIT(&cocoa_state->pt);
+        }
+    } while (state->more && cocoa_state->block < 0 && (state->block_error) < COAP_MAX_ATTEMPTS);
+
+    PT_END(&cocoa_state->pt);
+}
+
+int cocoa_last_retransmissions(void)
+{
+    return last_retransmissions;
+}
+
+uint16_t cocoa_rto(const coap_endpoint_t *ep)
+{
+    for (int i = 0; i < COCOA_CONF_MAX_PEERS; i++)
+    {
+        if (peers[i].used && coap_endpoint_cmp(&peers[i].endpoint, ep))
+            return peers[i].rto;
+    }
+    return 0;
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t value)
+{
+    p = put_u16(p, value >> 16);
+    return put_u16(p, value & 0xFFFF);
+}
+
+static uint8_t *put_estimator(uint8_t *p, const cocoa_estimator_t *e)
+{
+    p = put_u16(p, e->srtt);
+    p = put_u16(p, e->rttvar);
+    return put_u16(p, e->samples);
+}
+
+int cocoa_encode(uint8_t *buf, int size)
+{
+    uint8_t *p = buf;
+    uint8_t *count;
+
+    if (size < COCOA_SNAPSHOT_SIZE)
+        return 0;
+
+    *p++ = COCOA_VERSION;
+    count = p++;
+    *p++ = 0;
+    *p++ = 0;
+    p = put_u32(p, clock_seconds());
+
+    *count = 0;
+    for (int i = 0; i < COCOA_CONF_MAX_PEERS; i++)
+    {
+        const cocoa_peer_t *peer = &peers[i];
+        char endpoint[COCOA_ENDPOINT_LENGTH + 1];
+
+        if (!peer->used)
+            continue;
+
+        memset(endpoint, 0, sizeof(endpoint));
+        coap_endpoint_snprint(endpoint, sizeof(endpoint), &peer->endpoint);
+        memcpy(p, endpoint, COCOA_ENDPOINT_LENGTH);
+        p += COCOA_ENDPOINT_LENGTH;
+
+        p = put_u16(p, peer->rto);
+        p = put_estimator(p, &peer->strong);
+        p = put_estimator(p, &peer->weak);
+        p = put_u16(p, peer->exchanges);
+        p = put_u16(p, peer->retransmissions);
+        p = put_u16(p, peer->timeouts);
+        (*count)++;
+    }
+    return p - buf;
+}
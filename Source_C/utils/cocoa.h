@@ -0,0 +1,128 @@
+#ifndef COCOA_H
+#define COCOA_H
+
+/*
+Adaptive retransmission timeouts for confirmable requests (CoCoA).
+
+COAP_BLOCKING_REQUEST waits the same 2-3 s for the first ACK and doubles it at
+every retransmission, whether the peer is a sensor one hop away or the server
+behind the border router. COCOA_BLOCKING_REQUEST is a drop-in replacement that
+keeps a retransmission timeout (RTO) per destination, learnt from the round-trip
+times of its exchanges:
+
+  - strong estimator: exchanges answered at the first transmission,
+    RTO = SRTT + 4 * RTTVAR, weighs 1/2 in the RTO;
+  - weak estimator: exchanges answered after one or two retransmissions, timed
+    from the first one, RTO = SRTT + RTTVAR, weighs 1/4 in the RTO.
+
+The first timeout of an exchange is drawn in [RTO, 1.5 * RTO]. The back-off factor
+is 3 below 1 s, 1.5 above 3 s and 2 in between, so a short RTO that misfires
+backs off quickly and a long one does not grow out of hand. An RTO not updated
+for a while drifts back towards the initial value. The retransmission count
+stays COAP_MAX_RETRANSMIT.
+
+The CoAP engine is not modified: the first transmission goes through
+coap_send_transaction() as usual, then the retransmission timer of the
+transaction is rescheduled with the peer RTO and its callback replaced.
+
+Snapshot layout of the statistics (version 1, big endian):
+  header  u8 version, u8 peer count, u16 reserved, u32 uptime (s)
+  peer    char endpoint[COCOA_ENDPOINT_LENGTH] (NUL padded), u16 RTO (ms),
+          u16 strong SRTT, u16 strong RTTVAR, u16 strong samples,
+          u16 weak SRTT, u16 weak RTTVAR, u16 weak samples (ms, ms, count),
+          u16 exchanges, u16 retransmissions, u16 timeouts
+*/
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include "coap-blocking-api.h"
+#include <stdint.h>
+
+#define COCOA_VERSION 1
+
+// Destinations tracked at once; the least recently used one is replaced
+#ifndef COCOA_CONF_MAX_PEERS
+#define COCOA_CONF_MAX_PEERS 6
+#endif
+
+// RTO of a destination without samples, in ms
+#ifndef COCOA_CONF_INITIAL_RTO
+#define COCOA_CONF_INITIAL_RTO 2000
+#endif
+
+// Bounds of the RTO, in ms: the lower one keeps a fast link from retransmitting on jitter
+#ifndef COCOA_CONF_MIN_RTO
+#define COCOA_CONF_MIN_RTO 500
+#endif
+
+#ifndef COCOA_CONF_MAX_RTO
+#define COCOA_CONF_MAX_RTO 32000
+#endif
+
+#define COCOA_ENDPOINT_LENGTH 48
+#define COCOA_HEADER_SIZE 8
+#define COCOA_PEER_SIZE (COCOA_ENDPOINT_LENGTH + 20)
+#define COCOA_SNAPSHOT_SIZE (COCOA_HEADER_SIZE + COCOA_CONF_MAX_PEERS * COCOA_PEER_SIZE)
+
+typedef struct
+{
+    uint16_t srtt;
+    uint16_t rttvar;
+    uint16_t samples;
+} cocoa_estimator_t;
+
+typedef struct
+{
+    coap_endpoint_t endpoint;
+    uint8_t used;
+    uint32_t last_used;
+    uint32_t last_update;
+    uint16_t rto;
+    cocoa_estimator_t strong;
+    cocoa_estimator_t weak;
+    uint16_t exchanges;
+    uint16_t retransmissions;
+    uint16_t timeouts;
+} cocoa_peer_t;
+
+typedef struct
+{
+    coap_request_state_t state;
+    struct pt pt;
+    struct process *process;
+    cocoa_peer_t *peer;
+    uint32_t sent;
+    uint16_t rto;
+    uint8_t transmissions;
+    int32_t block; // Block2 number to fetch alone, -1 for the whole resource
+} cocoa_request_state_t;
+
+PT_THREAD(cocoa_blocking_request(cocoa_request_state_t *cocoa_state, process_event_t ev,
+                                 coap_endpoint_t *remote_ep,
+                                 coap_message_t *request,
+                                 coap_blocking_response_handler_t request_callback));
+
+#define COCOA_BLOCKING_REQUEST(server_endpoint, request, chunk_handler) \
+    COCOA_BLOCKING_BLOCK_REQUEST(server_endpoint, request, -1, chunk_handler)
+
+// Fetch only the Block2 block block_num of a resource, of COAP_MAX_CHUNK_SIZE bytes
+#define COCOA_BLOCKING_BLOCK_REQUEST(server_endpoint, request, block_num, chunk_handler) \
+    {                                                                                 \
+        static cocoa_request_state_t cocoa_state;                                     \
+        cocoa_state.block = (block_num);                                              \
+        PT_SPAWN(process_pt, &cocoa_state.pt,                                         \
+                 cocoa_blocking_request(&cocoa_state, ev,                             \
+                                        server_endpoint,                              \
+                                        request, chunk_handler));                     \
+    }
+
+// Retransmissions of the last exchange (all its blocks), timed out or not
+int cocoa_last_retransmissions(void);
+
+// Current RTO of a destination in ms, 0 when it is not tracked
+uint16_t cocoa_rto(const coap_endpoint_t *ep);
+
+// Encode the per-destination statistics into buf, return their length
+int cocoa_encode(uint8_t *buf, int size);
+
+#endif
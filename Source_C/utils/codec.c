@@ -0,0 +1,150 @@
+#include "codec.h"
+#include <string.h>
+
+typedef struct
+{
+    char *p;
+    char *end;
+} writer_t;
+
+static void put_char(writer_t *w, char c)
+{
+    if (w->p < w->end)
+        *w->p = c;
+    w->p++;
+}
+
+static void put_string(writer_t *w, const char *s)
+{
+    while (*s)
+        put_char(w, *s++);
+}
+
+static void put_key(writer_t *w, const char *key)
+{
+    put_char(w, '"');
+    put_string(w, key);
+    put_string(w, "\":");
+}
+
+static void put_int(writer_t *w, int value)
+{
+    char digits[11];
+    int n = 0;
+    unsigned int u = value < 0 ? -(unsigned int)value : (unsigned int)value;
+
+    if (value < 0)
+        put_char(w, '-');
+    do
+    {
+        digits[n++] = '0' + u % 10;
+        u /= 10;
+    } while (u > 0);
+    while (n > 0)
+        put_char(w, digits[--n]);
+}
+
+int codec_encode(char *buf, int size, const char *object, const char *const keys[], const int values[], int count)
+{
+    writer_t w = {buf, buf + size - 1}; // Room for the NUL
+
+    if (size <= 0)
+        return 0;
+
+    put_char(&w, '{');
+    if (object != NULL)
+    {
+        put_key(&w, object);
+        put_char(&w, '{');
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (i > 0)
+            put_char(&w, ',');
+        put_key(&w, keys[i]);
+        put_int(&w, values[i]);
+    }
+    if (object != NULL)
+        put_char(&w, '}');
+    put_char(&w, '}');
+
+    if (w.p > w.end)
+    {
+        buf[0] = '\0';
+        return 0;
+    }
+    *w.p = '\0';
+    return w.p - buf;
+}
+
+int codec_encode_int(char *buf, int size, const char *key, int value)
+{
+    return codec_encode(buf, size, NULL, &key, &value, 1);
+}
+
+// Return the position right after "key": and any blanks, NULL if the key is not there
+static const uint8_t *find_value(const uint8_t *payload, int len, const char *key)
+{
+    int key_len = strlen(key);
+    const uint8_t *end = payload + len;
+
+    for (const uint8_t *p = payload; p + key_len + 2 <= end; p++)
+    {
+        if (p[0] != '"' || memcmp(p + 1, key, key_len) != 0 || p[key_len + 1] != '"')
+            continue;
+
+        p += key_len + 2;
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        if (p >= end || *p != ':')
+            continue;
+        p++;
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        return p;
+    }
+    return NULL;
+}
+
+int codec_find_int(const uint8_t *payload, int len, const char *key, int *value)
+{
+    const uint8_t *end = payload + len;
+    const uint8_t *p = find_value(payload, len, key);
+    int negative = 0;
+    int result = 0;
+
+    if (p == NULL)
+        return 0;
+    if (p < end && *p == '-')
+    {
+        negative = 1;
+        p++;
+    }
+    if (p >= end || *p < '0' || *p > '9')
+        return 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        result = result * 10 + (*p++ - '0');
+
+    *value = negative ? -result : result;
+    return 1;
+}
+
+int codec_find_string(const uint8_t *payload, int len, const char *key, char *out, int size)
+{
+    const uint8_t *end = payload + len;
+    const uint8_t *p = find_value(payload, len, key);
+    int n = 0;
+
+    if (p == NULL || p >= end || *p != '"')
+        return 0;
+    for (p++; p < end && *p != '"'; p++)
+    {
+        if (n >= size - 1)
+            return 0;
+        out[n++] = *p;
+    }
+    if (p >= end)
+        return 0; // Unterminated string
+    out[n] = '\0';
+    return 1;
+}
@@ -0,0 +1,26 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+/*
+Flat JSON payloads exchanged between the motes and the server: objects of integer
+fields, e.g. {"ph":6} or {"npk":{"n":50,"p":53,"k":48}}, and the string fields of
+the discovery responses. No sscanf/snprintf/atof, so no floating point code is
+pulled in. CoAP payloads are not NUL terminated: the decoders take a length.
+*/
+
+#include <stdint.h>
+
+// Encode {"keys[0]":values[0],...}, wrapped in {"object":...} when object is not NULL.
+// Return the length (a NUL is appended), 0 if it does not fit in size.
+int codec_encode(char *buf, int size, const char *object, const char *const keys[], const int values[], int count);
+
+// Encode a single field {"key":value}
+int codec_encode_int(char *buf, int size, const char *key, int value);
+
+// Find "key": followed by an integer anywhere in the payload; return 1 if found
+int codec_find_int(const uint8_t *payload, int len, const char *key, int *value);
+
+// Find "key": followed by a string, copied NUL terminated into out; return 1 if found and it fits
+int codec_find_string(const uint8_t *payload, int len, const char *key, char *out, int size);
+
+#endif
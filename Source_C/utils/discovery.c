@@ -0,0 +1,272 @@
+#include "discovery.h"
+#include "coap-observe-client.h"
+#include "registration.h"
+#include "cocoa.h"
+#include "codec.h"
+#include "logging.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+PROCESS(discovery_process, "Discovery Process");
+
+process_event_t discovery_event;
+
+typedef struct
+{
+    const char *name;
+    coap_endpoint_t candidates[DISCOVERY_CANDIDATES]; // Closest instance first
+    uint8_t candidate_count;
+    uint8_t current;           // Candidate read
+    uint8_t failures;
+    int16_t row;               // Row of the last lookup, -1 without one
+    unsigned long next_lookup; // clock_seconds() from which a lookup is due
+} discovery_entry_t;
+
+static discovery_entry_t entries[DISCOVERY_CONF_MAX_ENTRIES];
+static int entry_count = 0;
+static int looking_up = -1;
+static struct process *requester;
+
+static int position_row = -1;
+static int position_col = -1;
+
+static coap_observee_t *registry_observee = NULL;
+static char registry_url[] = REGISTRY_URL;
+static int registry_version = 0;
+static int registry_synced = 0;
+
+int discovery_add(const char *name)
+{
+    discovery_entry_t *e;
+
+    if (entry_count == DISCOVERY_CONF_MAX_ENTRIES)
+        return -1;
+    e = &entries[entry_count];
+    memset(e, 0, sizeof(*e));
+    e->name = name;
+    e->row = -1;
+    return entry_count++;
+}
+
+void discovery_set_position(int row, int col)
+{
+    position_row = row;
+    position_col = col;
+}
+
+static int is_due(const discovery_entry_t *e, unsigned long now)
+{
+    if ((long)(now - e->next_lookup) >= 0)
+        return 1;
+
+    // The mote moved down the rows, away from where the closest instances were looked up
+    return position_row >= 0 && (e->row < 0 || abs(position_row - e->row) >= DISCOVERY_CONF_ZONE_STEP);
+}
+
+int discovery_due(void)
+{
+    unsigned long now = clock_seconds();
+
+    for (int i = 0; i < entry_count; i++)
+    {
+        if (is_due(&entries[i], now))
+            return 1;
+    }
+    return 0;
+}
+
+const coap_endpoint_t *discovery_endpoint(int entry)
+{
+    if (entry < 0 || entry >= entry_count || entries[entry].candidate_count == 0)
+        return NULL;
+    return &entries[entry].candidates[entries[entry].current];
+}
+
+void discovery_result(int entry, int answered)
+{
+    discovery_entry_t *e;
+
+    if (entry < 0 || entry >= entry_count)
+        return;
+    e = &entries[entry];
+
+    if (answered)
+    {
+        e->failures = 0;
+    }
+    else if (++(e->failures) >= DISCOVERY_CONF_MAX_FAILURES)
+    {
+        APP_LOG("No response from %s: looking it up again\n", e->name);
+        e->failures = 0;
+        e->next_lookup = clock_seconds();
+
+        // Read the other instance until the lookup
+        if (e->candidate_count > 1)
+            e->current = (e->current + 1) % e->candidate_count;
+    }
+}
+
+static void invalidate_all(void)
+{
+    unsigned long now = clock_seconds();
+
+    for (int i = 0; i < entry_count; i++)
+        entries[i].next_lookup = now;
+}
+
+void discovery_invalidate(const char *name)
+{
+    size_t len = strcspn(name, "@");
+
+    for (int i = 0; i < entry_count; i++)
+    {
+        discovery_entry_t *e = &entries[i];
+
+        if (strlen(e->name) == len && strncmp(e->name, name, len) == 0)
+        {
+            APP_LOG("%s changed in the registry\n", name);
+            e->next_lookup = clock_seconds();
+        }
+    }
+}
+
+/*-------------------------------REGISTRY-------------------------------*/
+
+static void registry_notification_callback(coap_observee_t *observee, void *notification, coap_notification_flag_t flag)
+{
+    const uint8_t *payload;
+    char name[DISCOVERY_NAME_LENGTH];
+    int version;
+    int len;
+
+    if (flag != OBSERVE_OK && flag != NOTIFICATION_OK)
+    {
+        // Observed again at the next refresh
+        registry_observee = NULL;
+        return;
+    }
+
+    len = coap_get_payload(notification, &payload);
+    if (len <= 0 || !codec_find_int(payload, len, "version", &version))
+        return;
+
+    if (registry_synced && version != registry_version)
+    {
+        // Only a notification that follows the last one tells everything that changed
+        if (flag == NOTIFICATION_OK && version == registry_version + 1 &&
+            codec_find_string(payload, len, "name", name, sizeof(name)))
+            discovery_invalidate(name);
+        else
+            invalidate_all();
+    }
+    registry_version = version;
+    registry_synced = 1;
+}
+
+/*-------------------------------LOOKUP-------------------------------*/
+
+static int parse_candidate(const uint8_t *payload, int len, const char *key, coap_endpoint_t *ep)
+{
+    char addr[DISCOVERY_ADDR_LENGTH];
+    char uri[DISCOVERY_ADDR_LENGTH + 16];
+
+    if (!codec_find_string(payload, len, key, addr, sizeof(addr)))
+        return 0;
+    snprintf(uri, sizeof(uri), "coap://[%s]:5683", addr);
+    APP_LOG("%s at %s\n", key, addr);
+    return coap_endpoint_parse(uri, strlen(uri), ep);
+}
+
+static void discovery_response_callback(coap_message_t *response)
+{
+    discovery_entry_t *e = &entries[looking_up];
+    coap_endpoint_t found[DISCOVERY_CANDIDATES];
+    const uint8_t *payload;
+    int len;
+
+    if (response == NULL)
+    {
+        APP_LOG("Discovery of %s failed: no response from server.\n", e->name);
+        return;
+    }
+
+    len = coap_get_payload(response, &payload);
+    if (len <= 0 || !parse_candidate(payload, len, e->name, &found[0]))
+    {
+        APP_LOG("%s not found by the server.\n", e->name);
+        return;
+    }
+
+    memcpy(&e->candidates[0], &found[0], sizeof(found[0]));
+    e->candidate_count = 1;
+    e->current = 0;
+    if (parse_candidate(payload, len, "alt", &found[1]))
+    {
+        memcpy(&e->candidates[1], &found[1], sizeof(found[1]));
+        e->candidate_count = 2;
+
+        uint16_t rto_closest = cocoa_rto(&found[0]);
+        uint16_t rto_alt = cocoa_rto(&found[1]);
+
+        // The closest in the field unless both were measured and the other answers clearly faster
+        if (rto_closest > 0 && rto_alt > 0 && 4UL * rto_alt < 3UL * rto_closest)
+            e->current = 1;
+    }
+
+    e->failures = 0;
+    e->row = position_row;
+    e->next_lookup = clock_seconds() + DISCOVERY_CONF_TTL;
+}
+
+void discovery_refresh(void)
+{
+    if (discovery_event == 0)
+        discovery_event = process_alloc_event();
+
+    requester = PROCESS_CURRENT();
+    process_start(&discovery_process, NULL);
+}
+
+PROCESS_THREAD(discovery_process, ev, data)
+{
+    static coap_endpoint_t server_ep;
+    static coap_message_t request[1];
+    static char payload[DISCOVERY_NAME_LENGTH + 48];
+
+    PROCESS_BEGIN();
+
+    coap_endpoint_parse(SERVER_EP, strlen(SERVER_EP), &server_ep);
+
+    // Observe the registry before the lookups, so no change slips in between
+    if (registry_observee == NULL)
+        registry_observee = coap_obs_request_registration(&server_ep, registry_url, registry_notification_callback, NULL);
+
+    for (looking_up = 0; looking_up < entry_count; looking_up++)
+    {
+        discovery_entry_t *e = &entries[looking_up];
+
+        if (!is_due(e, clock_seconds()))
+            continue;
+
+        // Not looked up again before the retry interval, unless the lookup succeeds
+        e->next_lookup = clock_seconds() + DISCOVERY_CONF_RETRY_INTERVAL;
+        e->row = position_row;
+
+        if (position_row >= 0)
+            snprintf(payload, sizeof(payload), "{\"name\": \"%s\", \"row\": %d, \"col\": %d}", e->name, position_row, position_col);
+        else
+            snprintf(payload, sizeof(payload), "{\"name\": \"%s\"}", e->name);
+
+        coap_init_message(request, COAP_TYPE_CON, COAP_POST, 0);
+        coap_set_header_uri_path(request, DISCOVER_URL);
+        coap_set_header_content_format(request, APPLICATION_JSON);
+        coap_set_payload(request, (uint8_t *)payload, strlen(payload));
+        COCOA_BLOCKING_REQUEST(&server_ep, request, discovery_response_callback);
+    }
+    looking_up = -1;
+
+    process_post(requester, discovery_event, NULL);
+
+    PROCESS_END();
+}
@@ -0,0 +1,88 @@
+#ifndef DISCOVERY_H
+#define DISCOVERY_H
+
+/*
+Cache of the addresses of the devices a mote talks to, looked up with the /discover
+resource of the CoAP server.
+
+A device type may have several instances ("npk@1", "npk@2", ...) registered with
+the zone of the field they cover. Once discovery_set_position() gave the position
+of the mote, a lookup sends it and the server answers with the two instances
+closest to it, {"<name>": "<address>", "alt": "<address>"}. The closest is read,
+unless the retransmission timeouts measured to both (cocoa.h) say the other answers
+clearly faster: the RTT grows with the hops and the link losses to the instance. The entry is looked up again
+when the mote has moved DISCOVERY_CONF_ZONE_STEP rows away from where it was
+looked up, so the instance follows the mote down the field.
+
+An address is trusted for DISCOVERY_CONF_TTL seconds, then looked up again. After
+DISCOVERY_CONF_MAX_FAILURES requests in a row without a response the other instance
+is read until the entry is looked up again. The cache also observes REGISTRY_URL,
+whose representation is {"version": n, "name": "..."}, the registry version and
+the last device added or moved: the entry of that device is looked up again. A
+notification whose version is not the next one means some were missed, and every
+entry is looked up.
+
+Until a new lookup succeeds the old addresses are still used. discovery_refresh()
+runs the due lookups in a process of its own and posts discovery_event to the
+calling process when it is over, like registration_start().
+*/
+
+#include "contiki.h"
+#include "coap-engine.h"
+
+#define DISCOVER_URL "/discover" // discovery endpoint
+#define REGISTRY_URL "/registry" // observable registry version
+
+#ifndef DISCOVERY_CONF_MAX_ENTRIES
+#define DISCOVERY_CONF_MAX_ENTRIES 4
+#endif
+
+// Seconds an address is used before it is looked up again
+#ifndef DISCOVERY_CONF_TTL
+#define DISCOVERY_CONF_TTL 600
+#endif
+
+// Requests in a row without a response before the other instance is read
+#ifndef DISCOVERY_CONF_MAX_FAILURES
+#define DISCOVERY_CONF_MAX_FAILURES 2
+#endif
+
+// Seconds before a failed lookup is tried again
+#ifndef DISCOVERY_CONF_RETRY_INTERVAL
+#define DISCOVERY_CONF_RETRY_INTERVAL 60
+#endif
+
+// Rows the mote moves before the closest instances are looked up again
+#ifndef DISCOVERY_CONF_ZONE_STEP
+#define DISCOVERY_CONF_ZONE_STEP 4
+#endif
+
+#define DISCOVERY_CANDIDATES 2
+#define DISCOVERY_NAME_LENGTH 32
+#define DISCOVERY_ADDR_LENGTH 46
+
+extern process_event_t discovery_event;
+
+// Add a device type to the cache; entries are numbered from 0 in the order they are added.
+// Return the entry, -1 when the cache is full
+int discovery_add(const char *name);
+
+// Position of the mote in the field, in cells
+void discovery_set_position(int row, int col);
+
+// 1 when a lookup is due
+int discovery_due(void);
+
+// Look up the due entries, then post discovery_event to the calling process
+void discovery_refresh(void);
+
+// Endpoint of the instance read for an entry, NULL while none was ever found
+const coap_endpoint_t *discovery_endpoint(int entry);
+
+// Outcome of a request to the instance of an entry: 1 answered, 0 timed out
+void discovery_result(int entry, int answered);
+
+// Look up again the entry of a device, named as in the registry ("<type>@<instance>" matches "<type>")
+void discovery_invalidate(const char *name);
+
+#endif
@@ -0,0 +1,85 @@
+#include "energy.h"
+#include "sys/energest.h"
+#include <string.h>
+
+static uint64_t totals[ENERGY_MAX_PHASES][ENERGY_COUNTERS];
+static uint64_t last[ENERGY_COUNTERS];
+static uint8_t phase_count = 1;
+static uint8_t current = ENERGY_PHASE_IDLE;
+static uint32_t units = 0;
+
+static void sample(uint64_t *now)
+{
+    energest_flush();
+    now[0] = energest_type_time(ENERGEST_TYPE_CPU);
+    now[1] = energest_type_time(ENERGEST_TYPE_LPM) + energest_type_time(ENERGEST_TYPE_DEEP_LPM);
+    now[2] = energest_type_time(ENERGEST_TYPE_TRANSMIT);
+    now[3] = energest_type_time(ENERGEST_TYPE_LISTEN);
+}
+
+void energy_init(uint8_t phases)
+{
+    memset(totals, 0, sizeof(totals));
+    phase_count = phases > ENERGY_MAX_PHASES ? ENERGY_MAX_PHASES : phases;
+    current = ENERGY_PHASE_IDLE;
+    units = 0;
+    sample(last);
+}
+
+void energy_switch(uint8_t phase)
+{
+    uint64_t now[ENERGY_COUNTERS];
+
+    sample(now);
+    for (int i = 0; i < ENERGY_COUNTERS; i++)
+    {
+        // A counter that went back would wrap the total
+        if (now[i] >= last[i])
+            totals[current][i] += now[i] - last[i];
+        last[i] = now[i];
+    }
+    if (phase < phase_count)
+        current = phase;
+}
+
+void energy_unit_done(void)
+{
+    units++;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = (value >> 16) & 0xFF;
+    p[2] = (value >> 8) & 0xFF;
+    p[3] = value & 0xFF;
+    return p + 4;
+}
+
+int energy_encode(uint8_t *buf, int size)
+{
+    uint8_t *p = buf;
+
+    if (size < ENERGY_SNAPSHOT_SIZE(phase_count))
+        return 0;
+
+    // Account the time spent so far in the current phase
+    energy_switch(current);
+
+    *p++ = ENERGY_VERSION;
+    *p++ = phase_count;
+    *p++ = ENERGY_COUNTERS;
+    *p++ = 0;
+    p = put_u32(p, ENERGEST_SECOND);
+    p = put_u32(p, units);
+
+    for (int i = 0; i < phase_count; i++)
+    {
+        for (int j = 0; j < ENERGY_COUNTERS; j++)
+        {
+            p = put_u32(p, totals[i][j] >> 32);
+            p = put_u32(p, totals[i][j] & 0xFFFFFFFF);
+        }
+    }
+    return p - buf;
+}
@@ -0,0 +1,51 @@
+#ifndef ENERGY_H
+#define ENERGY_H
+
+/*
+Energest accounting per workflow phase.
+
+The firmware switches phase as its workflow moves on; the Energest time spent in
+each phase (CPU, LPM, radio TX and RX) is added to that phase. Units are the work
+items the energy is spread over: sown cells on the actuator, served requests on a
+sensor. Needs ENERGEST_CONF_ON (see project-conf.h).
+
+Snapshot layout (version 1, big endian):
+  header  u8 version, u8 phase count, u8 counters per phase, u8 reserved,
+          u32 ENERGEST_SECOND, u32 units
+  phase   u64 CPU, u64 LPM (deep LPM included), u64 TX, u64 RX ticks
+*/
+
+#include "contiki.h"
+#include <stdint.h>
+
+#define ENERGY_VERSION 1
+#define ENERGY_MAX_PHASES 5
+#define ENERGY_COUNTERS 4
+
+// Phases of the actuator
+#define ENERGY_PHASE_IDLE 0      // Waiting for the next cell (also the phase of idle sensors)
+#define ENERGY_PHASE_SENSING 1   // Sensor fan-out
+#define ENERGY_PHASE_INFERENCE 2 // Decision tree
+#define ENERGY_PHASE_SEEDING 3   // Seeding wait
+#define ENERGY_PHASE_REPORTING 4 // /save exchanges
+
+// Phases of a sensor
+#define ENERGY_PHASE_REQUEST 1   // Request handler
+#define ENERGY_PHASE_SAMPLING 2  // Periodic sample into the rolling window
+
+#define ENERGY_ACTUATOR_PHASES 5
+#define ENERGY_SENSOR_PHASES 3
+
+#define ENERGY_SNAPSHOT_SIZE(phases) (12 + (phases) * ENERGY_COUNTERS * 8)
+
+void energy_init(uint8_t phases);
+
+// Close the current phase and start accounting to another one
+void energy_switch(uint8_t phase);
+
+void energy_unit_done(void);
+
+// Encode a snapshot into buf, return its length
+int energy_encode(uint8_t *buf, int size);
+
+#endif
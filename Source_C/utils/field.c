@@ -0,0 +1,124 @@
+#include "field.h"
+#include "rng.h"
+
+// Fixed point of the noise: 1.0
+#define FIELD_ONE 4096
+
+// Standard deviation of the sum of the octaves is FIELD_ONE * 256 / FIELD_GAIN
+#define FIELD_GAIN 526
+
+typedef struct
+{
+    int16_t mean;
+    int16_t stddev;
+    int16_t low;
+    int16_t high;
+    int16_t noise; // Standard deviation of a reading around the value of the cell
+    int16_t scale; // Cells between the points of the coarsest lattice
+} field_quantity_t;
+
+// Means and standard deviations of the dataset, ranges of the sensors
+static const field_quantity_t quantities[FIELD_QUANTITIES] = {
+    {50, 36, 0, 140, 4, 16}, // Nitrogen
+    {53, 32, 5, 145, 4, 16}, // Phosphorus
+    {48, 50, 5, 205, 5, 16}, // Potassium
+    {6, 1, 3, 10, 0, 32},    // pH
+    {71, 22, 0, 100, 3, 8},  // Moisture
+    {25, 5, 8, 43, 1, 32}};  // Temperature
+
+// Hash of a lattice point (finalizer of MurmurHash3)
+static uint32_t hash(uint32_t layer, int x, int y)
+{
+    uint32_t h = (uint32_t)FIELD_CONF_SEED * 0x9E3779B9u ^ layer * 0x85EBCA6Bu ^ (uint32_t)x * 0xC2B2AE35u ^ (uint32_t)y * 0x27D4EB2Fu;
+
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// Value of a lattice point in [-FIELD_ONE, FIELD_ONE)
+static int32_t lattice(uint32_t layer, int x, int y)
+{
+    return (int32_t)(hash(layer, x, y) >> 19) - FIELD_ONE;
+}
+
+// Smoothstep 3t^2 - 2t^3 of t in [0, FIELD_ONE], so the blend has no kink at the points
+static int32_t fade(int32_t t)
+{
+    return t * t / FIELD_ONE * (3 * FIELD_ONE - 2 * t) / FIELD_ONE;
+}
+
+static int32_t lerp(int32_t a, int32_t b, int32_t t)
+{
+    return a + (b - a) * t / FIELD_ONE;
+}
+
+// One lattice of the given scale, in [-FIELD_ONE, FIELD_ONE)
+static int32_t octave(uint32_t layer, int row, int col, int scale)
+{
+    int x = row / scale, y = col / scale;
+    int32_t tx = fade((row % scale) * FIELD_ONE / scale);
+    int32_t ty = fade((col % scale) * FIELD_ONE / scale);
+
+    return lerp(lerp(lattice(layer, x, y), lattice(layer, x, y + 1), ty),
+                lerp(lattice(layer, x + 1, y), lattice(layer, x + 1, y + 1), ty), tx);
+}
+
+int field_value(int quantity, int row, int col)
+{
+    const field_quantity_t *q = &quantities[quantity];
+    int32_t noise = 0;
+    int32_t scaled;
+    int scale = q->scale;
+
+    for (int i = 0; i < FIELD_CONF_OCTAVES; i++)
+    {
+        noise += octave(quantity * FIELD_CONF_OCTAVES + i, row, col, scale) >> i;
+        if (scale > 1)
+            scale /= 2;
+    }
+
+    // noise * FIELD_GAIN / 256 has a standard deviation of FIELD_ONE
+    scaled = q->stddev * noise / 16 * FIELD_GAIN / (FIELD_ONE * 16);
+    return rng_clamp(q->mean + scaled, q->low, q->high);
+}
+
+int field_sample(int quantity, int row, int col)
+{
+    const field_quantity_t *q = &quantities[quantity];
+
+    return rng_clamp(field_value(quantity, row, col) + rng_gaussian(0, q->noise), q->low, q->high);
+}
+
+// Non-negative integer of a query variable, -1 when missing or not a number
+static int query_int(coap_message_t *request, const char *name)
+{
+    const char *text;
+    int len = coap_get_query_variable(request, name, &text);
+    int value = 0;
+
+    if (len <= 0)
+        return -1;
+    for (int i = 0; i < len; i++)
+    {
+        if (text[i] < '0' || text[i] > '9')
+            return -1;
+        value = value * 10 + (text[i] - '0');
+    }
+    return value;
+}
+
+int field_query(coap_message_t *request, int *row, int *col)
+{
+    int r = query_int(request, "r");
+    int c = query_int(request, "c");
+
+    if (r < 0 || c < 0 || (r == *row && c == *col))
+        return 0;
+    *row = r;
+    *col = c;
+    return 1;
+}
@@ -0,0 +1,55 @@
+#ifndef FIELD_H
+#define FIELD_H
+
+/*
+Soil of a simulated field, the same for every mote that asks about the same cell.
+
+Each quantity is value noise over the cells: pseudo-random values on a lattice of
+points every `scale` cells, hashed from FIELD_CONF_SEED, the quantity and the point,
+and blended smoothly in between. FIELD_CONF_OCTAVES lattices of halving scale and
+amplitude are added, so neighbouring cells are close and the field still has detail.
+The sum is scaled to the mean and standard deviation of the dataset the model was
+trained on. Integer arithmetic only, no libm.
+
+A sensor reads field_value() at the cell of the actuator plus measurement noise
+(field_sample()); the actuator names the cell in the query of its GET, ?r=<row>&c=<col>.
+
+Grid file written by the simulator (--field-grid), in the byte order of the host:
+  header  char[4] "SBFG", u32 seed, u16 rows, u16 cols, u16 quantities, u16 reserved
+  values  int16 field_value() per quantity, per column, per row
+*/
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include <stdint.h>
+
+#ifndef FIELD_CONF_SEED
+#define FIELD_CONF_SEED 1
+#endif
+
+#ifndef FIELD_CONF_OCTAVES
+#define FIELD_CONF_OCTAVES 3
+#endif
+
+// Quantities, in the feature order of the model
+#define FIELD_NITROGEN 0
+#define FIELD_PHOSPHORUS 1
+#define FIELD_POTASSIUM 2
+#define FIELD_PH 3
+#define FIELD_MOISTURE 4
+#define FIELD_TEMPERATURE 5
+#define FIELD_QUANTITIES 6
+
+#define FIELD_GRID_MAGIC "SBFG"
+#define FIELD_GRID_HEADER_SIZE 16
+
+// Value of a quantity at a cell (row, col >= 0), within the range of its sensor
+int field_value(int quantity, int row, int col);
+
+// A reading of the sensor of the quantity at a cell: field_value() plus measurement noise
+int field_sample(int quantity, int row, int col);
+
+// Take the cell of ?r=&c= in a request into row and col; return 1 when it differs from theirs
+int field_query(coap_message_t *request, int *row, int *col);
+
+#endif
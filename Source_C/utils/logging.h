@@ -0,0 +1,25 @@
+#ifndef LOGGING_H
+#define LOGGING_H
+
+/*
+Console output of the firmware. Every message goes through APP_LOG, so a build
+with APP_LOG_CONF_ENABLED 0 in project-conf.h drops both the calls and their
+format strings from the image.
+*/
+
+#include <stdio.h>
+
+#ifndef APP_LOG_CONF_ENABLED
+#define APP_LOG_CONF_ENABLED 1
+#endif
+
+#if APP_LOG_CONF_ENABLED
+#define APP_LOG(...) printf(__VA_ARGS__)
+#else
+#define APP_LOG(...) \
+    do               \
+    {                \
+    } while (0)
+#endif
+
+#endif
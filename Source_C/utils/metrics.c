@@ -0,0 +1,174 @@
+#include "metrics.h"
+#include <string.h>
+
+static const struct
+{
+    uint8_t unit;
+    uint16_t hist_base;
+} layout[METRIC_COUNT] = {
+    [METRIC_NPK_FETCH] = {METRICS_UNIT_MS, 16},
+    [METRIC_PH_FETCH] = {METRICS_UNIT_MS, 16},
+    [METRIC_TEMP_FETCH] = {METRICS_UNIT_MS, 16},
+    [METRIC_MOISTURE_FETCH] = {METRICS_UNIT_MS, 16},
+    [METRIC_INFERENCE] = {METRICS_UNIT_US, 16},
+    [METRIC_SEEDING] = {METRICS_UNIT_MS, 256},
+    [METRIC_SAVE] = {METRICS_UNIT_MS, 16},
+    [METRIC_CELL] = {METRICS_UNIT_100MS, 16}};
+
+static metric_t metrics[METRIC_COUNT];
+static clock_time_t started[METRIC_COUNT];
+static uint32_t cells = 0;
+static uint16_t retransmissions = 0;
+static uint16_t timeouts = 0;
+
+// Exchange in progress (one at a time, like COAP_BLOCKING_REQUEST)
+static metric_id_t exchange_id;
+static short int exchange_responded = 0;
+
+static uint16_t saturate16(uint32_t value)
+{
+    return value > 0xFFFF ? 0xFFFF : (uint16_t)value;
+}
+
+static void add_saturated(uint16_t *counter, uint32_t amount)
+{
+    *counter = saturate16((uint32_t)*counter + amount);
+}
+
+void metrics_init(void)
+{
+    memset(metrics, 0, sizeof(metrics));
+    cells = 0;
+    retransmissions = 0;
+    timeouts = 0;
+}
+
+void metrics_record(metric_id_t id, uint32_t value)
+{
+    metric_t *m = &metrics[id];
+    uint32_t limit = layout[id].hist_base;
+    int bin = 0;
+
+    value = saturate16(value);
+    if (m->count == 0 || value < m->min)
+        m->min = value;
+    if (value > m->max)
+        m->max = value;
+
+    // Once the count saturates the mean and the histogram stay frozen
+    if (m->count == 0xFFFF)
+        return;
+    m->count++;
+    m->sum += value;
+
+    while (bin < METRICS_HIST_BINS - 1 && value >= limit)
+    {
+        limit *= 4;
+        bin++;
+    }
+    if (m->hist[bin] < 0xFF)
+        m->hist[bin]++;
+}
+
+void metrics_start(metric_id_t id)
+{
+    started[id] = clock_time();
+}
+
+void metrics_stop(metric_id_t id)
+{
+    uint32_t ticks = clock_time() - started[id];
+    uint32_t value;
+
+    switch (layout[id].unit)
+    {
+    case METRICS_UNIT_US:
+        value = (uint32_t)((uint64_t)ticks * 1000000 / CLOCK_SECOND);
+        break;
+    case METRICS_UNIT_100MS:
+        value = (uint32_t)((uint64_t)ticks * 10 / CLOCK_SECOND);
+        break;
+    default:
+        value = (uint32_t)((uint64_t)ticks * 1000 / CLOCK_SECOND);
+        break;
+    }
+    metrics_record(id, value);
+}
+
+void metrics_exchange_begin(metric_id_t id)
+{
+    exchange_id = id;
+    exchange_responded = 0;
+    metrics_start(id);
+}
+
+void metrics_exchange_response(void)
+{
+    exchange_responded = 1;
+}
+
+void metrics_exchange_end(int retransmitted)
+{
+    uint32_t rtt = (uint32_t)((uint64_t)(clock_time() - started[exchange_id]) * 1000 / CLOCK_SECOND);
+
+    add_saturated(&retransmissions, retransmitted);
+    if (!exchange_responded)
+    {
+        // The blocking request gives up after the last retransmission
+        add_saturated(&timeouts, 1);
+        return;
+    }
+    metrics_record(exchange_id, rtt);
+}
+
+void metrics_cell_done(void)
+{
+    metrics_stop(METRIC_CELL);
+    cells++;
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t value)
+{
+    p = put_u16(p, value >> 16);
+    return put_u16(p, value & 0xFFFF);
+}
+
+int metrics_encode(uint8_t *buf, int size)
+{
+    uint8_t *p = buf;
+
+    if (size < METRICS_SNAPSHOT_SIZE)
+        return 0;
+
+    *p++ = METRICS_VERSION;
+    *p++ = METRIC_COUNT;
+    *p++ = METRICS_HIST_BINS;
+    *p++ = 0;
+    p = put_u32(p, clock_seconds());
+    p = put_u32(p, cells);
+    p = put_u16(p, retransmissions);
+    p = put_u16(p, timeouts);
+
+    for (int i = 0; i < METRIC_COUNT; i++)
+    {
+        const metric_t *m = &metrics[i];
+
+        *p++ = i;
+        *p++ = layout[i].unit;
+        p = put_u16(p, m->count);
+        p = put_u16(p, m->min);
+        p = put_u16(p, m->max);
+        p = put_u16(p, m->count ? m->sum / m->count : 0);
+        p = put_u16(p, layout[i].hist_base);
+        memcpy(p, m->hist, METRICS_HIST_BINS);
+        p += METRICS_HIST_BINS;
+    }
+    return p - buf;
+}
@@ -0,0 +1,81 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/*
+Per-phase timing counters of the actuator.
+
+Every phase of a cell (sensor fetches, inference, seeding, /save exchanges) keeps
+count, min, max, mean and a small histogram of its duration. The whole set is
+encoded in a compact binary snapshot, served by the observable metrics resource.
+
+Snapshot layout (version 1, big endian):
+  header  u8 version, u8 metric count, u8 histogram bins, u8 reserved,
+          u32 uptime (s), u32 cells, u16 retransmissions, u16 timeouts
+  metric  u8 id, u8 unit, u16 count, u16 min, u16 max, u16 mean,
+          u16 histogram base, u8 histogram[METRICS_HIST_BINS]
+
+Histogram bin 0 counts values below the base, bin i values below base * 4^i,
+the last bin everything above. Values and counters saturate instead of wrapping.
+Retransmissions are the ones counted by the request (cocoa.h), timed out
+exchanges included.
+*/
+
+#include "contiki.h"
+#include <stdint.h>
+
+#define METRICS_VERSION 1
+#define METRICS_HIST_BINS 8
+
+#define METRICS_HEADER_SIZE 16
+#define METRICS_RECORD_SIZE (12 + METRICS_HIST_BINS)
+
+// Unit of the values of a metric
+#define METRICS_UNIT_US 0
+#define METRICS_UNIT_MS 1
+#define METRICS_UNIT_100MS 2
+
+typedef enum
+{
+    METRIC_NPK_FETCH,
+    METRIC_PH_FETCH,
+    METRIC_TEMP_FETCH,
+    METRIC_MOISTURE_FETCH,
+    METRIC_INFERENCE,
+    METRIC_SEEDING,
+    METRIC_SAVE,
+    METRIC_CELL,
+    METRIC_COUNT
+} metric_id_t;
+
+#define METRICS_SNAPSHOT_SIZE (METRICS_HEADER_SIZE + METRIC_COUNT * METRICS_RECORD_SIZE)
+
+typedef struct
+{
+    uint16_t count;
+    uint16_t min;
+    uint16_t max;
+    uint32_t sum;
+    uint8_t hist[METRICS_HIST_BINS];
+} metric_t;
+
+void metrics_init(void);
+
+// Record a duration, in the unit of the metric
+void metrics_record(metric_id_t id, uint32_t value);
+
+// Time a phase on the clock (ms resolution)
+void metrics_start(metric_id_t id);
+void metrics_stop(metric_id_t id);
+
+// Time a CoAP exchange: the response callback calls metrics_exchange_response(),
+// the end gets the number of retransmissions of the exchange
+void metrics_exchange_begin(metric_id_t id);
+void metrics_exchange_response(void);
+void metrics_exchange_end(int retransmitted);
+
+void metrics_cell_done(void);
+
+// Encode a snapshot into buf, return its length
+int metrics_encode(uint8_t *buf, int size);
+
+#endif
@@ -0,0 +1,257 @@
+#include "model.h"
+#include "lib/crc16.h"
+#include <string.h>
+
+// The image in use and the one being received or waiting for model_commit()
+static uint8_t images[2][MODEL_MAX_SIZE];
+static uint8_t active = 0;
+static uint8_t loaded = 0;
+static uint8_t pending = 0;
+static uint32_t received = 0;
+
+static int feature_count = 0;
+static const char *error = NULL; // Reason the last upload was rejected
+
+void model_init(int features)
+{
+    feature_count = features;
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static int image_trees(const uint8_t *image)
+{
+    return image[3];
+}
+
+static int image_nodes(const uint8_t *image)
+{
+    return get_u16(image + 4);
+}
+
+static int image_leaves(const uint8_t *image)
+{
+    return get_u16(image + 6);
+}
+
+static const uint8_t *image_node(const uint8_t *image, int32_t index)
+{
+    return image + MODEL_HEADER_SIZE + 2 * image_trees(image) + MODEL_NODE_SIZE * index;
+}
+
+static const uint8_t *image_leaf_classes(const uint8_t *image)
+{
+    return image_node(image, image_nodes(image));
+}
+
+static void read_node(const uint8_t *p, model_node_t *node)
+{
+    node->feature = p[0];
+    node->threshold = (int16_t)get_u16(p + 1);
+    node->left = (int16_t)get_u16(p + 3);
+    node->right = (int16_t)get_u16(p + 5);
+}
+
+// A child of node index: a later node or a leaf
+static int valid_child(const uint8_t *image, int32_t index, int16_t child)
+{
+    if (child < 0)
+        return -(child + 1) < image_leaves(image);
+    return child > 0 && index + child < image_nodes(image);
+}
+
+// NULL when the image can be used, the reason otherwise
+static const char *validate(const uint8_t *image, uint32_t len)
+{
+    int trees, nodes, leaves;
+    model_node_t node;
+
+    if (len < MODEL_HEADER_SIZE + 2)
+        return "Model too short";
+    trees = image_trees(image);
+    nodes = image_nodes(image);
+    leaves = image_leaves(image);
+
+    if (image[0] != MODEL_FORMAT)
+        return "Unknown model format";
+    if (image[1] != feature_count)
+        return "Wrong feature count";
+    if (image[2] == 0 || image[2] > MODEL_CONF_MAX_CLASSES)
+        return "Too many classes";
+    if (trees == 0 || trees > MODEL_CONF_MAX_TREES || nodes == 0 || nodes > MODEL_CONF_MAX_NODES ||
+        leaves == 0 || leaves > MODEL_CONF_MAX_LEAVES)
+        return "Model too large";
+    if (len != (uint32_t)(MODEL_HEADER_SIZE + 2 * trees + MODEL_NODE_SIZE * nodes + leaves + 2))
+        return "Wrong model size";
+    if (crc16_data(image, len - 2, 0) != get_u16(image + len - 2))
+        return "Wrong checksum";
+
+    for (int tree = 0; tree < trees; tree++)
+    {
+        if (get_u16(image + MODEL_HEADER_SIZE + 2 * tree) >= nodes)
+            return "Wrong tree root";
+    }
+    for (int32_t i = 0; i < nodes; i++)
+    {
+        read_node(image_node(image, i), &node);
+        if (node.feature >= feature_count)
+            return "Wrong feature";
+        if (!valid_child(image, i, node.left) || !valid_child(image, i, node.right))
+            return "Wrong child";
+    }
+    for (int i = 0; i < leaves; i++)
+    {
+        if (image_leaf_classes(image)[i] >= image[2])
+            return "Wrong class";
+    }
+    return NULL;
+}
+
+int model_upload(const uint8_t *data, int len, uint32_t offset, int more)
+{
+    uint8_t *image = images[active ^ 1];
+
+    // A block sent again because its response was lost
+    if (offset > 0 && offset + len == received)
+        return more ? MODEL_UPLOAD_MORE : (error == NULL ? MODEL_UPLOAD_DONE : MODEL_UPLOAD_INVALID);
+
+    // The first block starts a new upload, and the one waiting is dropped
+    if (offset == 0)
+    {
+        received = 0;
+        pending = 0;
+    }
+    if (offset != received)
+        return MODEL_UPLOAD_INCOMPLETE;
+    if (offset + len > MODEL_MAX_SIZE)
+    {
+        received = 0;
+        return MODEL_UPLOAD_TOO_LARGE;
+    }
+
+    memcpy(image + offset, data, len);
+    received += len;
+    if (more)
+        return MODEL_UPLOAD_MORE;
+
+    if ((error = validate(image, received)) != NULL)
+        return MODEL_UPLOAD_INVALID;
+    pending = 1;
+    return MODEL_UPLOAD_DONE;
+}
+
+const char *model_error(void)
+{
+    return error != NULL ? error : "";
+}
+
+int model_commit(void)
+{
+    if (!pending)
+        return 0;
+    active ^= 1;
+    loaded = 1;
+    pending = 0;
+    return 1;
+}
+
+int model_loaded(void)
+{
+    return loaded;
+}
+
+uint32_t model_version(void)
+{
+    return loaded ? get_u32(images[active] + 8) : 0;
+}
+
+uint32_t model_pending_version(void)
+{
+    return pending ? get_u32(images[active ^ 1] + 8) : 0;
+}
+
+int model_trees(void)
+{
+    return image_trees(images[active]);
+}
+
+int32_t model_root(int tree)
+{
+    return get_u16(images[active] + MODEL_HEADER_SIZE + 2 * tree);
+}
+
+void model_node(int32_t index, model_node_t *node)
+{
+    read_node(image_node(images[active], index), node);
+}
+
+// Class of the leaf the features reach in a tree of the model in use
+static int tree_class(int tree, const int16_t *features)
+{
+    const uint8_t *image = images[active];
+    int32_t index = model_root(tree);
+    model_node_t node;
+    int16_t child;
+
+    for (;;)
+    {
+        read_node(image_node(image, index), &node);
+        child = features[node.feature] < node.threshold ? node.left : node.right;
+        if (child < 0)
+            return image_leaf_classes(image)[-(child + 1)];
+        index += child;
+    }
+}
+
+int model_predict(const int16_t *features, int count)
+{
+    model_vote_t vote;
+
+    if (!loaded || count < feature_count)
+        return -1;
+    if (model_trees() == 1)
+        return tree_class(0, features);
+
+    model_vote_start(&vote, images[active][2], model_trees());
+    for (int tree = 0; tree < model_trees(); tree++)
+    {
+        if (model_vote_add(&vote, tree_class(tree, features)))
+            break;
+    }
+    return vote.best;
+}
+
+void model_vote_start(model_vote_t *vote, int classes, int trees)
+{
+    memset(vote->votes, 0, classes);
+    vote->best = 0;
+    vote->runner = 0;
+    vote->remaining = trees;
+}
+
+int model_vote_add(model_vote_t *vote, int class)
+{
+    uint8_t count = ++vote->votes[class];
+
+    vote->remaining--;
+    if (class != vote->best)
+    {
+        // A class that ties the leader takes the lead when it is lower
+        if (count > vote->votes[vote->best] || (count == vote->votes[vote->best] && class < vote->best))
+        {
+            vote->runner = vote->votes[vote->best];
+            vote->best = class;
+        }
+        else if (count > vote->runner)
+            vote->runner = count;
+    }
+    return vote->runner + vote->remaining < vote->votes[vote->best];
+}
@@ -0,0 +1,104 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+/*
+Seed model uploaded over CoAP, used instead of the one compiled into the image.
+
+The model is a table of decision trees, sent with Block1 as an image (big endian):
+  header  u8 format, u8 features, u8 classes, u8 trees, u16 nodes, u16 leaves, u32 version
+  roots   u16 per tree, the first node of the tree
+  nodes   u8 feature, i16 threshold, i16 left, i16 right
+  leaves  u8 class per leaf
+  crc     u16 CRC-16 of everything before it (crc16_data() of Contiki, initial value 0)
+
+As in emlearn, a node goes left when the feature is below the threshold, its children
+are relative to it and a negative child -(i + 1) is leaf i. A child always comes after
+its node, so every walk ends. The image is received in a buffer of its own, checked
+against the feature count given to model_init() and kept aside until model_commit()
+puts it in use, between two cells; a model in use is never written to.
+*/
+
+#include "contiki.h"
+#include <stdint.h>
+
+#define MODEL_FORMAT 1
+#define MODEL_HEADER_SIZE 12
+#define MODEL_NODE_SIZE 7
+
+#ifndef MODEL_CONF_MAX_TREES
+#define MODEL_CONF_MAX_TREES 4
+#endif
+#ifndef MODEL_CONF_MAX_NODES
+#define MODEL_CONF_MAX_NODES 64
+#endif
+#ifndef MODEL_CONF_MAX_LEAVES
+#define MODEL_CONF_MAX_LEAVES 64
+#endif
+#ifndef MODEL_CONF_MAX_CLASSES
+#define MODEL_CONF_MAX_CLASSES 32
+#endif
+
+// Largest image accepted
+#define MODEL_MAX_SIZE (MODEL_HEADER_SIZE + 2 * MODEL_CONF_MAX_TREES + MODEL_NODE_SIZE * MODEL_CONF_MAX_NODES + MODEL_CONF_MAX_LEAVES + 2)
+
+// Outcome of model_upload()
+#define MODEL_UPLOAD_MORE 0          // Block stored, send the next one
+#define MODEL_UPLOAD_DONE 1          // Image complete and valid, used from the next model_commit()
+#define MODEL_UPLOAD_INVALID -1      // Image rejected, model_error() tells why
+#define MODEL_UPLOAD_TOO_LARGE -2    // Larger than MODEL_MAX_SIZE
+#define MODEL_UPLOAD_INCOMPLETE -3   // Block out of order: start again from block 0
+
+typedef struct
+{
+    uint8_t feature;
+    int16_t threshold;
+    int16_t left;
+    int16_t right;
+} model_node_t;
+
+// Features a model must take
+void model_init(int features);
+
+// Store a block of an upload at offset; more is 0 for the last one
+int model_upload(const uint8_t *data, int len, uint32_t offset, int more);
+
+// Reason of the last rejected upload
+const char *model_error(void);
+
+// Put the last valid upload in use; return 1 when the model changed
+int model_commit(void);
+
+// 1 when an uploaded model is in use, 0 while the compiled-in one is
+int model_loaded(void);
+
+// Version of the model in use and of the one waiting for model_commit(), 0 for none
+uint32_t model_version(void);
+uint32_t model_pending_version(void);
+
+// Trees of the model in use and their nodes
+int model_trees(void);
+int32_t model_root(int tree);
+void model_node(int32_t index, model_node_t *node);
+
+// Class of the features, -1 without an uploaded model
+int model_predict(const int16_t *features, int count);
+
+/*
+Majority vote of the trees of a model, ties to the lowest class as in emlearn. The leader
+and the most votes of any other class are kept as the votes come, so the vote can stop as
+soon as the trees left cannot change the outcome and never scans the counters.
+*/
+typedef struct
+{
+    uint8_t votes[MODEL_CONF_MAX_CLASSES];
+    uint8_t best;      // Class in the lead
+    uint8_t runner;    // Most votes of any other class
+    uint8_t remaining; // Trees still to vote
+} model_vote_t;
+
+void model_vote_start(model_vote_t *vote, int classes, int trees);
+
+// Count the class of a tree; 1 once no class can catch up with vote->best
+int model_vote_add(model_vote_t *vote, int class);
+
+#endif
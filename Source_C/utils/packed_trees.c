@@ -0,0 +1,65 @@
+#include "packed_trees.h"
+
+// count bits (at most 16) from bit of data
+static uint16_t read_bits(const uint8_t *data, uint32_t bit, int count)
+{
+    const uint8_t *p = data + (bit >> 3);
+    uint32_t window = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+
+    return (window >> (24 - (bit & 7) - count)) & ((1UL << count) - 1);
+}
+
+static int16_t read_child(const packed_trees_t *trees, uint32_t bit)
+{
+    uint16_t child = read_bits(trees->nodes, bit, trees->child_bits);
+    uint16_t leaf = 1U << (trees->child_bits - 1);
+
+    return child & leaf ? -(int16_t)(child & ~leaf) - 1 : (int16_t)child;
+}
+
+void packed_trees_node(const packed_trees_t *trees, int32_t index, model_node_t *node)
+{
+    uint32_t bit = (uint32_t)index * (trees->feature_bits + trees->threshold_bits + 2 * trees->child_bits);
+
+    node->feature = read_bits(trees->nodes, bit, trees->feature_bits);
+    bit += trees->feature_bits;
+    node->threshold = trees->bases[node->feature] + read_bits(trees->nodes, bit, trees->threshold_bits);
+    bit += trees->threshold_bits;
+    node->left = read_child(trees, bit);
+    node->right = read_child(trees, bit + trees->child_bits);
+}
+
+// Class of the leaf the features reach in a tree
+static int tree_class(const packed_trees_t *trees, int tree, const int16_t *features)
+{
+    int32_t index = trees->roots[tree];
+    model_node_t node;
+    int16_t child;
+
+    for (;;)
+    {
+        packed_trees_node(trees, index, &node);
+        child = features[node.feature] < node.threshold ? node.left : node.right;
+        if (child < 0)
+            return -(child + 1);
+        index += child;
+    }
+}
+
+int packed_trees_predict(const packed_trees_t *trees, const int16_t *features, int count)
+{
+    model_vote_t vote;
+
+    if (count < trees->n_features || trees->n_classes > MODEL_CONF_MAX_CLASSES)
+        return -1;
+    if (trees->n_trees == 1)
+        return tree_class(trees, 0, features);
+
+    model_vote_start(&vote, trees->n_classes, trees->n_trees);
+    for (int tree = 0; tree < trees->n_trees; tree++)
+    {
+        if (model_vote_add(&vote, tree_class(trees, tree, features)))
+            break;
+    }
+    return vote.best;
+}
@@ -0,0 +1,43 @@
+#ifndef PACKED_TREES_H
+#define PACKED_TREES_H
+
+/*
+Decision trees compiled into the image, in the packed node format of ML/model_pack.py.
+
+Node i takes feature_bits + threshold_bits + 2 * child_bits at bit i of that width in
+nodes, most significant bit first:
+  feature      feature_bits
+  threshold    threshold_bits, unsigned: the threshold is bases[feature] plus this value
+  left, right  child_bits each: with the top bit set a leaf, the class in the other bits,
+               otherwise the offset of the child from the node
+
+As in emlearn, a node goes left when the feature is below the threshold. A threshold is
+stored as the distance from the lowest threshold of its feature: 8 bits when every feature
+spans less than 256 between its thresholds, as the sensor ranges do, 16 otherwise. The
+comparisons are then those of the emlearn model, bit for bit.
+*/
+
+#include <stdint.h>
+#include "model.h"
+
+typedef struct
+{
+    uint8_t n_features;
+    uint8_t n_classes;
+    uint8_t n_trees;
+    uint16_t n_nodes;
+    uint8_t feature_bits;
+    uint8_t threshold_bits;
+    uint8_t child_bits;
+    const uint16_t *roots;
+    const int16_t *bases;
+    const uint8_t *nodes; // Two bytes of padding at the end, fields are read 24 bits at a time
+} packed_trees_t;
+
+// Node of the trees, with the children of model.h: relative, leaf -(class + 1)
+void packed_trees_node(const packed_trees_t *trees, int32_t index, model_node_t *node);
+
+// Class of the features, ties to the lowest as in emlearn; -1 without enough features
+int packed_trees_predict(const packed_trees_t *trees, const int16_t *features, int count);
+
+#endif
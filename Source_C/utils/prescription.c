@@ -0,0 +1,215 @@
+#include "prescription.h"
+#include "registration.h"
+#include "cocoa.h"
+#include "logging.h"
+#include <stdio.h>
+#include <string.h>
+
+#define BLOCK_SIZE COAP_MAX_CHUNK_SIZE
+
+PROCESS(prescription_process, "Prescription Process");
+
+process_event_t prescription_event;
+
+static int survey = -1; // Field of the map, -1 without one
+static int field_rows;
+static int field_cols;
+static uint8_t bits = 0; // Bits per cell, 0 until the header was read
+
+// Two consecutive blocks of the map, from window_block
+static uint8_t window[2 * BLOCK_SIZE];
+static int32_t window_block = 0;
+static uint8_t window_blocks = 0;
+
+static int target_row;
+static int target_col;
+static int32_t fetch_block;
+static uint8_t fetch_slot;
+static uint8_t fetched;
+static struct process *requester;
+
+void prescription_start(int survey_id, int rows, int cols)
+{
+    survey = survey_id;
+    field_rows = rows;
+    field_cols = cols;
+    bits = 0;
+    window_blocks = 0;
+    APP_LOG("Following the prescription map of field %d\n", survey_id);
+}
+
+void prescription_stop(void)
+{
+    survey = -1;
+}
+
+int prescription_active(void)
+{
+    return survey >= 0;
+}
+
+static uint32_t cell_bit(int row, int col)
+{
+    return PRESCRIPTION_HEADER_SIZE * 8 + ((uint32_t)row * field_cols + col) * bits;
+}
+
+static int loaded(int32_t block)
+{
+    return block >= window_block && block < window_block + window_blocks;
+}
+
+int prescription_due(int row, int col)
+{
+    uint32_t bit;
+
+    if (survey < 0)
+        return 0;
+    if (bits == 0)
+        return 1;
+    bit = cell_bit(row, col);
+    return !loaded(bit / (8 * BLOCK_SIZE)) || !loaded((bit + bits - 1) / (8 * BLOCK_SIZE));
+}
+
+int prescription_seed(int row, int col)
+{
+    uint32_t bit;
+    int value = 0;
+
+    if (survey < 0 || prescription_due(row, col))
+        return -1;
+
+    bit = cell_bit(row, col);
+    for (int i = 0; i < bits; i++, bit++)
+    {
+        uint8_t byte = window[bit / 8 - window_block * BLOCK_SIZE];
+        value = value << 1 | ((byte >> (7 - bit % 8)) & 1);
+    }
+    return value == PRESCRIPTION_NONE(bits) ? -1 : value;
+}
+
+static void parse_header(void)
+{
+    int rows = window[2] << 8 | window[3];
+    int cols = window[4] << 8 | window[5];
+
+    if (window[0] != PRESCRIPTION_VERSION || window[1] == 0 || window[1] > PRESCRIPTION_MAX_BITS ||
+        rows != field_rows || cols != field_cols)
+    {
+        APP_LOG("Prescription map of field %d does not fit this field: ignored\n", survey);
+        prescription_stop();
+        return;
+    }
+    bits = window[1];
+}
+
+// Next block the target cell needs and its place in the window, 0 when there is none
+static int next_block(void)
+{
+    uint32_t bit;
+    int32_t first, last;
+
+    if (survey < 0)
+        return 0;
+
+    if (bits == 0)
+    {
+        // The header comes first
+        window_blocks = 0;
+        window_block = 0;
+        fetch_block = 0;
+        fetch_slot = 0;
+        return 1;
+    }
+
+    bit = cell_bit(target_row, target_col);
+    first = bit / (8 * BLOCK_SIZE);
+    last = (bit + bits - 1) / (8 * BLOCK_SIZE);
+
+    if (!loaded(first))
+    {
+        window_block = first;
+        window_blocks = 0;
+        fetch_block = first;
+        fetch_slot = 0;
+        return 1;
+    }
+    if (!loaded(last))
+    {
+        // Moving forward: the second block becomes the first one
+        if (first != window_block)
+        {
+            memcpy(window, window + BLOCK_SIZE, BLOCK_SIZE);
+            window_block = first;
+            window_blocks = 1;
+        }
+        fetch_block = last;
+        fetch_slot = 1;
+        return 1;
+    }
+    return 0;
+}
+
+static void block_callback(coap_message_t *response)
+{
+    const uint8_t *payload;
+    int len;
+
+    if (response == NULL)
+        return;
+
+    len = coap_get_payload(response, &payload);
+    if (response->code != CONTENT_2_05 || len <= 0)
+    {
+        APP_LOG("No prescription map for field %d: sensing every cell\n", survey);
+        prescription_stop();
+        return;
+    }
+    if (len > BLOCK_SIZE)
+        len = BLOCK_SIZE;
+    memcpy(window + fetch_slot * BLOCK_SIZE, payload, len);
+    window_blocks = fetch_slot + 1;
+    fetched = 1;
+}
+
+void prescription_fetch(int row, int col)
+{
+    if (prescription_event == 0)
+        prescription_event = process_alloc_event();
+
+    target_row = row;
+    target_col = col;
+    requester = PROCESS_CURRENT();
+    process_start(&prescription_process, NULL);
+}
+
+PROCESS_THREAD(prescription_process, ev, data)
+{
+    static coap_endpoint_t server_ep;
+    static coap_message_t request[1];
+    static char query[24];
+
+    PROCESS_BEGIN();
+
+    coap_endpoint_parse(SERVER_EP, strlen(SERVER_EP), &server_ep);
+    snprintf(query, sizeof(query), "field=%d", survey);
+
+    // Header, then at most the two blocks of the cell
+    while (next_block())
+    {
+        coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+        coap_set_header_uri_path(request, PRESCRIPTION_URL);
+        coap_set_header_uri_query(request, query);
+        fetched = 0;
+        COCOA_BLOCKING_BLOCK_REQUEST(&server_ep, request, fetch_block, block_callback);
+
+        // Not fetched: the cell is sensed, the next one tries again
+        if (!fetched)
+            break;
+        if (bits == 0)
+            parse_header();
+    }
+
+    process_post(requester, prescription_event, NULL);
+
+    PROCESS_END();
+}
@@ -0,0 +1,53 @@
+#ifndef PRESCRIPTION_H
+#define PRESCRIPTION_H
+
+/*
+Seed types of a field computed by the server from an earlier survey (prescription map).
+
+GET PRESCRIPTION_URL?field=<id> returns the map of a surveyed field, evaluated with
+the same model as the actuator. Layout (version 1, big endian):
+  header  u8 version, u8 bits per cell, u16 rows, u16 cols
+  cells   row after row, bits per cell each, most significant bit first
+
+A cell holding all ones has no survey data and is sensed as usual. The map is read
+with Block2 one block at a time as the actuator moves: at most two blocks, those of
+the current cell, are kept. A map whose size is not the one of the field is ignored.
+prescription_fetch() runs the requests in a process of its own and posts
+prescription_event to the calling process when it is over, like discovery_refresh().
+*/
+
+#include "contiki.h"
+#include "coap-engine.h"
+
+#define PRESCRIPTION_URL "/prescription"
+
+#define PRESCRIPTION_VERSION 1
+#define PRESCRIPTION_HEADER_SIZE 6
+
+// Largest cell width in bits
+#define PRESCRIPTION_MAX_BITS 8
+
+// Value of a cell without survey data
+#define PRESCRIPTION_NONE(bits) ((1 << (bits)) - 1)
+
+extern process_event_t prescription_event;
+
+// Follow the map of a surveyed field for a field of rows x cols cells
+void prescription_start(int survey_id, int rows, int cols);
+
+// Stop following the map
+void prescription_stop(void);
+
+// 1 when a map is followed
+int prescription_active(void);
+
+// 1 when the blocks of a cell have to be fetched first
+int prescription_due(int row, int col);
+
+// Fetch the blocks of a cell, then post prescription_event to the calling process
+void prescription_fetch(int row, int col);
+
+// Seed type of a cell, -1 when it is not prescribed and is sensed as usual
+int prescription_seed(int row, int col);
+
+#endif
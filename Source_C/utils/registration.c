@@ -0,0 +1,101 @@
+#include "registration.h"
+#include "coap-engine.h"
+#include "coap-blocking-api.h"
+#include "logging.h"
+#include <stdio.h>
+#include <string.h>
+
+PROCESS(registration_process, "Registration Process");
+
+process_event_t registration_event;
+
+static char payload[64]; // Name, or JSON with the instance and zone
+static int payload_len;
+static clock_time_t interval;
+static struct process *requester;
+static int retries_left = 0;
+static int got_response;
+
+// Handler for the response to the CoAP registration, not called when the request times out
+static void registration_response_handler(coap_message_t *response)
+{
+    if (response != NULL)
+    {
+        got_response = 1;
+        retries_left = -1; // Exit the registration loop
+    }
+}
+
+void registration_start(const char *name, clock_time_t retry_interval)
+{
+    char instance[8] = "";
+
+    if (registration_event == 0)
+        registration_event = process_alloc_event();
+
+    interval = retry_interval;
+
+    if (REGISTRATION_CONF_INSTANCE > 0)
+        snprintf(instance, sizeof(instance), "@%d", REGISTRATION_CONF_INSTANCE);
+    if (REGISTRATION_CONF_ZONE_ROW >= 0)
+        payload_len = snprintf(payload, sizeof(payload), "{\"name\": \"%s%s\", \"row\": %d, \"col\": %d}",
+                               name, instance, REGISTRATION_CONF_ZONE_ROW, REGISTRATION_CONF_ZONE_COL);
+    else
+        payload_len = snprintf(payload, sizeof(payload), "%s%s", name, instance);
+
+    requester = PROCESS_CURRENT();
+    retries_left = MAX_REGISTRATION_RETRY;
+    process_start(&registration_process, NULL);
+}
+
+int registration_succeeded(void)
+{
+    return retries_left < 0;
+}
+
+PROCESS_THREAD(registration_process, ev, data)
+{
+    static coap_endpoint_t server_ep;
+    static coap_message_t request[1];
+    static struct etimer retry_timer;
+
+    PROCESS_BEGIN();
+
+    coap_endpoint_parse(SERVER_EP, strlen(SERVER_EP), &server_ep);
+
+    while (retries_left > 0)
+    {
+        coap_init_message(request, COAP_TYPE_CON, COAP_POST, 0);
+        coap_set_header_uri_path(request, REGISTER_URL);
+        coap_set_payload(request, (uint8_t *)payload, payload_len);
+
+        // Send the registration request and handle the response
+        got_response = 0;
+        COAP_BLOCKING_REQUEST(&server_ep, request, registration_response_handler);
+
+        if (!got_response)
+        {
+            APP_LOG("Request timed out\n");
+            retries_left--;
+        }
+
+        if (retries_left > 0)
+        {
+            // If registration failed, wait and retry
+            etimer_set(&retry_timer, interval);
+            PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&retry_timer));
+        }
+    }
+
+    if (registration_succeeded())
+    {
+        APP_LOG("Registration successful\n");
+    }
+    else
+    {
+        APP_LOG("Registration failed after maximum attempts\n");
+    }
+    process_post(requester, registration_event, NULL);
+
+    PROCESS_END();
+}
@@ -0,0 +1,48 @@
+#ifndef REGISTRATION_H
+#define REGISTRATION_H
+
+/*
+Registration of a mote with the CoAP server, shared by the actuator and the sensors.
+
+registration_start() runs the registration in a process of its own: the device name
+is POSTed to REGISTER_URL up to MAX_REGISTRATION_RETRY times, waiting the given
+interval after every failed attempt. When it is over, registration_event is posted
+to the calling process and registration_succeeded() tells the outcome.
+
+A site with redundant sensors gives each one an instance number and the zone of
+the field it covers, in cells: the payload is then
+{"name": "<name>@<instance>", "row": <row>, "col": <col>} and the server hands the
+actuator the instance closest to it (discovery.h).
+*/
+
+#include "contiki.h"
+
+#ifndef SERVER_EP
+#define SERVER_EP "coap://[fd00::1]:5683" // server CoAP address
+#endif
+#define REGISTER_URL "/register"          // registration endpoint
+
+#ifndef MAX_REGISTRATION_RETRY
+#define MAX_REGISTRATION_RETRY 5
+#endif
+
+// Instance of the device among those of its type, 0 to register the bare name
+#ifndef REGISTRATION_CONF_INSTANCE
+#define REGISTRATION_CONF_INSTANCE 0
+#endif
+
+// Zone covered by the device, -1 when it has none
+#ifndef REGISTRATION_CONF_ZONE_ROW
+#define REGISTRATION_CONF_ZONE_ROW -1
+#endif
+
+#ifndef REGISTRATION_CONF_ZONE_COL
+#define REGISTRATION_CONF_ZONE_COL 0
+#endif
+
+extern process_event_t registration_event;
+
+void registration_start(const char *name, clock_time_t retry_interval);
+int registration_succeeded(void);
+
+#endif
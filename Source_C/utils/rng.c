@@ -0,0 +1,35 @@
+#include "rng.h"
+#include "contiki.h"
+#include "lib/random.h"
+#include <stdint.h>
+
+// Resolution of the uniform samples, as a power of two
+#define UNIFORM_BITS 12
+#define UNIFORM_ONE (1 << UNIFORM_BITS)
+
+int rng_gaussian(int mean, int stddev)
+{
+    int32_t sum = 0;
+
+    /*
+    The sum of 12 uniform samples in [0, 1) has mean 6 and variance 1 (Irwin-Hall).
+    The samples are fixed point with UNIFORM_BITS fractional bits.
+    */
+    for (int i = 0; i < 12; i++)
+    {
+        sum += random_rand() & (UNIFORM_ONE - 1);
+    }
+    sum -= 6 * UNIFORM_ONE; // Shift the mean to 0
+
+    // Apply standard deviation and mean, rounding to the nearest integer
+    return mean + (int)(((int32_t)stddev * sum + (sum < 0 ? -UNIFORM_ONE / 2 : UNIFORM_ONE / 2)) / UNIFORM_ONE);
+}
+
+int rng_clamp(int value, int low, int high)
+{
+    if (value < low)
+        return low;
+    if (value > high)
+        return high;
+    return value;
+}
@@ -0,0 +1,15 @@
+#ifndef RNG_H
+#define RNG_H
+
+/*
+Random readings of the simulated sensors, drawn from the Contiki random generator
+(random_rand(), seeded by the platform). Integer arithmetic only, no libm.
+*/
+
+// Approximately normal value with the given mean and standard deviation
+int rng_gaussian(int mean, int stddev);
+
+// Value clamped to [low, high]
+int rng_clamp(int value, int low, int high);
+
+#endif
@@ -0,0 +1,120 @@
+#include "rolling.h"
+#include <string.h>
+
+#define SLOT(seq) ((seq) & (ROLLING_CONF_WINDOW - 1))
+
+// Names of the aggregates in the agg query variable, by ROLLING_* value
+static const char *const aggregate_names[] = {"median", "mean", "ewma", "min", "max", "last"};
+
+// num / den rounded to the nearest integer, den > 0
+static int round_div(int32_t num, int32_t den)
+{
+    return (int)((num + (num < 0 ? -den / 2 : den / 2)) / den);
+}
+
+void rolling_init(rolling_t *r)
+{
+    memset(r, 0, sizeof(*r));
+}
+
+// Drop the positions that leave the window when sample seq comes in
+static void queue_expire(rolling_queue_t *q, uint16_t seq)
+{
+    while (q->len > 0 && (uint16_t)(seq - q->seq[q->head]) >= ROLLING_CONF_WINDOW)
+    {
+        q->head = SLOT(q->head + 1);
+        q->len--;
+    }
+}
+
+// Append sample seq, after dropping the samples it beats: sign 1 keeps the min at the front, -1 the max
+static void queue_push(rolling_queue_t *q, const int16_t *samples, uint16_t seq, int value, int sign)
+{
+    while (q->len > 0 && sign * samples[SLOT(q->seq[SLOT(q->head + q->len - 1)])] >= sign * value)
+        q->len--;
+    q->seq[SLOT(q->head + q->len)] = seq;
+    q->len++;
+}
+
+int rolling_add(rolling_t *r, int value)
+{
+    uint16_t seq = r->seq;
+
+    // The sample in the slot is the oldest of a full window
+    if (r->count == ROLLING_CONF_WINDOW)
+        r->sum -= r->samples[SLOT(seq)];
+    else
+        r->count++;
+
+    queue_expire(&r->min, seq);
+    queue_expire(&r->max, seq);
+    queue_push(&r->min, r->samples, seq, value, 1);
+    queue_push(&r->max, r->samples, seq, value, -1);
+
+    r->samples[SLOT(seq)] = value;
+    r->sum += value;
+    if (seq == 0 && r->count == 1)
+        r->ewma = (int32_t)value * 256;
+    else
+        r->ewma += ((int32_t)value * 256 - r->ewma) / (1 << ROLLING_CONF_EWMA_SHIFT);
+    r->seq = seq + 1;
+    return SLOT(r->seq) == 0;
+}
+
+int rolling_count(const rolling_t *r)
+{
+    return r->count;
+}
+
+static int median(const rolling_t *r)
+{
+    int16_t sorted[ROLLING_CONF_WINDOW];
+    int i, j;
+
+    // Insertion sort of the window: the samples are in no particular order once it wrapped
+    for (i = 0; i < r->count; i++)
+    {
+        int16_t value = r->samples[SLOT(r->seq - 1 - i)];
+        for (j = i; j > 0 && sorted[j - 1] > value; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = value;
+    }
+    return round_div(sorted[(r->count - 1) / 2] + sorted[r->count / 2], 2);
+}
+
+int rolling_get(const rolling_t *r, int aggregate)
+{
+    if (r->count == 0)
+        return 0;
+
+    switch (aggregate)
+    {
+    case ROLLING_MEAN:
+        return round_div(r->sum, r->count);
+    case ROLLING_EWMA:
+        return round_div(r->ewma, 256);
+    case ROLLING_MIN:
+        return r->samples[SLOT(r->min.seq[r->min.head])];
+    case ROLLING_MAX:
+        return r->samples[SLOT(r->max.seq[r->max.head])];
+    case ROLLING_LAST:
+        return r->samples[SLOT(r->seq - 1)];
+    default:
+        return median(r);
+    }
+}
+
+int rolling_query(coap_message_t *request)
+{
+    const char *name;
+    int len = coap_get_query_variable(request, "agg", &name);
+
+    if (len <= 0)
+        return ROLLING_MEDIAN;
+    for (int i = 0; i < (int)(sizeof(aggregate_names) / sizeof(aggregate_names[0])); i++)
+    {
+        if ((int)strlen(aggregate_names[i]) == len && memcmp(aggregate_names[i], name, len) == 0)
+            return i;
+    }
+    return -1;
+}
@@ -0,0 +1,92 @@
+#ifndef ROLLING_H
+#define ROLLING_H
+
+/*
+Rolling aggregates of a sensor sampled at a fixed rate.
+
+The last ROLLING_CONF_WINDOW samples are kept in a ring. Every sample updates in
+constant time the sum of the window (rolling mean), an EWMA in 8.8 fixed point, and
+two monotonic queues of the window positions whose value can still become the min
+or the max: a sample pops the values it beats from the back of each queue and
+leaves them out for good, so a sample costs one push and at most as many pops as
+pushes on average. The median is the one aggregate computed on read, over a copy of
+the window: reads come once per cell, samples at least a window of them.
+*/
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include <stdint.h>
+
+// Samples in the window, a power of two up to 128
+#ifndef ROLLING_CONF_WINDOW
+#define ROLLING_CONF_WINDOW 16
+#endif
+
+/*
+Interval between two samples of a sensor, 0 to sample only when a request names
+another cell. The window is kept across requests and every sample updates its
+aggregates, so a read serves the last ROLLING_CONF_WINDOW periods and observers are
+notified as the window is renewed.
+*/
+#ifndef ROLLING_CONF_SAMPLE_INTERVAL
+#define ROLLING_CONF_SAMPLE_INTERVAL (CLOCK_SECOND / 4)
+#endif
+
+// Refill the window with ROLLING_CONF_WINDOW samples when a request names another cell;
+// 0 leaves the periodic samples of the new cell to push out the old ones. The simulator
+// builds its sensors with 1 and no periodic sampling (sim/Makefile), for a probe that
+// moves with the actuator.
+#ifndef ROLLING_CONF_SETTLE
+#define ROLLING_CONF_SETTLE 0
+#endif
+
+// Weight of a new sample in the EWMA: 1 / 2^ROLLING_CONF_EWMA_SHIFT
+#ifndef ROLLING_CONF_EWMA_SHIFT
+#define ROLLING_CONF_EWMA_SHIFT 3
+#endif
+
+#if ROLLING_CONF_WINDOW & (ROLLING_CONF_WINDOW - 1) || ROLLING_CONF_WINDOW > 128
+#error "ROLLING_CONF_WINDOW must be a power of two up to 128"
+#endif
+
+// Aggregates, as named in the agg query variable of a GET (rolling_query())
+#define ROLLING_MEDIAN 0
+#define ROLLING_MEAN 1
+#define ROLLING_EWMA 2
+#define ROLLING_MIN 3
+#define ROLLING_MAX 4
+#define ROLLING_LAST 5
+
+// Window positions in the order of their samples, oldest first
+typedef struct
+{
+    uint16_t seq[ROLLING_CONF_WINDOW];
+    uint8_t head;
+    uint8_t len;
+} rolling_queue_t;
+
+typedef struct
+{
+    int16_t samples[ROLLING_CONF_WINDOW];
+    uint16_t seq;   // Samples taken, wrapping; sample seq is at samples[seq % ROLLING_CONF_WINDOW]
+    uint8_t count;  // Samples in the window
+    int32_t sum;    // Of the window
+    int32_t ewma;   // 8.8 fixed point
+    rolling_queue_t min, max;
+} rolling_t;
+
+void rolling_init(rolling_t *r);
+
+// Add a sample; return 1 every ROLLING_CONF_WINDOW samples, once the window was all renewed
+int rolling_add(rolling_t *r, int value);
+
+// Samples the aggregates are over, 0 before the first one
+int rolling_count(const rolling_t *r);
+
+// An aggregate of the window (ROLLING_*), 0 while it is empty
+int rolling_get(const rolling_t *r, int aggregate);
+
+// Aggregate asked for by the agg query variable of a request, ROLLING_MEDIAN without one, -1 if unknown
+int rolling_query(coap_message_t *request);
+
+#endif
@@ -0,0 +1,48 @@
+#include "sampling.h"
+#include <stdlib.h>
+
+typedef struct
+{
+    uint8_t valid;
+    int16_t row;
+    int16_t col;
+    unsigned long time; // clock_seconds() of the reading
+} sampling_reading_t;
+
+static sampling_reading_t readings[SAMPLING_CONF_MAX_SENSORS];
+
+void sampling_reset(void)
+{
+    for (int i = 0; i < SAMPLING_CONF_MAX_SENSORS; i++)
+        readings[i].valid = 0;
+}
+
+int sampling_reusable(int sensor, const sampling_policy_t *policy, int row, int col, int margin)
+{
+    const sampling_reading_t *r;
+
+    if (sensor < 0 || sensor >= SAMPLING_CONF_MAX_SENSORS || policy->cells == 0)
+        return 0;
+    r = &readings[sensor];
+
+    if (!r->valid || abs(row - r->row) + abs(col - r->col) > policy->cells)
+        return 0;
+    if (clock_seconds() - r->time > policy->age)
+        return 0;
+
+    // The expected change could move the decision to another branch
+    return margin > policy->tolerance;
+}
+
+void sampling_taken(int sensor, int row, int col)
+{
+    sampling_reading_t *r;
+
+    if (sensor < 0 || sensor >= SAMPLING_CONF_MAX_SENSORS)
+        return;
+    r = &readings[sensor];
+    r->valid = 1;
+    r->row = row;
+    r->col = col;
+    r->time = clock_seconds();
+}
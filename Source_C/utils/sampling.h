@@ -0,0 +1,42 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+/*
+Reuse of the sensor readings across neighbouring cells.
+
+A reading stays valid for the cells within policy.cells of the cell it was taken
+in (Manhattan distance) and for policy.age seconds. While it is valid it may be
+used again instead of reading the sensor, provided the decision does not hang on
+it: the caller gives the smallest change of the reading that would move the model
+to another branch, and the reading is reused only when that margin is larger than
+policy.tolerance, the change expected across the validity range. Out of range, too
+old or too close to a split, the sensor is read again.
+*/
+
+#include "contiki.h"
+#include <stdint.h>
+
+#ifndef SAMPLING_CONF_MAX_SENSORS
+#define SAMPLING_CONF_MAX_SENSORS 4
+#endif
+
+typedef struct
+{
+    uint8_t cells;     // Cells a reading covers around its own, 0 reads the sensor every cell
+    uint16_t age;      // Seconds a reading is valid
+    int16_t tolerance; // Change of the reading expected within that range
+} sampling_policy_t;
+
+// Read the sensor for every cell
+#define SAMPLING_POLICY_ALWAYS {0, 0, 0}
+
+// Forget every reading, at the start of a field
+void sampling_reset(void);
+
+// 1 when the last reading of a sensor can be used for a cell, given the split margin of its value
+int sampling_reusable(int sensor, const sampling_policy_t *policy, int row, int col, int margin);
+
+// A reading of a sensor was taken for a cell
+void sampling_taken(int sensor, int row, int col);
+
+#endif
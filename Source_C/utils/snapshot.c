@@ -0,0 +1,28 @@
+#include "snapshot.h"
+#include <string.h>
+
+void snapshot_serve(snapshot_t *snapshot, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+    int32_t start = offset != NULL ? *offset : 0;
+    int len;
+
+    if (start == 0)
+        snapshot->len = snapshot->encode(snapshot->buf, snapshot->size);
+
+    if (start >= snapshot->len)
+    {
+        coap_set_status_code(response, BAD_OPTION_4_02);
+        coap_set_payload(response, (uint8_t *)"BlockOutOfScope", strlen("BlockOutOfScope"));
+        return;
+    }
+
+    len = snapshot->len - start < preferred_size ? snapshot->len - start : preferred_size;
+    memcpy(buffer, snapshot->buf + start, len);
+    coap_set_header_content_format(response, APPLICATION_OCTET_STREAM);
+    coap_set_payload(response, buffer, len);
+
+    if (offset != NULL)
+        *offset = start + len < snapshot->len ? start + len : -1;
+    else if (len < snapshot->len)
+        coap_set_header_block2(response, 0, 1, preferred_size);
+}
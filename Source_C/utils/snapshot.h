@@ -0,0 +1,24 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/*
+Serves a binary snapshot that is larger than one CoAP block from a GET handler.
+
+The snapshot is encoded on the first block (and for every notification) and the
+following blocks are sliced from that copy, so a client never mixes two snapshots.
+Notifications carry the first block only; observers fetch the rest with Block2.
+*/
+
+#include "coap-engine.h"
+
+typedef struct
+{
+    uint8_t *buf;
+    int size;
+    int len;
+    int (*encode)(uint8_t *buf, int size);
+} snapshot_t;
+
+void snapshot_serve(snapshot_t *snapshot, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+
+#endif
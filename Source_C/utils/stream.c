@@ -0,0 +1,167 @@
+#include "stream.h"
+#include "lib/random.h"
+#include <string.h>
+
+// State of a buffered record
+#define RECORD_UNSENT 0
+#define RECORD_SENT 1
+#define RECORD_ACKED 2
+
+typedef struct
+{
+    uint16_t seq;
+    uint8_t state;
+    uint8_t data[STREAM_RECORD_SIZE];
+} stream_record_t;
+
+static stream_record_t ring[STREAM_CONF_RECORDS];
+static int head = 0;
+static int count = 0;
+static uint16_t next_seq = 0;
+static uint16_t session = 0;
+static uint16_t dropped = 0;
+
+static stream_record_t *record_at(int i)
+{
+    return &ring[(head + i) % STREAM_CONF_RECORDS];
+}
+
+static void release_acked(void)
+{
+    while (count > 0 && ring[head].state == RECORD_ACKED)
+    {
+        head = (head + 1) % STREAM_CONF_RECORDS;
+        count--;
+    }
+}
+
+void stream_init(void)
+{
+    head = 0;
+    count = 0;
+    next_seq = 0;
+    dropped = 0;
+    session = random_rand();
+}
+
+uint16_t stream_push(const uint8_t *record)
+{
+    stream_record_t *r;
+
+    if (count == STREAM_CONF_RECORDS)
+    {
+        // Never acknowledged: give up the oldest record
+        head = (head + 1) % STREAM_CONF_RECORDS;
+        count--;
+        if (dropped < 0xFFFF)
+            dropped++;
+    }
+
+    r = record_at(count++);
+    r->seq = next_seq++;
+    r->state = RECORD_UNSENT;
+    memcpy(r->data, record, STREAM_RECORD_SIZE);
+    return r->seq;
+}
+
+int stream_pending(void)
+{
+    int pending = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (record_at(i)->state != RECORD_ACKED)
+            pending++;
+    }
+    return pending;
+}
+
+uint16_t stream_dropped(void)
+{
+    return dropped;
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+    return p + 2;
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint8_t *put_header(uint8_t *p, uint8_t records)
+{
+    *p++ = STREAM_VERSION;
+    *p++ = records;
+    p = put_u16(p, session);
+    return put_u16(p, count > 0 ? ring[head].seq : next_seq);
+}
+
+int stream_encode(uint8_t *buf, int size)
+{
+    uint8_t *p = buf + STREAM_HEADER_SIZE;
+    uint8_t records = 0;
+
+    for (int i = 0; i < count && STREAM_MESSAGE_SIZE(records + 1) <= size; i++)
+    {
+        stream_record_t *r = record_at(i);
+
+        if (r->state != RECORD_UNSENT)
+            continue;
+        p = put_u16(p, r->seq);
+        memcpy(p, r->data, STREAM_RECORD_SIZE);
+        p += STREAM_RECORD_SIZE;
+        r->state = RECORD_SENT;
+        records++;
+    }
+
+    if (records == 0)
+        return 0;
+    put_header(buf, records);
+    return p - buf;
+}
+
+int stream_encode_ack_request(uint8_t *buf, int size)
+{
+    if (size < STREAM_HEADER_SIZE)
+        return 0;
+    put_header(buf, 0);
+    return STREAM_HEADER_SIZE;
+}
+
+int stream_ack(const uint8_t *payload, int len)
+{
+    uint16_t next;
+    uint32_t received;
+    int released = 0;
+
+    if (payload == NULL || len < STREAM_ACK_SIZE || payload[0] != STREAM_VERSION || get_u16(payload + 2) != session)
+        return -1;
+    next = get_u16(payload + 4);
+    received = (uint32_t)get_u16(payload + 6) << 16 | get_u16(payload + 8);
+
+    for (int i = 0; i < count; i++)
+    {
+        stream_record_t *r = record_at(i);
+        uint16_t offset = r->seq - next;
+
+        if (r->state == RECORD_ACKED)
+            continue;
+        if ((int16_t)offset < 0 || (offset < 32 && (received >> offset) & 1))
+        {
+            r->state = RECORD_ACKED;
+            released++;
+        }
+        else if (r->state == RECORD_SENT)
+        {
+            // Lost on the way: send it again
+            r->state = RECORD_UNSENT;
+        }
+    }
+    release_acked();
+    return released;
+}
@@ -0,0 +1,73 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+/*
+Non-confirmable record stream with aggregated acknowledgements.
+
+Records of a fixed size get a sequence number and wait in a buffer until the
+server has acknowledged them. They are sent in NON messages, as many per message
+as fit, and only once until the next acknowledgement, so no record waits for a
+round trip. Every few records the sender asks for an acknowledgement with a
+confirmable message without records: the response tells which records arrived
+and the missing ones are sent again. When the buffer is full the oldest record
+is dropped.
+
+Message layout (version 1, big endian):
+  header  u8 version, u8 record count, u16 session, u16 base
+  record  u16 sequence number, STREAM_RECORD_SIZE bytes
+The session is drawn at boot, so the server can tell a restarted sender. Base is
+the oldest sequence number still buffered: the server stops waiting for the
+records before it.
+
+Acknowledgement, the response to every message:
+  u8 version, u8 reserved, u16 session, u16 next, u32 received
+All records before next arrived; bit i of received is set when record next + i did.
+*/
+
+#include "contiki.h"
+#include <stdint.h>
+
+#define STREAM_VERSION 1
+
+// Records kept until acknowledged
+#ifndef STREAM_CONF_RECORDS
+#define STREAM_CONF_RECORDS 16
+#endif
+
+#ifndef STREAM_CONF_RECORD_SIZE
+#define STREAM_CONF_RECORD_SIZE 20
+#endif
+
+#define STREAM_RECORD_SIZE STREAM_CONF_RECORD_SIZE
+#define STREAM_HEADER_SIZE 6
+#define STREAM_ACK_SIZE 10
+#define STREAM_MESSAGE_SIZE(records) (STREAM_HEADER_SIZE + (records) * (2 + STREAM_RECORD_SIZE))
+
+// The acknowledgement window covers the whole buffer
+#if STREAM_CONF_RECORDS > 32
+#error "STREAM_CONF_RECORDS must not exceed the 32 records of an acknowledgement"
+#endif
+
+void stream_init(void);
+
+// Append a record, dropping the oldest one when the buffer is full; return its sequence number
+uint16_t stream_push(const uint8_t *record);
+
+// Records waiting for an acknowledgement
+int stream_pending(void);
+
+// Records dropped unacknowledged so far
+uint16_t stream_dropped(void);
+
+// Encode the records not sent since the last acknowledgement, as many as fit in size.
+// Return the message length, 0 when there is nothing to send
+int stream_encode(uint8_t *buf, int size);
+
+// Encode an acknowledgement request: a message without records
+int stream_encode_ack_request(uint8_t *buf, int size);
+
+// Apply an acknowledgement: release the records it covers and mark the others for
+// sending again. Return the number of records released, -1 when it is not valid
+int stream_ack(const uint8_t *payload, int len);
+
+#endif
@@ -5,9 +5,12 @@ from flask_cors import CORS
 import threading
 import datetime
 from db_manager_mysql import get_field_progress, FieldNotFoundError
-from db_manager_mysql import add_field, get_sensor_by_name
-from coapthon.client.helperclient import HelperClient
+from db_manager_mysql import add_field
+from device_registry import DeviceRegistry
+from coap_client import CoAPClient
+from coverage import CoverageCache, CoverageError, decode_coverage
 import json
+import aiocoap
 
 
 app = Flask(__name__)
@@ -21,6 +24,18 @@ sowing_status = "Not started"
 # Create a lock object to manage access to global variables
 lock = threading.Lock()
 
+# Read-only view of the devices registered by the CoAP server, refreshed in the background
+registry = DeviceRegistry(persist=False)
+
+# One CoAP client (one socket) for every request and observation of the process
+coap_client = CoAPClient()
+
+# Last coverage map of each actuator, revalidated with its ETag
+coverage_cache = CoverageCache()
+
+# Largest payload of a POST to the actuator: it takes one block (COAP_MAX_CHUNK_SIZE)
+SOWING_PAYLOAD_LIMIT = 64
+
 
 # Classe CoAPObserver
 class CoAPObserver:
@@ -28,7 +43,7 @@ class CoAPObserver:
         self.server_host = server_host
         self.server_port = server_port
         self.resource_path = resource_path
-        self.client = HelperClient(server=(self.server_host, self.server_port))
+        self.observation = None
         self.lock = threading.Lock()
 
     def observe(self):
@@ -36,7 +51,7 @@ class CoAPObserver:
         Subscribes the observer in the CoAP resource and handles notifications.        
         """
         try:
-            self.client.observe(self.resource_path, self.handle_notification)
+            self.observation = coap_client.observe(self.server_host, self.resource_path, self.handle_notification, port=self.server_port)
             print(f"Subscribed to {self.resource_path}. Waiting for notifications...")
         except Exception as e:
             print(f"Failed to subscribe: {e}")
@@ -89,9 +104,10 @@ class CoAPObserver:
     
     def stop_observing(self):
         """
-        End the observation and close the client.
+        End the observation; the shared client stays open.
         """
-        self.client.stop()
+        if self.observation:
+            self.observation.cancel()
         print("Stopped observing.")
 
 
@@ -106,20 +122,27 @@ def send_coap_msg_to_actuator(method, ip_address, payload=None):
     :return: The response from the COAP server, or None if there was an error
     """
     try:
-        client = HelperClient(server=(ip_address, 5683))  # Default COAP port is 5683
-        response = None
-        if method == "POST":
-            response = client.post("sowing_actuator", payload)
-        elif method == "PUT":
-            response = client.put("sowing_actuator", payload)
-        elif method == "DELETE":
-            response = client.delete("sowing_actuator")
-        client.stop()
-        return response
+        if method not in ("POST", "PUT", "DELETE"):
+            return None
+        # Default COAP port is 5683
+        return coap_client.request(method, ip_address, "sowing_actuator", payload if method != "DELETE" else None)
     except Exception as e:
         print(f"Error sending COAP message: {e}")
         return None
 
+def sowing_payload(length, width, square_size, field_id, survey_field_id=None):
+    """
+    Builds the payload that starts the sowing actuator, without spaces.
+
+    :param survey_field_id: The field whose prescription map the actuator follows, or None
+    :return: The payload, or None if it does not fit in one block of the actuator
+    """
+    payload = f'{{"length":{length},"width":{width},"square_size":{square_size},"field_id":{field_id}'
+    if survey_field_id is not None:
+        payload += f',"survey":{int(survey_field_id)}'
+    payload += '}'
+    return payload if len(payload.encode('utf-8')) <= SOWING_PAYLOAD_LIMIT else None
+
 # Serve HTML pages
 @app.route("/")
 def index():
@@ -157,6 +180,11 @@ def start_sowing():
             length = data['length']
             width = data['width']
             square_size = data['square_size']
+
+            # Optional field surveyed earlier: the actuator follows its prescription map
+            survey_field_id = data.get('survey_field_id')
+            if survey_field_id is not None and not str(survey_field_id).isdigit():
+                return jsonify({"message": "Invalid survey_field_id"}), 400
             
             # Logic to start the sowing process
             sowing_initialized = True
@@ -165,7 +193,7 @@ def start_sowing():
             start_sowing_date = datetime.datetime.now()
 
             # Get the actuator IP from the database
-            actuator = get_sensor_by_name("sowing_actuator")
+            actuator = registry.lookup("sowing_actuator")
             actuator_ip = actuator['ipv6_address'] if actuator else None
 
             if not actuator_ip:
@@ -175,8 +203,11 @@ def start_sowing():
             # Call the add_field function with the relevant data
             field_id = add_field(length, width, square_size, start_sowing_date)
 
-            # Send COAP message to the sowing actuator
-            coap_payload = f'{{"length": {length}, "width": {width}, "square_size": {square_size}, "field_id": {field_id}}}'
+            # Send COAP message to the sowing actuator, in one block
+            coap_payload = sowing_payload(length, width, square_size, field_id, survey_field_id)
+            if coap_payload is None:
+                sowing_initialized = False
+                return jsonify({"message": f"Sowing parameters longer than {SOWING_PAYLOAD_LIMIT} bytes"}), 400
 
             print(f"Sending COAP message to actuator {actuator_ip} with payload: {coap_payload}")
 
@@ -211,7 +242,7 @@ def change_sowing_status():
     with lock:
         if sowing_initialized:
             # Get the actuator IP from the database
-            actuator = get_sensor_by_name("sowing_actuator")
+            actuator = registry.lookup("sowing_actuator")
             if not actuator or 'ipv6_address' not in actuator:
                 # Return error if actuator IP not found
                 return jsonify({"message": "Actuator IP not found"}), 500
@@ -257,7 +288,7 @@ def stop_sowing():
     with lock:
         if sowing_initialized:
             # Get the actuator IP from the database
-            actuator = get_sensor_by_name("sowing_actuator")
+            actuator = registry.lookup("sowing_actuator")
             if not actuator or 'ipv6_address' not in actuator:
                 # Return error if actuator IP not found
                 return jsonify({"message": "Actuator IP not found"}), 500
@@ -338,6 +369,46 @@ def get_sowing_percentage():
             }
             return jsonify(response_data), 409
 
+@app.route("/coverage", methods=["GET"])
+def get_coverage():
+    """
+    Retrieves the map of the sown cells from the actuator (sowing_actuator/coverage),
+    in one Block2 transfer instead of a query of the Cell table.
+
+    Returns:
+        Response: A JSON response with "field_id", "rows", "cols", "sown" and "cells",
+        a list of rows of 0 (not sown) and 1 (sown), and the status codes:
+            - 200 if the map was read.
+            - 500 if the actuator is not found or did not answer.
+    """
+    actuator = registry.lookup("sowing_actuator")
+    if not actuator:
+        return jsonify({"message": "Actuator not found"}), 500
+    host = actuator['ipv6_address']
+
+    # Unchanged since the last read: the actuator answers 2.03 without payload
+    for _ in range(2):
+        response = coap_client.request("GET", host, "sowing_actuator/coverage", etag=coverage_cache.etag(host))
+        if response is None or not response.code.is_successful():
+            return jsonify({"message": "Failed to read the coverage map"}), 500
+        if response.code == aiocoap.VALID and coverage_cache.get(host) is not None:
+            return jsonify(coverage_cache.get(host)), 200
+        try:
+            coverage = decode_coverage(response.payload)
+        except CoverageError as e:
+            # Most likely a cell sown during the transfer: read it again once
+            print(f"Coverage map of {host}: {e}")
+            continue
+        etags = response.opt.etags
+        coverage_cache.put(host, etags[0] if etags else None, coverage)
+        return jsonify(coverage), 200
+
+    return jsonify({"message": "Inconsistent coverage map"}), 500
+
 if __name__ == "__main__":
+    # Load the devices and keep them in sync with the CoAP server's registrations
+    registry.load()
+    registry.start_refresh()
+
     # Run the Flask application in debug mode
     app.run(debug=True)
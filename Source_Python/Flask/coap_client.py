@@ -0,0 +1,116 @@
+import asyncio
+import threading
+import aiocoap
+
+# Seconds to wait for the response to a request
+REQUEST_TIMEOUT = 30
+
+METHODS = {
+    "GET": aiocoap.GET,
+    "POST": aiocoap.POST,
+    "PUT": aiocoap.PUT,
+    "DELETE": aiocoap.DELETE
+}
+
+
+def coap_uri(host, port, path):
+    # IPv6 literals must be bracketed inside a URI
+    if ':' in host and not host.startswith('['):
+        host = f"[{host}]"
+    return f"coap://{host}:{port}/{path.lstrip('/')}"
+
+
+class Observation:
+    """
+    Handle of an observation registered on the shared client.
+    """
+
+    def __init__(self, client, uri, callback):
+        self.client = client
+        self.uri = uri
+        self.callback = callback
+        self._request = None
+
+    def cancel(self):
+        """
+        Stop observing; safe to call from any thread, including the notification callback.
+        """
+        self.client._loop.call_soon_threadsafe(self._cancel)
+
+    def _cancel(self):
+        if self._request is not None and not self._request.observation.cancelled:
+            self._request.observation.cancel()
+
+
+class CoAPClient:
+    """
+    Single long-lived CoAP client shared by the whole Flask process.
+    All requests and observations go through one aiocoap context (one socket),
+    driven by an event loop on a background thread; responses and notifications
+    are matched to their exchange by token, so the number of threads does not
+    grow with the number of actuators.
+    """
+
+    def __init__(self):
+        self._loop = asyncio.new_event_loop()
+        self._context = None
+        self._ready = threading.Event()
+        self._thread = threading.Thread(target=self._run, name="coap-client", daemon=True)
+        self._thread.start()
+        self._ready.wait()
+
+    def request(self, method, host, path, payload=None, port=5683, timeout=REQUEST_TIMEOUT, etag=None):
+        """
+        Send a request and wait for its response.
+        :param method: The method to use ('GET', 'POST', 'PUT', 'DELETE')
+        :param etag: ETag of the representation already known, answered 2.03 while it is current
+        :return: The response message, or None if the exchange failed or timed out
+        """
+        message = aiocoap.Message(code=METHODS[method], uri=coap_uri(host, port, path))
+        if payload is not None:
+            message.payload = payload.encode('utf-8') if isinstance(payload, str) else payload
+        if etag is not None:
+            message.opt.etags = (etag,)
+
+        future = asyncio.run_coroutine_threadsafe(self._request(message), self._loop)
+        try:
+            return future.result(timeout)
+        except Exception as e:
+            future.cancel()
+            print(f"CoAP {method} to {host} failed: {e}")
+            return None
+
+    def observe(self, host, path, callback, port=5683):
+        """
+        Observe a resource; callback(response) is called for every notification,
+        and with None when the observation ends with an error.
+        :return: An Observation handle
+        """
+        observation = Observation(self, coap_uri(host, port, path), callback)
+        asyncio.run_coroutine_threadsafe(self._observe(observation), self._loop)
+        return observation
+
+    def stop(self):
+        asyncio.run_coroutine_threadsafe(self._context.shutdown(), self._loop).result(REQUEST_TIMEOUT)
+        self._loop.call_soon_threadsafe(self._loop.stop)
+
+    def _run(self):
+        asyncio.set_event_loop(self._loop)
+        self._context = self._loop.run_until_complete(aiocoap.Context.create_client_context())
+        self._ready.set()
+        self._loop.run_forever()
+
+    async def _request(self, message):
+        return await self._context.request(message).response
+
+    async def _observe(self, observation):
+        message = aiocoap.Message(code=aiocoap.GET, uri=observation.uri, observe=0)
+        request = self._context.request(message)
+        observation._request = request
+        try:
+            observation.callback(await request.response)
+            async for notification in request.observation:
+                observation.callback(notification)
+        except Exception as e:
+            print(f"Observation of {observation.uri} ended: {e}")
+            observation.callback(None)
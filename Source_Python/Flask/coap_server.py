@@ -1,236 +1,425 @@
-import os
 import json
-import threading
+import time
 import signal
-from coapthon.server.coap import CoAP
-from coapthon.resources.resource import Resource
-from db_manager_mysql import add_device, create_database_and_tables, get_sensor_by_name, add_cell, npk
-from coapthon import defines
-import re
+import asyncio
+import aiocoap
+import aiocoap.resource as resource
+from db_manager_mysql import create_database_and_tables, add_cell, get_field_survey, npk
+from device_registry import DeviceRegistry, device_type_of
+from reassembly import ReassemblyBuffer
+from record_stream import RecordStreams, StreamError, decode_message, measured
+from prescription import build_prescription
+from seed_model import SeedModel
+from server_metrics import ServerMetrics, WorkerPool, WorkerPoolFull
+
+# CoAP content formats
+TEXT_PLAIN = 0
+APPLICATION_OCTET_STREAM = 42
+APPLICATION_JSON = 50
+
+# DB worker pool: blocking queries run here, never on the event loop
+DB_WORKERS = 8        # Threads running DB work
+DB_QUEUE_LIMIT = 64   # Jobs allowed to wait for a thread before requests are rejected
+RETRY_AFTER = 5       # Max-Age (seconds) suggested to clients rejected with 5.03
+
+# Seconds a prescription map is kept: the actuator reads it one block at a time
+PRESCRIPTION_TTL = 300
 
 expected_keys = {'npk', 'ph', 'moisture', 'temp', 'seed_type', 'row', 'col', 'field_id'}
-received_data = {}
 
+# Partial cell records, one per reporting actuator
+received_data = ReassemblyBuffer(expected_keys)
 
-class RegistrationResource(Resource):
-    def __init__(self, name="RegistrationResource", coap_server=None):
-        super(RegistrationResource, self).__init__(name, coap_server, visible=True, observable=True)
-        self.content_format = "text/plain"
-        self.payload = "Register a device by sending its name."
+# Acknowledgement state of the actuators streaming their cell records
+record_streams = RecordStreams()
 
-    def render_POST_advanced(self, request, response):
+
+def source_of(request):
+    """
+    Return the (host, port) endpoint a request was sent from.
+    """
+    sockaddr = request.remote.sockaddr
+    return sockaddr[0], sockaddr[1]
+
+
+def text_response(code, text):
+    return aiocoap.Message(code=code, payload=text.encode('utf-8'), content_format=TEXT_PLAIN)
+
+
+def json_response(code, data):
+    return aiocoap.Message(code=code, payload=json.dumps(data).encode('utf-8'), content_format=APPLICATION_JSON)
+
+
+class ServerResource(resource.Resource):
+    """
+    Base class of the server resources: measures the latency of every request
+    and answers 5.03 Service Unavailable when the DB worker pool is saturated.
+    """
+
+    def __init__(self, name, server):
+        super(ServerResource, self).__init__()
+        self.name = name
+        self.server = server
+
+    async def render(self, request):
+        start = time.monotonic()
+        try:
+            response = await super(ServerResource, self).render(request)
+        except WorkerPoolFull:
+            print(f"DB queue full, rejecting request to {self.name}")  # Debug log
+            response = text_response(aiocoap.SERVICE_UNAVAILABLE, "Server busy, retry later")
+            response.opt.max_age = RETRY_AFTER
+        self.server.metrics.observe(self.name, response.code, time.monotonic() - start)
+        return response
+
+    async def run_db(self, fn, *args, **kwargs):
+        return await self.server.workers.run(fn, *args, **kwargs)
+
+
+def parse_registration(text):
+    """
+    Parse a registration payload: a bare device name, or {"name": ..., "row": r, "col": c}
+    for a device that covers a zone of the field (Source_C/utils/registration.h).
+    :return: (name, zone row, zone column), the zone None when not given
+    """
+    if not text.startswith('{'):
+        return text, None, None
+    payload = json.loads(text)
+    row = payload.get('row')
+    if row is None or row < 0:
+        return payload.get('name', ''), None, None
+    return payload.get('name', ''), int(row), int(payload.get('col', 0))
+
+
+class RegistrationResource(ServerResource):
+    def __init__(self, server):
+        super(RegistrationResource, self).__init__("register", server)
+
+    async def render_post(self, request):
         """
         Method to handle POST requests for device registration.
         :param request: The incoming CoAP request
-        :param response: The outgoing CoAP response
-        :return: A tuple containing the resource and the response
+        :return: The outgoing CoAP response
         """
         try:
-            device_name = request.payload.strip()
+            device_name, zone_row, zone_col = parse_registration(request.payload.decode('utf-8').strip())
             print(f"Received device name: {device_name}")  # Debug log
 
             if not device_name:
-                response.code = defines.Codes.BAD_REQUEST.number  # 4.00 Bad Request
-                response.payload = "Error: Device name is required."
                 print("Error: Device name is required.")  # Debug log
-                return self, response
+                return text_response(aiocoap.BAD_REQUEST, "Error: Device name is required.")
 
-            ip_address = request.source[0]
+            ip_address = source_of(request)[0]
             print(f"Received from IP: {ip_address}")  # Debug log
 
-            # Add the device to the database
-            return_code = add_device(device_name, ip_address)
+            # Add the device to the registry, persisted in the background
+            return_code = self.server.registry.register(device_name, ip_address, zone_row, zone_col)
 
             if return_code == 1:
-                response.code = defines.Codes.CREATED.number  # 2.01 Created
-                response.payload = f"Device '{device_name}' registered successfully from IP {ip_address}."
-            elif return_code == 2:
-                response.code = defines.Codes.CHANGED.number  # 2.04 Changed
-                response.payload = f"Device '{device_name}' updated successfully, new IP {ip_address}."
+                response = text_response(aiocoap.CREATED, f"Device '{device_name}' registered successfully from IP {ip_address}.")
+            else:
+                response = text_response(aiocoap.CHANGED, f"Device '{device_name}' updated successfully, new IP {ip_address}.")
 
-            print(response.payload)  # Debug log
+            print(response.payload.decode('utf-8'))  # Debug log
+            return response
 
         except Exception as e:
-            response.code = defines.Codes.INTERNAL_SERVER_ERROR.number  # 5.00 Internal Server Error
-            response.payload = f"Error in registration: {str(e)}"
             print(f"Error in registration: {str(e)}")  # Debug log
-
-        return self, response
-    
+            return text_response(aiocoap.INTERNAL_SERVER_ERROR, f"Error in registration: {str(e)}")
 
 
-class DeviceNameDiscoverResource(Resource):
-    def __init__(self, name="DeviceNameDiscoverResource", coap_server=None):
-        super(DeviceNameDiscoverResource, self).__init__(name, coap_server, visible=True, observable=True)
-        self.content_format = "application/json"
+class DeviceNameDiscoverResource(ServerResource):
+    def __init__(self, server):
+        super(DeviceNameDiscoverResource, self).__init__("discover", server)
 
-    def render_POST_advanced(self, request, response):
+    async def render_post(self, request):
         """
-        Handle advanced POST request for device discovery by name.
+        Handle POST request for device discovery by name.
         """
         try:
             # Parse JSON payload
-            payload_str = request.payload.decode('utf-8') if isinstance(request.payload, bytes) else request.payload
-            
-            print(f"RICEVUTO QUESTO PAYLOAD {payload_str}")
-            
-            payload = json.loads(payload_str)
+            payload = json.loads(request.payload.decode('utf-8'))
             print(f"Received JSON payload: {payload}")
 
             # Extract the device name from the payload
-            device_name = payload.get('name')
+            device_name = payload.get('name') if isinstance(payload, dict) else None
             if not device_name:
                 # If 'name' is not present in the payload, return a bad request response
-                response.code = defines.Codes.BAD_REQUEST.number  # 4.00 Bad Request
-                response.payload = json.dumps({"error": "Device name is required"})
-                return self, response
+                return json_response(aiocoap.BAD_REQUEST, {"error": "Device name is required"})
 
             print(f"Received device name: {device_name}")
 
-            # Get the device information using the device name
-            device_dict = get_sensor_by_name(device_name)
+            if 'row' in payload:
+                # The instances closest to the position of the requester, answered under the requested name
+                nearest = self.server.registry.nearest(device_type_of(device_name), int(payload['row']), int(payload.get('col', 0)))
+                if nearest:
+                    result = {device_name: nearest[0]['ipv6_address']}
+                    if len(nearest) > 1:
+                        result['alt'] = nearest[1]['ipv6_address']
+                    return json_response(aiocoap.CONTENT, result)
+
+            # Get the device information using the device name, else any instance of the type
+            device_dict = self.server.registry.get(device_name)
+            if device_dict is None:
+                instances = self.server.registry.get_by_type(device_name)
+                if instances:
+                    device_dict = dict(instances[0], name=device_name)
 
             if device_dict and isinstance(device_dict, dict):
                 # If device is found and is a dictionary
                 if 'name' in device_dict and 'ipv6_address' in device_dict:
-                    # Properly serialize device information to JSON
-                    response.payload = json.dumps({
-                        device_dict['name']: device_dict['ipv6_address']
-                    })
-                    response.code = defines.Codes.CONTENT.number  # 2.05 Content
-                    response.content_type = defines.Content_types["application/json"]
+                    response = json_response(aiocoap.CONTENT, {device_dict['name']: device_dict['ipv6_address']})
                 else:
                     # If device data is incomplete
-                    response.code = defines.Codes.INTERNAL_SERVER_ERROR.number  # 5.00 Internal Server Error
-                    response.payload = json.dumps({"error": "Device data is incomplete"})
+                    response = json_response(aiocoap.INTERNAL_SERVER_ERROR, {"error": "Device data is incomplete"})
             else:
                 # If device is not found
-                response.code = defines.Codes.NOT_FOUND.number  # 4.04 Not Found
-                response.payload = json.dumps({"error": "Device not found"})
+                response = json_response(aiocoap.NOT_FOUND, {"error": "Device not found"})
 
-        except json.JSONDecodeError:
+        except (json.JSONDecodeError, UnicodeDecodeError):
             # JSON decoding failed
-            response.code = defines.Codes.BAD_REQUEST.number  # 4.00 Bad Request
-            response.payload = json.dumps({"error": "Invalid JSON payload"})
-        
+            response = json_response(aiocoap.BAD_REQUEST, {"error": "Invalid JSON payload"})
         except Exception as e:
             # General exception handling
-            response.code = defines.Codes.INTERNAL_SERVER_ERROR.number  # 5.00 Internal Server Error
-            response.payload = json.dumps({"error": str(e)})
-            print(f"Error in render_POST_advanced: {str(e)}")  # Debug log
+            print(f"Error in discovery: {str(e)}")  # Debug log
+            response = json_response(aiocoap.INTERNAL_SERVER_ERROR, {"error": str(e)})
 
         print(f"Response payload: {response.payload}")  # Debug log
-        return self, response
+        return response
+
+
+class RegistryResource(resource.ObservableResource):
+    """
+    Observable version of the device registry: {"version": n, "name": "..."}, the
+    number of changes so far and the last device added or moved. The actuators
+    observe it to drop the cached address of a device as soon as it changes
+    (Source_C/utils/discovery.h).
+    """
+
+    def __init__(self, registry):
+        super(RegistryResource, self).__init__()
+        self.version = 0
+        self.changed = ""
+        registry.add_listener(self.device_changed)
+
+    def device_changed(self, name):
+        self.version += 1
+        self.changed = name
+        self.updated_state()
+
+    async def render_get(self, request):
+        return json_response(aiocoap.CONTENT, {"version": self.version, "name": self.changed})
 
 
-class SaveResource(Resource):
-    def __init__(self, name="SaveResource", coap_server=None):
-        super(SaveResource, self).__init__(name, coap_server=coap_server, visible=True, observable=True)
-        self.content_format = "application/json"  
+class SaveResource(ServerResource):
+    def __init__(self, server):
+        super(SaveResource, self).__init__("save", server)
 
-    def render_POST_advanced(self, request, response):
+    async def render_post(self, request):
         """
         Method for handling POST requests. Accumulates data and updates the DB when all necessary data has been received.
         :param request: The incoming CoAP request.
-        :param response: The outgoing CoAP response
-        :return: A tuple containing the resource and the response
+        :return: The outgoing CoAP response
         """
-        print("Received advanced POST request.")
-        
         try:
-            payload_str = request.payload
+            payload_str = request.payload.decode('utf-8')
             print(f"Raw payload: {payload_str}")
 
             if not payload_str:
-                response.code = defines.Codes.BAD_REQUEST.number
-                response.payload = "No payload received"
-                return self, response
+                return text_response(aiocoap.BAD_REQUEST, "No payload received")
 
             # Parse the JSON payload
             payload = json.loads(payload_str)
-            print(f"Parsed JSON payload: {payload}")
-            
-            # Update data received globally
-            global received_data
-            received_data.update(payload)
-
-            # Check if all the necessary data are present            
-            if all(k in received_data for k in expected_keys):
-                npk_values = received_data.get('npk', {})
-                npk_data = npk(n=npk_values.get('n'), p=npk_values.get('p'), k=npk_values.get('k'))
-
-                return_code = add_cell(
-                    field_id=received_data.get('field_id'),
-                    c_row=received_data.get('row'),
-                    c_col=received_data.get('col'),
+
+            if not isinstance(payload, dict):
+                return text_response(aiocoap.BAD_REQUEST, "Expected a JSON object")
+
+            # Merge the fragment into the record of the sending actuator
+            source = source_of(request)
+            record = received_data.add(source, payload)
+
+            if record is None:
+                # Still missing data, wait for more messages
+                return text_response(aiocoap.VALID, "Data received, waiting for more.")
+
+            # A cell seeded from a prescription map has no readings
+            npk_values = record.get('npk', {})
+            npk_data = npk(n=measured(npk_values.get('n')), p=measured(npk_values.get('p')), k=measured(npk_values.get('k')))
+
+            try:
+                return_code = await self.run_db(
+                    add_cell,
+                    field_id=record.get('field_id'),
+                    c_row=record.get('row'),
+                    c_col=record.get('col'),
                     npk=npk_data,
-                    moisture=received_data.get('moisture'),
-                    ph=received_data.get('ph'),
-                    temperature=received_data.get('temp'),
-                    sowed=received_data.get('seed_type')
-                )                    
-                print(f"Received data: {received_data.values()}")
-
-                # Clear the accumulated data after saving
-                received_data.clear()
-
-                # Set the response based on the return code
-                if return_code == 1:
-                    response.code = defines.Codes.CREATED.number  # 2.01 Created
-                    response.payload = "New cell added"
-                elif return_code == 2:
-                    response.code = defines.Codes.CHANGED.number  # 2.04 Changed
-                    response.payload = "Cell updated"
-                else:
-                    response.code = defines.Codes.CONTENT.number  # 2.05 Content
-                    response.payload = "Cell data unchanged"
+                    moisture=measured(record.get('moisture')),
+                    ph=measured(record.get('ph')),
+                    temperature=measured(record.get('temp')),
+                    sowed=record.get('seed_type')
+                )
+            except WorkerPoolFull:
+                # The mote resends only the last fragment after the 5.03: keep the others for it
+                received_data.restore(source, record)
+                raise
+            print(f"Received data from {source}: {record.values()}")
+
+            # Set the response based on the return code
+            if return_code == 1:
+                return text_response(aiocoap.CREATED, "New cell added")
+            elif return_code == 2:
+                return text_response(aiocoap.CHANGED, "Cell updated")
             else:
-                # Still missing data, wait for more messages
-                print("Still missing data, waiting for more.")
-                response.code = defines.Codes.VALID.number  # 2.03 Valid
-                response.payload = "Data received, waiting for more."
+                return text_response(aiocoap.CONTENT, "Cell data unchanged")
 
-        except json.JSONDecodeError:
+        except (json.JSONDecodeError, UnicodeDecodeError):
             print("Error: Invalid JSON payload")
-            response.code = defines.Codes.BAD_REQUEST.number
-            response.payload = "Invalid JSON payload"
+            return text_response(aiocoap.BAD_REQUEST, "Invalid JSON payload")
+        except WorkerPoolFull:
+            raise
         except Exception as e:
             print(f"Error: {str(e)}")
-            response.code = defines.Codes.INTERNAL_SERVER_ERROR.number
-            response.payload = f"Error: {str(e)}"
+            return text_response(aiocoap.INTERNAL_SERVER_ERROR, f"Error: {str(e)}")
+
 
-        return self, response
+class SaveStreamResource(ServerResource):
+    def __init__(self, server):
+        super(SaveStreamResource, self).__init__("save/stream", server)
 
-class CoAPServer(CoAP):
+    async def render_post(self, request):
+        """
+        Store the cell records of a stream message (Source_C/utils/stream.h), sent
+        as NON, and answer with the acknowledgement of the stream. A message without
+        records is an acknowledgement request, sent as CON.
+        """
+        try:
+            session, base, records = decode_message(request.payload)
+        except StreamError as e:
+            return text_response(aiocoap.BAD_REQUEST, str(e))
+
+        host = source_of(request)[0]
+        for seq, record in record_streams.receive(host, session, base, records):
+            try:
+                await self.run_db(
+                    add_cell,
+                    field_id=record['field_id'],
+                    c_row=record['row'],
+                    c_col=record['col'],
+                    npk=npk(n=record['n'], p=record['p'], k=record['k']),
+                    moisture=record['moisture'],
+                    ph=record['ph'],
+                    temperature=record['temp'],
+                    sowed=record['seed_type']
+                )
+            except WorkerPoolFull:
+                # Not acknowledged: the actuator sends it again
+                break
+            except Exception as e:
+                print(f"Error storing streamed record {seq} from {host}: {str(e)}")
+                continue
+            record_streams.stored(host, session, seq)
+            print(f"Received record {seq} from {host}: {record}")
+
+        return aiocoap.Message(code=aiocoap.CHANGED, payload=record_streams.ack(host), content_format=APPLICATION_OCTET_STREAM)
+
+
+class PrescriptionResource(ServerResource):
+    """
+    Prescription map of a surveyed field (Source_C/utils/prescription.h): the seed
+    type the model of the actuator gives the readings stored for every cell.
+    GET /prescription?field=<id>, read by the actuator with Block2.
+    """
+
+    def __init__(self, server):
+        super(PrescriptionResource, self).__init__("prescription", server)
+        self.model = SeedModel()
+        self._maps = {}  # field id -> (time built, packed map)
+
+    async def render_get(self, request):
+        query = dict(q.split('=', 1) for q in request.opt.uri_query if '=' in q)
+        field = query.get('field', '')
+        if not field.isdigit():
+            return text_response(aiocoap.BAD_REQUEST, "Expected ?field=<id>")
+        field_id = int(field)
+
+        # Every block is a request of its own: build the map once for all of them
+        cached = self._maps.get(field_id)
+        if cached is None or time.monotonic() - cached[0] > PRESCRIPTION_TTL:
+            survey = await self.run_db(get_field_survey, field_id)
+            if survey is None:
+                self._maps.pop(field_id, None)
+                return text_response(aiocoap.NOT_FOUND, "No survey of the field")
+            rows, cols, cells = survey
+            cached = (time.monotonic(), build_prescription(rows, cols, cells, self.model))
+            self._maps[field_id] = cached
+
+        return aiocoap.Message(code=aiocoap.CONTENT, payload=cached[1], content_format=APPLICATION_OCTET_STREAM)
+
+
+class MetricsResource(resource.Resource):
+    """
+    Exposes request latency percentiles, response codes and DB queue depth as JSON.
+    """
+
+    def __init__(self, server):
+        super(MetricsResource, self).__init__()
+        self.server = server
+
+    async def render_get(self, request):
+        data = self.server.metrics.to_dict()
+        data["reassembly"] = {"pending": received_data.pending()}
+        data["streams"] = {"actuators": len(record_streams)}
+        data["registry"] = {"devices": len(self.server.registry)}
+        return json_response(aiocoap.CONTENT, data)
+
+
+class CoAPServer:
     def __init__(self, host, port=5683):
-        super(CoAPServer, self).__init__((host, port))
-        self.add_resource('register', RegistrationResource())
-        self.add_resource('discover', DeviceNameDiscoverResource()) 
-        self.add_resource('save', SaveResource())
-        self._running = threading.Event()
-        self._running.set()
-
-    def start(self):
+        self.host = host
+        self.port = port
+        self.metrics = ServerMetrics()
+        self.workers = WorkerPool(DB_WORKERS, DB_QUEUE_LIMIT, self.metrics)
+        self.registry = DeviceRegistry()
+
+        self.site = resource.Site()
+        self.site.add_resource(['.well-known', 'core'], resource.WKCResource(self.site.get_resources_as_linkheader))
+        self.site.add_resource(['register'], RegistrationResource(self))
+        self.site.add_resource(['discover'], DeviceNameDiscoverResource(self))
+        self.site.add_resource(['registry'], RegistryResource(self.registry))
+        self.site.add_resource(['save'], SaveResource(self))
+        self.site.add_resource(['save', 'stream'], SaveStreamResource(self))
+        self.site.add_resource(['prescription'], PrescriptionResource(self))
+        self.site.add_resource(['metrics'], MetricsResource(self))
+
+        self.context = None
+        self._stopped = None
+
+    async def start(self):
         print(f"Starting CoAP server...")
-        while self._running.is_set():
-            self.listen(10)
+        self._stopped = asyncio.Event()
+        self.registry.load()
+        self.context = await aiocoap.Context.create_server_context(self.site, bind=(self.host, self.port))
+        await self._stopped.wait()
+
+        await self.context.shutdown()
+        self.workers.shutdown()
+        self.registry.close()
+        print("CoAP Server stopped.")
 
     def stop(self):
         """
-        Shutdown the CoAP server by closing the socket.
+        Shutdown the CoAP server.
         """
-        if self._socket:  # Check if the socket exists before closing it
-            self._running.clear()  # Indicate that the server should stop
-            self._socket.close()
-            print("CoAP Server stopped.")
+        if self._stopped is not None:
+            self._stopped.set()
+
 
-def signal_handler(signal, frame):
+def signal_handler(coap_server):
     print("\nInterrupt received, stopping server...")
     coap_server.stop()
-    os._exit(0)
 
-if __name__ == "__main__":
 
+async def main():
     # Create the database and tables if they don't exist
     create_database_and_tables()
 
@@ -239,12 +428,15 @@ if __name__ == "__main__":
     coap_server = CoAPServer(host, port)
 
     # Set up the signal handler for interrupts
-    signal.signal(signal.SIGINT, signal_handler)
+    asyncio.get_running_loop().add_signal_handler(signal.SIGINT, signal_handler, coap_server)
+
+    print("CoAP Server is running...")
+    await coap_server.start()
 
+
+if __name__ == "__main__":
     try:
-        print("CoAP Server is running...")
-        coap_server.start()
+        asyncio.run(main())
     except Exception as e:
         print(f"Exception occurred: {e}")
-        coap_server.stop()
-        os._exit(1)
+        raise SystemExit(1)
@@ -0,0 +1,58 @@
+import struct
+import threading
+
+COVERAGE_VERSION = 1
+
+# Layout of sowing_actuator/coverage (Source_C/utils/actuator.h): version, field id, rows, cols, sown cells
+HEADER = struct.Struct(">BHHHH")
+
+
+class CoverageError(ValueError):
+    pass
+
+
+def decode_coverage(payload):
+    """
+    Decode the coverage map of the actuator.
+    :return: dict with field_id, rows, cols, sown and cells, a list of rows of 0/1
+    """
+    if len(payload) < HEADER.size:
+        raise CoverageError("Coverage map too short")
+    version, field_id, rows, cols, sown = HEADER.unpack_from(payload, 0)
+    if version != COVERAGE_VERSION:
+        raise CoverageError(f"Unsupported coverage version {version}")
+    bitmap = payload[HEADER.size:]
+    if len(bitmap) < (rows * cols + 7) // 8:
+        raise CoverageError(f"Truncated coverage map of {rows}x{cols} cells")
+
+    # Cell row * cols + col is bit (cell % 8) of byte (cell / 8)
+    cells = [[(bitmap[(r * cols + c) // 8] >> ((r * cols + c) % 8)) & 1 for c in range(cols)] for r in range(rows)]
+    if sum(map(sum, cells)) != sown:
+        # A cell was sown between two blocks
+        raise CoverageError("Blocks of two versions of the coverage map")
+    return {"field_id": field_id, "rows": rows, "cols": cols, "sown": sown, "cells": cells}
+
+
+class CoverageCache:
+    """
+    Last coverage map read from each actuator with its ETag: the actuator answers
+    2.03 Valid without payload while no cell was sown since.
+    """
+
+    def __init__(self):
+        self._maps = {}
+        self._lock = threading.Lock()
+
+    def etag(self, host):
+        with self._lock:
+            cached = self._maps.get(host)
+            return cached[0] if cached else None
+
+    def get(self, host):
+        with self._lock:
+            cached = self._maps.get(host)
+            return cached[1] if cached else None
+
+    def put(self, host, etag, coverage):
+        with self._lock:
+            self._maps[host] = (etag, coverage)
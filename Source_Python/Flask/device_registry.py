@@ -0,0 +1,226 @@
+import time
+import threading
+import logging
+from concurrent.futures import ThreadPoolExecutor
+from db_manager_mysql import add_device, get_all_devices, get_sensor_by_name
+
+logger = logging.getLogger(__name__)
+
+# Seconds between two reloads of a read-only registry (see start_refresh)
+REFRESH_INTERVAL = 5
+
+
+def device_type_of(name):
+    """
+    Return the type of a device from its name.
+    Instance names have the form '<type>@<instance>'; a bare name is its own type.
+    """
+    return name.split('@', 1)[0]
+
+
+def zone_distance(entry, row, col):
+    """
+    Return the distance in cells from the zone of a device to a cell; devices without a zone come last.
+    """
+    if entry.zone_row is None:
+        return float('inf')
+    return abs(entry.zone_row - row) + abs((entry.zone_col or 0) - col)
+
+
+class DeviceEntry:
+    def __init__(self, name, ipv6_address, zone_row=None, zone_col=None):
+        self.name = name
+        self.device_type = device_type_of(name)
+        self.ipv6_address = ipv6_address
+        self.zone_row = zone_row
+        self.zone_col = zone_col
+        self.last_seen = time.time()
+        self.write_failed = False
+
+    def to_dict(self):
+        return {
+            "name": self.name,
+            "ipv6_address": self.ipv6_address
+        }
+
+
+class DeviceRegistry:
+    """
+    In-memory view of the Device table, indexed by name and by type.
+    Lookups never touch the database; registrations are applied in memory and
+    written through to MySQL by a single background writer, only when they change something.
+    """
+
+    def __init__(self, persist=True):
+        self._lock = threading.Lock()
+        self._by_name = {}
+        self._by_type = {}
+        self._listeners = []
+        # A single writer keeps the writes of a device in registration order
+        self._writer = ThreadPoolExecutor(max_workers=1, thread_name_prefix="registry-writer") if persist else None
+        self._refresh_thread = None
+        self._refresh_stop = threading.Event()
+
+    def load(self):
+        """
+        Load every device from the database. Known devices are updated in place and keep
+        their liveness, new ones are added and the ones no longer stored are dropped.
+        A failed read leaves the registry as it was.
+        """
+        devices = get_all_devices()
+        if devices is None:
+            logger.warning("Device table unreadable, keeping the registry as it was.")
+            return
+        with self._lock:
+            for name in [name for name in self._by_name if name not in devices]:
+                entry = self._by_name.pop(name)
+                self._by_type.get(entry.device_type, {}).pop(name, None)
+            for name, device in devices.items():
+                entry = self._by_name.get(name)
+                if entry is None:
+                    self._put(DeviceEntry(name, device["ipv6_address"], device.get("zone_row"), device.get("zone_col")))
+                else:
+                    entry.ipv6_address = device["ipv6_address"]
+                    entry.zone_row = device.get("zone_row")
+                    entry.zone_col = device.get("zone_col")
+        logger.info(f"Device registry loaded with {len(devices)} devices.")
+
+    def register(self, name, ipv6_address, zone_row=None, zone_col=None):
+        """
+        Register a device or refresh its address, zone and liveness.
+        :return: 1 if the device is new, 2 if it was already known
+        """
+        with self._lock:
+            entry = self._by_name.get(name)
+            if entry is None:
+                entry = DeviceEntry(name, ipv6_address, zone_row, zone_col)
+                self._put(entry)
+                return_code = 1
+                changed = True
+            else:
+                # A failed write is retried on the next registration
+                changed = (entry.ipv6_address != ipv6_address or entry.zone_row != zone_row or
+                           entry.zone_col != zone_col or entry.write_failed)
+                entry.ipv6_address = ipv6_address
+                entry.zone_row = zone_row
+                entry.zone_col = zone_col
+                entry.write_failed = False
+                entry.last_seen = time.time()
+                return_code = 2
+
+        if changed:
+            self._write_through(name, ipv6_address, zone_row, zone_col)
+            self._notify(name)
+        return return_code
+
+    def get(self, name):
+        """
+        Return the device with the given name as a dictionary, or None.
+        """
+        with self._lock:
+            entry = self._by_name.get(name)
+            return entry.to_dict() if entry else None
+
+    def get_by_type(self, device_type):
+        """
+        Return every device of the given type, most recently seen first.
+        """
+        with self._lock:
+            entries = sorted(self._by_type.get(device_type, {}).values(), key=lambda e: e.last_seen, reverse=True)
+            return [entry.to_dict() for entry in entries]
+
+    def nearest(self, device_type, row, col, count=2):
+        """
+        Return the devices of the given type whose zone is closest to a cell, at most count.
+        Among devices at the same distance the most recently seen comes first.
+        """
+        with self._lock:
+            entries = sorted(self._by_type.get(device_type, {}).values(), key=lambda e: e.last_seen, reverse=True)
+            entries.sort(key=lambda e: zone_distance(e, row, col))
+            return [entry.to_dict() for entry in entries[:count]]
+
+    def touch(self, name):
+        """
+        Refresh the liveness timestamp of a device.
+        """
+        with self._lock:
+            entry = self._by_name.get(name)
+            if entry:
+                entry.last_seen = time.time()
+
+    def last_seen(self, name):
+        with self._lock:
+            entry = self._by_name.get(name)
+            return entry.last_seen if entry else None
+
+    def add_listener(self, callback):
+        """
+        Register callback(name), called after a device is added or changes address or zone.
+        """
+        self._listeners.append(callback)
+
+    def __len__(self):
+        with self._lock:
+            return len(self._by_name)
+
+    def start_refresh(self, interval=REFRESH_INTERVAL):
+        """
+        Periodically reload the registry in the background.
+        Used by processes that only read devices registered by the CoAP server.
+        """
+        def refresh_loop():
+            while not self._refresh_stop.wait(interval):
+                try:
+                    self.load()
+                except Exception as e:
+                    logger.error(f"Error refreshing device registry: {str(e)}")
+
+        self._refresh_thread = threading.Thread(target=refresh_loop, name="registry-refresh", daemon=True)
+        self._refresh_thread.start()
+
+    def lookup(self, name):
+        """
+        Like get(), but falls back to the database for devices registered after the last refresh.
+        """
+        device = self.get(name)
+        if device is None:
+            device = get_sensor_by_name(name)
+            if device:
+                with self._lock:
+                    self._put(DeviceEntry(device["name"], device["ipv6_address"], device.get("zone_row"), device.get("zone_col")))
+        return device
+
+    def close(self):
+        self._refresh_stop.set()
+        if self._writer:
+            self._writer.shutdown(wait=True)
+
+    def _put(self, entry):
+        old = self._by_name.get(entry.name)
+        if old is not None:
+            self._by_type.get(old.device_type, {}).pop(old.name, None)
+        self._by_name[entry.name] = entry
+        self._by_type.setdefault(entry.device_type, {})[entry.name] = entry
+
+    def _write_through(self, name, ipv6_address, zone_row, zone_col):
+        if self._writer is None:
+            return
+
+        def write():
+            try:
+                add_device(name, ipv6_address, zone_row, zone_col)
+            except Exception as e:
+                logger.error(f"Error persisting device '{name}': {str(e)}")
+                with self._lock:
+                    entry = self._by_name.get(name)
+                    if entry and entry.ipv6_address == ipv6_address:
+                        entry.write_failed = True
+
+        self._writer.submit(write)
+
+    def _notify(self, name):
+        for callback in self._listeners:
+            try:
+                callback(name)
+            except Exception as e:
+                logger.error(f"Error in registry listener: {str(e)}")
@@ -0,0 +1,43 @@
+import struct
+
+PRESCRIPTION_VERSION = 1
+
+# Layout of Source_C/utils/prescription.h: version, bits per cell, rows, cols
+HEADER = struct.Struct(">BBHH")
+
+# Bits per cell: enough for the seed types of the model and the value of a cell without survey data
+PRESCRIPTION_BITS = 5
+NO_SURVEY = (1 << PRESCRIPTION_BITS) - 1
+
+
+def build_prescription(rows, cols, cells, model):
+    """
+    Pack the prescription map of a surveyed field: the seed type the model gives
+    the readings of every cell, row after row, PRESCRIPTION_BITS bits each, most
+    significant bit first. A cell without complete readings holds NO_SURVEY and
+    is sensed by the actuator.
+    :param cells: dicts with row, col and the readings named as in seed_model.FEATURES
+    """
+    seeds = [NO_SURVEY] * (rows * cols)
+    for cell in cells:
+        row, col = cell['row'], cell['col']
+        if not (0 <= row < rows and 0 <= col < cols):
+            continue
+        seed = model.predict(cell)
+        if seed is not None and seed < NO_SURVEY:
+            seeds[row * cols + col] = seed
+
+    bits = 0
+    value = 0
+    packed = bytearray()
+    for seed in seeds:
+        value = value << PRESCRIPTION_BITS | seed
+        bits += PRESCRIPTION_BITS
+        while bits >= 8:
+            bits -= 8
+            packed.append((value >> bits) & 0xFF)
+        value &= (1 << bits) - 1
+    if bits:
+        packed.append((value << (8 - bits)) & 0xFF)
+
+    return HEADER.pack(PRESCRIPTION_VERSION, PRESCRIPTION_BITS, rows, cols) + bytes(packed)
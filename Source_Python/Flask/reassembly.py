@@ -0,0 +1,134 @@
+import time
+import threading
+import logging
+
+logger = logging.getLogger(__name__)
+
+# Keys that open a new cell record: the actuator always sends them first
+HEADER_KEYS = {'row', 'col', 'field_id'}
+
+# Seconds after which an incomplete record is considered abandoned.
+# The actuator spaces its fragments 10 s apart, so a full record takes about a minute.
+REASSEMBLY_TIMEOUT = 120
+
+# Upper bound on the number of partial records kept at the same time
+MAX_PARTIAL_RECORDS = 1024
+
+
+class PartialRecord:
+    def __init__(self):
+        self.data = {}
+        self.last_update = time.monotonic()
+
+    def update(self, fragment):
+        self.data.update(fragment)
+        self.last_update = time.monotonic()
+
+
+class ReassemblyBuffer:
+    """
+    Reassembles cell records sent as several fragments.
+    Partial records are keyed by source endpoint and field, so concurrent actuators,
+    or one actuator moving to another field, never mix their cells. Only the header
+    fragment carries the field: the later fragments of an endpoint go to the field
+    its last header named. A fragment carrying the cell header (row, col, field_id)
+    opens a new record; stale partial records are evicted after a timeout.
+    """
+
+    def __init__(self, expected_keys, timeout=REASSEMBLY_TIMEOUT, max_records=MAX_PARTIAL_RECORDS):
+        self.expected_keys = set(expected_keys)
+        self.timeout = timeout
+        self.max_records = max_records
+        self._records = {}  # (endpoint, field_id) -> PartialRecord
+        self._fields = {}   # endpoint -> field_id of its last header
+        self._lock = threading.Lock()
+        self._last_sweep = time.monotonic()
+
+    def add(self, endpoint, fragment):
+        """
+        Merge a fragment into the record of the given endpoint.
+        :param endpoint: The source endpoint of the fragment (host, port)
+        :param fragment: The parsed JSON fragment
+        :return: The complete record when all expected keys are present, None otherwise
+        """
+        with self._lock:
+            self._evict_stale()
+
+            if 'field_id' in fragment:
+                self._fields[endpoint] = fragment['field_id']
+            key = (endpoint, self._fields.get(endpoint))
+            record = self._records.get(key)
+
+            # A new cell header starts a new record, dropping any unfinished one of the field
+            if HEADER_KEYS & fragment.keys():
+                if record is not None and self._is_new_cell(record, fragment):
+                    logger.warning(f"Discarding incomplete record from {endpoint}: {record.data}")
+                    record = None
+
+            if record is None:
+                if len(self._records) >= self.max_records:
+                    self._evict_oldest()
+                record = PartialRecord()
+                self._records[key] = record
+
+            record.update(fragment)
+
+            if all(k in record.data for k in self.expected_keys):
+                del self._records[key]
+                return record.data
+
+            return None
+
+    def restore(self, endpoint, data):
+        """
+        Put back a complete record that could not be stored, so that the retransmission
+        of its last fragment completes it again instead of finding the earlier ones gone.
+        A record the endpoint started since then is kept.
+        :param endpoint: The source endpoint the record came from
+        :param data: The record returned by add()
+        """
+        with self._lock:
+            key = (endpoint, data.get('field_id'))
+            if key in self._records:
+                return
+            if len(self._records) >= self.max_records:
+                self._evict_oldest()
+            record = PartialRecord()
+            record.update(data)
+            self._records[key] = record
+            self._fields.setdefault(endpoint, key[1])
+
+    def pending(self):
+        """
+        Return the number of partial records currently buffered.
+        """
+        with self._lock:
+            return len(self._records)
+
+    def _is_new_cell(self, record, fragment):
+        # The fragment describes a different cell than the one being assembled
+        for key in HEADER_KEYS:
+            if key in fragment and key in record.data and record.data[key] != fragment[key]:
+                return True
+        # The previous record already carries measurements: a header restarts it
+        return bool(record.data.keys() - HEADER_KEYS) and HEADER_KEYS <= fragment.keys()
+
+    def _evict_stale(self):
+        now = time.monotonic()
+        # Sweeping every call would be O(n) per fragment: do it at most twice per timeout
+        if now - self._last_sweep < self.timeout / 2:
+            return
+        self._last_sweep = now
+        stale = [key for key, rec in self._records.items() if now - rec.last_update > self.timeout]
+        for key in stale:
+            logger.warning(f"Evicting stale record from {key[0]}: {self._records[key].data}")
+            del self._records[key]
+        # Forget the field of the endpoints left without a record
+        endpoints = {endpoint for endpoint, _ in self._records}
+        for endpoint in [ep for ep in self._fields if ep not in endpoints]:
+            del self._fields[endpoint]
+
+    def _evict_oldest(self):
+        oldest = min(self._records, key=lambda key: self._records[key].last_update)
+        logger.warning(f"Reassembly buffer full, evicting record from {oldest[0]}")
+        del self._records[oldest]
@@ -0,0 +1,132 @@
+import struct
+import threading
+
+STREAM_VERSION = 1
+
+# Layouts of Source_C/utils/stream.h and of the cell record in Source_C/utils/actuator.h
+HEADER = struct.Struct(">BBHH")
+ENTRY = struct.Struct(">H10h")
+ACK = struct.Struct(">BBHHI")
+CELL_KEYS = ('field_id', 'row', 'col', 'n', 'p', 'k', 'moisture', 'temp', 'ph', 'seed_type')
+
+# Sensor value of a cell seeded from a prescription map, whose sensors were not read
+NOT_MEASURED = -32768
+SENSOR_KEYS = ('n', 'p', 'k', 'moisture', 'temp', 'ph')
+
+# Records an acknowledgement covers after the cumulative one
+ACK_WINDOW = 32
+
+
+class StreamError(ValueError):
+    pass
+
+
+def measured(value):
+    """
+    Return a sensor value of a cell record, None when the sensor was not read.
+    """
+    return None if value == NOT_MEASURED else value
+
+
+def decode_message(payload):
+    """
+    Decode a stream message.
+    :return: (session, base, list of (sequence number, cell record dict))
+    """
+    if len(payload) < HEADER.size:
+        raise StreamError("Message too short")
+    version, count, session, base = HEADER.unpack_from(payload, 0)
+    if version != STREAM_VERSION:
+        raise StreamError(f"Unsupported stream version {version}")
+    if len(payload) < HEADER.size + count * ENTRY.size:
+        raise StreamError(f"Truncated message: {count} records announced")
+
+    records = []
+    for i in range(count):
+        seq, *values = ENTRY.unpack_from(payload, HEADER.size + i * ENTRY.size)
+        record = dict(zip(CELL_KEYS, values))
+        for key in SENSOR_KEYS:
+            record[key] = measured(record[key])
+        records.append((seq, record))
+    return session, base, records
+
+
+class StreamState:
+    def __init__(self, session, base):
+        self.session = session
+        self.next = base
+        self.received = 0  # Bit i: record next + i stored
+
+    def skip_to(self, base):
+        # The sender dropped the records before base: stop waiting for them
+        while (self.next - base) & 0x8000:
+            self.received >>= 1
+            self.next = (self.next + 1) & 0xFFFF
+        self._advance()
+
+    def offset(self, seq):
+        """
+        Return the position of a record in the window, None when it was already
+        acknowledged or is beyond the window.
+        """
+        offset = (seq - self.next) & 0xFFFF
+        if offset >= ACK_WINDOW or (self.received >> offset) & 1:
+            return None
+        return offset
+
+    def mark(self, seq):
+        offset = self.offset(seq)
+        if offset is not None:
+            self.received |= 1 << offset
+            self._advance()
+
+    def ack(self):
+        return ACK.pack(STREAM_VERSION, 0, self.session, self.next, self.received)
+
+    def _advance(self):
+        while self.received & 1:
+            self.received >>= 1
+            self.next = (self.next + 1) & 0xFFFF
+
+
+class RecordStreams:
+    """
+    Receiving side of the record streams of the actuators (Source_C/utils/stream.h).
+    Every source host has one stream; a new session means the actuator restarted
+    and resets it. A record is acknowledged once it is stored, so a record whose
+    storage failed is sent again by the actuator.
+    """
+
+    def __init__(self):
+        self._streams = {}
+        self._lock = threading.Lock()
+
+    def receive(self, host, session, base, records):
+        """
+        Open or update the stream of a host with the header of a message.
+        :return: the (sequence number, record) pairs not stored yet
+        """
+        with self._lock:
+            stream = self._streams.get(host)
+            if stream is None or stream.session != session:
+                stream = StreamState(session, base)
+                self._streams[host] = stream
+            stream.skip_to(base)
+            return [(seq, record) for seq, record in records if stream.offset(seq) is not None]
+
+    def stored(self, host, session, seq):
+        """
+        Acknowledge a record once it is in the DB.
+        """
+        with self._lock:
+            stream = self._streams.get(host)
+            if stream is not None and stream.session == session:
+                stream.mark(seq)
+
+    def ack(self, host):
+        with self._lock:
+            return self._streams[host].ack()
+
+    def __len__(self):
+        with self._lock:
+            return len(self._streams)
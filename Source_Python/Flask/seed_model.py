@@ -0,0 +1,85 @@
+import os
+import re
+
+# Model of the actuator, packed by ML/model_pack.py (Source_C/utils/DT_model.h)
+MODEL_PATH = os.environ.get(
+    "SEEDBOT_MODEL",
+    os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "Source_C", "utils", "DT_model.h"))
+
+# Features of the model, in the order of apply_decision_tree_model() in actuator.c;
+# there is no sensor for the last one, which is left at 0
+FEATURES = ('n', 'p', 'k', 'ph', 'moisture', 'temperature')
+FEATURE_COUNT = 7
+
+
+class SeedModel:
+    """
+    The decision trees of the actuator, read from the C header, so the server
+    picks the seed type of a cell exactly as the actuator would.
+    The nodes are unpacked as packed_trees_node() does (Source_C/utils/packed_trees.h).
+    """
+
+    def __init__(self, path=MODEL_PATH):
+        with open(path) as f:
+            text = f.read()
+        data = self._array(text, "_nodes")
+        bases = self._array(text, "_bases")
+        widths = [self._field(text, name) for name in ("feature_bits", "threshold_bits", "child_bits")]
+        self.roots = self._array(text, "_roots")
+        self.classes = self._field(text, "n_classes")
+        self.nodes = [self._node(data, bases, i * (widths[0] + widths[1] + 2 * widths[2]), *widths)
+                      for i in range(self._field(text, "n_nodes"))]
+        # Leaf i holds class i
+        self.leaves = list(range(self.classes))
+
+    @staticmethod
+    def _array(text, name):
+        values = re.search(name + r"\[\d+\] = \{(.*?)\};", text, re.S).group(1)
+        return [int(v, 0) for v in values.split(',') if v.strip()]
+
+    @staticmethod
+    def _field(text, name):
+        return int(re.search(r"\." + name + r" = (\d+)", text).group(1))
+
+    @staticmethod
+    def _node(data, bases, bit, feature_bits, threshold_bits, child_bits):
+        def read(count):
+            nonlocal bit
+            value = 0
+            for i in range(bit, bit + count):
+                value = value << 1 | (data[i >> 3] >> (7 - (i & 7))) & 1
+            bit += count
+            return value
+
+        def child(value):
+            leaf = 1 << (child_bits - 1)
+            return -(value & ~leaf) - 1 if value & leaf else value
+
+        feature = read(feature_bits)
+        threshold = bases[feature] + read(threshold_bits)
+        return feature, threshold, child(read(child_bits)), child(read(child_bits))
+
+    def _tree(self, root, features):
+        # Children are relative to their node, a negative child is leaf -(child + 1)
+        index = root
+        while True:
+            feature, value, left, right = self.nodes[index]
+            child = left if features[feature] < value else right
+            if child < 0:
+                return self.leaves[-child - 1]
+            index += child
+
+    def predict(self, cell):
+        """
+        Seed type of a cell, None when one of its readings is missing.
+        :param cell: dict with the readings named as in FEATURES
+        """
+        if any(cell.get(name) is None for name in FEATURES):
+            return None
+        features = [int(cell[name]) for name in FEATURES] + [0] * (FEATURE_COUNT - len(FEATURES))
+
+        # Majority vote, ties to the lowest class as in eml_trees
+        votes = [0] * self.classes
+        for root in self.roots:
+            votes[self._tree(root, features)] += 1
+        return votes.index(max(votes))
@@ -0,0 +1,127 @@
+import time
+import asyncio
+import functools
+import threading
+from collections import deque, Counter
+from concurrent.futures import ThreadPoolExecutor
+
+# Number of latency samples kept per resource for the percentiles
+LATENCY_WINDOW = 2048
+
+
+class WorkerPoolFull(Exception):
+    """Exception raised when the DB worker queue is full and a job is rejected."""
+    pass
+
+
+class ResourceMetrics:
+    def __init__(self):
+        self.count = 0
+        self.codes = Counter()
+        self.latencies = deque(maxlen=LATENCY_WINDOW)
+        self.max_latency = 0.0
+
+    def observe(self, code, latency):
+        self.count += 1
+        self.codes[code] += 1
+        self.latencies.append(latency)
+        self.max_latency = max(self.max_latency, latency)
+
+    def to_dict(self):
+        samples = sorted(self.latencies)
+        return {
+            "count": self.count,
+            "p50_ms": _percentile_ms(samples, 50),
+            "p90_ms": _percentile_ms(samples, 90),
+            "p99_ms": _percentile_ms(samples, 99),
+            "max_ms": round(self.max_latency * 1000, 3),
+            "codes": dict(self.codes)
+        }
+
+
+def _percentile_ms(samples, percentile):
+    if not samples:
+        return None
+    index = min(len(samples) - 1, int(len(samples) * percentile / 100))
+    return round(samples[index] * 1000, 3)
+
+
+class ServerMetrics:
+    """
+    Request latency per resource and DB queue depth of the CoAP server.
+    """
+
+    def __init__(self):
+        self._lock = threading.Lock()
+        self._resources = {}
+        self.started = time.monotonic()
+        self.in_flight = 0
+        self.queue_depth = 0
+        self.max_queue_depth = 0
+        self.rejected = 0
+
+    def observe(self, resource_name, code, latency):
+        with self._lock:
+            self._resources.setdefault(resource_name, ResourceMetrics()).observe(str(code), latency)
+
+    def set_queue(self, in_flight, queue_depth):
+        with self._lock:
+            self.in_flight = in_flight
+            self.queue_depth = queue_depth
+            self.max_queue_depth = max(self.max_queue_depth, queue_depth)
+
+    def reject(self):
+        with self._lock:
+            self.rejected += 1
+
+    def to_dict(self):
+        with self._lock:
+            return {
+                "uptime_s": int(time.monotonic() - self.started),
+                "resources": {name: m.to_dict() for name, m in self._resources.items()},
+                "db": {
+                    "in_flight": self.in_flight,
+                    "queue_depth": self.queue_depth,
+                    "max_queue_depth": self.max_queue_depth,
+                    "rejected": self.rejected
+                }
+            }
+
+
+class WorkerPool:
+    """
+    Bounded pool of threads running the blocking DB calls off the event loop.
+    Jobs beyond workers + queue_limit are rejected with WorkerPoolFull so that
+    a slow database sheds load instead of stalling every mote.
+    """
+
+    def __init__(self, workers, queue_limit, metrics):
+        self.workers = workers
+        self.limit = workers + queue_limit
+        self.metrics = metrics
+        self._executor = ThreadPoolExecutor(max_workers=workers, thread_name_prefix="db-worker")
+        # Only touched from the event loop thread
+        self._pending = 0
+
+    async def run(self, fn, *args, **kwargs):
+        """
+        Run fn(*args, **kwargs) on the pool and wait for its result.
+        :raises WorkerPoolFull: When the queue is already at its limit
+        """
+        if self._pending >= self.limit:
+            self.metrics.reject()
+            raise WorkerPoolFull()
+
+        self._update_pending(+1)
+        try:
+            loop = asyncio.get_running_loop()
+            return await loop.run_in_executor(self._executor, functools.partial(fn, *args, **kwargs))
+        finally:
+            self._update_pending(-1)
+
+    def shutdown(self):
+        self._executor.shutdown(wait=True)
+
+    def _update_pending(self, delta):
+        self._pending += delta
+        self.metrics.set_queue(min(self._pending, self.workers), max(0, self._pending - self.workers))
@@ -0,0 +1,90 @@
+"""
+Tests of the /save resource of coap_server.py when the DB worker pool is full.
+
+aiocoap and the MySQL layer are replaced by stubs, so the tests run without a
+CoAP stack or a database: python3 -m unittest test_save_resource
+"""
+import json
+import types
+import asyncio
+import unittest
+import test_support
+
+test_support.install()
+
+import coap_server  # noqa: E402
+from reassembly import ReassemblyBuffer  # noqa: E402
+from server_metrics import ServerMetrics, WorkerPool  # noqa: E402
+
+ENDPOINT = ('fd00::202', 5683)
+
+FRAGMENTS = [
+    {"row": 3, "col": 4, "field_id": 1},
+    {"npk": {"n": 10, "p": 20, "k": 30}},
+    {"moisture": 40},
+    {"temp": 21},
+    {"ph": 6},
+    {"seed_type": 2},
+]
+
+
+def post(fragment):
+    return types.SimpleNamespace(payload=json.dumps(fragment).encode('utf-8'),
+                                 remote=types.SimpleNamespace(sockaddr=ENDPOINT))
+
+
+class SaveResourceTest(unittest.TestCase):
+
+    def setUp(self):
+        self.stored = []
+        coap_server.add_cell = lambda **cell: self.stored.append(cell) or 1
+        coap_server.received_data = ReassemblyBuffer(coap_server.expected_keys)
+        metrics = ServerMetrics()
+        self.workers = WorkerPool(1, 0, metrics)
+        self.resource = coap_server.SaveResource(types.SimpleNamespace(metrics=metrics, workers=self.workers))
+
+    def tearDown(self):
+        self.workers.shutdown()
+
+    def send(self, fragment):
+        return asyncio.run(self.resource.render(post(fragment)))
+
+    def test_record_survives_full_pool(self):
+        for fragment in FRAGMENTS[:-1]:
+            self.assertEqual(self.send(fragment).code, coap_server.aiocoap.VALID)
+
+        # Every thread busy: the complete record is rejected with a Max-Age
+        self.workers._pending = self.workers.limit
+        response = self.send(FRAGMENTS[-1])
+        self.assertEqual(response.code, coap_server.aiocoap.SERVICE_UNAVAILABLE)
+        self.assertEqual(response.opt.max_age, coap_server.RETRY_AFTER)
+        self.assertEqual(self.stored, [])
+        self.assertEqual(coap_server.received_data.pending(), 1)
+
+        # The mote sends the last fragment again once the pool has drained
+        self.workers._pending = 0
+        self.assertEqual(self.send(FRAGMENTS[-1]).code, coap_server.aiocoap.CREATED)
+        self.assertEqual(len(self.stored), 1)
+        cell = self.stored[0]
+        self.assertEqual((cell['field_id'], cell['c_row'], cell['c_col']), (1, 3, 4))
+        self.assertEqual((cell['npk'], cell['moisture'], cell['ph'], cell['temperature'], cell['sowed']),
+                         ((10, 20, 30), 40, 6, 21, 2))
+        self.assertEqual(coap_server.received_data.pending(), 0)
+
+    def test_new_cell_after_rejection(self):
+        for fragment in FRAGMENTS[:-1]:
+            self.send(fragment)
+        self.workers._pending = self.workers.limit
+        self.send(FRAGMENTS[-1])
+        self.workers._pending = 0
+
+        # The mote gave up on the cell: the header of the next one replaces the kept record
+        self.send({"row": 3, "col": 5, "field_id": 1})
+        self.assertEqual(coap_server.received_data.pending(), 1)
+        for fragment in FRAGMENTS[1:]:
+            self.send(fragment)
+        self.assertEqual([cell['c_col'] for cell in self.stored], [5])
+
+
+if __name__ == '__main__':
+    unittest.main()
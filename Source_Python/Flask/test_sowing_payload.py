@@ -0,0 +1,56 @@
+"""
+Tests of the payload app.py sends to the actuator to start the sowing, which
+must fit in one 64-byte block of the actuator.
+
+Flask, aiocoap, the CoAP client and the MySQL layer are replaced by stubs:
+python3 -m unittest test_sowing_payload
+"""
+import unittest
+import test_support
+
+test_support.install()
+
+import app  # noqa: E402
+
+# Exactly one block: '{"length":64,"width":64,"square_size":1,"field_id":1,"survey":7}'
+FULL_BLOCK = dict(length=64, width=64, square_size=1, field_id=1, survey_field_id=7)
+
+
+class SowingPayloadTest(unittest.TestCase):
+
+    def test_payload_up_to_one_block(self):
+        payload = app.sowing_payload(**FULL_BLOCK)
+        self.assertEqual(payload, '{"length":64,"width":64,"square_size":1,"field_id":1,"survey":7}')
+        self.assertEqual(len(payload), app.SOWING_PAYLOAD_LIMIT)
+        self.assertEqual(app.sowing_payload(64, 64, 1, 12), '{"length":64,"width":64,"square_size":1,"field_id":12}')
+
+    def test_payload_over_one_block(self):
+        self.assertIsNone(app.sowing_payload(**dict(FULL_BLOCK, field_id=12)))
+
+
+class StartSowingTest(unittest.TestCase):
+
+    def setUp(self):
+        self.sent = []
+        app.sowing_initialized = False
+        app.request.get_json = lambda: {"length": 64, "width": 64, "square_size": 1, "survey_field_id": 7}
+        app.registry.lookup = lambda name: {"name": name, "ipv6_address": "fd00::201"}
+        app.send_coap_msg_to_actuator = lambda method, ip, payload: self.sent.append(payload) or payload
+        app.CoAPObserver.observe = lambda observer: None
+
+    def test_full_block_is_sent(self):
+        app.add_field = lambda *args: 1
+        body, status = app.start_sowing()
+        self.assertEqual(status, 200)
+        self.assertEqual(len(self.sent[0]), app.SOWING_PAYLOAD_LIMIT)
+
+    def test_longer_payload_is_refused(self):
+        app.add_field = lambda *args: 12
+        body, status = app.start_sowing()
+        self.assertEqual(status, 400)
+        self.assertEqual(self.sent, [])
+        self.assertFalse(app.sowing_initialized)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,75 @@
+"""
+Stand-ins for the packages the tests of the Flask directory run without: aiocoap,
+Flask, the shared CoAP client and the MySQL layer. install() registers them in
+sys.modules, and must run before app.py or coap_server.py is imported.
+"""
+import sys
+import types
+
+
+def aiocoap_module():
+    aiocoap = types.ModuleType('aiocoap')
+    for name, code in (('CREATED', 65), ('CHANGED', 68), ('CONTENT', 69), ('VALID', 67),
+                       ('BAD_REQUEST', 128), ('NOT_FOUND', 132), ('INTERNAL_SERVER_ERROR', 160), ('SERVICE_UNAVAILABLE', 163)):
+        setattr(aiocoap, name, code)
+
+    class Message:
+        def __init__(self, code=None, payload=b'', content_format=None, **kwargs):
+            self.code = code
+            self.payload = payload
+            self.opt = types.SimpleNamespace(max_age=None, content_format=content_format)
+
+    class Resource:
+        async def render(self, request):
+            return await self.render_post(request)
+
+    aiocoap.Message = Message
+    aiocoap.resource = types.ModuleType('aiocoap.resource')
+    aiocoap.resource.Resource = Resource
+    aiocoap.resource.ObservableResource = Resource
+    return aiocoap
+
+
+def flask_modules():
+    class App:
+        logger = None
+
+        def __init__(self, name):
+            self.name = name
+
+        def route(self, *args, **kwargs):
+            return lambda fn: fn
+
+    flask = types.ModuleType('flask')
+    flask.Flask = App
+    flask.request = types.SimpleNamespace(get_json=lambda: None)
+    flask.jsonify = lambda data: data
+    flask.render_template = lambda name: name
+    socketio = types.ModuleType('flask_socketio')
+    socketio.SocketIO = lambda app, **kwargs: types.SimpleNamespace(emit=lambda *args: None)
+    socketio.emit = None
+    cors = types.ModuleType('flask_cors')
+    cors.CORS = None
+    return flask, socketio, cors
+
+
+def db_module():
+    db = types.ModuleType('db_manager_mysql')
+    db.npk = lambda n, p, k: (n, p, k)
+    db.FieldNotFoundError = type('FieldNotFoundError', (Exception,), {})
+    for name in ('create_database_and_tables', 'add_cell', 'get_field_survey', 'get_field_progress', 'add_field',
+                 'add_device', 'get_all_devices', 'get_sensor_by_name'):
+        setattr(db, name, None)
+    return db
+
+
+def coap_client_module():
+    coap_client = types.ModuleType('coap_client')
+    coap_client.CoAPClient = lambda: types.SimpleNamespace(request=None, observe=lambda *args, **kwargs: None)
+    return coap_client
+
+
+def install():
+    aiocoap = aiocoap_module()
+    for module in (aiocoap, aiocoap.resource, *flask_modules(), db_module(), coap_client_module()):
+        sys.modules.setdefault(module.__name__, module)
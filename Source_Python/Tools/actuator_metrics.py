@@ -0,0 +1,108 @@
+"""
+Reads the /metrics resource of an actuator and prints its per-phase timings.
+
+The resource is the binary snapshot described in Source_C/utils/metrics.h; it is
+larger than one block, so it comes back with Block2 (handled by aiocoap).
+
+Usage: python3 actuator_metrics.py fd00::206:6:6:6 [--observe]
+"""
+import sys
+import struct
+import asyncio
+import argparse
+import aiocoap
+
+METRICS_VERSION = 1
+
+HEADER = struct.Struct(">BBBBIIHH")
+RECORD = struct.Struct(">BBHHHHH")
+
+# Same order as metric_id_t
+METRIC_NAMES = ["npk fetch", "ph fetch", "temp fetch", "moisture fetch", "inference", "seeding", "save", "cell"]
+
+# Unit of the values of a metric, as (label, factor to milliseconds)
+UNITS = {0: ("us", 0.001), 1: ("ms", 1.0), 2: ("100ms", 100.0)}
+
+
+def decode(payload):
+    """
+    Decode a metrics snapshot.
+    :return: dict with the header fields and a list of metrics
+    """
+    version, count, bins, _, uptime, cells, retransmissions, timeouts = HEADER.unpack_from(payload, 0)
+    if version != METRICS_VERSION:
+        raise ValueError(f"Unsupported metrics version {version}")
+
+    metrics = []
+    offset = HEADER.size
+    for _ in range(count):
+        metric_id, unit, n, low, high, mean, hist_base = RECORD.unpack_from(payload, offset)
+        offset += RECORD.size
+        hist = list(payload[offset:offset + bins])
+        offset += bins
+        label, factor = UNITS.get(unit, ("?", 1.0))
+        metrics.append({
+            "name": METRIC_NAMES[metric_id] if metric_id < len(METRIC_NAMES) else f"metric {metric_id}",
+            "count": n,
+            "min_ms": low * factor,
+            "max_ms": high * factor,
+            "mean_ms": mean * factor,
+            # Upper bound of every histogram bin, in ms; the last one is open
+            "bins_ms": [hist_base * 4 ** i * factor for i in range(bins - 1)],
+            "hist": hist
+        })
+
+    return {"uptime_s": uptime, "cells": cells, "retransmissions": retransmissions, "timeouts": timeouts, "metrics": metrics}
+
+
+def print_metrics(snapshot):
+    print(f"Uptime {snapshot['uptime_s']} s, {snapshot['cells']} cells, "
+          f"{snapshot['retransmissions']} retransmissions (estimated), {snapshot['timeouts']} timeouts")
+    print(f"{'Phase':<16} {'n':>6} {'min ms':>10} {'mean ms':>10} {'max ms':>10}  histogram")
+    for m in snapshot["metrics"]:
+        bins = " ".join(f"<{format_ms(limit)}:{count}" for limit, count in zip(m["bins_ms"], m["hist"]))
+        bins += f" >={format_ms(m['bins_ms'][-1])}:{m['hist'][-1]}"
+        print(f"{m['name']:<16} {m['count']:>6} {m['min_ms']:>10.3f} {m['mean_ms']:>10.3f} {m['max_ms']:>10.3f}  {bins}")
+    print()
+
+
+def format_ms(value):
+    if value >= 1000:
+        return f"{value / 1000:g}s"
+    if value >= 1:
+        return f"{value:g}ms"
+    return f"{value * 1000:g}us"
+
+
+async def main(args):
+    host = f"[{args.host}]" if ':' in args.host else args.host
+    uri = f"coap://{host}:{args.port}/metrics"
+    context = await aiocoap.Context.create_client_context()
+
+    try:
+        request = aiocoap.Message(code=aiocoap.GET, uri=uri, observe=0 if args.observe else None)
+        pending = context.request(request)
+        response = await pending.response
+        if not response.code.is_successful():
+            print(f"Error: {response.code}")
+            return 1
+        print_metrics(decode(response.payload))
+
+        if args.observe:
+            # A notification is sent after every cell
+            async for notification in pending.observation:
+                print_metrics(decode(notification.payload))
+    finally:
+        await context.shutdown()
+    return 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Print the per-phase timings of a SeedBot actuator.")
+    parser.add_argument("host", help="address of the actuator")
+    parser.add_argument("--port", type=int, default=5683)
+    parser.add_argument("--observe", action="store_true", help="keep printing a snapshot after every cell")
+    try:
+        sys.exit(asyncio.run(main(parser.parse_args())))
+    except KeyboardInterrupt:
+        sys.exit(1)
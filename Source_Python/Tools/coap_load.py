@@ -0,0 +1,372 @@
+"""
+Load generator for coap_server.py.
+
+Every virtual site is one actuator and its four sensors, each with its own UDP
+socket (so the server sees one endpoint per mote, as with real motes). A site
+replays the message mix of the firmware: the five /register requests, the
+/discover burst of the actuator and then the six /save fragments of every cell.
+Requests are sent as CON with the retransmission timing of Contiki-NG; loss and
+jitter are applied on the client side, in both directions.
+
+The readings are random, or with --field-grid those of a soil field written by
+the simulator (seedbot-sim --field-grid FILE, layout in Source_C/utils/field.h):
+site i reports the cells of row i of the grid.
+
+Usage: python3 coap_load.py --host fd00::1 --sites 200 --cells 20 --loss 0.02
+"""
+import sys
+import json
+import mmap
+import time
+import random
+import socket
+import struct
+import asyncio
+import argparse
+from collections import Counter
+import aiocoap
+
+# CoAP content format of the JSON payloads
+APPLICATION_JSON = 50
+
+# Retransmission parameters of the Contiki-NG CoAP engine (coap-transactions.h)
+RESPONSE_TIMEOUT = 3.0       # Seconds before the first retransmission
+RESPONSE_RANDOM_FACTOR = 1.5
+MAX_RETRANSMIT = 4
+SEPARATE_RESPONSE_TIMEOUT = 30.0  # Seconds to wait for a response after an empty ACK
+
+# A fragment answered 5.03 is sent again after its Max-Age, at most this many times (SAVE_CONF_BUSY_RETRIES)
+SAVE_BUSY_RETRIES = 3
+SERVICE_UNAVAILABLE = (5 << 5) | 3
+
+SENSOR_TYPES = ['npk', 'ph', 'moisture', 'temperature']
+ACTUATOR_TYPE = 'sowing_actuator'
+
+# Number of latency samples kept per resource for the percentiles
+LATENCY_WINDOW = 100000
+
+# Grid file of a soil field (Source_C/utils/field.h), in the byte order of the host that wrote it
+FIELD_GRID_HEADER = struct.Struct("=4sIHHHH")
+FIELD_GRID_MAGIC = b"SBFG"
+
+
+def code_name(code):
+    return "%d.%02d" % (code >> 5, code & 0x1F)
+
+
+class ResourceStats:
+    def __init__(self):
+        self.count = 0
+        self.timeouts = 0
+        self.retransmissions = 0
+        self.codes = Counter()
+        self.latencies = []
+
+    def observe(self, code, latency, retransmissions):
+        self.count += 1
+        self.retransmissions += retransmissions
+        if code is None:
+            self.timeouts += 1
+            self.codes['timeout'] += 1
+            return
+        self.codes[code_name(code)] += 1
+        if len(self.latencies) < LATENCY_WINDOW:
+            self.latencies.append(latency)
+
+    def percentile_ms(self, percentile):
+        if not self.latencies:
+            return None
+        samples = sorted(self.latencies)
+        index = min(len(samples) - 1, int(len(samples) * percentile / 100))
+        return samples[index] * 1000
+
+
+class LoadStats:
+    """
+    Client-side view of the run: latency, response codes and timeouts per resource.
+    """
+
+    def __init__(self):
+        self.resources = {}
+        self.cells = 0
+        self.started = None
+        self.finished = None
+
+    def observe(self, resource_name, code, latency, retransmissions):
+        self.resources.setdefault(resource_name, ResourceStats()).observe(code, latency, retransmissions)
+
+    def report(self, server_metrics=None):
+        elapsed = (self.finished or time.monotonic()) - self.started
+        total = sum(r.count for r in self.resources.values())
+
+        print(f"Duration   : {elapsed:.1f} s")
+        print(f"Requests   : {total} ({total / elapsed:.1f}/s)")
+        print(f"Cells      : {self.cells} ({self.cells / elapsed:.2f}/s, {self.cells * 3600 / elapsed:.0f}/h)")
+        print()
+        print(f"{'Resource':<10} {'n':>7} {'req/s':>8} {'p50 ms':>8} {'p90 ms':>8} {'p99 ms':>8} {'max ms':>8} {'retx':>6} {'timeouts':>8}  codes")
+        for name in sorted(self.resources):
+            r = self.resources[name]
+            cols = [r.percentile_ms(p) for p in (50, 90, 99, 100)]
+            cols = ["-" if value is None else f"{value:.1f}" for value in cols]
+            codes = ", ".join(f"{code}: {count}" for code, count in sorted(r.codes.items()))
+            print(f"{name:<10} {r.count:>7} {r.count / elapsed:>8.1f} {cols[0]:>8} {cols[1]:>8} {cols[2]:>8} {cols[3]:>8} {r.retransmissions:>6} {r.timeouts:>8}  {codes}")
+
+        if server_metrics is not None:
+            db = server_metrics.get('db', {})
+            print()
+            print(f"Server DB  : max queue depth {db.get('max_queue_depth')}, rejected {db.get('rejected')}")
+
+
+class Mote(asyncio.DatagramProtocol):
+    """
+    One virtual mote: a UDP socket with its own message IDs and tokens, sending
+    one confirmable request at a time like COAP_BLOCKING_REQUEST does.
+    """
+
+    def __init__(self, name, server, config, stats):
+        self.name = name
+        self.server = server
+        self.config = config
+        self.stats = stats
+        self.transport = None
+        self.next_mid = random.getrandbits(16)
+        self.next_token = random.getrandbits(16)
+        self._pending = None  # (mid, token, future) of the exchange in progress
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, addr):
+        if random.random() < self.config.loss:
+            return
+        try:
+            message = aiocoap.Message.decode(data)
+        except Exception:
+            return
+
+        # Confirmable (separate) responses are acknowledged whether or not they are still expected
+        if message.mtype == aiocoap.CON:
+            self._send(aiocoap.Message(mtype=aiocoap.ACK, mid=message.mid, code=aiocoap.EMPTY))
+
+        if self._pending is None:
+            return
+        mid, token, future = self._pending
+        if future.done():
+            return
+        if message.mtype == aiocoap.ACK and message.mid == mid and message.code == aiocoap.EMPTY:
+            # Empty ACK: the response will follow in a separate message
+            future.set_result(None)
+        elif message.token == token and message.code != aiocoap.EMPTY:
+            future.set_result(message)
+        elif message.mtype == aiocoap.RST and message.mid == mid:
+            future.set_result(message)
+
+    def _send(self, message):
+        if random.random() < self.config.loss:
+            return
+        self.transport.sendto(message.encode(), self.server)
+
+    async def request(self, resource_name, payload, content_format=None):
+        """
+        Send a POST to the server and wait for its response.
+        :return: The response message, or None if the exchange timed out
+        """
+        loop = asyncio.get_running_loop()
+        mid = self.next_mid = (self.next_mid + 1) & 0xFFFF
+        self.next_token = (self.next_token + 1) & 0xFFFF
+        token = self.next_token.to_bytes(2, 'big')
+
+        message = aiocoap.Message(mtype=aiocoap.CON, mid=mid, token=token, code=aiocoap.POST, payload=payload.encode('utf-8'))
+        message.opt.uri_path = (resource_name,)
+        if content_format is not None:
+            message.opt.content_format = content_format
+
+        if self.config.jitter > 0:
+            await asyncio.sleep(random.uniform(0, self.config.jitter))
+
+        start = time.monotonic()
+        timeout = RESPONSE_TIMEOUT * random.uniform(1, RESPONSE_RANDOM_FACTOR)
+        response = None
+        retransmissions = 0
+        separate = False
+
+        for attempt in range(MAX_RETRANSMIT + 1):
+            future = loop.create_future()
+            self._pending = (mid, token, future)
+            self._send(message)
+            try:
+                response = await asyncio.wait_for(future, timeout)
+            except asyncio.TimeoutError:
+                retransmissions += attempt < MAX_RETRANSMIT
+                timeout *= 2
+                continue
+            if response is None:
+                separate = True
+            break
+
+        if separate:
+            future = loop.create_future()
+            self._pending = (mid, token, future)
+            try:
+                response = await asyncio.wait_for(future, SEPARATE_RESPONSE_TIMEOUT)
+            except asyncio.TimeoutError:
+                response = None
+        self._pending = None
+
+        self.stats.observe(resource_name, None if response is None else int(response.code), time.monotonic() - start, retransmissions)
+        return response
+
+    def close(self):
+        if self.transport is not None:
+            self.transport.close()
+
+
+class FieldGrid:
+    """Soil of a simulated field, mapped from its grid file rather than read into memory."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self._map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, self.seed, self.rows, self.cols, self.quantities, _ = FIELD_GRID_HEADER.unpack_from(self._map, 0)
+        if magic != FIELD_GRID_MAGIC or self.quantities < 6:
+            raise ValueError(f"{path} is not a field grid")
+        self._cell = struct.Struct(f"={self.quantities}h")
+
+    def readings(self, row, col):
+        """N, P, K, pH, moisture and temperature of a cell, wrapping around the grid."""
+        offset = FIELD_GRID_HEADER.size + ((row % self.rows) * self.cols + col % self.cols) * self._cell.size
+        return self._cell.unpack_from(self._map, offset)[:6]
+
+
+def random_readings():
+    return (random.randint(0, 140), random.randint(5, 145), random.randint(5, 205),
+            random.randint(3, 10), random.randint(14, 100), random.randint(8, 44))
+
+
+async def open_mote(name, server, config, stats):
+    loop = asyncio.get_running_loop()
+    family = socket.AF_INET6 if ':' in server[0] else socket.AF_INET
+    local = ('::', 0) if family == socket.AF_INET6 else ('0.0.0.0', 0)
+    _, mote = await loop.create_datagram_endpoint(lambda: Mote(name, server, config, stats), local_addr=local, family=family)
+    return mote
+
+
+async def save_fragment(actuator, fragment):
+    """
+    Send one /save fragment like the firmware does: a 5.03 (database pool full) is
+    answered by sending the fragment again, in a new exchange, after its Max-Age.
+    """
+    for attempt in range(SAVE_BUSY_RETRIES + 1):
+        response = await actuator.request('save', fragment, APPLICATION_JSON)
+        if response is None or int(response.code) != SERVICE_UNAVAILABLE or attempt == SAVE_BUSY_RETRIES:
+            return response
+        await asyncio.sleep(response.opt.max_age if response.opt.max_age is not None else 60)
+
+
+async def run_site(index, server, config, stats):
+    """
+    Replay the life of one actuator and its sensors: registration, discovery and sowing.
+    """
+    suffix = f"@{index}" if config.instances else ""
+    sensors = [await open_mote(f"{kind}{suffix}", server, config, stats) for kind in SENSOR_TYPES]
+    actuator = await open_mote(f"{ACTUATOR_TYPE}{suffix}", server, config, stats)
+    motes = sensors + [actuator]
+
+    try:
+        # Motes boot at different times
+        await asyncio.sleep(random.uniform(0, config.ramp))
+        await asyncio.gather(*(mote.request('register', mote.name) for mote in motes))
+
+        for sensor in sensors:
+            await actuator.request('discover', json.dumps({"name": sensor.name}), APPLICATION_JSON)
+
+        for cell in range(config.cells):
+            row, col = index, cell
+            n, p, k, ph, moisture, temp = config.field.readings(row, col) if config.field else random_readings()
+            fragments = [
+                f"{{\"row\":{row}, \"col\":{col}, \"field_id\":{config.field_id}}}",
+                f"{{\"npk\":{{\"n\":{n}, \"p\":{p}, \"k\":{k}}}}}",
+                f"{{\"moisture\":{moisture}}}",
+                f"{{\"temp\":{temp}}}",
+                f"{{\"ph\":{ph}}}",
+                f"{{\"seed_type\":{random.randint(0, 21)}}}"
+            ]
+            for fragment in fragments:
+                await save_fragment(actuator, fragment)
+                if config.pace > 0:
+                    await asyncio.sleep(config.pace)
+            stats.cells += 1
+    finally:
+        for mote in motes:
+            mote.close()
+
+
+async def fetch_server_metrics(server):
+    context = await aiocoap.Context.create_client_context()
+    try:
+        host = f"[{server[0]}]" if ':' in server[0] else server[0]
+        request = aiocoap.Message(code=aiocoap.GET, uri=f"coap://{host}:{server[1]}/metrics")
+        response = await asyncio.wait_for(context.request(request).response, 10)
+        return json.loads(response.payload.decode('utf-8'))
+    except Exception as e:
+        print(f"Could not read the server metrics: {e}")
+        return None
+    finally:
+        await context.shutdown()
+
+
+async def main(config):
+    server = (config.host, config.port)
+    stats = LoadStats()
+    limit = asyncio.Semaphore(config.concurrency) if config.concurrency > 0 else None
+
+    async def limited_site(index):
+        if limit is None:
+            return await run_site(index, server, config, stats)
+        async with limit:
+            return await run_site(index, server, config, stats)
+
+    print(f"Load: {config.sites} sites x {config.cells} cells against {config.host}:{config.port}, "
+          f"loss {config.loss}, jitter {config.jitter * 1000:.0f} ms")
+
+    stats.started = time.monotonic()
+    await asyncio.gather(*(limited_site(i) for i in range(config.sites)))
+    stats.finished = time.monotonic()
+
+    stats.report(await fetch_server_metrics(server))
+
+
+def parse_args(argv):
+    parser = argparse.ArgumentParser(description="Emulate many SeedBot motes against the CoAP server.")
+    parser.add_argument("--host", default="::1", help="address of the CoAP server")
+    parser.add_argument("--port", type=int, default=5683)
+    parser.add_argument("--sites", type=int, default=100, help="virtual actuators, each with its four sensors")
+    parser.add_argument("--cells", type=int, default=10, help="cells reported by every actuator")
+    parser.add_argument("--concurrency", type=int, default=0, help="sites running at the same time (0: all)")
+    parser.add_argument("--field-id", type=int, default=1, help="field the cells are stored in (must exist)")
+    parser.add_argument("--loss", type=float, default=0.0, help="probability of dropping a datagram, in each direction")
+    parser.add_argument("--jitter", type=float, default=0.0, help="max random delay before each request, in seconds")
+    parser.add_argument("--ramp", type=float, default=5.0, help="sites boot at random over this many seconds")
+    parser.add_argument("--pace", type=float, default=0.0, help="pause after each /save, in seconds (the firmware uses 10)")
+    parser.add_argument("--no-instances", dest="instances", action="store_false",
+                        help="register the bare firmware names instead of '<type>@<site>'")
+    parser.add_argument("--seed", type=int, default=None, help="seed of the random generator")
+    parser.add_argument("--field-grid", help="report the readings of this soil field (seedbot-sim --field-grid)")
+    config = parser.parse_args(argv)
+
+    if not 0 <= config.loss < 1 or config.sites <= 0 or config.cells < 0:
+        parser.error("invalid load parameters")
+    try:
+        config.field = FieldGrid(config.field_grid) if config.field_grid else None
+    except (OSError, ValueError) as e:
+        parser.error(str(e))
+    return config
+
+
+if __name__ == "__main__":
+    config = parse_args(sys.argv[1:])
+    random.seed(config.seed)
+    try:
+        asyncio.run(main(config))
+    except KeyboardInterrupt:
+        raise SystemExit(1)
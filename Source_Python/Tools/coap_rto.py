@@ -0,0 +1,76 @@
+"""
+Reads the /rto resource of the actuator and prints, per destination, the round-trip
+estimates and the retransmission timeout its confirmable requests use.
+
+The resource is the binary snapshot described in Source_C/utils/cocoa.h: the RTO,
+the strong (answered at the first transmission) and weak (answered after a
+retransmission) estimators, and the exchange, retransmission and timeout counts.
+
+Usage: python3 coap_rto.py fd00::206:6:6:6
+"""
+import sys
+import struct
+import asyncio
+import argparse
+import aiocoap
+
+COCOA_VERSION = 1
+ENDPOINT_LENGTH = 48
+
+HEADER = struct.Struct(">BBHI")
+PEER = struct.Struct(f">{ENDPOINT_LENGTH}sHHHHHHHHHH")
+
+
+def decode(payload):
+    """
+    Decode an RTO snapshot.
+    :return: dict with the uptime and a list of destinations
+    """
+    version, count, _, uptime = HEADER.unpack_from(payload, 0)
+    if version != COCOA_VERSION:
+        raise ValueError(f"Unsupported RTO snapshot version {version}")
+
+    peers = []
+    for i in range(count):
+        (endpoint, rto, srtt, rttvar, strong, weak_srtt, weak_rttvar, weak,
+         exchanges, retransmissions, timeouts) = PEER.unpack_from(payload, HEADER.size + i * PEER.size)
+        peers.append({"endpoint": endpoint.rstrip(b"\0").decode(), "rto": rto,
+                      "strong": {"srtt": srtt, "rttvar": rttvar, "samples": strong},
+                      "weak": {"srtt": weak_srtt, "rttvar": weak_rttvar, "samples": weak},
+                      "exchanges": exchanges, "retransmissions": retransmissions, "timeouts": timeouts})
+
+    return {"uptime": uptime, "peers": peers}
+
+
+def print_rto(snapshot):
+    print(f"Uptime {snapshot['uptime']} s")
+    print(f"{'Destination':<40} {'RTO ms':>7} {'SRTT':>6} {'RTTVAR':>6} {'n':>5} {'wSRTT':>6} {'wVAR':>6} {'n':>5} "
+          f"{'exch':>6} {'retx':>6} {'t/o':>5}")
+    for p in snapshot["peers"]:
+        s, w = p["strong"], p["weak"]
+        print(f"{p['endpoint']:<40} {p['rto']:>7} {s['srtt']:>6} {s['rttvar']:>6} {s['samples']:>5} "
+              f"{w['srtt']:>6} {w['rttvar']:>6} {w['samples']:>5} "
+              f"{p['exchanges']:>6} {p['retransmissions']:>6} {p['timeouts']:>5}")
+
+
+async def main(args):
+    host = f"[{args.host}]" if ':' in args.host else args.host
+    context = await aiocoap.Context.create_client_context()
+
+    try:
+        request = aiocoap.Message(code=aiocoap.GET, uri=f"coap://{host}:{args.port}/rto")
+        response = await context.request(request).response
+        if not response.code.is_successful():
+            print(f"Error: {response.code}")
+            return 1
+        print_rto(decode(response.payload))
+    finally:
+        await context.shutdown()
+    return 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Print the retransmission timeouts of the SeedBot actuator.")
+    parser.add_argument("host", help="address of the actuator")
+    parser.add_argument("--port", type=int, default=5683)
+    sys.exit(asyncio.run(main(parser.parse_args())))
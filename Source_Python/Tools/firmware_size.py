@@ -0,0 +1,80 @@
+"""
+Size benchmark of the firmware images: .text, .data and .bss of every image, the
+flash (text + data) and static RAM (data + bss) they take, and the change against
+a saved baseline.
+
+Usage:
+  python3 firmware_size.py build/nrf52840/dk/actuator.nrf52840 --size arm-none-eabi-size --save sizes.json
+  python3 firmware_size.py build/nrf52840/dk/*.nrf52840 --size arm-none-eabi-size --baseline sizes.json
+"""
+import os
+import sys
+import json
+import argparse
+import subprocess
+
+SECTIONS = ("text", "data", "bss")
+
+
+def measure(image, size_tool):
+    """
+    Read the section sizes of an image with the Berkeley output of size(1).
+    :return: dict with text, data, bss, rom and ram in bytes
+    """
+    output = subprocess.run([size_tool, "-B", image], check=True, capture_output=True, text=True).stdout
+    fields = output.splitlines()[1].split()
+    sizes = dict(zip(SECTIONS, (int(f) for f in fields[:3])))
+    sizes["rom"] = sizes["text"] + sizes["data"]
+    sizes["ram"] = sizes["data"] + sizes["bss"]
+    return sizes
+
+
+def image_name(path):
+    return os.path.splitext(os.path.basename(path))[0]
+
+
+def print_sizes(sizes, baseline):
+    columns = SECTIONS + ("rom", "ram")
+    print(f"{'Image':<20}" + "".join(f"{c:>14}" for c in columns))
+    for name, image in sizes.items():
+        before = baseline.get(name)
+        cells = []
+        for c in columns:
+            cell = f"{image[c]}"
+            if before is not None and c in before:
+                cell += f" ({image[c] - before[c]:+d})"
+            cells.append(f"{cell:>14}")
+        print(f"{name:<20}" + "".join(cells))
+
+
+def main(args):
+    sizes = {image_name(image): measure(image, args.size) for image in args.images}
+
+    baseline = {}
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+    print_sizes(sizes, baseline)
+
+    if args.save:
+        with open(args.save, "w") as f:
+            json.dump(sizes, f, indent=2, sort_keys=True)
+
+    # With a budget, fail when an image grew over the baseline by more than it
+    if args.baseline and args.max_growth is not None:
+        grown = [name for name, image in sizes.items()
+                 if name in baseline and image["rom"] - baseline[name]["rom"] > args.max_growth]
+        if grown:
+            print(f"Flash grew by more than {args.max_growth} bytes: {', '.join(grown)}")
+            return 1
+    return 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Track the section sizes of the SeedBot firmware images.")
+    parser.add_argument("images", nargs="+", help="ELF images or relocatable objects")
+    parser.add_argument("--size", default="size", help="size tool of the toolchain (default: size)")
+    parser.add_argument("--baseline", help="JSON file saved by an earlier run, to print the differences")
+    parser.add_argument("--save", help="write the sizes to this JSON file")
+    parser.add_argument("--max-growth", type=int, help="bytes of flash an image may grow over the baseline")
+    sys.exit(main(parser.parse_args()))
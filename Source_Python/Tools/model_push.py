@@ -0,0 +1,140 @@
+"""
+Pushes a seed model to SeedBot actuators over CoAP, without reflashing them.
+
+The model is read from the C header written by ML/model_pack.py (Source_C/utils/DT_model.h
+by default) and sent to the /model resource of every actuator as the image described
+in Source_C/utils/model.h, in 64-byte Block1 blocks. The actuator checks the image and
+puts it in use at its next cell; /model then reports the version.
+
+Usage: python3 model_push.py --version 2 fd00::206:6:6:6 [fd00::207:7:7:7 ...]
+"""
+import os
+import re
+import sys
+import struct
+import asyncio
+import argparse
+import aiocoap
+import aiocoap.optiontypes
+
+MODEL_FORMAT = 1
+MODEL_PATH = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "Source_C", "utils", "DT_model.h")
+
+HEADER = struct.Struct(">BBBBHHI")
+NODE = struct.Struct(">Bhhh")
+
+# Largest block the actuator takes (COAP_MAX_CHUNK_SIZE): 2 ** (4 + 2)
+BLOCK_SZX = 2
+BLOCK_SIZE = 1 << (4 + BLOCK_SZX)
+
+
+def crc16(data, acc=0):
+    """CRC-16 of Contiki (os/lib/crc16.c), as model.c checks it."""
+    for b in data:
+        acc ^= b
+        acc = ((acc >> 8) | (acc << 8)) & 0xFFFF
+        acc ^= ((acc & 0xFF00) << 4) & 0xFFFF
+        acc ^= (acc >> 8) >> 4
+        acc ^= (acc & 0xFF00) >> 5
+    return acc
+
+
+def _array(text, name):
+    values = re.search(name + r"\[\d+\] = \{(.*?)\};", text, re.S).group(1)
+    return [int(v, 0) for v in values.split(',') if v.strip()]
+
+
+def _field(text, name):
+    return int(re.search(r"\." + name + r" = (\d+)", text).group(1))
+
+
+def _bits(data, bit, count):
+    value = 0
+    for i in range(bit, bit + count):
+        value = value << 1 | (data[i >> 3] >> (7 - (i & 7))) & 1
+    return value
+
+
+def read_nodes(text):
+    """
+    Nodes of a packed header (Source_C/utils/packed_trees.h), children relative
+    and leaf -(class + 1) as in the image.
+    """
+    data = _array(text, "_nodes")
+    bases = _array(text, "_bases")
+    feature_bits, threshold_bits, child_bits = (_field(text, f) for f in ("feature_bits", "threshold_bits", "child_bits"))
+    leaf = 1 << (child_bits - 1)
+    nodes = []
+    for i in range(_field(text, "n_nodes")):
+        bit = i * (feature_bits + threshold_bits + 2 * child_bits)
+        feature = _bits(data, bit, feature_bits)
+        threshold = bases[feature] + _bits(data, bit + feature_bits, threshold_bits)
+        children = [_bits(data, bit + feature_bits + threshold_bits + j * child_bits, child_bits) for j in range(2)]
+        nodes.append((feature, threshold, *(-(c & ~leaf) - 1 if c & leaf else c for c in children)))
+    return nodes
+
+
+def build_image(path, version):
+    """
+    Image of the model in a packed header; leaf i holds class i.
+    :return: bytes ready for the /model resource
+    """
+    with open(path) as f:
+        text = f.read()
+    nodes = read_nodes(text)
+    roots = _array(text, "_roots")
+    classes = _field(text, "n_classes")
+    leaves = list(range(classes))
+
+    image = HEADER.pack(MODEL_FORMAT, _field(text, "n_features"), classes, len(roots), len(nodes), len(leaves), version)
+    image += b"".join(struct.pack(">H", root) for root in roots)
+    image += b"".join(NODE.pack(*node) for node in nodes)
+    image += bytes(leaves)
+    return image + struct.pack(">H", crc16(image))
+
+
+async def push(context, host, port, image):
+    """
+    Send the image one block at a time and read back the version waiting at the actuator.
+    :return: error message, None on success
+    """
+    uri = f"coap://[{host}]:{port}/model" if ':' in host else f"coap://{host}:{port}/model"
+    for num, offset in enumerate(range(0, len(image), BLOCK_SIZE)):
+        request = aiocoap.Message(code=aiocoap.PUT, uri=uri, payload=image[offset:offset + BLOCK_SIZE])
+        request.opt.block1 = aiocoap.optiontypes.BlockOption.BlockwiseTuple(
+            num, offset + BLOCK_SIZE < len(image), BLOCK_SZX)
+        response = await context.request(request, handle_blockwise=False).response
+        if response.code not in (aiocoap.CONTINUE, aiocoap.CHANGED):
+            return f"{response.code} {response.payload.decode(errors='replace')}".strip()
+
+    response = await context.request(aiocoap.Message(code=aiocoap.GET, uri=uri)).response
+    return None if response.code.is_successful() else str(response.code)
+
+
+async def main(args):
+    image = build_image(args.model, args.version)
+    print(f"Model version {args.version}: {len(image)} bytes, {(len(image) + BLOCK_SIZE - 1) // BLOCK_SIZE} blocks")
+    context = await aiocoap.Context.create_client_context()
+
+    failed = 0
+    try:
+        results = await asyncio.gather(*(push(context, host, args.port, image) for host in args.hosts),
+                                       return_exceptions=True)
+        for host, error in zip(args.hosts, results):
+            print(f"{host:<30} {'pushed' if error is None else f'failed: {error}'}")
+            failed += error is not None
+    finally:
+        await context.shutdown()
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Push a seed model to SeedBot actuators.")
+    parser.add_argument("hosts", nargs="+", help="addresses of the actuators")
+    parser.add_argument("--model", default=MODEL_PATH, help="packed header of the model (ML/model_pack.py)")
+    parser.add_argument("--version", type=int, required=True, help="version of the model, above 0")
+    parser.add_argument("--port", type=int, default=5683)
+    args = parser.parse_args()
+    if not 0 < args.version < 1 << 32:
+        parser.error("the version must be between 1 and 2^32 - 1")
+    sys.exit(asyncio.run(main(args)))
@@ -0,0 +1,80 @@
+"""
+Reads the /energy resource of a mote and prints its energy use per workflow phase.
+
+The resource is the binary snapshot described in Source_C/utils/energy.h: the
+Energest CPU, LPM, TX and RX time of every phase, and the number of work units
+(sown cells on the actuator, served requests on a sensor).
+
+Usage: python3 mote_energy.py fd00::206:6:6:6
+"""
+import sys
+import struct
+import asyncio
+import argparse
+import aiocoap
+
+ENERGY_VERSION = 1
+
+HEADER = struct.Struct(">BBBBII")
+COUNTERS = struct.Struct(">QQQQ")
+
+ACTUATOR_PHASES = ["idle", "sensing", "inference", "seeding", "reporting"]
+SENSOR_PHASES = ["idle", "request", "sampling"]
+
+# nRF52840 at 3 V with the DC/DC converter on (same figures as the simulator)
+SUPPLY_V = 3.0
+CURRENT_MA = {"cpu": 3.3, "lpm": 0.003, "tx": 4.8, "rx": 4.6}
+
+
+def decode(payload):
+    """
+    Decode an energy snapshot.
+    :return: dict with the units and, per phase, the seconds spent in each state and the energy in mJ
+    """
+    version, count, counters, _, second, units = HEADER.unpack_from(payload, 0)
+    if version != ENERGY_VERSION or counters != 4:
+        raise ValueError(f"Unsupported energy snapshot (version {version}, {counters} counters)")
+
+    names = ACTUATOR_PHASES if count == len(ACTUATOR_PHASES) else SENSOR_PHASES
+    phases = []
+    for i in range(count):
+        ticks = COUNTERS.unpack_from(payload, HEADER.size + i * COUNTERS.size)
+        seconds = dict(zip(("cpu", "lpm", "tx", "rx"), (t / second for t in ticks)))
+        mj = SUPPLY_V * sum(CURRENT_MA[state] * seconds[state] for state in seconds)
+        phases.append({"name": names[i] if i < len(names) else f"phase {i}", "seconds": seconds, "mj": mj})
+
+    return {"units": units, "phases": phases}
+
+
+def print_energy(snapshot):
+    units = snapshot["units"]
+    print(f"{units} units (cells or requests)")
+    print(f"{'Phase':<12} {'cpu ms':>10} {'lpm s':>10} {'tx ms':>10} {'rx s':>10} {'mJ':>10} {'mJ/unit':>10}")
+    for phase in snapshot["phases"]:
+        s = phase["seconds"]
+        per_unit = phase["mj"] / units if units else 0.0
+        print(f"{phase['name']:<12} {s['cpu'] * 1000:>10.1f} {s['lpm']:>10.1f} {s['tx'] * 1000:>10.1f} {s['rx']:>10.1f} "
+              f"{phase['mj']:>10.1f} {per_unit:>10.2f}")
+
+
+async def main(args):
+    host = f"[{args.host}]" if ':' in args.host else args.host
+    context = await aiocoap.Context.create_client_context()
+
+    try:
+        request = aiocoap.Message(code=aiocoap.GET, uri=f"coap://{host}:{args.port}/energy")
+        response = await context.request(request).response
+        if not response.code.is_successful():
+            print(f"Error: {response.code}")
+            return 1
+        print_energy(decode(response.payload))
+    finally:
+        await context.shutdown()
+    return 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Print the energy use per phase of a SeedBot mote.")
+    parser.add_argument("host", help="address of the mote")
+    parser.add_argument("--port", type=int, default=5683)
+    sys.exit(asyncio.run(main(parser.parse_args())))
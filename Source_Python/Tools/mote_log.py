@@ -0,0 +1,134 @@
+"""
+Reads the /log resource of a mote and prints its binary log records as text.
+
+The resource is the snapshot described in Source_C/utils/binlog.h; the event
+numbers, argument counts and formats come from Source_C/utils/binlog_events.def,
+so the decoder always matches the firmware built from the same tree.
+
+Usage: python3 mote_log.py fd00::206:6:6:6 [--follow 10]
+"""
+import os
+import re
+import sys
+import struct
+import asyncio
+import argparse
+import aiocoap
+
+BINLOG_VERSION = 1
+
+HEADER = struct.Struct(">BBHIIII")
+
+EVENTS_DEF = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "Source_C", "utils", "binlog_events.def")
+
+EVENT_LINE = re.compile(r'^BINLOG_EVENT\(\s*(\w+)\s*,\s*(\w+)\s*,\s*(\d+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)', re.MULTILINE)
+
+
+def load_events(path):
+    """
+    Read the event table.
+    :return: list of (name, level, argument count, format), indexed by event number
+    """
+    with open(path) as f:
+        text = f.read()
+    return [(name, level, int(argc), fmt.encode().decode("unicode_escape"))
+            for name, level, argc, fmt in EVENT_LINE.findall(text)]
+
+
+def read_varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        b = data[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            return value, pos
+
+
+def decode(payload, events):
+    """
+    Decode a log snapshot.
+    :return: dict with the header fields and a list of records (seq, seconds, level, text)
+    """
+    version, _, length, second, first_seq, first_time, dropped = HEADER.unpack_from(payload, 0)
+    if version != BINLOG_VERSION:
+        raise ValueError(f"Unsupported log version {version}")
+
+    data = payload[HEADER.size:HEADER.size + length]
+    records = []
+    pos = 0
+    seq = first_seq
+    ticks = first_time
+    while pos < len(data):
+        event = data[pos]
+        dt, pos = read_varint(data, pos + 1)
+        if records:
+            ticks += dt
+
+        if event >= len(events):
+            # Built from another tree: the argument count is unknown, stop here
+            records.append({"seq": seq, "time": ticks / second, "level": "?", "text": f"unknown event {event}"})
+            break
+        name, level, argc, fmt = events[event]
+        args = []
+        for _ in range(argc):
+            zigzag, pos = read_varint(data, pos)
+            args.append((zigzag >> 1) ^ -(zigzag & 1))
+        records.append({"seq": seq, "time": ticks / second, "level": level, "text": fmt % tuple(args)})
+        seq += 1
+
+    return {"dropped": dropped, "next_seq": seq, "records": records}
+
+
+def print_records(log, after=None):
+    for r in log["records"]:
+        if after is None or r["seq"] >= after:
+            print(f"{r['seq']:>6} [{r['time']:>10.3f}] {r['level']:<4} {r['text']}")
+
+
+async def fetch(context, uri):
+    response = await context.request(aiocoap.Message(code=aiocoap.GET, uri=uri)).response
+    if not response.code.is_successful():
+        raise RuntimeError(f"Error: {response.code}")
+    return response.payload
+
+
+async def main(args):
+    events = load_events(args.events)
+    host = f"[{args.host}]" if ':' in args.host else args.host
+    uri = f"coap://{host}:{args.port}/log"
+    context = await aiocoap.Context.create_client_context()
+
+    try:
+        log = decode(await fetch(context, uri), events)
+        print(f"{log['dropped']} records dropped by the mote so far")
+        print_records(log)
+
+        # Poll and print only the records not seen yet
+        while args.follow:
+            await asyncio.sleep(args.follow)
+            seen = log["next_seq"]
+            log = decode(await fetch(context, uri), events)
+            if log["records"] and log["records"][0]["seq"] > seen:
+                print(f"... {log['records'][0]['seq'] - seen} records lost between two reads")
+            print_records(log, after=seen)
+    except RuntimeError as e:
+        print(e)
+        return 1
+    finally:
+        await context.shutdown()
+    return 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Print the binary log of a SeedBot mote.")
+    parser.add_argument("host", help="address of the mote")
+    parser.add_argument("--port", type=int, default=5683)
+    parser.add_argument("--events", default=EVENTS_DEF, help="event table of the firmware (binlog_events.def)")
+    parser.add_argument("--follow", type=float, metavar="SECONDS", help="keep reading the log at this interval")
+    try:
+        sys.exit(asyncio.run(main(parser.parse_args())))
+    except KeyboardInterrupt:
+        sys.exit(1)